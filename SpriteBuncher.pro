@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Top level project - builds the packing engine library, then the app and
+# the command line tool, benchmark and tests that use it. Open this one in QtCreator.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = core app cli bench tests
+
+core.subdir = core
+
+app.file = buncher.pro
+app.depends = core
+
+cli.file = cli/buncher-cli.pro
+cli.depends = core
+
+bench.file = bench/buncher-bench.pro
+bench.depends = core
+
+tests.subdir = tests
+tests.depends = core
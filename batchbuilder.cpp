@@ -0,0 +1,317 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "batchbuilder.h"
+#include "sheetbuilder.h"
+#include "exportmanifest.h"
+#include "parallel.h"
+
+#include <QtDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QMutex>
+#include <QTextStream>
+#include <QVector>
+#include <QWaitCondition>
+#include <algorithm>
+
+namespace {
+
+// One folder's work, from preparing to finished.
+struct BatchTask
+{
+    SheetBuilder builder;
+    ExportManifest manifest; // of the inputs and settings, from the up to date check.
+    qint64 cost; // estimated peak memory, clamped to the budget.
+    bool finished;
+    BatchResult result;
+};
+
+// Name of a status, for the report.
+QString statusName( BatchResult::Status status )
+{
+    switch ( status ) {
+    case BatchResult::BATCH_DONE: return "done";
+    case BatchResult::BATCH_UP_TO_DATE: return "up-to-date";
+    case BatchResult::BATCH_CHECKED: return "checked";
+    case BatchResult::BATCH_PACK_FAILED: return "pack-failed";
+    case BatchResult::BATCH_NO_IMAGES: return "no-images";
+    case BatchResult::BATCH_FAILED: return "failed";
+    }
+    return QString();
+}
+
+// Estimated peak memory for a folder: its sprites (decoded, plus a working copy if they're cropped or scaled), and
+// the bands of sheet being rendered and encoded. Only the image headers are read.
+qint64 estimateMemory( const SheetBuilder &builder, bool checkOnly )
+{
+    qint64 bytes = 0;
+    foreach ( const QFileInfo &file, builder.inputFiles() ) {
+        QSize size = QImageReader( file.filePath() ).size();
+        if ( size.isValid() )
+            bytes += qint64( size.width() ) * size.height() * 4;
+    }
+    bytes *= 2;
+    if ( builder.pixelBudget() > 0 )
+        bytes = qMin( bytes, builder.pixelBudget() );
+    if ( !checkOnly )
+        bytes += 2 * SheetBuilder::ExportBandBytes;
+    return bytes;
+}
+
+}
+
+BatchResult::BatchResult()
+{
+    status = BATCH_FAILED;
+    sprites = 0;
+    failed = 0;
+    width = 0;
+    height = 0;
+    msecs = 0;
+}
+
+BatchBuilder::BatchBuilder()
+{
+    m_checkOnly = false;
+    m_memoryBudget = DefaultMemoryBudget;
+    m_pixelBudget = 0;
+}
+
+void BatchBuilder::addFolder( const QString &path )
+{
+    m_folders.append( QDir( path ).absolutePath() );
+}
+
+bool BatchBuilder::readProjectFile( const QString &fileName, QString &error )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly | QIODevice::Text )) {
+        error = "Could not read the project file: " + fileName;
+        return false;
+    }
+    QDir base = QFileInfo( fileName ).absoluteDir();
+    QTextStream in( &file );
+    while ( !in.atEnd() ) {
+        QString line = in.readLine().trimmed();
+        if ( line.isEmpty() || line.startsWith( '#' ))
+            continue;
+        addFolder( base.absoluteFilePath( line ));
+    }
+    return true;
+}
+
+const QStringList& BatchBuilder::folders() const
+{
+    return m_folders;
+}
+
+void BatchBuilder::setSettingsFile( const QString &fileName )
+{
+    m_settingsFile = fileName;
+}
+
+void BatchBuilder::setOverrides( const QJsonObject &overrides )
+{
+    m_overrides = overrides;
+}
+
+void BatchBuilder::setCheckOnly( bool check )
+{
+    m_checkOnly = check;
+}
+
+void BatchBuilder::setMemoryBudget( qint64 bytes )
+{
+    m_memoryBudget = qMax( qint64( 1 ), bytes );
+}
+
+qint64 BatchBuilder::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+void BatchBuilder::setPixelBudget( qint64 bytes )
+{
+    m_pixelBudget = qMax( qint64( 0 ), bytes );
+}
+
+qint64 BatchBuilder::pixelBudget() const
+{
+    return m_pixelBudget;
+}
+
+QList<BatchResult> BatchBuilder::run( const ResultFunction &finished ) const
+{
+    qDebug() << "BatchBuilder::run -" << m_folders.size() << "folders";
+    QVector<BatchTask> tasks( m_folders.size() );
+    QMutex resultMutex;
+    int ndone = 0;
+    auto finish = [&]( BatchTask &task ) {
+        task.finished = true;
+        QMutexLocker lock( &resultMutex );
+        ++ndone;
+        if ( finished )
+            finished( task.result, ndone, tasks.size() );
+    };
+
+    // Settings, up to date checks and memory estimates. These only read settings files, hash the inputs and read
+    // image headers, so it's all mostly IO and is done in parallel too.
+    parallelFor( tasks.size(), [&]( int i ) {
+        BatchTask &task = tasks[i];
+        task.finished = false;
+        task.cost = 0;
+        task.result.folder = m_folders[i];
+        QDir dir( m_folders[i] );
+        if ( !dir.exists() || !dir.isReadable() ) {
+            task.result.error = "Could not open the input folder.";
+            finish( task );
+            return;
+        }
+        task.builder.setInputFolder( dir.absolutePath() );
+        task.builder.setPixelBudget( m_pixelBudget );
+        BuncherSettings settings;
+        if ( !m_settingsFile.isEmpty() ) {
+            if ( !settings.load( m_settingsFile )) {
+                task.result.error = "Could not read the settings file: " + m_settingsFile;
+                finish( task );
+                return;
+            }
+        }
+        else
+            settings.load( task.builder.settingsFileName() );
+        settings.fromJson( m_overrides );
+        task.builder.setSettings( settings );
+        if ( !m_checkOnly && task.builder.isUpToDate( &task.manifest )) {
+            task.result.status = BatchResult::BATCH_UP_TO_DATE;
+            finish( task );
+            return;
+        }
+        task.cost = qMin( estimateMemory( task.builder, m_checkOnly ), m_memoryBudget );
+    });
+
+    // The rest are queued biggest first.
+    QList<int> pending;
+    for (int i = 0; i < tasks.size(); ++i) {
+        if ( !tasks[i].finished )
+            pending.append( i );
+    }
+    std::stable_sort( pending.begin(), pending.end(), [&]( int a, int b ) { return tasks[a].cost > tasks[b].cost; });
+
+    // Folders are started on the pool as they fit in the memory left, the first (biggest) that fits first. One waiting
+    // for memory doesn't hold a pool thread - this thread starts it when a finished folder frees enough - so the
+    // threads not running folders are free to help with the running folders' bands and chunks.
+    QMutex queueMutex;
+    QWaitCondition folderFinished;
+    qint64 memoryUsed = 0;
+    int nrunning = 0;
+    int maxRunning = qMax( 1, QThreadPool::globalInstance()->maxThreadCount() );
+    QList< QFuture<void> > running;
+    auto runFolder = [&]( int i ) {
+        BatchTask &task = tasks[i];
+        SheetBuilder &builder = task.builder;
+        BatchResult &result = task.result;
+        QElapsedTimer timer;
+        timer.start();
+        result.sprites = builder.loadSprites();
+        if ( result.sprites == 0 )
+            result.status = BatchResult::BATCH_NO_IMAGES;
+        else {
+            result.failed = builder.pack();
+            result.width = builder.sheetProperties().width;
+            result.height = builder.sheetProperties().height;
+            if ( result.failed > 0 )
+                result.status = BatchResult::BATCH_PACK_FAILED;
+            else if ( m_checkOnly )
+                result.status = BatchResult::BATCH_CHECKED;
+            else {
+                switch ( builder.exportFiles( result.error, SheetBuilder::ProgressFunction(), &task.manifest )) {
+                case SheetBuilder::EXPORT_DONE:
+                    result.status = BatchResult::BATCH_DONE;
+                    break;
+                case SheetBuilder::EXPORT_UP_TO_DATE:
+                    result.status = BatchResult::BATCH_UP_TO_DATE;
+                    break;
+                default:
+                    result.status = BatchResult::BATCH_FAILED;
+                }
+            }
+        }
+        result.stats = builder.stats();
+        result.memory = builder.memoryUsage();
+        result.report = builder.report();
+        builder.clearSprites();
+        result.msecs = timer.elapsed();
+        finish( task );
+        QMutexLocker lock( &queueMutex );
+        memoryUsed -= task.cost;
+        --nrunning;
+        folderFinished.wakeAll();
+    };
+    {
+        QMutexLocker lock( &queueMutex );
+        while ( !pending.isEmpty() || nrunning > 0 ) {
+            for (int p = 0; p < pending.size() && nrunning < maxRunning; ) {
+                int i = pending[p];
+                if ( nrunning == 0 || memoryUsed + tasks[i].cost <= m_memoryBudget ) {
+                    pending.removeAt( p );
+                    memoryUsed += tasks[i].cost;
+                    ++nrunning;
+                    running.append( QtConcurrent::run( [&runFolder, i]() { runFolder( i ); }));
+                }
+                else
+                    ++p;
+            }
+            folderFinished.wait( &queueMutex );
+        }
+    }
+    for (int f = 0; f < running.size(); ++f)
+        running[f].waitForFinished(); // (they've all finished - this just makes sure none is still returning)
+
+    QList<BatchResult> results;
+    for (int i = 0; i < tasks.size(); ++i)
+        results.append( tasks[i].result );
+    return results;
+}
+
+QJsonObject BatchBuilder::report( const QList<BatchResult> &results )
+{
+    QJsonArray folders;
+    Stats total;
+    MemoryUsage largest;
+    foreach ( const BatchResult &result, results ) {
+        QJsonObject folder = result.report;
+        folder.insert( "folder", result.folder );
+        folder.insert( "status", statusName( result.status ));
+        folder.insert( "msecs", double( result.msecs ));
+        if ( !result.error.isEmpty() )
+            folder.insert( "error", result.error );
+        folders.append( folder );
+        total.add( result.stats );
+        for (int i = 0; i < MemoryUsage::NumCategories; ++i)
+            largest.setPeak( MemoryUsage::Categories( i ), result.memory.bytes( MemoryUsage::Categories( i )));
+    }
+    QJsonObject obj;
+    obj.insert( "folders", folders );
+    obj.insert( "stats", total.toJson() );
+    obj.insert( "memory", largest.toJson() );
+    return obj;
+}
@@ -0,0 +1,146 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCHBUILDER_H
+#define BATCHBUILDER_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+#include "memoryusage.h"
+#include "stats.h"
+
+//! The outcome of one folder in a batch.
+struct BatchResult
+{
+    //! Constructor.
+    BatchResult();
+
+    //! What happened to a folder.
+    enum Status { BATCH_DONE = 0, BATCH_UP_TO_DATE, BATCH_CHECKED, BATCH_PACK_FAILED, BATCH_NO_IMAGES, BATCH_FAILED };
+
+    //! The input folder.
+    QString folder;
+    //! One of Status.
+    Status status;
+    //! Number of sprites loaded.
+    int sprites;
+    //! Number of sprites that didn't fit on the sheet.
+    int failed;
+    //! Packed sheet width.
+    int width;
+    //! Packed sheet height.
+    int height;
+    //! Description of the problem, for BATCH_FAILED.
+    QString error;
+    //! Time taken, in milliseconds.
+    qint64 msecs;
+    //! Timings and counters for the folder.
+    Stats stats;
+    //! Memory held by the folder when it finished (see SheetBuilder::memoryUsage).
+    MemoryUsage memory;
+    //! The folder's report (see SheetBuilder::report), or empty if it was skipped.
+    QJsonObject report;
+};
+
+//! Packs and exports many folders at once, on the shared thread pool (see SheetBuilder for one folder).
+/*! Folders are started largest first, so the biggest ones aren't left running alone at the end. Inside each folder,
+ *  decoding, band rendering and encoding are split up with parallelFor, so threads that run out of folders help finish
+ *  the ones still going. Folders already up to date are found (by hashing their inputs) before anything is loaded.
+ *
+ *  Memory is kept within a budget: each folder's peak use is estimated from its image headers, and a folder only
+ *  starts when its estimate fits in what's left (smaller folders go ahead of a big one that's waiting). A folder
+ *  bigger than the whole budget runs on its own. Folders waiting for memory don't take up pool threads - run()'s own
+ *  thread starts each one when it fits - so while a big folder runs alone, every thread can help it.
+ */
+class BatchBuilder
+{
+public:
+    //! Called as each folder finishes (one call at a time), with the number finished so far and the total.
+    typedef std::function<void( const BatchResult &result, int done, int total )> ResultFunction;
+
+    //! Constructor.
+    BatchBuilder();
+
+    //! Adds a folder to process.
+    void addFolder( const QString &path );
+
+    //! Adds the folders listed in a project file.
+    /*! Project files are plain text, one folder per line, relative to the project file's own folder. Blank lines and
+     *  lines starting with '#' are skipped.
+     * \param error - set to a description of the problem, on failure.
+     * \returns false - if the file can't be read.
+     */
+    bool readProjectFile( const QString &fileName, QString &error );
+
+    //! Returns the folders added so far.
+    const QStringList& folders() const;
+
+    //! Sets a settings file to use for every folder. By default (empty) each folder's own buncher.data is used.
+    void setSettingsFile( const QString &fileName );
+
+    //! Sets settings to override in every folder, using the settings file's key names (see BuncherSettings::fromJson).
+    void setOverrides( const QJsonObject &overrides );
+
+    //! Only load and pack, to check everything fits - nothing is written.
+    void setCheckOnly( bool check );
+
+    //! Sets roughly how much memory (in bytes) the folders being processed may use between them.
+    void setMemoryBudget( qint64 bytes );
+    //! Returns the memory budget.
+    qint64 memoryBudget() const;
+
+    //! Sets a pixel budget for each folder (see SheetBuilder::setPixelBudget), or 0 (the default) for none.
+    /*! A folder's memory estimate is capped by it, so big folders can run alongside others.
+     */
+    void setPixelBudget( qint64 bytes );
+    //! Returns the pixel budget per folder.
+    qint64 pixelBudget() const;
+
+    //! Processes all the folders, and returns their results in the order they were added.
+    /*! The calling thread only starts folders and waits for them, so call it from outside the global thread pool
+     *  (e.g. the main thread), or it holds a pool thread for the whole run.
+     */
+    QList<BatchResult> run( const ResultFunction &finished = ResultFunction() ) const;
+
+    //! Returns a machine-readable report of a run: each folder's report, the stats of them all added up, and the most
+    //! memory any one folder held in each category (with the peak RSS of the whole run).
+    static QJsonObject report( const QList<BatchResult> &results );
+
+    //! Default memory budget, in bytes.
+    static const qint64 DefaultMemoryBudget = 2048LL * 1024 * 1024;
+
+protected:
+    //! Folders to process.
+    QStringList m_folders;
+    //! Settings file for every folder, or empty for their own.
+    QString m_settingsFile;
+    //! Settings overrides.
+    QJsonObject m_overrides;
+    //! Check only, no export.
+    bool m_checkOnly;
+    //! Memory budget, in bytes.
+    qint64 m_memoryBudget;
+    //! Pixel budget per folder, in bytes (0 for none).
+    qint64 m_pixelBudget;
+};
+
+#endif // BATCHBUILDER_H
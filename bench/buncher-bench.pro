@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# buncher-bench - times the packers (buncher-core) on synthetic sprite sets,
+# and writes the results as json. Run "buncher-bench --help" for the options.
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+QT       -= widgets
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = buncher-bench
+TEMPLATE = app
+
+# The packing engine (core/core.pro) - zlib comes along with it.
+include(../core/core.pri)
+
+SOURCES += main.cpp
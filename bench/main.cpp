@@ -0,0 +1,539 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// buncher-bench - times the packers on reproducible synthetic sprite sets, and writes the results as json, so they can
+// be compared across versions. Only sizes are packed (no pixels), so it measures the packing algorithms alone. It also
+// times the alpha bleed pass on a full sheet.
+
+#include "packer.h"
+#include "packsprite.h"
+#include "memoryusage.h"
+#include "sheetproperties.h"
+#include "sheetrenderer.h"
+#include "stats.h"
+#include "maxrects/MaxRectsBinPack.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <math.h>
+
+namespace {
+
+// Padding added around every sprite, as the app's default sheet settings do.
+const int Padding = 2;
+
+// Synthetic sprite sets.
+enum Distributions { DIST_UNIFORM = 0, DIST_POWER_LAW, DIST_PARTICLES, DIST_BACKGROUNDS, DIST_STRIPS, DIST_SQUARES,
+                     DIST_ELONGATED };
+const int NumDistributions = 7; // --> Keep this up-to-date when adding distributions! (and distributionName)
+
+// The packers: each of the app's packing methods (through Packer, sorted as SheetBuilder sorts them), then each
+// MaxRectsBinPack heuristic on its own, fed the rects in the order they were made.
+enum Methods { METHOD_MAXRECTS_BESTAREA = 0, METHOD_MAXRECTS_SHORTSIDE, METHOD_MAXRECTS_LONGSIDE,
+               METHOD_MAXRECTS_BOTTOMLEFT, METHOD_MAXRECTS_CONTACTPOINT, METHOD_ROWS_BY_NAME, METHOD_ROWS_BY_AREA,
+               METHOD_ROWS_BY_HEIGHT, METHOD_ROWS_BY_WIDTH, METHOD_BIN_BESTAREA, METHOD_BIN_SHORTSIDE,
+               METHOD_BIN_LONGSIDE, METHOD_BIN_BOTTOMLEFT, METHOD_BIN_CONTACTPOINT };
+const int NumMethods = 14; // --> Keep this up-to-date when adding methods! (and methodName)
+
+QString distributionName( int dist )
+{
+    switch ( dist ) {
+    case DIST_UNIFORM: return "uniform";
+    case DIST_POWER_LAW: return "power-law";
+    case DIST_PARTICLES: return "particles";
+    case DIST_BACKGROUNDS: return "backgrounds";
+    case DIST_STRIPS: return "strips";
+    case DIST_SQUARES: return "squares";
+    case DIST_ELONGATED: return "elongated";
+    }
+    return QString();
+}
+
+QString methodName( int method )
+{
+    switch ( method ) {
+    case METHOD_MAXRECTS_BESTAREA: return "maxrects-bestarea";
+    case METHOD_MAXRECTS_SHORTSIDE: return "maxrects-shortside";
+    case METHOD_MAXRECTS_LONGSIDE: return "maxrects-longside";
+    case METHOD_MAXRECTS_BOTTOMLEFT: return "maxrects-bottomleft";
+    case METHOD_MAXRECTS_CONTACTPOINT: return "maxrects-contactpoint";
+    case METHOD_ROWS_BY_NAME: return "rows-name";
+    case METHOD_ROWS_BY_AREA: return "rows-area";
+    case METHOD_ROWS_BY_HEIGHT: return "rows-height";
+    case METHOD_ROWS_BY_WIDTH: return "rows-width";
+    case METHOD_BIN_BESTAREA: return "bin-bestarea";
+    case METHOD_BIN_SHORTSIDE: return "bin-shortside";
+    case METHOD_BIN_LONGSIDE: return "bin-longside";
+    case METHOD_BIN_BOTTOMLEFT: return "bin-bottomleft";
+    case METHOD_BIN_CONTACTPOINT: return "bin-contactpoint";
+    }
+    return QString();
+}
+
+rbp::MaxRectsBinPack::FreeRectChoiceHeuristic heuristicFor( int method )
+{
+    switch ( method ) {
+    case METHOD_MAXRECTS_SHORTSIDE:
+    case METHOD_BIN_SHORTSIDE:
+        return rbp::MaxRectsBinPack::RectBestShortSideFit;
+    case METHOD_MAXRECTS_LONGSIDE:
+    case METHOD_BIN_LONGSIDE:
+        return rbp::MaxRectsBinPack::RectBestLongSideFit;
+    case METHOD_MAXRECTS_BOTTOMLEFT:
+    case METHOD_BIN_BOTTOMLEFT:
+        return rbp::MaxRectsBinPack::RectBottomLeftRule;
+    case METHOD_MAXRECTS_CONTACTPOINT:
+    case METHOD_BIN_CONTACTPOINT:
+        return rbp::MaxRectsBinPack::RectContactPointRule;
+    default:
+        return rbp::MaxRectsBinPack::RectBestAreaFit;
+    }
+}
+
+// xorshift64*, so the sets are the same on every platform and compiler (unlike the std distributions).
+class Random
+{
+public:
+    explicit Random( quint64 seed ) : m_state( seed * 0x9E3779B97F4A7C15ULL + 1 ) {}
+    quint64 next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 2685821657736338717ULL;
+    }
+    // Returns a number in [0, 1).
+    double uniform() { return double( next() >> 11 ) * ( 1.0 / 9007199254740992.0 ); }
+    // Returns a number in [lo, hi].
+    int range( int lo, int hi ) { return lo + int( uniform() * ( hi - lo + 1 )); }
+private:
+    quint64 m_state;
+};
+
+// Makes count sprite sizes. The same seed, distribution and count always give the same sizes.
+QVector<QSize> makeRects( int dist, int count, quint64 seed )
+{
+    Random rng( seed ^ ( quint64( dist + 1 ) << 32 ) ^ quint64( count ));
+    QVector<QSize> rects;
+    rects.reserve( count );
+    while ( rects.size() < count ) {
+        switch ( dist ) {
+        case DIST_UNIFORM:
+            rects.append( QSize( rng.range( 8, 256 ), rng.range( 8, 256 )));
+            break;
+        case DIST_POWER_LAW: {
+            // Pareto sizes (alpha 1.5): mostly small, with a long tail of big ones.
+            double size = qMin( 2048.0, 8.0 / pow( 1.0 - rng.uniform(), 1.0 / 1.5 ));
+            double aspect = sqrt( pow( 2.0, rng.uniform() * 2.0 - 1.0 ));
+            rects.append( QSize( qMax( 1, int( size * aspect )), qMax( 1, int( size / aspect ))));
+            break;
+        }
+        case DIST_PARTICLES:
+            rects.append( QSize( rng.range( 2, 16 ), rng.range( 2, 16 )));
+            break;
+        case DIST_BACKGROUNDS:
+            // A few huge backgrounds among small props.
+            if ( rng.uniform() < 0.02 )
+                rects.append( QSize( rng.range( 512, 2048 ), rng.range( 512, 2048 )));
+            else
+                rects.append( QSize( rng.range( 16, 64 ), rng.range( 16, 64 )));
+            break;
+        case DIST_STRIPS: {
+            // Animations: runs of same-sized frames.
+            QSize frame( rng.range( 32, 128 ), rng.range( 32, 128 ));
+            int frames = rng.range( 8, 32 );
+            for (int i = 0; i < frames && rects.size() < count; ++i)
+                rects.append( frame );
+            break;
+        }
+        case DIST_SQUARES: {
+            int size = rng.range( 8, 256 );
+            rects.append( QSize( size, size ));
+            break;
+        }
+        case DIST_ELONGATED: {
+            int length = rng.range( 64, 512 );
+            int width = qMax( 1, length / rng.range( 4, 16 ));
+            rects.append( rng.uniform() < 0.5 ? QSize( length, width ) : QSize( width, length ));
+            break;
+        }
+        }
+    }
+    return rects;
+}
+
+// Returns a square sheet side that fits the (padded) rects at roughly the given fill, and fits the biggest one.
+int sheetSide( const QVector<QSize> &rects, double fill )
+{
+    qint64 area = 0;
+    int biggest = 0;
+    foreach ( const QSize &size, rects ) {
+        area += qint64( size.width() + Padding ) * ( size.height() + Padding );
+        biggest = qMax( biggest, qMax( size.width(), size.height() ) + Padding );
+    }
+    return qMax( biggest, int( ceil( sqrt( area / fill ))));
+}
+
+// Returns the order SheetBuilder would sort the sprites in for a method (see SheetBuilder::insertSprite).
+QVector<int> packingOrder( const QVector<QSize> &rects, int method )
+{
+    QVector<int> order( rects.size() );
+    for (int i = 0; i < order.size(); ++i)
+        order[i] = i;
+    if ( method <= METHOD_MAXRECTS_CONTACTPOINT || method == METHOD_ROWS_BY_AREA )
+        std::stable_sort( order.begin(), order.end(), [&]( int a, int b ) {
+            return qint64( rects[a].width() ) * rects[a].height() > qint64( rects[b].width() ) * rects[b].height(); });
+    else if ( method == METHOD_ROWS_BY_HEIGHT )
+        std::stable_sort( order.begin(), order.end(), [&]( int a, int b ) { return rects[a].height() > rects[b].height(); });
+    else if ( method == METHOD_ROWS_BY_WIDTH )
+        std::stable_sort( order.begin(), order.end(), [&]( int a, int b ) { return rects[a].width() > rects[b].width(); });
+    return order;
+}
+
+// Packs the rects with one method, and returns the run's results.
+QJsonObject runMethod( const QVector<QSize> &rects, int method, int side )
+{
+    qint64 nsecs = 0, usedArea = 0;
+    int failed = 0;
+    qint64 freeRectsPeak = 0, pruneTests = 0;
+    QElapsedTimer timer;
+    if ( method < METHOD_BIN_BESTAREA ) {
+        QVector<int> order = packingOrder( rects, method );
+        QList<PackSprite> sprites;
+        sprites.reserve( rects.size() );
+        for (int i = 0; i < order.size(); ++i)
+            sprites.append( PackSprite( rects[order[i]], QString::number( order[i] )));
+        SheetProperties prop;
+        prop.width = side;
+        prop.height = side;
+        prop.padding = Padding;
+        prop.border = 0;
+        Stats stats;
+        timer.start();
+        if ( method <= METHOD_MAXRECTS_CONTACTPOINT )
+            failed = Packer::MaxRects( prop, sprites, heuristicFor( method ), true, false, 0, 0, 1.0, 1, 0, &stats );
+        else
+            failed = Packer::Rows( prop, sprites, false, false, 0, 0, 1.0, 1, 0, &stats );
+        nsecs = timer.nsecsElapsed();
+        foreach ( const PackSprite &sprite, sprites )
+            usedArea += qint64( sprite.packedRect().width ) * sprite.packedRect().height;
+        freeRectsPeak = stats.count( Stats::COUNT_FREE_RECTS_PEAK );
+        pruneTests = stats.count( Stats::COUNT_PRUNE_TESTS );
+    }
+    else {
+        rbp::MaxRectsBinPack bin( side, side, true );
+        rbp::MaxRectsBinPack::FreeRectChoiceHeuristic heuristic = heuristicFor( method );
+        timer.start();
+        foreach ( const QSize &size, rects ) {
+            rbp::Rect rect = bin.Insert( size.width() + Padding, size.height() + Padding, heuristic );
+            if ( rect.height > 0 )
+                usedArea += qint64( rect.width ) * rect.height;
+            else
+                failed++;
+        }
+        nsecs = timer.nsecsElapsed();
+        freeRectsPeak = qint64( bin.FreeRectsPeak() );
+        pruneTests = qint64( bin.PruneTests() );
+    }
+    QJsonObject run;
+    run.insert( "msecs", nsecs / 1000000.0 );
+    run.insert( "nsPerInsert", rects.isEmpty() ? 0.0 : double( nsecs ) / rects.size() );
+    run.insert( "occupancy", double( usedArea ) / ( double( side ) * side ));
+    run.insert( "failed", failed );
+    run.insert( "freeRectsPeak", double( freeRectsPeak ));
+    run.insert( "freeRectsBytes", double( freeRectsPeak * qint64( sizeof( rbp::Rect ))));
+    run.insert( "pruneTests", double( pruneTests ));
+    run.insert( "peakRss", double( MemoryUsage::PeakRss() )); // (process-wide, so it only ever goes up)
+    return run;
+}
+
+// Times SheetRenderer::BleedAlpha on a square sheet of the given side, filled with uniform sprites (each an opaque
+// ellipse, so there are transparent pixels inside the sprite rects as well as around them). Runs it repeats times, on a
+// fresh copy of the sheet each time.
+QJsonObject runBleed( int side, quint64 seed, double fill, int repeats )
+{
+    // (uniform sprites average about 134 x 134 with the padding)
+    int count = qMax( 1, int( double( side ) * side * fill / ( 134.0 * 134.0 )));
+    QVector<QSize> rects = makeRects( DIST_UNIFORM, count, seed );
+    QVector<int> order = packingOrder( rects, METHOD_MAXRECTS_BESTAREA );
+    QList<PackSprite> sprites;
+    sprites.reserve( rects.size() );
+    for (int i = 0; i < order.size(); ++i)
+        sprites.append( PackSprite( rects[order[i]], QString::number( order[i] )));
+    SheetProperties prop;
+    prop.width = side;
+    prop.height = side;
+    prop.padding = Padding;
+    prop.border = 0;
+    int failed = Packer::MaxRects( prop, sprites, rbp::MaxRectsBinPack::RectBestAreaFit, true, false, 0, 0, 1.0, 1, 0, 0 );
+
+    QImage sheet( side, side, QImage::Format_ARGB32 );
+    if ( sheet.isNull() ) {
+        QJsonObject run;
+        run.insert( "error", QString( "Out of memory" ));
+        return run;
+    }
+    sheet.fill( 0 );
+    Random rng( seed ^ quint64( side ));
+    foreach ( const PackSprite &sprite, sprites ) {
+        QRect rect = SheetRenderer::SpriteRect( sprite, prop );
+        if ( rect.isEmpty() )
+            continue;
+        QRgb colour = qRgba( rng.range( 0, 255 ), rng.range( 0, 255 ), rng.range( 0, 255 ), 255 );
+        double rx = rect.width() / 2.0, ry = rect.height() / 2.0;
+        for (int y = 0; y < rect.height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb*>( sheet.scanLine( rect.top() + y )) + rect.left();
+            double dy = ( y + 0.5 - ry ) / ry;
+            for (int x = 0; x < rect.width(); ++x) {
+                double dx = ( x + 0.5 - rx ) / rx;
+                if ( dx*dx + dy*dy <= 1.0 )
+                    line[x] = colour;
+            }
+        }
+    }
+
+    double best = 0.0, total = 0.0;
+    for (int i = 0; i < repeats; ++i) {
+        QImage image = sheet.copy();
+        QElapsedTimer timer;
+        timer.start();
+        SheetRenderer::BleedAlpha( image, QPoint( 0, 0 ), prop, sprites );
+        double msecs = timer.nsecsElapsed() / 1000000.0;
+        best = i == 0 ? msecs : qMin( best, msecs );
+        total += msecs;
+    }
+    QJsonObject run;
+    run.insert( "sheetSize", side );
+    run.insert( "sprites", sprites.size() - failed );
+    run.insert( "repeats", repeats );
+    run.insert( "msecs", best );
+    run.insert( "meanMsecs", total / repeats );
+    run.insert( "peakRss", double( MemoryUsage::PeakRss() ));
+    return run;
+}
+
+// Parses a comma separated list of names (or numbers, for counts) against the known ones.
+bool parseList( const QString &value, int known, QString ( *name )( int ), QVector<int> &out, QString &error )
+{
+    out.clear();
+    foreach ( const QString &item, value.split( ',', QString::SkipEmptyParts )) {
+        int found = -1;
+        for (int i = 0; i < known; ++i) {
+            if ( name( i ) == item.trimmed() )
+                found = i;
+        }
+        if ( found < 0 ) {
+            error = "Unknown name: " + item;
+            return false;
+        }
+        out.append( found );
+    }
+    return !out.isEmpty();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCoreApplication::setApplicationName( "SpriteBuncher" );
+    QCoreApplication::setOrganizationName( "GoodReactions" );
+    QCoreApplication::setOrganizationDomain( "goodreactions.com" );
+
+    // Update this when doing a new release:
+    QCoreApplication::setApplicationVersion( "1.0b" );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Times every packing method on synthetic sprite sets, and the alpha bleed pass on a "
+                                      "full sheet, and writes the results as json "
+                                      "(progress goes to stderr). The sets are the same for the same seed, so runs can "
+                                      "be compared across versions." );
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption outputOption( QStringList() << "o" << "output", "Write the json to <file> instead of stdout.", "file" );
+    QCommandLineOption countsOption( "counts", "Comma separated sprite counts (default 100,1000,10000,100000).", "list" );
+    QCommandLineOption distOption( "distributions", "Comma separated sprite sets (default all - see --list).", "list" );
+    QCommandLineOption methodOption( "methods", "Comma separated methods (default all - see --list).", "list" );
+    QCommandLineOption seedOption( "seed", "Seed for the sprite sets (default 1).", "n" );
+    QCommandLineOption fillOption( "fill", "How full the sheet would be if packing were perfect (default 0.9), which sets "
+                                   "its size.", "ratio" );
+    QCommandLineOption maxOption( "max-seconds", "Skip a run if, going by the previous count, it looks like taking longer "
+                                  "than this (default 60).", "s" );
+    QCommandLineOption bleedOption( "bleed", "Comma separated sheet sizes to time the alpha bleed pass on (default 4096, "
+                                    "0 for none).", "list" );
+    QCommandLineOption listOption( "list", "List the sprite sets and methods." );
+    parser.addOption( outputOption );
+    parser.addOption( countsOption );
+    parser.addOption( distOption );
+    parser.addOption( methodOption );
+    parser.addOption( seedOption );
+    parser.addOption( fillOption );
+    parser.addOption( maxOption );
+    parser.addOption( bleedOption );
+    parser.addOption( listOption );
+    parser.process( a );
+
+    QTextStream out( stdout );
+    QTextStream err( stderr );
+    QLoggingCategory::setFilterRules( "default.debug=false" );
+
+    if ( parser.isSet( listOption )) {
+        out << "Sprite sets:";
+        for (int i = 0; i < NumDistributions; ++i)
+            out << " " << distributionName( i );
+        out << "\nMethods:";
+        for (int i = 0; i < NumMethods; ++i)
+            out << " " << methodName( i );
+        out << "\n";
+        return 0;
+    }
+
+    QVector<int> counts;
+    foreach ( const QString &item, parser.value( countsOption ).split( ',', QString::SkipEmptyParts )) {
+        bool ok;
+        int count = item.toInt( &ok );
+        if ( !ok || count <= 0 ) {
+            err << "Counts must be positive numbers: " << item << "\n";
+            return 1;
+        }
+        counts.append( count );
+    }
+    if ( counts.isEmpty() )
+        counts << 100 << 1000 << 10000 << 100000;
+    QVector<int> bleedSizes;
+    foreach ( const QString &item, parser.value( bleedOption ).split( ',', QString::SkipEmptyParts )) {
+        bool ok;
+        int side = item.toInt( &ok );
+        if ( !ok || side < 0 ) {
+            err << "Bleed sheet sizes must be numbers: " << item << "\n";
+            return 1;
+        }
+        if ( side > 0 )
+            bleedSizes.append( side );
+    }
+    if ( !parser.isSet( bleedOption ))
+        bleedSizes << 4096;
+    QVector<int> dists, methods;
+    QString error;
+    if ( parser.isSet( distOption ) && !parseList( parser.value( distOption ), NumDistributions, distributionName, dists, error )) {
+        err << error << "\n";
+        return 1;
+    }
+    if ( parser.isSet( methodOption ) && !parseList( parser.value( methodOption ), NumMethods, methodName, methods, error )) {
+        err << error << "\n";
+        return 1;
+    }
+    for (int i = 0; dists.isEmpty() && i < NumDistributions; ++i)
+        dists.append( i );
+    for (int i = 0; methods.isEmpty() && i < NumMethods; ++i)
+        methods.append( i );
+    quint64 seed = parser.isSet( seedOption ) ? parser.value( seedOption ).toULongLong() : 1;
+    double fill = parser.isSet( fillOption ) ? parser.value( fillOption ).toDouble() : 0.9;
+    double maxSeconds = parser.isSet( maxOption ) ? parser.value( maxOption ).toDouble() : 60.0;
+    if ( fill <= 0.0 || fill > 1.0 || maxSeconds <= 0.0 ) {
+        err << "The fill must be between 0 and 1, and max-seconds positive.\n";
+        return 1;
+    }
+
+    // Time of each method's last run on each set, to predict the next count's (packing is roughly quadratic).
+    QHash<QString, QPair<int, double> > lastRuns;
+    QJsonArray runs;
+    foreach ( int dist, dists ) {
+        foreach ( int count, counts ) {
+            QVector<QSize> rects = makeRects( dist, count, seed );
+            int side = sheetSide( rects, fill );
+            foreach ( int method, methods ) {
+                QString key = distributionName( dist ) + "/" + methodName( method );
+                QJsonObject run;
+                if ( lastRuns.contains( key )) {
+                    double ratio = double( count ) / lastRuns[key].first;
+                    double predicted = lastRuns[key].second * ratio * ratio;
+                    if ( predicted > maxSeconds * 1000.0 ) {
+                        run.insert( "skipped", true );
+                        run.insert( "predictedMsecs", predicted );
+                    }
+                }
+                if ( !run.contains( "skipped" )) {
+                    run = runMethod( rects, method, side );
+                    lastRuns.insert( key, qMakePair( count, run.value( "msecs" ).toDouble() ));
+                }
+                run.insert( "distribution", distributionName( dist ));
+                run.insert( "count", count );
+                run.insert( "method", methodName( method ));
+                run.insert( "sheetSize", side );
+                runs.append( run );
+                err << key << " x " << count << ": ";
+                if ( run.contains( "skipped" ))
+                    err << "skipped (would take about " << int( run.value( "predictedMsecs" ).toDouble() / 1000.0 ) << " s)\n";
+                else
+                    err << run.value( "msecs" ).toDouble() << " ms, " << run.value( "failed" ).toInt() << " failed, "
+                        << int( run.value( "occupancy" ).toDouble() * 100.0 ) << "% used\n";
+                err.flush();
+            }
+        }
+    }
+
+    // The alpha bleed pass, which should take under 100 ms on a 4096 x 4096 sheet.
+    QJsonArray bleeds;
+    foreach ( int side, bleedSizes ) {
+        QJsonObject run = runBleed( side, seed, fill, 5 );
+        bleeds.append( run );
+        err << "bleed " << side << " x " << side << ": ";
+        if ( run.contains( "error" ))
+            err << run.value( "error" ).toString() << "\n";
+        else
+            err << run.value( "msecs" ).toDouble() << " ms (best of " << run.value( "repeats" ).toInt() << "), "
+                << run.value( "sprites" ).toInt() << " sprites\n";
+        err.flush();
+    }
+
+    QJsonObject result;
+    result.insert( "benchmark", QString( "buncher-bench" ));
+    result.insert( "version", QCoreApplication::applicationVersion() );
+    result.insert( "qt", QString( qVersion() ));
+    result.insert( "seed", double( seed ));
+    result.insert( "fill", fill );
+    result.insert( "padding", Padding );
+    result.insert( "runs", runs );
+    result.insert( "bleed", bleeds );
+    QByteArray json = QJsonDocument( result ).toJson();
+    if ( parser.isSet( outputOption )) {
+        QFile file( parser.value( outputOption ));
+        if ( !file.open( QIODevice::WriteOnly ) || file.write( json ) != json.size() ) {
+            err << "Could not write " << parser.value( outputOption ) << "\n";
+            return 1;
+        }
+    }
+    else
+        out << json;
+    return 0;
+}
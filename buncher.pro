@@ -4,35 +4,32 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
+CONFIG += c++11
+
 #CONFIG(release, debug|release):DEFINES += QT_NO_DEBUG_OUTPUT
 
 TARGET = SpriteBuncher
 TEMPLATE = app
 
+# The packing engine (core/core.pro) - zlib comes along with it.
+include(core/core.pri)
+
 RC_FILE = myapp.rc
 ICON = buncher.icns
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    	maxrects/Rect.cpp \
-    	maxrects/MaxRectsBinPack.cpp \
-    	packer.cpp \
-        pixmapitem.cpp \
-        packsprite.cpp \
-        dataexporter.cpp
+        sheetpreviewitem.cpp \
+        spriteindex.cpp
 
 HEADERS  += mainwindow.h \
-        maxrects/Rect.h \
-        maxrects/MaxRectsBinPack.h \
-        packer.h \
-        pixmapitem.h \
-        packsprite.h \
         customstylesheet.h \
-        dataexporter.h
+        sheetpreviewitem.h \
+        spriteindex.h
 
 FORMS    += mainwindow.ui \
         aboutbox.ui
@@ -0,0 +1,274 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "bunchersettings.h"
+#include "dataexporter.h"
+#include "imageconverter.h"
+#include "pngwriter.h"
+#include "texturecompressor.h"
+#include "texturewriter.h"
+
+#include <QDebug>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+int BuncherSettings::NumPackMethods = 9; // --> Keep this up-to-date when adding methods! (must match the ui methodComboBox)
+int BuncherSettings::NumImageFormats = 12; // --> Keep this up-to-date when adding formats! (must match the ui imgFormatComboBox)
+int BuncherSettings::NumVariants = 3; // --> Keep this up-to-date when adding variants! (must match the ui variantsComboBox)
+
+namespace {
+
+// Reads an int setting, if it's there and in range [min, max].
+void readInt( const QJsonObject &obj, const QString &key, int &value, int min, int max )
+{
+    if ( obj.contains( key )) {
+        double val = obj.value( key ).toDouble( -1.0 );
+        if ( val >= min && val <= max )
+            value = int( val );
+    }
+}
+
+// Reads a bool setting, if it's there.
+void readBool( const QJsonObject &obj, const QString &key, bool &value )
+{
+    if ( obj.contains( key ))
+        value = obj.value( key ).toBool();
+}
+
+}
+
+BuncherSettings::BuncherSettings()
+{
+    sheetWidth = 1024;
+    sheetHeight = 1024;
+    padding = 2;
+    border = 2;
+    expand = 0;
+    extrude = 0;
+    scale = 1.0;
+    method = MAXRECTS_BESTAREA;
+    dataFormat = DataExporter::FORMAT_GENERIC_XML;
+    imageFormat = FORMAT_ARGB32;
+    dither = ImageConverter::DITHER_NONE;
+    bleed = false;
+    pngCompression = PngWriter::COMPRESSION_DEFAULT;
+    texQuality = TextureCompressor::QUALITY_NORMAL;
+    texContainer = TextureWriter::CONTAINER_KTX;
+    mipmaps = false;
+    blockAlign = false;
+    variants = VARIANTS_NONE;
+    rotation = false;
+    cropping = false;
+    subfolders = false;
+    baseName = "sheet";
+}
+
+void BuncherSettings::fromJson( const QJsonObject &obj )
+{
+    readInt( obj, "sheetw", sheetWidth, 16, 1000000 );
+    readInt( obj, "sheeth", sheetHeight, 16, 1000000 );
+    readInt( obj, "padding", padding, 0, 9999 );
+    readInt( obj, "border", border, 0, 9999 );
+    readInt( obj, "expand", expand, 0, 1000 );
+    readInt( obj, "extrude", extrude, 0, 1000 );
+    if ( obj.contains( "scale" )) {
+        double val = obj.value( "scale" ).toDouble();
+        if ( val >= 0.1 && val <= 100.0 )
+            scale = val;
+    }
+    readInt( obj, "method", method, 0, NumPackMethods - 1 );
+    readInt( obj, "format", dataFormat, 0, DataExporter::NumDataFormats - 1 ); // data format
+    if ( obj.contains( "extraformats" )) { // more data formats
+        QJsonArray jsarr = obj.value( "extraformats" ).toArray();
+        extraFormats.clear();
+        for (int i = 0; i < jsarr.size(); ++i) {
+            int format = jsarr.at( i ).toInt( -1 );
+            if ( format >= 0 && format < DataExporter::NumDataFormats && !extraFormats.contains( format ))
+                extraFormats.append( format );
+        }
+    }
+    readInt( obj, "imgformat", imageFormat, 0, NumImageFormats - 1 ); // image format
+    readInt( obj, "dither", dither, 0, ImageConverter::NumDitherModes - 1 ); // dithering mode (for reduced colour formats)
+    readBool( obj, "bleed", bleed );
+    readInt( obj, "pngcompression", pngCompression, 0, PngWriter::NumCompressionLevels - 1 );
+    readInt( obj, "texquality", texQuality, 0, TextureCompressor::NumQualityLevels - 1 ); // block-compressed texture quality preset
+    readInt( obj, "texcontainer", texContainer, 0, TextureWriter::NumContainers - 1 );
+    readBool( obj, "mipmaps", mipmaps );
+    readBool( obj, "blockalign", blockAlign );
+    readInt( obj, "variants", variants, 0, NumVariants - 1 );
+    readBool( obj, "rotation", rotation );
+    readBool( obj, "cropping", cropping );
+    readBool( obj, "subfolders", subfolders );
+    if ( obj.contains( "basename" )) {
+        QString str = obj.value( "basename" ).toString();
+        if ( str.length() > 0 )
+            baseName = str;
+    }
+    if ( obj.contains( "version" )) // (SpriteBuncher app version)
+        qDebug() << "version string = "  << obj.value( "version" ).toString();
+}
+
+QJsonObject BuncherSettings::toJson() const
+{
+    QJsonObject gameObject;
+    gameObject.insert( "sheetw", sheetWidth );
+    gameObject.insert( "sheeth", sheetHeight );
+    gameObject.insert( "expand", expand );
+    gameObject.insert( "extrude", extrude );
+    gameObject.insert( "padding", padding );
+    gameObject.insert( "border", border );
+    gameObject.insert( "scale", scale );
+    gameObject.insert( "method", method );
+    gameObject.insert( "format", dataFormat ); // data export format
+    QJsonArray extras;
+    foreach ( int format, extraFormats )
+        extras.append( format );
+    gameObject.insert( "extraformats", extras ); // more data formats, exported at the same time
+    gameObject.insert( "imgformat", imageFormat ); // image export format
+    gameObject.insert( "dither", dither );
+    gameObject.insert( "bleed", bleed );
+    gameObject.insert( "pngcompression", pngCompression );
+    gameObject.insert( "texquality", texQuality );
+    gameObject.insert( "texcontainer", texContainer );
+    gameObject.insert( "mipmaps", mipmaps );
+    gameObject.insert( "blockalign", blockAlign );
+    gameObject.insert( "variants", variants );
+    gameObject.insert( "rotation", rotation );
+    gameObject.insert( "cropping", cropping );
+    gameObject.insert( "subfolders", subfolders );
+    gameObject.insert( "basename", baseName );
+    gameObject.insert( "version", QCoreApplication::applicationVersion() );
+    return gameObject;
+}
+
+bool BuncherSettings::load( const QString &fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly | QIODevice::Text )) {
+        qDebug() << "(no previous json file exists).";
+        return false;
+    }
+    QByteArray val = file.readAll();
+    qDebug() << "Read json: " << val;
+    fromJson( QJsonDocument::fromJson( val ).object() );
+    return true;
+}
+
+bool BuncherSettings::save( const QString &fileName ) const
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly )) {
+        qWarning("Couldn't open json file for saving.");
+        return false;
+    }
+    QJsonDocument saveDoc( toJson() );
+    return file.write( saveDoc.toJson() ) >= 0;
+}
+
+QImage::Format BuncherSettings::qImageFormat() const
+{
+    switch ( imageFormat ) {
+        case FORMAT_ARGB32: return QImage::Format_ARGB32;
+        case FORMAT_ARGB32_PRE: return QImage::Format_ARGB32_Premultiplied;
+        case FORMAT_ARGB4444_PREM: return QImage::Format_ARGB4444_Premultiplied;
+        case FORMAT_RGB888: return QImage::Format_RGB888;
+        case FORMAT_RGB565: return QImage::Format_RGB16; // 'RGB565'
+        case FORMAT_RGB565_PREM: return QImage::Format_ARGB8565_Premultiplied;
+        case FORMAT_RGB555: return QImage::Format_RGB555;
+        case FORMAT_BC1: // block-compressed formats are encoded from ARGB32.
+        case FORMAT_BC3:
+        case FORMAT_BC7:
+        case FORMAT_ETC2_RGBA: return QImage::Format_ARGB32;
+        case FORMAT_INDEXED8: return QImage::Format_ARGB32; // indexed is quantized from ARGB32.
+        default:
+            qWarning() << "warning: qImageFormat -- using 'default' img format, check format values";
+            return QImage::Format_ARGB32;
+    }
+}
+
+int BuncherSettings::textureFormat() const
+{
+    switch ( imageFormat ) {
+        case FORMAT_BC1: return TextureCompressor::TEXTURE_BC1;
+        case FORMAT_BC3: return TextureCompressor::TEXTURE_BC3;
+        case FORMAT_BC7: return TextureCompressor::TEXTURE_BC7;
+        case FORMAT_ETC2_RGBA: return TextureCompressor::TEXTURE_ETC2_RGBA;
+        default: return -1;
+    }
+}
+
+QString BuncherSettings::imageExtension() const
+{
+    if ( textureFormat() >= 0 )
+        return TextureWriter::fileExtension( TextureWriter::Containers( texContainer ));
+    return ".png";
+}
+
+QString BuncherSettings::pixelFormatName() const
+{
+    switch ( imageFormat ) {
+        case FORMAT_ARGB4444_PREM: return "RGBA4444";
+        case FORMAT_RGB888: return "RGB888";
+        case FORMAT_RGB565: return "RGB565";
+        case FORMAT_RGB565_PREM: return "RGBA5658";
+        case FORMAT_RGB555: return "RGB555";
+        case FORMAT_BC1: return "BC1";
+        case FORMAT_BC3: return "BC3";
+        case FORMAT_BC7: return "BC7";
+        case FORMAT_ETC2_RGBA: return "ETC2_RGBA8";
+        case FORMAT_INDEXED8: return "INDEXED8";
+        default: return "RGBA8888";
+    }
+}
+
+QList<int> BuncherSettings::dataFormats() const
+{
+    QList<int> formats;
+    formats.append( dataFormat );
+    foreach ( int format, extraFormats ) {
+        if ( !formats.contains( format ))
+            formats.append( format );
+    }
+    return formats;
+}
+
+int BuncherSettings::variantScale() const
+{
+    switch ( variants ) {
+        case VARIANTS_2X: return 2;
+        case VARIANTS_4X: return 4;
+        default: return 1;
+    }
+}
+
+QString BuncherSettings::variantSuffix( int factor ) const
+{
+    int vscale = variantScale() / factor;
+    if ( variantScale() == 1 || vscale == 1 )
+        return QString(); // (the @1x files keep the plain base name)
+    return "@" + QString::number( vscale ) + "x";
+}
+
+bool BuncherSettings::isBleeding() const
+{
+    // (only non-premultiplied output keeps colour in fully transparent pixels)
+    return bleed && qImageFormat() == QImage::Format_ARGB32;
+}
@@ -0,0 +1,129 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BUNCHERSETTINGS_H
+#define BUNCHERSETTINGS_H
+
+#include <QImage>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+//! All the options used to pack, render and export one folder's sprite sheet.
+/*! These are what the main window's widgets show, and what gets saved in the folder's json settings file
+ *  ("buncher.data"), so the same settings can be used without the UI (see SheetBuilder).
+ */
+struct BuncherSettings
+{
+    //! Constructor. Sets the same defaults as the UI form.
+    BuncherSettings();
+
+    //! Packing Methods. Indexes must match ui packComboBox -- be careful if adding new ones. Index is saved in json settings file.
+    enum PackMethods { MAXRECTS_BESTAREA = 0, MAXRECTS_SHORTSIDE, MAXRECTS_LONGSIDE, MAXRECTS_BOTTOMLEFT, MAXRECTS_CONTACTPOINT,
+                       ROWS_BY_NAME, ROWS_BY_AREA, ROWS_BY_HEIGHT, ROWS_BY_WIDTH };
+    //! Number of packing methods defined in PackMethods.
+    static int NumPackMethods;
+    //! Image formats for output. These get converted to matching QImage formats, except the block-compressed texture
+    //! formats (BC1 to ETC2), which are rendered in ARGB32 then encoded by TextureCompressor into a KTX file, and indexed,
+    //! which is rendered in ARGB32 then reduced to a palette by ColorQuantizer.
+    enum ImageFormats { FORMAT_ARGB32, FORMAT_ARGB32_PRE, FORMAT_ARGB4444_PREM, FORMAT_RGB888, FORMAT_RGB565, FORMAT_RGB565_PREM,
+                        FORMAT_RGB555, FORMAT_BC1, FORMAT_BC3, FORMAT_BC7, FORMAT_ETC2_RGBA, FORMAT_INDEXED8 };
+    //! Number of image formats defined in ImageFormats.
+    static int NumImageFormats;
+    //! Resolution variants exported from one packing. Indexes must match ui variantsComboBox. Index is saved in json settings file.
+    enum Variants { VARIANTS_NONE = 0, VARIANTS_2X, VARIANTS_4X };
+    //! Number of variant options defined in Variants.
+    static int NumVariants;
+
+    //! Sheet width in pixels.
+    int sheetWidth;
+    //! Sheet height in pixels.
+    int sheetHeight;
+    //! The gap added around each sprite, in pixels.
+    int padding;
+    //! The border added around the entire sheet, in pixels.
+    int border;
+    //! Pixels added on each side of every sprite.
+    int expand;
+    //! Number of edge pixels extruded around each sprite.
+    int extrude;
+    //! Scale factor for all sprites.
+    qreal scale;
+    //! Packing method (see PackMethods).
+    int method;
+    //! Main data format (see DataExporter::DataFormats).
+    int dataFormat;
+    //! Any more data formats to export at the same time.
+    QList<int> extraFormats;
+    //! Image format (see ImageFormats).
+    int imageFormat;
+    //! Dithering mode for reduced colour formats (see ImageConverter::DitherModes).
+    int dither;
+    //! Bleed sprite edge colours into the transparent pixels around them (see SheetRenderer::BleedAlpha).
+    bool bleed;
+    //! PNG compression level (see PngWriter::CompressionLevels).
+    int pngCompression;
+    //! Block-compressed texture quality (see TextureCompressor::QualityLevels).
+    int texQuality;
+    //! Block-compressed texture container (see TextureWriter::Containers).
+    int texContainer;
+    //! Write mipmaps for block-compressed textures.
+    bool mipmaps;
+    //! Align sprites to 4x4 blocks.
+    bool blockAlign;
+    //! Resolution variants to export (see Variants).
+    int variants;
+    //! Allow rotated sprites (MaxRects methods only).
+    bool rotation;
+    //! Crop transparent borders from sprites.
+    bool cropping;
+    //! Include images in subfolders.
+    bool subfolders;
+    //! Base file name (without extension) for output files.
+    QString baseName;
+
+    //! Reads settings from a json object, as saved by toJson(). Missing or invalid values keep their current setting.
+    void fromJson( const QJsonObject &obj );
+    //! Returns the settings as a json object, as saved in the json settings file.
+    QJsonObject toJson() const;
+
+    //! Reads settings from a json settings file (see fromJson). Returns false if the file couldn't be read.
+    bool load( const QString &fileName );
+    //! Writes the settings to a json settings file. Returns false on failure.
+    bool save( const QString &fileName ) const;
+
+    //! Returns the image format as a QImage format id (be careful, they use different enum values).
+    QImage::Format qImageFormat() const;
+    //! Returns the TextureCompressor::Formats id, or -1 if the image format isn't a block-compressed one.
+    int textureFormat() const;
+    //! Returns the file extension (including the dot) for the image format and container.
+    QString imageExtension() const;
+    //! Returns the name of the image format, as written in the data files.
+    QString pixelFormatName() const;
+    //! Returns the data formats to export - the main one, then any extra ones (DataExporter::DataFormats ids).
+    QList<int> dataFormats() const;
+    //! Returns the scale of the largest variant relative to the smallest (1 if variants are off).
+    int variantScale() const;
+    //! Returns the file name suffix for a variant factor times smaller than the packed sheet, e.g. "@2x" (the smallest has none).
+    QString variantSuffix( int factor ) const;
+    //! Returns true if sprite edge colours get bled into the transparent pixels around them (see SheetRenderer::BleedAlpha).
+    bool isBleeding() const;
+};
+
+#endif // BUNCHERSETTINGS_H
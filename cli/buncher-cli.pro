@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# buncher-cli - command line version of SpriteBuncher.
+# Same packing and export code as the app (buncher-core), but no widgets, so it runs on
+# machines without a display (it doesn't need a platform plugin either).
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent network
+QT       -= widgets
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+#CONFIG(release, debug|release):DEFINES += QT_NO_DEBUG_OUTPUT
+
+TARGET = buncher-cli
+TEMPLATE = app
+
+# The packing engine (core/core.pro) - zlib comes along with it.
+include(../core/core.pri)
+
+SOURCES += main.cpp \
+        packserver.cpp
+
+HEADERS  += packserver.h
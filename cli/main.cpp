@@ -0,0 +1,402 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// buncher-cli - packs and exports a folder's sprite sheet without any UI (or a windowing system).
+// Uses the same settings file ("buncher/buncher.data") as the main app, so folders set up there export the same here.
+
+#include "sheetbuilder.h"
+#include "batchbuilder.h"
+#include "dataexporter.h"
+#include "exportmanifest.h"
+#include "packserver.h"
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QLoggingCategory>
+#include <QTextStream>
+
+namespace {
+
+// Exit codes.
+const int ExitOk = 0;
+const int ExitError = 1;
+const int ExitPackFailed = 2;
+
+// Turns a --set value into json: numbers, true/false and arrays (e.g. "[4,5]") are parsed, anything else is a string.
+QJsonValue settingValue( const QString &str )
+{
+    QJsonDocument doc = QJsonDocument::fromJson( "[" + str.toUtf8() + "]" );
+    if ( doc.isArray() && doc.array().size() == 1 )
+        return doc.array().at( 0 );
+    return QJsonValue( str );
+}
+
+// Returns the --pixel-budget in bytes, or 0 if it isn't set. (main() checks it's valid.)
+qint64 pixelBudget( const QCommandLineParser &parser )
+{
+    return parser.isSet( "pixel-budget" ) ? parser.value( "pixel-budget" ).toLongLong() * 1024 * 1024 : 0;
+}
+
+// Writes a --report, to stdout if the file name's "-". Returns false (with a message) if it can't be written.
+bool writeReport( const QString &fileName, const QJsonObject &report )
+{
+    QByteArray json = QJsonDocument( report ).toJson();
+    if ( fileName == "-" ) {
+        QTextStream( stdout ) << json;
+        return true;
+    }
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ) || file.write( json ) != json.size() ) {
+        QTextStream( stderr ) << "Could not write the report: " << fileName << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Packs several folders (and/or a project file's) at once, printing a line as each finishes.
+int batchMain( const QCommandLineParser &parser, const QJsonObject &overrides )
+{
+    QTextStream out( stdout );
+    QTextStream err( stderr );
+    BatchBuilder batch;
+    foreach ( const QString &folder, parser.positionalArguments() )
+        batch.addFolder( folder );
+    QString error;
+    if ( parser.isSet( "project" ) && !batch.readProjectFile( parser.value( "project" ), error )) {
+        err << error << "\n";
+        return ExitError;
+    }
+    if ( batch.folders().isEmpty() ) {
+        err << "No folders to pack.\n";
+        return ExitError;
+    }
+    if ( parser.isSet( "memory" )) {
+        bool ok;
+        qint64 mb = parser.value( "memory" ).toLongLong( &ok );
+        if ( !ok || mb <= 0 ) {
+            err << "The memory budget must be a number of MB: " << parser.value( "memory" ) << "\n";
+            return ExitError;
+        }
+        batch.setMemoryBudget( mb * 1024 * 1024 );
+    }
+    if ( parser.isSet( "settings" ))
+        batch.setSettingsFile( parser.value( "settings" ));
+    batch.setOverrides( overrides );
+    batch.setCheckOnly( parser.isSet( "check" ));
+    batch.setPixelBudget( pixelBudget( parser ));
+
+    QList<BatchResult> results = batch.run( [&]( const BatchResult &result, int done, int total ) {
+        QString line = QString( "[%1/%2] %3 - " ).arg( done ).arg( total ).arg( QDir::toNativeSeparators( result.folder ));
+        switch ( result.status ) {
+        case BatchResult::BATCH_DONE:
+            line += QString( "exported, %1 images on a %2 x %3 sheet" ).arg( result.sprites ).arg( result.width ).arg( result.height );
+            break;
+        case BatchResult::BATCH_UP_TO_DATE:
+            line += "up to date";
+            break;
+        case BatchResult::BATCH_CHECKED:
+            line += QString( "%1 images fit on a %2 x %3 sheet" ).arg( result.sprites ).arg( result.width ).arg( result.height );
+            break;
+        case BatchResult::BATCH_PACK_FAILED:
+            line += QString( "%1 image(s) failed to pack (%2 Ok), try a bigger sheet" ).arg( result.failed ).arg( result.sprites - result.failed );
+            break;
+        case BatchResult::BATCH_NO_IMAGES:
+            line += "no images found";
+            break;
+        default:
+            line += "failed: " + result.error;
+        }
+        if ( result.msecs > 0 )
+            line += QString( " (%1 s)" ).arg( result.msecs / 1000.0, 0, 'f', 1 );
+        ( result.status >= BatchResult::BATCH_PACK_FAILED ? err : out ) << line << "\n";
+        out.flush();
+        err.flush();
+    });
+    if ( parser.isSet( "report" ))
+        writeReport( parser.value( "report" ), BatchBuilder::report( results ));
+
+    int nerrors = 0, nfails = 0;
+    foreach ( const BatchResult &result, results ) {
+        if ( result.status == BatchResult::BATCH_PACK_FAILED )
+            ++nfails;
+        else if ( result.status >= BatchResult::BATCH_NO_IMAGES )
+            ++nerrors;
+    }
+    out << results.size() - nerrors - nfails << " of " << results.size() << " folders Ok.\n";
+    if ( nerrors > 0 )
+        return ExitError;
+    return nfails > 0 ? ExitPackFailed : ExitOk;
+}
+
+// Sends the folder(s) to a running daemon (see PackServer), printing a line for each reply.
+// Returns -1 if there's no daemon to connect to.
+int clientMain( const QCommandLineParser &parser, const QJsonObject &overrides )
+{
+    QTextStream out( stdout );
+    QTextStream err( stderr );
+    QLocalSocket socket;
+    socket.connectToServer( parser.isSet( "socket" ) ? parser.value( "socket" ) : PackServer::defaultName() );
+    if ( !socket.waitForConnected( 1000 ))
+        return -1;
+    BatchBuilder folders; // (just for the folder list.)
+    foreach ( const QString &folder, parser.positionalArguments() )
+        folders.addFolder( folder );
+    QString error;
+    if ( parser.isSet( "project" ) && !folders.readProjectFile( parser.value( "project" ), error )) {
+        err << error << "\n";
+        return ExitError;
+    }
+    int nerrors = 0, nfails = 0;
+    QJsonArray replies;
+    foreach ( const QString &folder, folders.folders() ) {
+        QJsonObject request;
+        request.insert( "command", QString( parser.isSet( "check" ) ? "pack" : "export" ));
+        request.insert( "folder", folder );
+        request.insert( "settings", overrides );
+        if ( parser.isSet( "settings" ))
+            request.insert( "settingsfile", QFileInfo( parser.value( "settings" )).absoluteFilePath() );
+        socket.write( QJsonDocument( request ).toJson( QJsonDocument::Compact ) + "\n" );
+        while ( !socket.canReadLine() ) {
+            if ( !socket.waitForReadyRead( -1 )) {
+                err << "Lost the connection to the daemon: " << socket.errorString() << "\n";
+                return ExitError;
+            }
+        }
+        QJsonObject reply = QJsonDocument::fromJson( socket.readLine() ).object();
+        replies.append( reply );
+        QString status = reply.value( "status" ).toString();
+        QString line = QDir::toNativeSeparators( folder ) + " - ";
+        if ( status == "done" || status == "packed" )
+            line += QString( "%1 images on a %2 x %3 sheet" ).arg( reply.value( "sprites" ).toInt() )
+                    .arg( reply.value( "width" ).toInt() ).arg( reply.value( "height" ).toInt() );
+        else if ( status == "up-to-date" )
+            line += "up to date";
+        else if ( status == "pack-failed" )
+            line += QString( "%1 image(s) failed to pack, try a bigger sheet" ).arg( reply.value( "failed" ).toInt() );
+        else
+            line += "failed: " + reply.value( "error" ).toString();
+        line += QString( " (%1 decoded, %2 ms)" ).arg( reply.value( "decoded" ).toInt() ).arg( reply.value( "msecs" ).toInt() );
+        ( reply.value( "ok" ).toBool() ? out : err ) << line << "\n";
+        if ( status == "pack-failed" )
+            ++nfails;
+        else if ( !reply.value( "ok" ).toBool() )
+            ++nerrors;
+    }
+    if ( parser.isSet( "report" )) {
+        QJsonObject report;
+        report.insert( "folders", replies );
+        writeReport( parser.value( "report" ), report );
+    }
+    if ( nerrors > 0 )
+        return ExitError;
+    return nfails > 0 ? ExitPackFailed : ExitOk;
+}
+
+// Packs (and exports) a single folder.
+int folderMain( const QCommandLineParser &parser, const QJsonObject &overrides, SheetBuilder &builder )
+{
+    QTextStream out( stdout );
+    QTextStream err( stderr );
+    QDir dir( parser.positionalArguments().first() );
+    if ( !dir.exists() || !dir.isReadable() ) {
+        err << "Could not open the input folder: " << dir.path() << "\n";
+        return ExitError;
+    }
+
+    builder.setInputFolder( dir.absolutePath() );
+    builder.setPixelBudget( pixelBudget( parser ));
+    BuncherSettings settings;
+    settings.load( parser.isSet( "settings" ) ? parser.value( "settings" ) : builder.settingsFileName() );
+    settings.fromJson( overrides );
+    builder.setSettings( settings );
+
+    // An unchanged folder needs nothing decoding or packing.
+    ExportManifest manifest;
+    bool check = parser.isSet( "check" );
+    if ( !check && builder.isUpToDate( &manifest )) {
+        out << "Nothing has changed since the last export, the files are up to date.\n";
+        return ExitOk;
+    }
+
+    int nloaded = builder.loadSprites();
+    if ( nloaded == 0 ) {
+        err << "No images found in " << dir.path() << "\n";
+        return ExitError;
+    }
+    int nfails = builder.pack();
+    if ( nfails > 0 ) {
+        err << nfails << " image(s) failed to pack (" << nloaded - nfails << " Ok), try a bigger sheet.\n";
+        return ExitPackFailed;
+    }
+    out << nloaded << " images successfully packed on a " << builder.sheetProperties().width << " x "
+        << builder.sheetProperties().height << " sheet.\n";
+    if ( check )
+        return ExitOk;
+
+    out.flush();
+    QString error;
+    switch ( builder.exportFiles( error, SheetBuilder::ProgressFunction(), &manifest )) {
+    case SheetBuilder::EXPORT_DONE:
+        out << "Exported to " << QDir::toNativeSeparators( builder.outputFolder() ) << "\n";
+        return ExitOk;
+    case SheetBuilder::EXPORT_UP_TO_DATE:
+        out << "Nothing has changed since the last export, the files are up to date.\n";
+        return ExitOk;
+    default:
+        err << error << "\n";
+        return ExitError;
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCoreApplication::setApplicationName( "SpriteBuncher" );
+    QCoreApplication::setOrganizationName( "GoodReactions" );
+    QCoreApplication::setOrganizationDomain( "goodreactions.com" );
+
+    // Update this when doing a new release:
+    QCoreApplication::setApplicationVersion( "1.0b" );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Packs the images in a folder into a sprite sheet, and exports it to the folder's "
+                                      "'buncher' subfolder.\nExit status is 0 on success, 1 on errors, 2 if some images "
+                                      "didn't fit on the sheet (nothing is exported then).\nGiven several folders, or a "
+                                      "project file, they're all processed at once." );
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument( "folders", "Folder(s) of images to pack.", "folder..." );
+    QCommandLineOption projectOption( "project", "Also pack the folders listed in <file>, one per line, relative to the file.", "file" );
+    QCommandLineOption memoryOption( "memory", "With several folders, roughly how much memory they may use at once, in MB "
+                                     "(default " + QString::number( BatchBuilder::DefaultMemoryBudget / ( 1024 * 1024 )) + ").", "MB" );
+    QCommandLineOption pixelOption( "pixel-budget", "Keep at most this many MB of decoded images per folder, decoding "
+                                    "them again as needed - for folders too big to keep in memory.", "MB" );
+    QCommandLineOption settingsOption( "settings", "Read settings from <file>, instead of the folder's buncher/buncher.data.", "file" );
+    QCommandLineOption setOption( QStringList() << "s" << "set", "Override one setting, using the settings file's key names, "
+                                  "e.g. -s sheetw=2048 -s imgformat=9 -s extraformats=[4,5].", "key=value" );
+    QCommandLineOption checkOption( "check", "Only pack, to check everything fits - nothing is written." );
+    QCommandLineOption listOption( "list-formats", "List the data format ids, for the 'format' and 'extraformats' settings." );
+    QCommandLineOption daemonOption( "daemon", "Run as a daemon: stay running, and pack folders on request over a local "
+                                     "socket, keeping them decoded in memory in between (see --client)." );
+    QCommandLineOption clientOption( "client", "Ask the running daemon to pack the folder(s), instead of packing them here. "
+                                     "If there's no daemon, they're packed here anyway." );
+    QCommandLineOption socketOption( "socket", "The daemon's socket name (default " + PackServer::defaultName() + ").", "name" );
+    QCommandLineOption reportOption( "report", "Write a json report of where the time went (per stage timings and "
+                                     "counters) to <file>, or '-' for stdout.", "file" );
+    QCommandLineOption traceOption( "trace", "Record what each thread does, and when, to <file> - open it in "
+                                    "chrome://tracing or ui.perfetto.dev.", "file" );
+    QCommandLineOption verboseOption( QStringList() << "V" << "verbose", "Print debug output." );
+    parser.addOption( projectOption );
+    parser.addOption( memoryOption );
+    parser.addOption( pixelOption );
+    parser.addOption( settingsOption );
+    parser.addOption( setOption );
+    parser.addOption( checkOption );
+    parser.addOption( listOption );
+    parser.addOption( daemonOption );
+    parser.addOption( clientOption );
+    parser.addOption( socketOption );
+    parser.addOption( reportOption );
+    parser.addOption( traceOption );
+    parser.addOption( verboseOption );
+    parser.process( a );
+
+    QTextStream out( stdout );
+    QTextStream err( stderr );
+    if ( !parser.isSet( verboseOption ))
+        QLoggingCategory::setFilterRules( "default.debug=false" );
+
+    if ( parser.isSet( listOption )) {
+        for( int i = 0; i < DataExporter::NumDataFormats; i++ )
+            out << i << "  " << DataExporter::displayName( DataExporter::DataFormats(i) ) << "\n";
+        return ExitOk;
+    }
+    if ( parser.isSet( pixelOption )) {
+        bool ok;
+        qint64 mb = parser.value( pixelOption ).toLongLong( &ok );
+        if ( !ok || mb <= 0 ) {
+            err << "The pixel budget must be a number of MB: " << parser.value( pixelOption ) << "\n";
+            return ExitError;
+        }
+    }
+    if ( parser.isSet( daemonOption )) {
+        PackServer server;
+        server.setPixelBudget( pixelBudget( parser ));
+        QString name = parser.isSet( socketOption ) ? parser.value( socketOption ) : PackServer::defaultName();
+        if ( !server.listen( name )) {
+            err << "Could not listen on " << name << ": " << server.errorString() << "\n";
+            return ExitError;
+        }
+        out << "Listening on " << name << "\n";
+        out.flush();
+        return a.exec();
+    }
+    if ( parser.positionalArguments().isEmpty() && !parser.isSet( projectOption )) {
+        err << "Please give a folder to pack (see --help).\n";
+        return ExitError;
+    }
+    QJsonObject overrides;
+    foreach ( const QString &set, parser.values( setOption )) {
+        int eq = set.indexOf( '=' );
+        if ( eq <= 0 ) {
+            err << "Settings must be given as key=value: " << set << "\n";
+            return ExitError;
+        }
+        overrides.insert( set.left( eq ), settingValue( set.mid( eq + 1 )));
+    }
+    if ( parser.isSet( settingsOption ) && !BuncherSettings().load( parser.value( settingsOption ))) {
+        err << "Could not read the settings file: " << parser.value( settingsOption ) << "\n";
+        return ExitError;
+    }
+
+    if ( parser.isSet( clientOption )) {
+        int result = clientMain( parser, overrides );
+        if ( result >= 0 )
+            return result;
+        err << "No daemon running, packing here.\n";
+        err.flush();
+    }
+    if ( parser.isSet( traceOption ))
+        Trace::start();
+    int result;
+    if ( parser.positionalArguments().size() > 1 || parser.isSet( projectOption ))
+        result = batchMain( parser, overrides );
+    else {
+        SheetBuilder builder;
+        result = folderMain( parser, overrides, builder );
+        if ( parser.isSet( reportOption ) && !builder.inputFolder().isEmpty() )
+            writeReport( parser.value( reportOption ), builder.report() );
+    }
+    if ( parser.isSet( traceOption )) {
+        Trace::stop();
+        if ( !Trace::save( parser.value( traceOption )))
+            err << "Could not write the trace: " << parser.value( traceOption ) << "\n";
+    }
+    return result;
+}
@@ -0,0 +1,232 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "packserver.h"
+
+#include <QtDebug>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+PackServer::FolderCache::FolderCache()
+{
+    packed = false;
+    failed = 0;
+}
+
+PackServer::PackServer( QObject *parent ) :
+    QObject( parent ), m_pixelBudget( 0 )
+{
+    m_server = new QLocalServer( this );
+    connect( m_server, SIGNAL(newConnection()), this, SLOT(newConnection()) );
+}
+
+void PackServer::setPixelBudget( qint64 bytes )
+{
+    m_pixelBudget = bytes;
+}
+
+bool PackServer::listen( const QString &name )
+{
+    // If a server answers on the name, it's running - otherwise the socket is left over from a crash.
+    QLocalSocket probe;
+    probe.connectToServer( name );
+    if ( probe.waitForConnected( 500 )) {
+        probe.disconnectFromServer();
+        return false;
+    }
+    QLocalServer::removeServer( name );
+    return m_server->listen( name );
+}
+
+QString PackServer::errorString() const
+{
+    if ( m_server->isListening() )
+        return QString();
+    return m_server->errorString().isEmpty() ? "Another server is already running." : m_server->errorString();
+}
+
+QString PackServer::defaultName()
+{
+    return "buncher";
+}
+
+void PackServer::newConnection()
+{
+    while ( QLocalSocket *socket = m_server->nextPendingConnection() ) {
+        connect( socket, SIGNAL(readyRead()), this, SLOT(readRequests()) );
+        connect( socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()) );
+    }
+}
+
+void PackServer::readRequests()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>( sender() );
+    if ( !socket )
+        return;
+    while ( socket->canReadLine() ) {
+        QByteArray line = socket->readLine().trimmed();
+        if ( line.isEmpty() )
+            continue;
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson( line, &parseError );
+        QJsonObject reply;
+        if ( !doc.isObject() ) {
+            reply.insert( "ok", false );
+            reply.insert( "error", "Bad request: " + parseError.errorString() );
+        }
+        else
+            reply = handleRequest( doc.object() );
+        socket->write( QJsonDocument( reply ).toJson( QJsonDocument::Compact ) + "\n" );
+        socket->flush();
+        if ( doc.object().value( "command" ).toString() == "quit" ) {
+            socket->waitForBytesWritten( 1000 );
+            QCoreApplication::quit();
+        }
+    }
+}
+
+QJsonObject PackServer::handleRequest( const QJsonObject &request )
+{
+    QString command = request.value( "command" ).toString();
+    QJsonObject reply;
+    if ( command == "export" || command == "pack" )
+        reply = packFolder( request, command == "export" );
+    else if ( command == "forget" ) {
+        reply.insert( "ok", m_folders.remove( QDir( request.value( "folder" ).toString() ).absolutePath() ) > 0 );
+    }
+    else if ( command == "status" ) {
+        QJsonArray folders;
+        MemoryUsage total;
+        for (QMap<QString, FolderCache>::const_iterator it = m_folders.constBegin(); it != m_folders.constEnd(); ++it) {
+            MemoryUsage usage = it->builder.memoryUsage();
+            QJsonObject folder;
+            folder.insert( "folder", it.key() );
+            folder.insert( "sprites", it->builder.sprites().size() );
+            folder.insert( "packed", it->packed );
+            folder.insert( "bytes", double( usage.total() ));
+            folders.append( folder );
+            total.add( usage );
+        }
+        reply.insert( "ok", true );
+        reply.insert( "folders", folders );
+        reply.insert( "memory", total.toJson() );
+    }
+    else if ( command == "quit" )
+        reply.insert( "ok", true );
+    else {
+        reply.insert( "ok", false );
+        reply.insert( "error", "Unknown command: " + command );
+    }
+    if ( request.contains( "id" ))
+        reply.insert( "id", request.value( "id" ));
+    return reply;
+}
+
+QJsonObject PackServer::packFolder( const QJsonObject &request, bool exportFiles )
+{
+    QElapsedTimer timer;
+    timer.start();
+    QJsonObject reply;
+    reply.insert( "ok", false );
+    QDir dir( request.value( "folder" ).toString() );
+    if ( request.value( "folder" ).toString().isEmpty() || !dir.exists() || !dir.isReadable() ) {
+        reply.insert( "status", QString( "failed" ));
+        reply.insert( "error", "Could not open the input folder: " + dir.path() );
+        return reply;
+    }
+    QString path = dir.absolutePath();
+    bool cached = m_folders.contains( path );
+    FolderCache &cache = m_folders[path];
+    SheetBuilder &builder = cache.builder;
+    if ( !cached ) {
+        builder.setInputFolder( path );
+        builder.setPixelBudget( m_pixelBudget );
+    }
+
+    BuncherSettings settings;
+    if ( request.contains( "settingsfile" )) {
+        if ( !settings.load( request.value( "settingsfile" ).toString() )) {
+            reply.insert( "status", QString( "failed" ));
+            reply.insert( "error", "Could not read the settings file: " + request.value( "settingsfile" ).toString() );
+            return reply;
+        }
+    }
+    else
+        settings.load( builder.settingsFileName() );
+    if ( request.value( "settings" ).isObject() )
+        settings.fromJson( request.value( "settings" ).toObject() );
+    builder.setSettings( settings );
+    builder.clearStats();
+
+    // Only changed files are decoded. If none changed (or went), and the settings are the same, the sprites come back
+    // in the same order with their packed rects, so the last packing stands.
+    int nbefore = builder.sprites().size();
+    int ndecoded = builder.reloadSprites();
+    bool changed = ndecoded > 0 || builder.sprites().size() != nbefore;
+    reply.insert( "decoded", ndecoded );
+    reply.insert( "sprites", builder.sprites().size() );
+    if ( builder.sprites().isEmpty() ) {
+        cache.packed = false;
+        reply.insert( "status", QString( "no-images" ));
+        reply.insert( "error", "No images found in " + path );
+        reply.insert( "msecs", timer.elapsed() );
+        return reply;
+    }
+    QJsonObject settingsJson = settings.toJson();
+    bool repack = changed || !cache.packed || settingsJson != cache.packedSettings;
+    if ( repack ) {
+        cache.failed = builder.pack();
+        cache.packedSettings = settingsJson;
+        cache.packed = true;
+    }
+    reply.insert( "repacked", repack );
+    reply.insert( "failed", cache.failed );
+    reply.insert( "width", builder.sheetProperties().width );
+    reply.insert( "height", builder.sheetProperties().height );
+    if ( cache.failed > 0 )
+        reply.insert( "status", QString( "pack-failed" ));
+    else if ( !exportFiles ) {
+        reply.insert( "ok", true );
+        reply.insert( "status", QString( "packed" ));
+    }
+    else {
+        QString error;
+        switch ( builder.exportFiles( error )) {
+        case SheetBuilder::EXPORT_DONE:
+            reply.insert( "ok", true );
+            reply.insert( "status", QString( "done" ));
+            break;
+        case SheetBuilder::EXPORT_UP_TO_DATE:
+            reply.insert( "ok", true );
+            reply.insert( "status", QString( "up-to-date" ));
+            break;
+        default:
+            reply.insert( "status", QString( "failed" ));
+            reply.insert( "error", error );
+        }
+    }
+    reply.insert( "msecs", timer.elapsed() );
+    reply.insert( "stats", builder.stats().toJson() );
+    reply.insert( "memory", builder.memoryUsage().toJson() );
+    return reply;
+}
@@ -0,0 +1,103 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKSERVER_H
+#define PACKSERVER_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QMap>
+#include <QString>
+
+#include "sheetbuilder.h"
+
+class QLocalServer;
+class QLocalSocket;
+
+//! buncher-cli's daemon mode - packs and exports folders on request, over a local socket.
+/*! Each folder's sprites stay decoded in memory between requests, with their crop rects and the last packing, so a
+ *  request after a few images have changed only decodes those, and one with nothing changed doesn't repack at all.
+ *
+ *  The protocol is one json object per line, each way. Requests:
+ *  \code
+ *  {"id": 1, "command": "export", "folder": "/art/ui", "settings": {"sheetw": 2048}}
+ *  \endcode
+ *  - command - "export" (load, pack and export), "pack" (load and pack only), "forget" (drop a folder's cache),
+ *    "status" (list the cached folders, and the memory they hold) or "quit".
+ *  - settings - optional overrides, with the settings file's key names. "settingsfile" - optional settings file to use
+ *    instead of the folder's own.
+ *  - id - optional, copied to the reply.
+ *
+ *  Replies have "ok", and for pack/export: "status" ("done", "up-to-date", "packed", "pack-failed", "no-images" or
+ *  "failed"), "sprites", "failed", "width", "height", "decoded" (files decoded this time), "repacked", "msecs", "stats"
+ *  (see Stats::toJson), "memory" (see MemoryUsage::toJson), and "error" if anything went wrong.
+ */
+class PackServer : public QObject
+{
+    Q_OBJECT
+public:
+    //! Constructor.
+    explicit PackServer( QObject *parent = 0 );
+
+    //! Starts listening on the local socket (or named pipe, on windows) with the given name.
+    /*! A stale socket left by a crashed server is removed first. Returns false if another server is running.
+     */
+    bool listen( const QString &name );
+
+    //! Returns the reason listen() failed.
+    QString errorString() const;
+
+    //! Sets a pixel budget for each folder loaded from now on (see SheetBuilder::setPixelBudget), or 0 for none.
+    void setPixelBudget( qint64 bytes );
+
+    //! Handles one request, and returns the reply.
+    QJsonObject handleRequest( const QJsonObject &request );
+
+    //! Default socket name.
+    static QString defaultName();
+
+protected slots:
+    void newConnection();
+    void readRequests();
+
+protected:
+    //! One folder's cached state.
+    struct FolderCache
+    {
+        FolderCache();
+        //! Holds the decoded sprites and the last packing.
+        SheetBuilder builder;
+        //! Settings of the last packing (json, as saved).
+        QJsonObject packedSettings;
+        //! Whether the builder holds a packing.
+        bool packed;
+        //! Number of sprites that failed in the last packing.
+        int failed;
+    };
+
+    //! Loads (what's changed in) a folder, packs it if needed and optionally exports it.
+    QJsonObject packFolder( const QJsonObject &request, bool exportFiles );
+
+    QLocalServer *m_server;
+    //! Cached folders, by absolute path.
+    QMap<QString, FolderCache> m_folders;
+    //! Pixel budget per folder, in bytes (0 for none).
+    qint64 m_pixelBudget;
+};
+
+#endif // PACKSERVER_H
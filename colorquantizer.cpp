@@ -0,0 +1,445 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "colorquantizer.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <QThreadPool>
+#include <QtDebug>
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define BUNCHER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Histogram bins are 4 bits each of premultiplied red, green and blue, and 3 bits of alpha. The bins keep the exact
+// channel sums, so the palette colours aren't limited to this precision. The last bin counts fully transparent pixels.
+const int NumBins = 1 << 15;
+const int TransparentBin = NumBins;
+
+inline int binIndex( const int *c )
+{
+    return ( ( c[0] >> 4 ) << 11 ) | ( ( c[1] >> 4 ) << 7 ) | ( ( c[2] >> 4 ) << 3 ) | ( c[3] >> 5 );
+}
+
+// Premultiplies a pixel into c[4] (r, g, b, a).
+inline void premultiply( QRgb p, int *c )
+{
+    int a = qAlpha( p );
+    c[0] = ( qRed( p ) * a + 127 ) / 255;
+    c[1] = ( qGreen( p ) * a + 127 ) / 255;
+    c[2] = ( qBlue( p ) * a + 127 ) / 255;
+    c[3] = a;
+}
+
+const int bayer4[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+
+// A histogram entry, or palette colour, in premultiplied space.
+struct Colour {
+    double c[4];
+    double weight;
+};
+
+inline double distance( const double *a, const double *b )
+{
+    double d = 0;
+    for (int i = 0; i < 4; ++i)
+        d += ( a[i] - b[i] ) * ( a[i] - b[i] );
+    return d;
+}
+
+// Median cut box: a range of entries, and the channel it would be split on (the one with the largest weighted variance).
+struct Box {
+    int begin, end;
+    int channel;
+    double score;
+};
+
+void scoreBox( const QVector<Colour> &entries, Box &box )
+{
+    double w = 0, sum[4] = { 0, 0, 0, 0 }, sq[4] = { 0, 0, 0, 0 };
+    for (int i = box.begin; i < box.end; ++i) {
+        const Colour &e = entries[i];
+        w += e.weight;
+        for (int c = 0; c < 4; ++c) {
+            sum[c] += e.c[c] * e.weight;
+            sq[c] += e.c[c] * e.c[c] * e.weight;
+        }
+    }
+    box.channel = 0;
+    box.score = -1;
+    if ( box.end - box.begin < 2 )
+        return; // (can't be split)
+    for (int c = 0; c < 4; ++c) {
+        double var = sq[c] - sum[c] * sum[c] / w;
+        if ( var > box.score ) {
+            box.score = var;
+            box.channel = c;
+        }
+    }
+}
+
+Colour boxMean( const QVector<Colour> &entries, const Box &box )
+{
+    Colour m = { { 0, 0, 0, 0 }, 0 };
+    for (int i = box.begin; i < box.end; ++i) {
+        for (int c = 0; c < 4; ++c)
+            m.c[c] += entries[i].c[c] * entries[i].weight;
+        m.weight += entries[i].weight;
+    }
+    for (int c = 0; c < 4; ++c)
+        m.c[c] /= m.weight;
+    return m;
+}
+
+} // namespace
+
+ColorQuantizer::ColorQuantizer()
+    : m_maxColors( 256 )
+{
+    m_partial.resize( qMax( 1, QThreadPool::globalInstance()->maxThreadCount() ));
+}
+
+void ColorQuantizer::setMaxColors( int colors )
+{
+    m_maxColors = qBound( 2, colors, 256 );
+}
+
+void ColorQuantizer::addPixels( const QImage &image )
+{
+    if ( image.isNull() )
+        return;
+    QImage src = image.format() == QImage::Format_ARGB32 ? image : image.convertToFormat( QImage::Format_ARGB32 );
+    // Each thread counts a share of the rows into its own histogram, so no locking is needed.
+    int parts = qMin( m_partial.size(), src.height() );
+    QVector<Bin> *partial = m_partial.data(); // (detached here, not from the threads)
+    parallelFor( parts, [&]( int part ) {
+        QVector<Bin> &hist = partial[part];
+        if ( hist.isEmpty() ) {
+            hist.resize( NumBins + 1 );
+            memset( hist.data(), 0, sizeof( Bin ) * hist.size() );
+        }
+        Bin *bins = hist.data();
+        int y0 = src.height() * part / parts, y1 = src.height() * ( part + 1 ) / parts;
+        for (int y = y0; y < y1; ++y) {
+            const QRgb *s = reinterpret_cast<const QRgb*>( src.constScanLine( y ));
+            for (int x = 0; x < src.width(); ++x) {
+                if ( qAlpha( s[x] ) == 0 ) {
+                    bins[TransparentBin].count++;
+                    continue;
+                }
+                int c[4];
+                premultiply( s[x], c );
+                Bin &b = bins[binIndex( c )];
+                b.count++;
+                for (int i = 0; i < 4; ++i)
+                    b.sum[i] += c[i];
+            }
+        }
+    });
+}
+
+QVector<QRgb> ColorQuantizer::buildPalette()
+{
+    // Merge the threads' histograms into a list of the colours used, with their weights.
+    QVector<Colour> entries;
+    quint64 transparent = 0;
+    for (int bin = 0; bin <= NumBins; ++bin) {
+        Bin total = { 0, { 0, 0, 0, 0 } };
+        for (int p = 0; p < m_partial.size(); ++p) {
+            if ( m_partial[p].isEmpty() )
+                continue;
+            const Bin &b = m_partial[p][bin];
+            total.count += b.count;
+            for (int i = 0; i < 4; ++i)
+                total.sum[i] += b.sum[i];
+        }
+        if ( total.count == 0 )
+            continue;
+        if ( bin == TransparentBin ) {
+            transparent = total.count;
+            continue;
+        }
+        Colour e;
+        for (int i = 0; i < 4; ++i)
+            e.c[i] = double( total.sum[i] ) / total.count;
+        e.weight = double( total.count );
+        entries.append( e );
+    }
+
+    // Entry 0 is kept for fully transparent pixels.
+    int available = m_maxColors - ( transparent > 0 ? 1 : 0 );
+    QVector<Colour> pal;
+    if ( entries.size() <= available )
+        pal = entries;
+    else {
+        // Median cut - keep splitting the box with the largest variance, at the weighted median of its widest channel.
+        QVector<Box> boxes;
+        Box all = { 0, entries.size(), 0, 0 };
+        scoreBox( entries, all );
+        boxes.append( all );
+        while ( boxes.size() < available ) {
+            int pick = -1;
+            for (int i = 0; i < boxes.size(); ++i) {
+                if ( boxes[i].score > 0 && ( pick < 0 || boxes[i].score > boxes[pick].score ))
+                    pick = i;
+            }
+            if ( pick < 0 )
+                break;
+            Box box = boxes[pick];
+            int ch = box.channel;
+            std::sort( entries.begin() + box.begin, entries.begin() + box.end,
+                       [ch]( const Colour &a, const Colour &b ) { return a.c[ch] < b.c[ch]; } );
+            double half = 0, acc = 0;
+            for (int i = box.begin; i < box.end; ++i)
+                half += entries[i].weight;
+            half /= 2;
+            int split = box.begin + 1;
+            for (int i = box.begin; i < box.end - 1; ++i) {
+                acc += entries[i].weight;
+                split = i + 1;
+                if ( acc >= half )
+                    break;
+            }
+            Box lo = { box.begin, split, 0, 0 }, hi = { split, box.end, 0, 0 };
+            scoreBox( entries, lo );
+            scoreBox( entries, hi );
+            boxes[pick] = lo;
+            boxes.append( hi );
+        }
+        for (int i = 0; i < boxes.size(); ++i)
+            pal.append( boxMean( entries, boxes[i] ));
+
+        // K-means refinement - move each colour to the mean of the entries nearest to it. Entries are shared out in
+        // chunks, each summing into its own arrays.
+        int k = pal.size();
+        const int chunks = 64;
+        for (int pass = 0; pass < KMeansPasses; ++pass) {
+            QVector<double> sums( chunks * k * 5, 0.0 );
+            parallelFor( chunks, [&]( int chunk ) {
+                double *s = sums.data() + chunk * k * 5;
+                int i0 = int( qint64( entries.size() ) * chunk / chunks ), i1 = int( qint64( entries.size() ) * ( chunk + 1 ) / chunks );
+                for (int i = i0; i < i1; ++i) {
+                    int best = 0;
+                    double bestd = distance( entries[i].c, pal[0].c );
+                    for (int j = 1; j < k; ++j) {
+                        double d = distance( entries[i].c, pal[j].c );
+                        if ( d < bestd ) {
+                            bestd = d;
+                            best = j;
+                        }
+                    }
+                    for (int c = 0; c < 4; ++c)
+                        s[best * 5 + c] += entries[i].c[c] * entries[i].weight;
+                    s[best * 5 + 4] += entries[i].weight;
+                }
+            });
+            for (int j = 0; j < k; ++j) {
+                double t[5] = { 0, 0, 0, 0, 0 };
+                for (int chunk = 0; chunk < chunks; ++chunk)
+                    for (int c = 0; c < 5; ++c)
+                        t[c] += sums[( chunk * k + j ) * 5 + c];
+                if ( t[4] > 0 )
+                    for (int c = 0; c < 4; ++c)
+                        pal[j].c[c] = t[c] / t[4];
+            }
+        }
+    }
+
+    // Convert to straight alpha for the file, and keep the premultiplied values (as they'll be decoded) for mapping.
+    m_palette.clear();
+    if ( transparent > 0 )
+        m_palette.append( qRgba( 0, 0, 0, 0 ));
+    for (int i = 0; i < pal.size(); ++i) {
+        int a = qBound( 1, int( pal[i].c[3] + 0.5 ), 255 );
+        int rgb[3];
+        for (int c = 0; c < 3; ++c)
+            rgb[c] = qBound( 0, int( pal[i].c[c] * 255 / a + 0.5 ), 255 );
+        m_palette.append( qRgba( rgb[0], rgb[1], rgb[2], a ));
+    }
+    int padded = ( m_palette.size() + 3 ) & ~3;
+    m_rg = QVector<qint16>( padded * 2, 1000 ); // (padding entries are further away than any real colour)
+    m_ba = QVector<qint16>( padded * 2, 1000 );
+    for (int i = 0; i < m_palette.size(); ++i) {
+        int c[4];
+        premultiply( m_palette[i], c );
+        m_rg[i * 2] = qint16( c[0] );
+        m_rg[i * 2 + 1] = qint16( c[1] );
+        m_ba[i * 2] = qint16( c[2] );
+        m_ba[i * 2 + 1] = qint16( c[3] );
+    }
+    qDebug() << "ColorQuantizer - " << entries.size() << " histogram colours reduced to " << m_palette.size();
+    return m_palette;
+}
+
+QVector<QRgb> ColorQuantizer::palette() const
+{
+    return m_palette;
+}
+
+QImage ColorQuantizer::map( const QImage &image, const ImageConverter::DitherModes dither, int yOffset ) const
+{
+    if ( image.isNull() || m_palette.isEmpty() )
+        return QImage();
+    QImage src = image.format() == QImage::Format_ARGB32 ? image : image.convertToFormat( QImage::Format_ARGB32 );
+    QImage dst( src.size(), QImage::Format_Indexed8 );
+    if ( dst.isNull() )
+        return dst;
+    dst.setColorTable( m_palette );
+    dst.bits(); // (detach now - bands are written from several threads)
+    int band = ImageConverter::BandHeight;
+    int nbands = ( src.height() + band - 1 ) / band;
+    parallelFor( nbands, [&]( int b ) {
+        Trace::Span span( "map band", "encode" );
+        mapBand( src, dst, b * band, qMin( ( b + 1 ) * band, src.height() ), yOffset, dither );
+    });
+    return dst;
+}
+
+void ColorQuantizer::mapBand( const QImage &src, QImage &dst, int y0, int y1, int yOffset, ImageConverter::DitherModes dither ) const
+{
+    int width = src.width();
+    bool hasTransparent = qAlpha( m_palette[0] ) == 0;
+    if ( dither == ImageConverter::DITHER_DIFFUSION ) {
+        // Floyd-Steinberg, serpentine, on premultiplied values. Errors are kept in 16ths, and dont carry over from the
+        // previous band (as in ImageConverter).
+        QVector<int> errBuf( ( width + 2 ) * 4 * 2, 0 );
+        int *errCur = errBuf.data();
+        int *errNext = errCur + ( width + 2 ) * 4;
+        for (int y = y0; y < y1; ++y) {
+            const QRgb *s = reinterpret_cast<const QRgb*>( src.constScanLine( y ));
+            uchar *d = dst.scanLine( y );
+            bool ltr = ( ( y + yOffset ) & 1 ) == 0;
+            int dir = ltr ? 1 : -1;
+            for (int i = 0; i < width; ++i) {
+                int x = ltr ? i : width - 1 - i;
+                if ( hasTransparent && qAlpha( s[x] ) == 0 ) {
+                    d[x] = 0; // (fully transparent stays exact, and doesnt pass on any error)
+                    continue;
+                }
+                int c[4];
+                premultiply( s[x], c );
+                c[3] = qBound( 0, c[3] + ( errCur[( x + 1 ) * 4 + 3] + 8 ) / 16, 255 );
+                for (int ch = 0; ch < 3; ++ch)
+                    c[ch] = qBound( 0, c[ch] + ( errCur[( x + 1 ) * 4 + ch] + 8 ) / 16, c[3] );
+                int idx = nearest( c );
+                d[x] = uchar( idx );
+                const qint16 got[4] = { m_rg[idx * 2], m_rg[idx * 2 + 1], m_ba[idx * 2], m_ba[idx * 2 + 1] };
+                for (int ch = 0; ch < 4; ++ch) {
+                    int err = c[ch] - got[ch];
+                    errCur[( x + 1 + dir ) * 4 + ch] += err * 7;
+                    errNext[( x + 1 - dir ) * 4 + ch] += err * 3;
+                    errNext[( x + 1 ) * 4 + ch] += err * 5;
+                    errNext[( x + 1 + dir ) * 4 + ch] += err;
+                }
+            }
+            qSwap( errCur, errNext );
+            memset( errNext, 0, ( width + 2 ) * 4 * sizeof( int ));
+        }
+        return;
+    }
+
+    // Without dithering, sprite sheets repeat a lot of colours - a small cache saves most of the searches.
+    const int CacheSize = 4096;
+    QVector<QRgb> cacheKey( CacheSize, 0 );
+    QVector<uchar> cacheIdx( CacheSize, 0 );
+    QVector<bool> cacheUsed( CacheSize, false );
+    for (int y = y0; y < y1; ++y) {
+        const QRgb *s = reinterpret_cast<const QRgb*>( src.constScanLine( y ));
+        uchar *d = dst.scanLine( y );
+        for (int x = 0; x < width; ++x) {
+            QRgb p = s[x];
+            if ( hasTransparent && qAlpha( p ) == 0 ) {
+                d[x] = 0;
+                continue;
+            }
+            int c[4];
+            premultiply( p, c );
+            if ( dither == ImageConverter::DITHER_ORDERED ) {
+                // a small offset (scaled by alpha, so it stays premultiplied) from the same 4x4 pattern as ImageConverter
+                int t = ( bayer4[( y + yOffset ) & 3][x & 3] - 8 ) * c[3] / 255;
+                for (int ch = 0; ch < 3; ++ch)
+                    c[ch] = qBound( 0, c[ch] + t, c[3] );
+                d[x] = uchar( nearest( c ));
+                continue;
+            }
+            uint h = ( p ^ ( p >> 12 ) ^ ( p >> 24 )) & ( CacheSize - 1 );
+            if ( cacheUsed[h] && cacheKey[h] == p ) {
+                d[x] = cacheIdx[h];
+                continue;
+            }
+            uchar idx = uchar( nearest( c ));
+            cacheUsed[h] = true;
+            cacheKey[h] = p;
+            cacheIdx[h] = idx;
+            d[x] = idx;
+        }
+    }
+}
+
+int ColorQuantizer::nearest( const int *c ) const
+{
+    int n = m_rg.size() / 2;
+#ifdef BUNCHER_SSE2
+    // Four palette entries at a time. Differences are 16 bit (r,g) and (b,a) pairs, which madd squares and sums.
+    __m128i prg = _mm_set1_epi32( c[0] | ( c[1] << 16 ));
+    __m128i pba = _mm_set1_epi32( c[2] | ( c[3] << 16 ));
+    __m128i best = _mm_set1_epi32( INT_MAX );
+    __m128i bestIdx = _mm_setzero_si128();
+    __m128i idx = _mm_setr_epi32( 0, 1, 2, 3 );
+    const __m128i four = _mm_set1_epi32( 4 );
+    const qint16 *rg = m_rg.constData(), *ba = m_ba.constData();
+    for (int i = 0; i < n; i += 4) {
+        __m128i drg = _mm_sub_epi16( prg, _mm_loadu_si128( reinterpret_cast<const __m128i*>( rg + i * 2 )));
+        __m128i dba = _mm_sub_epi16( pba, _mm_loadu_si128( reinterpret_cast<const __m128i*>( ba + i * 2 )));
+        __m128i d = _mm_add_epi32( _mm_madd_epi16( drg, drg ), _mm_madd_epi16( dba, dba ));
+        __m128i less = _mm_cmplt_epi32( d, best );
+        best = _mm_or_si128( _mm_and_si128( less, d ), _mm_andnot_si128( less, best ));
+        bestIdx = _mm_or_si128( _mm_and_si128( less, idx ), _mm_andnot_si128( less, bestIdx ));
+        idx = _mm_add_epi32( idx, four );
+    }
+    int dist[4], index[4];
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( dist ), best );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( index ), bestIdx );
+    int result = index[0];
+    for (int i = 1; i < 4; ++i) {
+        if ( dist[i] < dist[0] || ( dist[i] == dist[0] && index[i] < result )) {
+            dist[0] = dist[i];
+            result = index[i];
+        }
+    }
+    return result;
+#else
+    int result = 0, bestd = INT_MAX;
+    for (int i = 0; i < n; ++i) {
+        int dr = c[0] - m_rg[i * 2], dg = c[1] - m_rg[i * 2 + 1], db = c[2] - m_ba[i * 2], da = c[3] - m_ba[i * 2 + 1];
+        int d = dr * dr + dg * dg + db * db + da * da;
+        if ( d < bestd ) {
+            bestd = d;
+            result = i;
+        }
+    }
+    return result;
+#endif
+}
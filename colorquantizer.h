@@ -0,0 +1,84 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLORQUANTIZER_H
+#define COLORQUANTIZER_H
+
+#include "imageconverter.h"
+
+#include <QImage>
+#include <QVector>
+
+//! Reduces images to a palette of up to 256 colours, for indexed (PNG-8) output.
+/*! Usage is addPixels() for every part of the image, then buildPalette(), then map() each part to palette indexes.
+ *  Because the palette is built from a histogram, a sheet can be fed through in bands - it never needs to be in memory
+ *  all at once.
+ *
+ *  Colours are compared premultiplied, so differences in barely visible pixels count for little, and all fully
+ *  transparent pixels share palette entry 0. The palette comes from a variance-based median cut of the histogram,
+ *  refined with a few rounds of k-means. Histogramming, k-means and mapping all run on the thread pool, and the
+ *  nearest-colour search is vectorised where SSE2 is available.
+ */
+class ColorQuantizer
+{
+public:
+    ColorQuantizer();
+
+    //! Sets the maximum palette size (2 to 256). Call before buildPalette().
+    void setMaxColors( int colors );
+
+    //! Adds an image's pixels to the histogram. Any QImage format is accepted, it's converted to ARGB32.
+    void addPixels( const QImage &image );
+
+    //! Builds the palette from all the pixels added so far.
+    /*! \returns the palette, as non-premultiplied colours. Entry 0 is transparent if any pixels were.
+     */
+    QVector<QRgb> buildPalette();
+
+    //! Returns the palette made by buildPalette().
+    QVector<QRgb> palette() const;
+
+    //! Maps an image to the palette.
+    /*! \param image - the pixels. Any QImage format is accepted, it's converted to ARGB32.
+     *  \param dither - dithering mode (error diffusion works on ImageConverter::BandHeight row bands, like the other formats).
+     *  \param yOffset - image row of the first row, so ordered dither patterns line up when mapping part of an image.
+     *  \returns an Indexed8 image with the palette as its colour table.
+     */
+    QImage map( const QImage &image, const ImageConverter::DitherModes dither = ImageConverter::DITHER_NONE, int yOffset = 0 ) const;
+
+    //! Number of k-means passes made after the median cut.
+    static const int KMeansPasses = 3;
+
+protected:
+    //! Histogram bin - pixel count, and the sums of their premultiplied channels (for accurate means).
+    struct Bin {
+        quint64 count;
+        quint64 sum[4];
+    };
+
+    void mapBand( const QImage &src, QImage &dst, int y0, int y1, int yOffset, ImageConverter::DitherModes dither ) const;
+    int nearest( const int *c ) const;
+
+    int m_maxColors;
+    QVector< QVector<Bin> > m_partial; // one histogram per thread, merged in buildPalette()
+    QVector<QRgb> m_palette;           // non-premultiplied, as written to file
+    QVector<qint16> m_rg;              // premultiplied palette as r,g and b,a pairs, padded to a multiple of 4 entries
+    QVector<qint16> m_ba;              // (laid out for the nearest colour search)
+};
+
+#endif // COLORQUANTIZER_H
@@ -0,0 +1,23 @@
+# Links the buncher-core library (see core.pro). Include this from any project that uses it,
+# and build core first (SpriteBuncher.pro does both).
+
+QT       += core gui concurrent
+CONFIG += c++11
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+
+BUNCHER_CORE_DIR = $$shadowed($$PWD)
+win32:CONFIG(release, debug|release): BUNCHER_CORE_DIR = $$BUNCHER_CORE_DIR/release
+else:win32:CONFIG(debug, debug|release): BUNCHER_CORE_DIR = $$BUNCHER_CORE_DIR/debug
+
+LIBS += -L$$BUNCHER_CORE_DIR -lbuncher-core
+win32-msvc*: PRE_TARGETDEPS += $$BUNCHER_CORE_DIR/buncher-core.lib
+else: PRE_TARGETDEPS += $$BUNCHER_CORE_DIR/libbuncher-core.a
+
+# zlib, for the png writer (Qt's own copy on windows).
+unix: LIBS += -lz
+win32: INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtZlib
+
+# psapi, for the peak memory use (see MemoryUsage).
+win32: LIBS += -lpsapi
@@ -0,0 +1,72 @@
+#-------------------------------------------------
+#
+# buncher-core - the packing engine, as a static library.
+# Loading, packing, rendering and export, with no widgets (see SheetBuilder
+# and PackJob). Used by the app and buncher-cli, and can be linked into other
+# tools too - include core.pri from their project files.
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+QT       -= widgets
+
+CONFIG += c++11 staticlib
+
+#CONFIG(release, debug|release):DEFINES += QT_NO_DEBUG_OUTPUT
+
+TARGET = buncher-core
+TEMPLATE = lib
+
+# zlib, for the png writer (Qt's own copy on windows).
+win32: INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtZlib
+
+INCLUDEPATH += ..
+
+SOURCES += ../maxrects/Rect.cpp \
+        ../maxrects/MaxRectsBinPack.cpp \
+        ../packer.cpp \
+        ../packsprite.cpp \
+        ../dataexporter.cpp \
+        ../sheetrenderer.cpp \
+        ../imageconverter.cpp \
+        ../pngwriter.cpp \
+        ../texturecompressor.cpp \
+        ../texturewriter.cpp \
+        ../colorquantizer.cpp \
+        ../textwriter.cpp \
+        ../exporttransaction.cpp \
+        ../exportmanifest.cpp \
+        ../bunchersettings.cpp \
+        ../sheetbuilder.cpp \
+        ../packjob.cpp \
+        ../batchbuilder.cpp \
+        ../stats.cpp \
+        ../trace.cpp \
+        ../memoryusage.cpp \
+        ../pixelcache.cpp
+
+HEADERS  += ../maxrects/Rect.h \
+        ../maxrects/MaxRectsBinPack.h \
+        ../packer.h \
+        ../packsprite.h \
+        ../sheetproperties.h \
+        ../dataexporter.h \
+        ../sheetrenderer.h \
+        ../imageconverter.h \
+        ../parallel.h \
+        ../pngwriter.h \
+        ../texturecompressor.h \
+        ../texturewriter.h \
+        ../colorquantizer.h \
+        ../textwriter.h \
+        ../exporttransaction.h \
+        ../exportmanifest.h \
+        ../bunchersettings.h \
+        ../sheetbuilder.h \
+        ../packjob.h \
+        ../batchbuilder.h \
+        ../stats.h \
+        ../trace.h \
+        ../memoryusage.h \
+        ../pixelcache.h \
+        ../reader/buncheratlas.h
@@ -18,16 +18,18 @@
 
 #include "dataexporter.h"
 
+#include "reader/buncheratlas.h"
+
 #include <QDebug>
-#include <QTextStream>
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
-#include <QJsonValue>
+#include <QMap>
 #include <QCoreApplication>
+#include <QSaveFile>
+#include <QSet>
+#include <QVector>
+#include <QtEndian>
+#include <algorithm>
 
-int DataExporter::NumDataFormats = 8; // --> Keep this up-to-date when adding formats! UI uses this to populate format combobox.
+int DataExporter::NumDataFormats = 10; // --> Keep this up-to-date when adding formats! UI uses this to populate format combobox.
 
 QString DataExporter::displayName( const DataFormats type )
 {
@@ -56,11 +58,41 @@ QString DataExporter::displayName( const DataFormats type )
     case FORMAT_COCOS2D:
         return "Cocos2d (PLIST)";
         break;
+    case FORMAT_BINARY:
+        return "Binary atlas";
+        break;
+    case FORMAT_CPP_HEADER:
+        return "C++ header (constexpr)";
+        break;
     default:
         return "Undefined"; // (shouldnt see this, check NumFormats etc.)
     }
 }
 
+QString DataExporter::fileExtension( const DataFormats type )
+{
+    switch( type ){
+    case FORMAT_GENERIC_XML:
+    case FORMAT_SPARROW:
+    case FORMAT_COCOS2D:
+        return ".xml";
+    case FORMAT_PLAINTEXT:
+    case FORMAT_GIDEROS:
+        return ".txt";
+    case FORMAT_LIBGDX:
+        return ".atlas";
+    case FORMAT_JSON:
+    case FORMAT_UNITY:
+        return ".json";
+    case FORMAT_BINARY:
+        return ".sbatlas";
+    case FORMAT_CPP_HEADER:
+        return ".h";
+    default:
+        return QString();
+    }
+}
+
 bool DataExporter::Export( const SheetProperties &sheetProp, const DataExporter::DataFormats format, const QString &path, const QString &filen,
                            const QList<PackSprite> &packedsprites )
 {
@@ -90,6 +122,12 @@ bool DataExporter::Export( const SheetProperties &sheetProp, const DataExporter:
         case FORMAT_COCOS2D:
         ok = ExportPLIST( sheetProp, path, filen, packedsprites, true ); // note cocos2d flag
         break;
+        case FORMAT_BINARY:
+        ok = ExportBinary( sheetProp, path, filen, packedsprites );
+        break;
+        case FORMAT_CPP_HEADER:
+        ok = ExportCppHeader( sheetProp, path, filen, packedsprites );
+        break;
     default:
         qDebug() << "Unsupported format in Expoter::Export";
     }
@@ -102,249 +140,519 @@ bool DataExporter::Export( const SheetProperties &sheetProp, const DataExporter:
 bool DataExporter::ExportXML( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites,
                               bool starlingStyle )
 {
-    QString str;
-    QTextStream qs(&str);
-    QString spriteTag = "sprite";
-    QString nameTag = "n";
-    QString widthTag = "w";
-    QString heightTag = "h";
+    TextWriter out;
+    if ( !OpenFile( out, path, filen, ".xml" ))
+        return false;
+    const char *spriteTag = "sprite";
+    const char *nameTag = "n";
+    const char *widthTag = "w";
+    const char *heightTag = "h";
     if ( starlingStyle ){
         spriteTag = "SubTexture";
         nameTag = "name";
         widthTag = "width";
         heightTag = "height";
     }
-    qs << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-    qs << "<!-- Exported from SpriteBuncher -->\n";
-    qs << "<TextureAtlas imagePath=" << quoted( filen + ".png" ); // note - png sheet file format assumed!
-    if ( !starlingStyle ) qs << " width=" << quoted( sheetProp.width ) << " height=" << quoted( sheetProp.height );
-    qs << ">\n";
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out << "<!-- Exported from SpriteBuncher -->\n";
+    out << "<TextureAtlas imagePath=" << quoted( sheetProp.imageName );
+    if ( !starlingStyle ) out << " width=" << quoted( sheetProp.width ) << " height=" << quoted( sheetProp.height );
+    out << ">\n";
     for (int i = 0; i < packedsprites.size(); ++i){
-        qs << "    <" << spriteTag << " " << nameTag << "=" << quoted( packedsprites[i].fileInfo().fileName() )
-           << " x=" << quoted( packedsprites[i].packedRect().x + sheetProp.border )
-           << " y=" << quoted (packedsprites[i].packedRect().y + sheetProp.border )
-           << " " << widthTag << "=" << quoted( packedsprites[i].packedRect().width - sheetProp.padding )
-           << " " << heightTag << "=" << quoted( packedsprites[i].packedRect().height - sheetProp.padding );
-        if ( !starlingStyle && packedsprites[i].isRotated() ) qs << " r=\"y\"";
-        qs << "/>\n";
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        out << "    <" << spriteTag << " " << nameTag << "=" << quoted( spr.fileName() )
+            << " x=" << quoted( rect.x + sheetProp.border )
+            << " y=" << quoted( rect.y + sheetProp.border )
+            << " " << widthTag << "=" << quoted( rect.width - sheetProp.padding )
+            << " " << heightTag << "=" << quoted( rect.height - sheetProp.padding );
+        if ( !starlingStyle && spr.isRotated() ) out << " r=\"y\"";
+        out << "/>\n";
     }
-    qs << "</TextureAtlas>\n";
-    bool ok = DataExporter::WriteFile( path, filen, ".xml", str );
-    return ok;
+    out << "</TextureAtlas>\n";
+    return out.commit();
 }
 
 bool DataExporter::ExportJSON( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites,
                                bool unityStyle )
-{   // Note - Qt's json classes are handy, but the output formatting isnt quite the same as
-    // Unity examples I've seen. Hopefully the extra newlines/whitespace are compatible, else
-    // we'll have to replace this.
-    QJsonObject jsMainObject;
-    QJsonArray jsFramesArray;
-
+{   // Written out directly rather than through Qt's json classes, so big sheets don't need a whole document tree in
+    // memory. The layout (sorted keys, 4 space indents) is the same as QJsonDocument gives.
+    TextWriter out;
+    if ( !OpenFile( out, path, filen, ".json" ))
+        return false;
+    out << "{\n    \"frames\": [\n";
     for (int i = 0; i < packedsprites.size(); ++i){
-        QJsonObject spriteObject;
-        if ( !unityStyle )
-            spriteObject.insert( "filename", packedsprites[i].fileInfo().fileName() );
-        QJsonObject frameObject;
-        frameObject.insert( "x", packedsprites[i].packedRect().x + sheetProp.border );
-        frameObject.insert( "y", packedsprites[i].packedRect().y + sheetProp.border );
-        frameObject.insert( "w", packedsprites[i].packedRect().width - sheetProp.padding );
-        frameObject.insert( "h", packedsprites[i].packedRect().height - sheetProp.padding );
-        spriteObject.insert( "frame", frameObject );
-
-        spriteObject.insert( "rotated", packedsprites[i].isRotated() );
-        spriteObject.insert( "trimmed", false ); // (not same as cropped)
-
-        QJsonObject srcObject;
-        srcObject.insert( "x", packedsprites[i].packedRect().x + sheetProp.border );
-        srcObject.insert( "y", packedsprites[i].packedRect().y + sheetProp.border );
-        srcObject.insert( "w", packedsprites[i].packedRect().width - sheetProp.padding );
-        srcObject.insert( "h", packedsprites[i].packedRect().height - sheetProp.padding );
-        spriteObject.insert( "spriteSourceSize", srcObject );
-
-        QJsonObject szObject;
-        szObject.insert( "w", packedsprites[i].packedRect().width - sheetProp.padding );
-        szObject.insert( "h", packedsprites[i].packedRect().height - sheetProp.padding );
-        spriteObject.insert( "sourceSize", szObject );
-
-        if ( unityStyle ){ // Unity format puts the sprite data inside a containing object, using the filename.
-            QJsonObject unityObject;
-            unityObject.insert( packedsprites[i].fileInfo().fileName(), spriteObject );
-            jsFramesArray.append( unityObject );
-        }
-        else{
-            jsFramesArray.append( spriteObject );
-        }
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        int x = rect.x + sheetProp.border;
+        int y = rect.y + sheetProp.border;
+        int wid = rect.width - sheetProp.padding;
+        int hgt = rect.height - sheetProp.padding;
+        // Unity format puts the sprite data inside a containing object, using the filename.
+        const char *ind = unityStyle ? "                " : "            ";
+        out << "        {\n";
+        if ( unityStyle )
+            out << "            " << TextWriter::JsonString{ spr.fileName() } << ": {\n";
+        else
+            out << ind << "\"filename\": " << TextWriter::JsonString{ spr.fileName() } << ",\n";
+        out << ind << "\"frame\": {\n"
+            << ind << "    \"h\": " << hgt << ",\n" << ind << "    \"w\": " << wid << ",\n"
+            << ind << "    \"x\": " << x << ",\n" << ind << "    \"y\": " << y << "\n" << ind << "},\n";
+        out << ind << "\"rotated\": " << ( spr.isRotated() ? "true" : "false" ) << ",\n";
+        out << ind << "\"sourceSize\": {\n"
+            << ind << "    \"h\": " << hgt << ",\n" << ind << "    \"w\": " << wid << "\n" << ind << "},\n";
+        out << ind << "\"spriteSourceSize\": {\n"
+            << ind << "    \"h\": " << hgt << ",\n" << ind << "    \"w\": " << wid << ",\n"
+            << ind << "    \"x\": " << x << ",\n" << ind << "    \"y\": " << y << "\n" << ind << "},\n";
+        out << ind << "\"trimmed\": false\n"; // (not same as cropped)
+        if ( unityStyle )
+            out << "            }\n";
+        out << ( i + 1 < packedsprites.size() ? "        },\n" : "        }\n" );
     }
-    jsMainObject.insert( "frames", jsFramesArray );
-
-    QJsonObject metaObject;
-    QString imgExtn = ".png";
-    metaObject.insert( "image", filen + imgExtn );
-    metaObject.insert( "app", QCoreApplication::applicationName() );
-    metaObject.insert( "version", QCoreApplication::applicationVersion() );
-    metaObject.insert( "scale", 1.0 );
-    metaObject.insert( "format", QString("RGBA8888") ); // [TODO - need to set this!]
-    QJsonObject mszObject;
-    mszObject.insert( "w", sheetProp.width );
-    mszObject.insert( "h", sheetProp.height );
-    metaObject.insert( "size", mszObject );
-    jsMainObject.insert( "meta", metaObject );
-
-    QJsonDocument jsDoc(jsMainObject);
-    QString str;
-    QTextStream qs(&str);
-    // qDebug() << jsDoc.toJson();
-    qs << jsDoc.toJson();
-    bool ok = DataExporter::WriteFile( path, filen, ".json", str );
-    return ok;
+    out << "    ],\n";
+    out << "    \"meta\": {\n";
+    out << "        \"app\": " << TextWriter::JsonString{ QCoreApplication::applicationName() } << ",\n";
+    out << "        \"format\": " << TextWriter::JsonString{ sheetProp.pixelFormat } << ",\n";
+    out << "        \"image\": " << TextWriter::JsonString{ sheetProp.imageName } << ",\n";
+    out << "        \"scale\": 1,\n";
+    out << "        \"size\": {\n";
+    out << "            \"h\": " << sheetProp.height << ",\n";
+    out << "            \"w\": " << sheetProp.width << "\n";
+    out << "        },\n";
+    out << "        \"version\": " << TextWriter::JsonString{ QCoreApplication::applicationVersion() } << "\n";
+    out << "    }\n";
+    out << "}\n";
+    return out.commit();
 }
 
 // See for example https://github.com/libgdx/libgdx/blob/master/tests/gdx-tests-android/assets/data/uiskin.atlas
 bool DataExporter::ExportLibGDX( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites )
 {
-    QString str;
-    QTextStream qs(&str);
-    qs << filen + ".png\n"; // Note - assumes png...
-    qs <<   "format: RGBA8888\n"; // [TODO - need to set this!]
-    qs <<  "filter: Linear,Linear\n";
-    qs <<  "repeat: none\n";
+    TextWriter out;
+    if ( !OpenFile( out, path, filen, ".atlas" ))
+        return false;
+    out << sheetProp.imageName << "\n";
+    out << "format: " << LibGDXFormat( sheetProp.pixelFormat ) << "\n";
+    out << "filter: Linear,Linear\n";
+    out << "repeat: none\n";
     for (int i = 0; i < packedsprites.size(); ++i){
-        qs << ( packedsprites[i].fileInfo().baseName() ) << "\n" // note - name without extn.
-           << "  rotate: false\n"
-           << "  xy: " << packedsprites[i].packedRect().x + sheetProp.border << ", " << packedsprites[i].packedRect().y + sheetProp.border << "\n"
-           << "  size: " << packedsprites[i].packedRect().width - sheetProp.padding << ", " << packedsprites[i].packedRect().height - sheetProp.padding << "\n"
-           << "  orig: " << packedsprites[i].packedRect().width - sheetProp.padding << ", " << packedsprites[i].packedRect().height - sheetProp.padding << "\n"
-           <<  "  offset: 0, 0\n"
-           <<  "  index: -1\n";
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        // Name without extn (as QFileInfo::baseName - but exporters can run in parallel, and QFileInfo isn't thread safe).
+        const QString &name = spr.fileName();
+        out << name.left( name.indexOf( '.' )) << "\n"
+            << "  rotate: false\n"
+            << "  xy: " << rect.x + sheetProp.border << ", " << rect.y + sheetProp.border << "\n"
+            << "  size: " << rect.width - sheetProp.padding << ", " << rect.height - sheetProp.padding << "\n"
+            << "  orig: " << rect.width - sheetProp.padding << ", " << rect.height - sheetProp.padding << "\n"
+            << "  offset: 0, 0\n"
+            << "  index: -1\n";
     }
-    bool ok = DataExporter::WriteFile( path, filen, ".atlas", str );
-    return ok;
+    return out.commit();
 }
 
 // This is a simple all-purpose text format - you could use this as a base for any new format.
 bool DataExporter::ExportPlainText( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites )
 {
-    QString str;
-    QTextStream qs(&str);
+    TextWriter out;
+    if ( !OpenFile( out, path, filen, ".txt" ))
+        return false;
     for (int i = 0; i < packedsprites.size(); ++i){
-        qs << "image=" << quoted( packedsprites[i].fileInfo().fileName() ) << "\t"
-           << " x=" << packedsprites[i].packedRect().x + sheetProp.border << "\t y=" << packedsprites[i].packedRect().y + sheetProp.border
-           << "\t width=" << packedsprites[i].packedRect().width - sheetProp.padding << "\t height=" << packedsprites[i].packedRect().height - sheetProp.padding
-           << "\t rotated=" << packedsprites[i].isRotated() << "\n";
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        out << "image=" << quoted( spr.fileName() ) << "\t"
+            << " x=" << rect.x + sheetProp.border << "\t y=" << rect.y + sheetProp.border
+            << "\t width=" << rect.width - sheetProp.padding << "\t height=" << rect.height - sheetProp.padding
+            << "\t rotated=" << ( spr.isRotated() ? "1" : "0" ) << "\n";
     }
-    bool ok = DataExporter::WriteFile( path, filen, ".txt", str );
-    return ok;
+    return out.commit();
 }
 
 // For Gideros see http://docs.giderosmobile.com/reference/gideros/TexturePack
 // Frame/trim data currently not written.
 bool DataExporter::ExportGideros( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites )
 {
-    QString str;
-    QTextStream qs(&str);
+    TextWriter out;
+    if ( !OpenFile( out, path, filen, ".txt" ))
+        return false;
     for (int i = 0; i < packedsprites.size(); ++i){
-        qs << packedsprites[i].fileInfo().fileName() << ", "
-           << packedsprites[i].packedRect().x + sheetProp.border << ", " << packedsprites[i].packedRect().y + sheetProp.border << ", "
-           << packedsprites[i].packedRect().width - sheetProp.padding << ", " << packedsprites[i].packedRect().height - sheetProp.padding << ", "
-           << "0, 0, 0, 0\n";
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        out << spr.fileName() << ", "
+            << rect.x + sheetProp.border << ", " << rect.y + sheetProp.border << ", "
+            << rect.width - sheetProp.padding << ", " << rect.height - sheetProp.padding << ", "
+            << "0, 0, 0, 0\n";
     }
-    bool ok = DataExporter::WriteFile( path, filen, ".txt", str );
-    return ok;
+    return out.commit();
 }
 
 bool DataExporter::ExportPLIST( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites,
                                 bool cocosStyle )
 {
-    QString str;
-    QTextStream qs(&str);
-    QString keytag = "<key>";
-    QString keytag2 = "</key>";
-    QString dicttag = "<dict>";
-    QString dicttag2 = "</dict>";
-    QString truetag = "<true/>";
-    QString falsetag = "<false/>";
-    QString strtag = "<string>";
-    QString strtag2 = "</string>";
-    QString tab = "    ";
-    QString tab2x = tab + tab;
-    QString tab4x = tab2x + tab2x;
+    TextWriter out;
+    if ( !OpenFile( out, path, filen, ".xml" ))
+        return false;
+    const char *keytag = "<key>";
+    const char *keytag2 = "</key>";
+    const char *dicttag = "<dict>";
+    const char *dicttag2 = "</dict>";
+    const char *truetag = "<true/>";
+    const char *falsetag = "<false/>";
+    const char *strtag = "<string>";
+    const char *strtag2 = "</string>";
+    const char *tab = "    ";
+    const char *tab2x = "        ";
+    const char *tab4x = "                ";
     if ( !cocosStyle ){
         // (non-cocos style options could go here)
     }
-    qs << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-    qs << "<!DOCTYPE plist PUBLIC \"-//Apple Computer//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n";
-    qs << "<plist version=\"1.0\">\n";
-    qs << tab << dicttag << "\n";
-    qs << tab2x << keytag << "frames" << keytag2 << "\n";
-    qs << tab2x << dicttag << "\n";
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out << "<!DOCTYPE plist PUBLIC \"-//Apple Computer//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n";
+    out << "<plist version=\"1.0\">\n";
+    out << tab << dicttag << "\n";
+    out << tab2x << keytag << "frames" << keytag2 << "\n";
+    out << tab2x << dicttag << "\n";
 
     for (int i = 0; i < packedsprites.size(); ++i){
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        int wid = rect.width - sheetProp.padding;
+        int hgt = rect.height - sheetProp.padding;
 
-        QString posx, posy, szw, szh;
-        posx.setNum( packedsprites[i].packedRect().x + sheetProp.border );
-        posy.setNum( packedsprites[i].packedRect().y + sheetProp.border );
-        szw.setNum( packedsprites[i].packedRect().width - sheetProp.padding );
-        szh.setNum( packedsprites[i].packedRect().height - sheetProp.padding );
-        QString posstr = "{" + posx + "," + posy + "}";
-        QString szstr = "{" + szw + "," + szh + "}";
-
-        qs << tab << tab2x << keytag << packedsprites[i].fileInfo().fileName() << keytag2 << "\n";          qs << tab4x << dicttag << "\n";
-        qs << tab4x << keytag << "frame" << keytag2 << "\n";
-        qs << tab4x << strtag << "{" << posstr << "," << szstr << "}" << strtag2 << "\n";
-        qs << tab4x << keytag << "offset" << keytag2 << "\n";
-        qs << tab4x << strtag << "{" << 0 << "," << 0 << "}" << strtag2 << "\n"; // Todo?
-        qs << tab4x << keytag << "rotated" << keytag2 << "\n";
-        if ( packedsprites[i].isRotated() )
-            qs << tab4x << falsetag << "\n";
+        out << tab << tab2x << keytag << spr.fileName() << keytag2 << "\n";
+        out << tab4x << dicttag << "\n";
+        out << tab4x << keytag << "frame" << keytag2 << "\n";
+        out << tab4x << strtag << "{{" << rect.x + sheetProp.border << "," << rect.y + sheetProp.border << "},{"
+            << wid << "," << hgt << "}}" << strtag2 << "\n";
+        out << tab4x << keytag << "offset" << keytag2 << "\n";
+        out << tab4x << strtag << "{" << 0 << "," << 0 << "}" << strtag2 << "\n"; // Todo?
+        out << tab4x << keytag << "rotated" << keytag2 << "\n";
+        if ( spr.isRotated() )
+            out << tab4x << falsetag << "\n";
         else
-            qs << tab4x << truetag << "\n";
+            out << tab4x << truetag << "\n";
 
-        qs << tab4x << keytag << "sourceColorRect" << keytag2 << "\n";
-        qs << tab4x << strtag << "{" << "{0,0}" << "," << szstr << "}" << strtag2 << "\n";
-        qs << tab4x << keytag << "sourceSize" << keytag2 << "\n";
-        qs << tab4x << strtag << "{" << szstr << "}" << strtag2 << "\n";
-        qs << tab << tab2x << dicttag2 << "\n";
+        out << tab4x << keytag << "sourceColorRect" << keytag2 << "\n";
+        out << tab4x << strtag << "{{0,0},{" << wid << "," << hgt << "}}" << strtag2 << "\n";
+        out << tab4x << keytag << "sourceSize" << keytag2 << "\n";
+        out << tab4x << strtag << "{{" << wid << "," << hgt << "}}" << strtag2 << "\n";
+        out << tab << tab2x << dicttag2 << "\n";
     }
-    qs << tab2x << dicttag2 << "\n";
-    qs << tab2x << keytag << "metadata" << keytag2 << "\n";
-    qs << tab2x << dicttag << "\n";
-    qs << tab << tab2x << keytag << "textureFileName" << keytag2 << "\n";
-    qs << tab << tab2x << strtag << filen + ".png" << strtag2 << "\n"; // NB png assumed.
-    qs << tab2x << dicttag2 << "\n";
-    qs << tab << dicttag2 << "\n";
-    qs << "</plist>\n";
-    bool ok = DataExporter::WriteFile( path, filen, ".xml", str );
-    return ok;
+    out << tab2x << dicttag2 << "\n";
+    out << tab2x << keytag << "metadata" << keytag2 << "\n";
+    out << tab2x << dicttag << "\n";
+    out << tab << tab2x << keytag << "textureFileName" << keytag2 << "\n";
+    out << tab << tab2x << strtag << sheetProp.imageName << strtag2 << "\n";
+    out << tab << tab2x << keytag << "pixelFormat" << keytag2 << "\n";
+    out << tab << tab2x << strtag << sheetProp.pixelFormat << strtag2 << "\n";
+    out << tab2x << dicttag2 << "\n";
+    out << tab << dicttag2 << "\n";
+    out << "</plist>\n";
+    return out.commit();
 }
 
-bool DataExporter::WriteFile( const QString &path, const QString &filen, const QString &extn, const QString &text )
+bool DataExporter::ExportBinary( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites )
 {
-    bool ok = false;
-    QFile outf( path + "/" + filen + extn );
-    if ( !outf.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Text)) { // (truncate ensures we wipe over prev content)
-        qDebug() << "WriteFile: Could not open output file for writing.";
+    // String table, and the name hashes. Only the first sprite with any name goes in the index.
+    int count = packedsprites.size();
+    QByteArray strings;
+    QVector<quint64> hashes( count );
+    QVector<int> indexed;
+    QSet<QByteArray> names;
+    QByteArray frames( count * int( sizeof( buncher::AtlasFrame )), 0 );
+    buncher::AtlasFrame *frame = reinterpret_cast<buncher::AtlasFrame*>( frames.data() );
+    for (int i = 0; i < count; ++i, ++frame){
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        QByteArray name = spr.fileName().toUtf8();
+        hashes[i] = buncher::AtlasHash( name.constData(), size_t( name.size() ));
+        if ( !names.contains( name )) {
+            names.insert( name );
+            indexed.append( i );
+        }
+        frame->name = qToLittleEndian<quint32>( quint32( strings.size() ));
+        frame->nameLength = qToLittleEndian<quint32>( quint32( name.size() ));
+        frame->x = qToLittleEndian<qint32>( rect.x + sheetProp.border );
+        frame->y = qToLittleEndian<qint32>( rect.y + sheetProp.border );
+        frame->width = qToLittleEndian<qint32>( rect.width - sheetProp.padding );
+        frame->height = qToLittleEndian<qint32>( rect.height - sheetProp.padding );
+        frame->flags = qToLittleEndian<quint32>( spr.isRotated() ? buncher::AtlasRotated : 0 );
+        strings.append( name ).append( '\0' );
     }
-    else{ ok = true;
-        QTextStream ts(&outf);
-        ts << text;
-        outf.close();
+    quint32 imageName = quint32( strings.size() );
+    strings.append( sheetProp.imageName.toUtf8() ).append( '\0' );
+    quint32 pixelFormat = quint32( strings.size() );
+    strings.append( sheetProp.pixelFormat.toUtf8() ).append( '\0' );
+
+    QVector<quint32> seeds, slots;
+    if ( !BuildHashIndex( hashes, indexed, seeds, slots )) {
+        qDebug() << "ExportBinary: Could not build the name index.";
+        return false;
     }
-    return ok;
+
+    // Sections in file order, each padded to 16 bytes.
+    QByteArray seedBytes( seeds.size() * 4, 0 ), slotBytes( slots.size() * 4, 0 );
+    for (int i = 0; i < seeds.size(); ++i)
+        qToLittleEndian<quint32>( seeds[i], reinterpret_cast<uchar*>( seedBytes.data() ) + i * 4 );
+    for (int i = 0; i < slots.size(); ++i)
+        qToLittleEndian<quint32>( slots[i], reinterpret_cast<uchar*>( slotBytes.data() ) + i * 4 );
+    QList<QByteArray*> sections;
+    sections << &frames << &seedBytes << &slotBytes << &strings;
+    QVector<qint64> offsets;
+    qint64 size = sizeof( buncher::AtlasHeader );
+    foreach ( QByteArray *section, sections ) {
+        offsets.append( size );
+        section->append( QByteArray( int( ( 16 - section->size() % 16 ) % 16 ), 0 ));
+        size += section->size();
+    }
+    if ( size > 0xffffffffLL ) {
+        qDebug() << "ExportBinary: Too much data for the binary format.";
+        return false;
+    }
+
+    buncher::AtlasHeader header;
+    memset( &header, 0, sizeof( header ));
+    memcpy( header.magic, "SBAT", 4 );
+    header.version = qToLittleEndian<quint32>( buncher::AtlasVersion );
+    header.headerSize = qToLittleEndian<quint32>( sizeof( buncher::AtlasHeader ));
+    header.fileSize = qToLittleEndian<quint32>( quint32( size ));
+    header.sheetWidth = qToLittleEndian<quint32>( quint32( sheetProp.width ));
+    header.sheetHeight = qToLittleEndian<quint32>( quint32( sheetProp.height ));
+    header.frameCount = qToLittleEndian<quint32>( quint32( count ));
+    header.frameSize = qToLittleEndian<quint32>( sizeof( buncher::AtlasFrame ));
+    header.framesOffset = qToLittleEndian<quint32>( quint32( offsets[0] ));
+    header.bucketCount = qToLittleEndian<quint32>( quint32( seeds.size() ));
+    header.seedsOffset = qToLittleEndian<quint32>( quint32( offsets[1] ));
+    header.slotCount = qToLittleEndian<quint32>( quint32( slots.size() ));
+    header.slotsOffset = qToLittleEndian<quint32>( quint32( offsets[2] ));
+    header.stringsOffset = qToLittleEndian<quint32>( quint32( offsets[3] ));
+    header.stringsSize = qToLittleEndian<quint32>( quint32( strings.size() ));
+    header.imageName = qToLittleEndian<quint32>( imageName );
+    header.pixelFormat = qToLittleEndian<quint32>( pixelFormat );
+
+    QSaveFile outf( path + "/" + filen + ".sbatlas" );
+    if ( !outf.open( QIODevice::WriteOnly )) {
+        qDebug() << "ExportBinary: Could not open output file for writing.";
+        return false;
+    }
+    outf.write( reinterpret_cast<const char*>( &header ), sizeof( header ));
+    foreach ( QByteArray *section, sections )
+        outf.write( *section );
+    if ( !outf.commit() ) {
+        qDebug() << "ExportBinary: Could not write output file - " << outf.errorString();
+        return false;
+    }
+    return true;
+}
+
+// Needs C++17 (inline variables, constexpr std::string_view). Lookups by a constant name fold away at compile time.
+bool DataExporter::ExportCppHeader( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites )
+{
+    TextWriter out;
+    if ( !OpenFile( out, path, filen, ".h" ))
+        return false;
+    int count = packedsprites.size();
+    double sheetw = qMax( 1, sheetProp.width );
+    double sheeth = qMax( 1, sheetProp.height );
+
+    // Enum names, made unique, and the UTF-8 names.
+    QVector<QString> ids( count );
+    QVector<QByteArray> names( count );
+    QSet<QString> usedIds;
+    usedIds.insert( "Count" );
+    for (int i = 0; i < count; ++i){
+        names[i] = packedsprites[i].fileName().toUtf8();
+        QString id = CppIdentifier( packedsprites[i].fileName() );
+        QString unique = id;
+        for (int n = 2; usedIds.contains( unique ); ++n)
+            unique = id + "_" + QString::number( n );
+        usedIds.insert( unique );
+        ids[i] = unique;
+    }
+    // The lookup table is sorted by name bytes (as std::string_view compares them), first of any duplicates only.
+    QVector<int> sorted( count );
+    for (int i = 0; i < count; ++i)
+        sorted[i] = i;
+    auto lessName = [&]( int a, int b ) {
+        int len = qMin( names[a].size(), names[b].size() );
+        int c = memcmp( names[a].constData(), names[b].constData(), size_t( len ));
+        return c != 0 ? c < 0 : names[a].size() < names[b].size();
+    };
+    std::stable_sort( sorted.begin(), sorted.end(), lessName );
+    sorted.erase( std::unique( sorted.begin(), sorted.end(), [&]( int a, int b ) { return names[a] == names[b]; }), sorted.end() );
+
+    out << "// Exported from SpriteBuncher - sprite data for " << sheetProp.imageName << ". Needs C++17.\n";
+    out << "#pragma once\n\n";
+    out << "#include <array>\n#include <cstddef>\n#include <cstdint>\n#include <string_view>\n\n";
+    out << "namespace " << CppIdentifier( filen ) << " {\n\n";
+    out << "struct Frame {\n";
+    out << "    std::int32_t x, y, width, height; // position and size on the sheet, in pixels\n";
+    out << "    bool rotated;\n";
+    out << "    float u0, v0, u1, v1;             // the same rect in texture coordinates\n";
+    out << "};\n\n";
+    out << "inline constexpr std::string_view imageName = \"" << CppStringLiteral( sheetProp.imageName.toUtf8() ).constData() << "\";\n";
+    out << "inline constexpr std::string_view pixelFormat = \"" << CppStringLiteral( sheetProp.pixelFormat.toUtf8() ).constData() << "\";\n";
+    out << "inline constexpr int sheetWidth = " << sheetProp.width << ";\n";
+    out << "inline constexpr int sheetHeight = " << sheetProp.height << ";\n\n";
+
+    out << "enum class SpriteId : std::uint32_t {\n";
+    for (int i = 0; i < count; ++i)
+        out << "    " << ids[i] << " = " << i << ",\n";
+    out << "    Count\n};\n\n";
+
+    auto floatLiteral = []( double val ) {
+        QString str = QString::number( val, 'g', 9 );
+        if ( !str.contains( '.' ) && !str.contains( 'e' ))
+            str += ".0"; // (so "0" and "1" get a valid 'f' suffix)
+        return str + "f";
+    };
+    out << "inline constexpr std::array<Frame, " << count << "> frames = {{\n";
+    for (int i = 0; i < count; ++i){
+        const PackSprite &spr = packedsprites[i];
+        rbp::Rect rect = spr.packedRect();
+        int x = rect.x + sheetProp.border;
+        int y = rect.y + sheetProp.border;
+        int wid = rect.width - sheetProp.padding;
+        int hgt = rect.height - sheetProp.padding;
+        out << "    { " << x << ", " << y << ", " << wid << ", " << hgt << ", " << ( spr.isRotated() ? "true" : "false" ) << ", "
+            << floatLiteral( x / sheetw ) << ", " << floatLiteral( y / sheeth ) << ", "
+            << floatLiteral( ( x + wid ) / sheetw ) << ", " << floatLiteral( ( y + hgt ) / sheeth ) << " }, // "
+            << ids[i] << "\n";
+    }
+    out << "}};\n\n";
+
+    out << "inline constexpr std::array<std::string_view, " << count << "> names = {{\n";
+    for (int i = 0; i < count; ++i)
+        out << "    \"" << CppStringLiteral( names[i] ).constData() << "\",\n";
+    out << "}};\n\n";
+
+    out << "struct NameEntry {\n    std::string_view name;\n    SpriteId id;\n};\n\n";
+    out << "// Sorted by name, for find().\n";
+    out << "inline constexpr std::array<NameEntry, " << sorted.size() << "> sortedNames = {{\n";
+    for (int i = 0; i < sorted.size(); ++i)
+        out << "    { \"" << CppStringLiteral( names[sorted[i]] ).constData() << "\", SpriteId::" << ids[sorted[i]] << " },\n";
+    out << "}};\n\n";
+
+    out << "//! Returns the id of the sprite with this file name, or SpriteId::Count if there's none.\n";
+    out << "constexpr SpriteId find( std::string_view name )\n{\n";
+    out << "    std::size_t lo = 0, hi = sortedNames.size();\n";
+    out << "    while ( lo < hi ) {\n";
+    out << "        std::size_t mid = lo + ( hi - lo ) / 2;\n";
+    out << "        if ( sortedNames[mid].name < name )\n";
+    out << "            lo = mid + 1;\n";
+    out << "        else\n";
+    out << "            hi = mid;\n";
+    out << "    }\n";
+    out << "    return lo < sortedNames.size() && sortedNames[lo].name == name ? sortedNames[lo].id : SpriteId::Count;\n";
+    out << "}\n\n";
+    out << "//! Returns a sprite's frame.\n";
+    out << "constexpr const Frame &frame( SpriteId id )\n{\n";
+    out << "    return frames[static_cast<std::size_t>( id )];\n";
+    out << "}\n\n";
+    out << "} // namespace " << CppIdentifier( filen ) << "\n";
+    return out.commit();
 }
 
-QString DataExporter::quoted( const QString &str, const QString &quote )
+QString DataExporter::LibGDXFormat( const QString &pixelFormat )
 {
-    QString ret = str;
-    ret.prepend( quote ).append( quote );
-    return ret;
+    if ( pixelFormat == "RGB888" || pixelFormat == "RGB565" || pixelFormat == "RGBA4444" )
+        return pixelFormat;
+    if ( pixelFormat == "RGB555" )
+        return "RGB565";
+    return "RGBA8888"; // (incl. RGBA5658, which has a full alpha channel)
+}
+
+QString DataExporter::CppIdentifier( const QString &str )
+{
+    QString id = str;
+    for (int i = 0; i < id.size(); ++i){
+        ushort c = id[i].unicode();
+        if ( !( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '_' ))
+            id[i] = '_';
+    }
+    if ( id.isEmpty() || id[0].isDigit() )
+        id.prepend( "s_" );
+    return id;
 }
 
-QString DataExporter::quoted( const int val, const QString &quote )
+QByteArray DataExporter::CppStringLiteral( const QByteArray &str )
 {
-    QString str;
-    str.setNum( val );
-    return quoted( str, quote );
+    QByteArray lit;
+    lit.reserve( str.size() );
+    for (int i = 0; i < str.size(); ++i){
+        uchar c = uchar( str[i] );
+        if ( c == '"' || c == '\\' )
+            lit.append( '\\' ).append( char( c ));
+        else if ( c >= 0x20 && c < 0x7f )
+            lit.append( char( c ));
+        else { // (octal escapes end after 3 digits, so a following digit can't be swallowed as with hex)
+            lit.append( '\\' );
+            lit.append( char( '0' + ( c >> 6 )));
+            lit.append( char( '0' + (( c >> 3 ) & 7 )));
+            lit.append( char( '0' + ( c & 7 )));
+        }
+    }
+    return lit;
+}
+
+bool DataExporter::BuildHashIndex( const QVector<quint64> &hashes, const QVector<int> &indexed, QVector<quint32> &seeds,
+                                   QVector<quint32> &slots )
+{
+    // CHD: about 4 names per bucket. Buckets are placed biggest first, while there are plenty of free slots, each
+    // trying seeds until all its names land in free slots. Single name buckets (which go last) always find a slot.
+    int count = indexed.size();
+    int nbuckets = qMax( 1, ( count + 3 ) / 4 );
+    seeds.fill( 0, count ? nbuckets : 0 );
+    slots.fill( 0, count );
+    if ( count == 0 )
+        return true;
+    QVector< QVector<int> > buckets( nbuckets );
+    foreach ( int i, indexed )
+        buckets[buncher::AtlasBucket( hashes[i], quint32( nbuckets ))].append( i );
+    QVector<int> order( nbuckets );
+    for (int b = 0; b < nbuckets; ++b)
+        order[b] = b;
+    std::stable_sort( order.begin(), order.end(), [&]( int a, int b ) { return buckets[a].size() > buckets[b].size(); });
+
+    QVector<bool> used( count, false );
+    QVector<quint32> trial;
+    for (int ib = 0; ib < nbuckets; ++ib){
+        const QVector<int> &bucket = buckets[order[ib]];
+        if ( bucket.isEmpty() )
+            break; // (the rest are empty too)
+        bool placed = false;
+        // (a bucket only fails every seed if two of its names have the same hash, so give up well before wrapping)
+        for (quint32 seed = 0; seed < 0x1000000 && !placed; ++seed){
+            trial.clear();
+            placed = true;
+            for (int k = 0; k < bucket.size() && placed; ++k){
+                quint32 slot = buncher::AtlasSlot( hashes[bucket[k]], seed, quint32( count ));
+                if ( used[int( slot )] || trial.contains( slot ))
+                    placed = false;
+                else
+                    trial.append( slot );
+            }
+            if ( placed ){
+                seeds[order[ib]] = seed;
+                for (int k = 0; k < bucket.size(); ++k){
+                    used[int( trial[k] )] = true;
+                    slots[int( trial[k] )] = quint32( bucket[k] );
+                }
+            }
+        }
+        if ( !placed )
+            return false;
+    }
+    return true;
+}
+
+bool DataExporter::OpenFile( TextWriter &out, const QString &path, const QString &filen, const QString &extn )
+{
+    if ( !out.open( path + "/" + filen + extn )) {
+        qDebug() << "OpenFile: Could not open output file for writing.";
+        return false;
+    }
+    return true;
 }
 
 const QList<PackSprite> DataExporter::sortByFileName( const  QList<PackSprite> input )
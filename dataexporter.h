@@ -2,11 +2,11 @@
 #define EXPORTER_H
 
 #include <QList>
-#include <QPixmap>
 #include <QFileInfo>
 
 #include "packsprite.h"
-#include "mainwindow.h"
+#include "textwriter.h"
+#include "sheetproperties.h"
 #include "./maxrects/MaxRectsBinPack.h"
 
 //! Performs data file export. Add new formats as required. Mostly static functions.
@@ -19,7 +19,8 @@ public:
      * \see NumDataFormats - the number of formats defined.
      */
     enum DataFormats { FORMAT_GENERIC_XML = 0, FORMAT_PLAINTEXT, FORMAT_LIBGDX, FORMAT_SPARROW, FORMAT_JSON, FORMAT_UNITY, FORMAT_GIDEROS,
-                       FORMAT_COCOS2D, FORMAT_CORONA, FORMAT_SPRITEKIT };
+                       FORMAT_COCOS2D, FORMAT_BINARY, FORMAT_CPP_HEADER,
+                       FORMAT_CORONA, FORMAT_SPRITEKIT };
     //! Number of supported data formats. Must match the total number of formats defined in DataFormats.
     /*!
      * \see DataFormats - enum where the formats are defined.
@@ -40,6 +41,9 @@ public:
     //! Returns readable form of the format type (as shown to user in UI menus etc).
     static QString displayName( const DataFormats type );
 
+    //! Returns the file extension (including the dot) of the format's data file.
+    static QString fileExtension( const DataFormats type );
+
 protected:
 
     //! Exports 'generic' XML file, and any variations, e.g. Sparrow/Starling.
@@ -103,20 +107,57 @@ protected:
     static bool ExportPLIST( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites,
                              bool cocosStyle = true );
 
-    //! Writes text to the output file. The the other format-specific functions use this.
-    /*! \param path - folder path to write to.
+    //! Exports a binary atlas file, for loading without parsing. See reader/buncheratlas.h for the layout and a reader.
+    /*! \param sheetProp - sheet properties struct.
+     *  \param path - folder path to write to.
      *  \param filen - filename (without extension).
-     *  \param extn - file extension.
-     *  \param text - the text to be written.
+     *  \param packedsprites - the list of packed sprites.
+     *  \returns true - if the operation was successful.
+     */
+    static bool ExportBinary( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites );
+
+    //! Exports a C++17 header, with the frames as constexpr data, an enum of sprite ids and a constexpr name lookup.
+    /*! \param sheetProp - sheet properties struct.
+     *  \param path - folder path to write to.
+     *  \param filen - filename (without extension). Also used as the namespace name.
+     *  \param packedsprites - the list of packed sprites.
      *  \returns true - if the operation was successful.
      */
-    static bool WriteFile( const QString &path, const QString &filen, const QString &extn, const QString &text );
+    static bool ExportCppHeader( const SheetProperties &sheetProp, const QString &path, const QString &filen, const QList<PackSprite> &packedsprites );
 
-    //! Convenience function, returns a string with added quotes.
-    static QString quoted( const QString &str, const QString &quote = "\"" );
+    //! Returns the libGDX Pixmap.Format name nearest to a sheet's pixel format (libGDX rejects any other name, so
+    //! compressed and indexed sheets are given as RGBA8888).
+    static QString LibGDXFormat( const QString &pixelFormat );
+
+    //! Returns a valid C++ identifier made from any string (anything but letters, digits and '_' becomes '_').
+    static QString CppIdentifier( const QString &str );
+
+    //! Returns a UTF-8 string as the inside of a C++ string literal, with anything but printable ASCII escaped.
+    static QByteArray CppStringLiteral( const QByteArray &str );
+
+    //! Builds the minimal perfect hash index for the binary format.
+    /*! \param hashes - name hashes of all the frames (see buncher::AtlasHash).
+     *  \param indexed - indexes of the frames to put in the index (ones with unique names).
+     *  \param seeds - set to the seed for each bucket.
+     *  \param slots - set to the frame index for each slot.
+     *  \returns true - if the operation was successful (it only fails if two names have the same 64 bit hash).
+     */
+    static bool BuildHashIndex( const QVector<quint64> &hashes, const QVector<int> &indexed, QVector<quint32> &seeds,
+                                QVector<quint32> &slots );
+
+    //! Opens the output file for a TextWriter. The other format-specific functions use this, then stream their text.
+    /*! The file is only replaced when the writer's commit() succeeds.
+     *  \param out - the writer to open.
+     *  \param path - folder path to write to.
+     *  \param filen - filename (without extension).
+     *  \param extn - file extension.
+     *  \returns true - if the operation was successful.
+     */
+    static bool OpenFile( TextWriter &out, const QString &path, const QString &filen, const QString &extn );
 
-    //! Overload. Convenience function, returns a string with added quotes around an integer.
-    static QString quoted( const int val, const QString &quote = "\"" );
+    //! Convenience function, wraps a string or integer so the writer puts quotes around it.
+    template <typename T>
+    static TextWriter::Quoted<T> quoted( const T &val ) { return TextWriter::Quoted<T>{ val }; }
 
     //! Sorts a packsprite list by filename [currently not used?].
     static const QList<PackSprite> sortByFileName( const  QList<PackSprite> input );
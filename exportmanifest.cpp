@@ -0,0 +1,128 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "exportmanifest.h"
+#include "parallel.h"
+
+#include <QtDebug>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QVector>
+
+ExportManifest::ExportManifest()
+{
+    m_appVersion = QCoreApplication::applicationVersion();
+}
+
+void ExportManifest::setSettings( const QJsonObject &settings )
+{
+    m_settings = settings;
+}
+
+bool ExportManifest::setInputs( const QString &inputDir, const QFileInfoList &files )
+{
+    QDir dir( inputDir );
+    QVector<QString> hashes( files.size() );
+    parallelFor( files.size(), [&]( int i ) {
+        QFile file( files[i].filePath() );
+        QCryptographicHash hash( QCryptographicHash::Sha256 );
+        if ( file.open( QIODevice::ReadOnly ) && hash.addData( &file ))
+            hashes[i] = QString::fromLatin1( hash.result().toHex() );
+    });
+    m_inputs.clear();
+    bool ok = true;
+    for (int i = 0; i < files.size(); ++i) {
+        if ( hashes[i].isEmpty() ) {
+            qWarning() << "ExportManifest - could not read " << files[i].filePath();
+            ok = false;
+        }
+        m_inputs.insert( dir.relativeFilePath( files[i].filePath() ), hashes[i] );
+    }
+    return ok;
+}
+
+void ExportManifest::setOutputs( const QStringList &files )
+{
+    m_outputs = files;
+}
+
+bool ExportManifest::matches( const ExportManifest &other ) const
+{
+    return m_appVersion == other.m_appVersion && m_settings == other.m_settings && m_inputs == other.m_inputs &&
+           !m_inputs.values().contains( QString() ); // (an unreadable file never matches)
+}
+
+bool ExportManifest::outputsExist( const QString &dir ) const
+{
+    if ( m_outputs.isEmpty() )
+        return false;
+    foreach ( const QString &file, m_outputs ) {
+        if ( !QFile::exists( dir + "/" + file ))
+            return false;
+    }
+    return true;
+}
+
+bool ExportManifest::load( const QString &fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ))
+        return false;
+    QJsonObject obj = QJsonDocument::fromJson( file.readAll() ).object();
+    if ( obj.isEmpty() )
+        return false;
+    m_appVersion = obj.value( "version" ).toString();
+    m_settings = obj.value( "settings" ).toObject();
+    m_inputs.clear();
+    QJsonObject inputs = obj.value( "inputs" ).toObject();
+    for (QJsonObject::const_iterator it = inputs.constBegin(); it != inputs.constEnd(); ++it)
+        m_inputs.insert( it.key(), it.value().toString() );
+    m_outputs.clear();
+    foreach ( const QJsonValue &val, obj.value( "outputs" ).toArray() )
+        m_outputs.append( val.toString() );
+    return true;
+}
+
+bool ExportManifest::save( const QString &fileName ) const
+{
+    QJsonObject inputs;
+    for (QMap<QString, QString>::const_iterator it = m_inputs.constBegin(); it != m_inputs.constEnd(); ++it)
+        inputs.insert( it.key(), it.value() );
+    QJsonObject obj;
+    obj.insert( "version", m_appVersion );
+    obj.insert( "settings", m_settings );
+    obj.insert( "inputs", inputs );
+    obj.insert( "outputs", QJsonArray::fromStringList( m_outputs ));
+    QSaveFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly )) {
+        qWarning() << "ExportManifest - could not write " << fileName;
+        return false;
+    }
+    file.write( QJsonDocument( obj ).toJson() );
+    return file.commit();
+}
+
+QString ExportManifest::fileName()
+{
+    return "buncher.manifest";
+}
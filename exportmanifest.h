@@ -0,0 +1,72 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPORTMANIFEST_H
+#define EXPORTMANIFEST_H
+
+#include <QFileInfoList>
+#include <QJsonObject>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+
+//! Records what an export was made from, so an unchanged folder can skip exporting.
+/*! The manifest holds a content hash of every input file, all the export settings, the app version, and the names of
+ *  the files written. It's saved next to the exported files. Before exporting, a manifest is built for the current
+ *  inputs and settings - if it matches the saved one and the outputs are all still there, nothing needs doing. Only
+ *  the input files are read (and hashed in parallel), none are decoded.
+ */
+class ExportManifest
+{
+public:
+    ExportManifest();
+
+    //! Sets the export settings (as saved in the json settings file).
+    void setSettings( const QJsonObject &settings );
+
+    //! Hashes the input files. Paths are stored relative to inputDir.
+    /*! \returns true - if every file could be read.
+     */
+    bool setInputs( const QString &inputDir, const QFileInfoList &files );
+
+    //! Sets the names of the exported files (in the output folder).
+    void setOutputs( const QStringList &files );
+
+    //! Returns true if the inputs, settings and app version are all the same as another manifest's.
+    bool matches( const ExportManifest &other ) const;
+
+    //! Returns true if all the output files exist in dir.
+    bool outputsExist( const QString &dir ) const;
+
+    //! Loads a saved manifest. Returns false if there's none, or it can't be read.
+    bool load( const QString &fileName );
+
+    //! Saves the manifest.
+    bool save( const QString &fileName ) const;
+
+    //! File name of the manifest in the output folder.
+    static QString fileName();
+
+protected:
+    QJsonObject m_settings;
+    QMap<QString, QString> m_inputs; // relative path -> hex hash
+    QStringList m_outputs;
+    QString m_appVersion;
+};
+
+#endif // EXPORTMANIFEST_H
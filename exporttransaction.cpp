@@ -0,0 +1,102 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "exporttransaction.h"
+
+#include <QtDebug>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+ExportTransaction::ExportTransaction( const QString &targetDir ) :
+    m_targetDir( targetDir ),
+    m_staging( targetDir + "/.export-XXXXXX" )
+{
+    if ( !m_staging.isValid() ) {
+        m_error = "Could not create a staging folder in " + targetDir;
+        qWarning() << "ExportTransaction - " << m_error;
+    }
+}
+
+bool ExportTransaction::isValid() const
+{
+    return m_staging.isValid();
+}
+
+QString ExportTransaction::stagingPath() const
+{
+    return m_staging.path();
+}
+
+bool ExportTransaction::commit()
+{
+    if ( !isValid() )
+        return false;
+    QDir staging( m_staging.path() );
+    QStringList files = staging.entryList( QDir::Files | QDir::Hidden );
+    QString backupDir = m_staging.path() + "/.previous";
+    if ( !staging.mkpath( backupDir )) {
+        m_error = "Could not create a backup folder.";
+        return false;
+    }
+
+    // Renames within one drive, so each file is replaced whole. Move the old files aside first...
+    QStringList backedUp, movedIn;
+    bool ok = true;
+    foreach ( const QString &file, files ) {
+        QString target = m_targetDir + "/" + file;
+        if ( !QFile::exists( target ))
+            continue;
+        if ( !QFile::rename( target, backupDir + "/" + file )) {
+            m_error = "Could not replace " + target;
+            ok = false;
+            break;
+        }
+        backedUp.append( file );
+    }
+    // ...then move the new ones in.
+    if ( ok ) {
+        foreach ( const QString &file, files ) {
+            if ( !QFile::rename( m_staging.path() + "/" + file, m_targetDir + "/" + file )) {
+                m_error = "Could not write " + m_targetDir + "/" + file;
+                ok = false;
+                break;
+            }
+            movedIn.append( file );
+        }
+    }
+    if ( !ok ) {
+        // Roll back - take out what was moved in, and restore the old files.
+        qWarning() << "ExportTransaction - " << m_error << ", rolling back";
+        foreach ( const QString &file, movedIn )
+            QFile::remove( m_targetDir + "/" + file );
+        foreach ( const QString &file, backedUp ) {
+            if ( !QFile::rename( backupDir + "/" + file, m_targetDir + "/" + file )) {
+                qWarning() << "ExportTransaction - could not restore " << file << ", it's kept in " << backupDir;
+                m_staging.setAutoRemove( false ); // (don't delete the only copy)
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+QString ExportTransaction::errorString() const
+{
+    return m_error;
+}
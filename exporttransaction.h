@@ -0,0 +1,57 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPORTTRANSACTION_H
+#define EXPORTTRANSACTION_H
+
+#include <QString>
+#include <QTemporaryDir>
+
+//! Makes an export replace all its files together, or none of them.
+/*! Files are written into a staging folder (a hidden temporary folder inside the target folder, so it's on the same
+ *  drive), then commit() moves them all into place. Existing files are moved aside first, and put back if any move
+ *  fails. If commit() isn't called - the export failed or was cancelled - the staging folder is just deleted, and the
+ *  target folder is as it was.
+ */
+class ExportTransaction
+{
+public:
+    //! Creates the staging folder inside targetDir.
+    explicit ExportTransaction( const QString &targetDir );
+
+    //! Returns true if the staging folder could be created.
+    bool isValid() const;
+
+    //! Folder to write the files to.
+    QString stagingPath() const;
+
+    //! Moves every file in the staging folder into the target folder, replacing any with the same names.
+    /*! \returns true - if the operation was successful. On failure the target folder is left as it was.
+     */
+    bool commit();
+
+    //! Returns a description of the last error.
+    QString errorString() const;
+
+protected:
+    QString m_targetDir;
+    QTemporaryDir m_staging; // (removed with its contents when we're done)
+    QString m_error;
+};
+
+#endif // EXPORTTRANSACTION_H
@@ -0,0 +1,272 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imageconverter.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <QDebug>
+#include <QVector>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define BUNCHER_SSE2
+#include <emmintrin.h>
+#endif
+
+int ImageConverter::NumDitherModes = 3; // --> Keep this up-to-date when adding modes! UI uses this to populate dither combobox.
+
+namespace {
+
+// Bit layout of a reduced output format. Channels are in memory order of a 32 bit pixel: blue, green, red, alpha.
+struct PixelLayout {
+    int maxval[4];      // largest value of each channel (0 if the format doesnt have it)
+    int shift[4];       // bit position of each channel in the 16 bit pixel
+    bool premultiplied; // colour channels must not exceed alpha
+    bool alphaByte;     // alpha is stored as a separate leading byte (ARGB8565)
+    int bytesPerPixel;
+};
+
+bool layoutForFormat( QImage::Format format, PixelLayout &l )
+{
+    switch ( format ) {
+    case QImage::Format_RGB16: { // 'RGB565'
+        PixelLayout rgb565 = { { 31, 63, 31, 0 }, { 0, 5, 11, 0 }, false, false, 2 };
+        l = rgb565;
+        return true;
+    }
+    case QImage::Format_RGB555: {
+        PixelLayout rgb555 = { { 31, 31, 31, 0 }, { 0, 5, 10, 0 }, false, false, 2 };
+        l = rgb555;
+        return true;
+    }
+    case QImage::Format_ARGB4444_Premultiplied: {
+        PixelLayout argb4444 = { { 15, 15, 15, 15 }, { 0, 4, 8, 12 }, true, false, 2 };
+        l = argb4444;
+        return true;
+    }
+    case QImage::Format_ARGB8565_Premultiplied: {
+        PixelLayout argb8565 = { { 31, 63, 31, 0 }, { 0, 5, 11, 0 }, true, true, 3 };
+        l = argb8565;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// 4x4 ordered dither matrix.
+const int bayer4[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+
+// Threshold added before quantising - 127 rounds to nearest, the ordered dither spreads it over 8..248.
+inline int threshold( ImageConverter::DitherModes dither, int x, int y )
+{
+    return dither == ImageConverter::DITHER_ORDERED ? bayer4[y & 3][x & 3] * 16 + 8 : 127;
+}
+
+// Scales an 8 bit value to 0..maxval, i.e. (c * maxval + t) / 255 (exact for the ranges used here).
+inline int quantize( int c, int maxval, int t )
+{
+    int x = c * maxval + t;
+    return ( x + 1 + ( x >> 8 )) >> 8;
+}
+
+// Writes one quantised pixel (channels in b,g,r,a order) to dst.
+inline void storePixel( uchar *dst, const int *q, int alpha8, const PixelLayout &l )
+{
+    quint16 v = quint16( ( q[0] << l.shift[0] ) | ( q[1] << l.shift[1] ) | ( q[2] << l.shift[2] ) | ( q[3] << l.shift[3] ));
+    if ( l.alphaByte ) {
+        dst[0] = uchar( alpha8 );
+        memcpy( dst + 1, &v, 2 ); // (Qt keeps the 565 part in native byte order)
+    }
+    else
+        memcpy( dst, &v, 2 );
+}
+
+// Colour channels of premultiplied formats are capped at the pixel's alpha.
+inline void clampToAlpha( int *q, int alpha8, const PixelLayout &l )
+{
+    if ( !l.premultiplied )
+        return;
+    for (int c = 0; c < 3; ++c) {
+        int cap = l.alphaByte ? ( alpha8 * l.maxval[c] ) / 255 : q[3];
+        if ( q[c] > cap )
+            q[c] = cap;
+    }
+}
+
+void convertRowScalar( const quint32 *src, uchar *dst, int x0, int x1, int y, const PixelLayout &l, ImageConverter::DitherModes dither )
+{
+    for (int x = x0; x < x1; ++x) {
+        quint32 p = src[x];
+        int t = threshold( dither, x, y );
+        int q[4];
+        for (int c = 0; c < 4; ++c)
+            q[c] = quantize( ( p >> ( 8 * c )) & 0xff, l.maxval[c], t );
+        int alpha8 = p >> 24;
+        clampToAlpha( q, alpha8, l );
+        storePixel( dst + x * l.bytesPerPixel, q, alpha8, l );
+    }
+}
+
+#ifdef BUNCHER_SSE2
+// Four pixels at a time, for the two byte formats. Channels are widened to 16 bits, quantised with the same
+// formula as the scalar code, then combined into pixels with a multiply-add.
+void convertRowSSE2( const quint32 *src, uchar *dst, int width, int y, const PixelLayout &l, ImageConverter::DitherModes dither, int &done )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16( 1 );
+    const __m128i maxv = _mm_setr_epi16( l.maxval[0], l.maxval[1], l.maxval[2], l.maxval[3],
+                                         l.maxval[0], l.maxval[1], l.maxval[2], l.maxval[3] );
+    const __m128i pack = _mm_setr_epi16( 1 << l.shift[0], 1 << l.shift[1], 1 << l.shift[2], l.maxval[3] ? 1 << l.shift[3] : 0,
+                                         1 << l.shift[0], 1 << l.shift[1], 1 << l.shift[2], l.maxval[3] ? 1 << l.shift[3] : 0 );
+    const __m128i bias32 = _mm_set1_epi32( 0x8000 );
+    const __m128i bias16 = _mm_set1_epi16( short( 0x8000 ));
+    // thresholds for pixels x%4 == 0,1 (low) and 2,3 (high) - the same for every group of four on this row.
+    int t[4];
+    for (int i = 0; i < 4; ++i)
+        t[i] = threshold( dither, i, y );
+    const __m128i tlo = _mm_setr_epi16( t[0], t[0], t[0], t[0], t[1], t[1], t[1], t[1] );
+    const __m128i thi = _mm_setr_epi16( t[2], t[2], t[2], t[2], t[3], t[3], t[3], t[3] );
+
+    int x = 0;
+    for ( ; x + 4 <= width; x += 4) {
+        __m128i px = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + x ));
+        __m128i q[2];
+        q[0] = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( px, zero ), maxv ), tlo );
+        q[1] = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( px, zero ), maxv ), thi );
+        __m128i out[2];
+        for (int h = 0; h < 2; ++h) {
+            // (x + 1 + (x >> 8)) >> 8, the divide by 255:
+            q[h] = _mm_srli_epi16( _mm_add_epi16( _mm_add_epi16( q[h], one ), _mm_srli_epi16( q[h], 8 )), 8 );
+            if ( l.premultiplied ) { // cap colour at alpha, which is lane 3 of each pixel
+                __m128i alpha = _mm_shufflehi_epi16( _mm_shufflelo_epi16( q[h], _MM_SHUFFLE( 3, 3, 3, 3 )), _MM_SHUFFLE( 3, 3, 3, 3 ));
+                q[h] = _mm_min_epi16( q[h], alpha );
+            }
+            // b*1 + g*(1<<gshift) and r*(1<<rshift) + a*(1<<ashift), then add the two halves of each pixel:
+            __m128i sums = _mm_madd_epi16( q[h], pack );
+            sums = _mm_add_epi32( sums, _mm_srli_epi64( sums, 32 ));
+            out[h] = _mm_shuffle_epi32( sums, _MM_SHUFFLE( 3, 3, 2, 0 ));
+        }
+        __m128i pixels = _mm_unpacklo_epi64( out[0], out[1] );
+        // pack to unsigned 16 bit (SSE2 only has a signed saturating pack, so shift the range first):
+        pixels = _mm_add_epi16( _mm_packs_epi32( _mm_sub_epi32( pixels, bias32 ), zero ), bias16 );
+        _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + 2 * x ), pixels );
+    }
+    done = x;
+}
+#endif
+
+void convertBand( const QImage &src, QImage &dst, int y0, int y1, int yOffset, const PixelLayout &l, ImageConverter::DitherModes dither )
+{
+    int width = src.width();
+    if ( dither == ImageConverter::DITHER_DIFFUSION ) {
+        // Floyd-Steinberg, serpentine. Errors are kept in 16ths, and dont carry over from the previous band.
+        QVector<int> errBuf( ( width + 2 ) * 4 * 2, 0 );
+        int *errCur = errBuf.data();
+        int *errNext = errCur + ( width + 2 ) * 4;
+        for (int y = y0; y < y1; ++y) {
+            const quint32 *s = reinterpret_cast<const quint32*>( src.constScanLine( y ));
+            uchar *d = dst.scanLine( y );
+            bool ltr = ( ( y + yOffset ) & 1 ) == 0;
+            int dir = ltr ? 1 : -1;
+            for (int i = 0; i < width; ++i) {
+                int x = ltr ? i : width - 1 - i;
+                quint32 p = s[x];
+                int q[4];
+                for (int c = 0; c < 4; ++c) {
+                    int v = int( ( p >> ( 8 * c )) & 0xff );
+                    if ( l.maxval[c] == 0 ) {
+                        q[c] = 0;
+                        continue;
+                    }
+                    v = qBound( 0, v + ( errCur[( x + 1 ) * 4 + c] + 8 ) / 16, 255 );
+                    q[c] = quantize( v, l.maxval[c], 127 );
+                    int err = v - ( q[c] * 255 + l.maxval[c] / 2 ) / l.maxval[c];
+                    errCur[( x + 1 + dir ) * 4 + c] += err * 7;
+                    errNext[( x + 1 - dir ) * 4 + c] += err * 3;
+                    errNext[( x + 1 ) * 4 + c] += err * 5;
+                    errNext[( x + 1 + dir ) * 4 + c] += err;
+                }
+                int alpha8 = p >> 24;
+                clampToAlpha( q, alpha8, l );
+                storePixel( d + x * l.bytesPerPixel, q, alpha8, l );
+            }
+            qSwap( errCur, errNext );
+            memset( errNext, 0, ( width + 2 ) * 4 * sizeof( int ));
+        }
+        return;
+    }
+
+    for (int y = y0; y < y1; ++y) {
+        const quint32 *s = reinterpret_cast<const quint32*>( src.constScanLine( y ));
+        uchar *d = dst.scanLine( y );
+        int done = 0;
+#ifdef BUNCHER_SSE2
+        if ( l.bytesPerPixel == 2 )
+            convertRowSSE2( s, d, width, y + yOffset, l, dither, done );
+#endif
+        convertRowScalar( s, d, done, width, y + yOffset, l, dither );
+    }
+}
+
+} // namespace
+
+QImage ImageConverter::Convert( const QImage &src, QImage::Format format, const DitherModes dither, int yOffset )
+{
+    if ( src.format() == format )
+        return src;
+    PixelLayout layout;
+    if ( !layoutForFormat( format, layout ))
+        return src.convertToFormat( format ); // (Qt's 8 bit per channel conversions are already fast, and need no dithering)
+
+    QImage pm = src.format() == QImage::Format_ARGB32_Premultiplied ? src : src.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+    QImage dst( pm.size(), format );
+    if ( dst.isNull() )
+        return dst;
+    dst.bits(); // (detach now - bands are written from several threads)
+    int nbands = ( pm.height() + BandHeight - 1 ) / BandHeight;
+    parallelFor( nbands, [&]( int band ) {
+        Trace::Span span( "convert band", "render" );
+        convertBand( pm, dst, band * BandHeight, qMin( ( band + 1 ) * BandHeight, pm.height() ), yOffset, layout, dither );
+    });
+    return dst;
+}
+
+bool ImageConverter::IsReducedFormat( QImage::Format format )
+{
+    PixelLayout layout;
+    return layoutForFormat( format, layout );
+}
+
+QString ImageConverter::displayName( const DitherModes mode )
+{
+    switch( mode ){
+    case DITHER_NONE:
+        return "None";
+        break;
+    case DITHER_ORDERED:
+        return "Ordered (4x4)";
+        break;
+    case DITHER_DIFFUSION:
+        return "Error diffusion";
+        break;
+    default:
+        return "Undefined"; // (shouldnt see this, check NumDitherModes etc.)
+    }
+}
@@ -0,0 +1,61 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGECONVERTER_H
+#define IMAGECONVERTER_H
+
+#include <QImage>
+#include <QString>
+
+//! Converts composited sheets to the output image formats.
+/*! Sheets are always composited in ARGB32 premultiplied (fast, and full quality), then converted here. The reduced
+ *  colour formats (RGB565, RGB555, RGBA4444 etc) use our own converters, which are vectorised where SSE2 is available,
+ *  can dither, and work on horizontal bands in parallel. Other formats use Qt's own conversions.
+ */
+class ImageConverter
+{
+public:
+
+    //! Dithering modes. Indexes must match ui ditherComboBox. Index is saved in json settings file.
+    /*!
+     * \see NumDitherModes - the number of modes defined.
+     */
+    enum DitherModes { DITHER_NONE = 0, DITHER_ORDERED, DITHER_DIFFUSION };
+    //! Number of dithering modes. Must match the total number of modes defined in DitherModes.
+    static int NumDitherModes;
+
+    //! Number of image rows converted as one parallel job.
+    static const int BandHeight = 32;
+
+    //! Converts a composited sheet to the output format.
+    /*! \param src - the composited sheet (or part of it), normally ARGB32 premultiplied.
+     *  \param format - the required output format.
+     *  \param dither - dithering mode, used for formats with less than 8 bits per channel.
+     *  \param yOffset - sheet row of the first image row, so ordered dither patterns line up when converting part of a sheet.
+     *  \returns the converted image.
+     */
+    static QImage Convert( const QImage &src, QImage::Format format, const DitherModes dither = DITHER_NONE, int yOffset = 0 );
+
+    //! Returns true if we have our own (reduced colour) converter for this format, i.e. dithering applies to it.
+    static bool IsReducedFormat( QImage::Format format );
+
+    //! Returns readable form of the dither mode (as shown to user in UI menus etc).
+    static QString displayName( const DitherModes mode );
+};
+
+#endif // IMAGECONVERTER_H
@@ -17,7 +17,9 @@
 */
 
 #include "mainwindow.h"
+#include "trace.h"
 #include <QApplication>
+#include <QDebug>
 
 int main(int argc, char *argv[])
 {
@@ -30,8 +32,19 @@ int main(int argc, char *argv[])
     // Update this when doing a new release:
     QCoreApplication::setApplicationVersion( "1.0b" );
 
+    // BUNCHER_TRACE=<file> records a trace of the session (see Trace), saved on quitting.
+    QString traceFile = QString::fromLocal8Bit( qgetenv( "BUNCHER_TRACE" ));
+    if ( !traceFile.isEmpty() )
+        Trace::start();
+
     MainWindow w;
     w.show();
     
-    return a.exec();
+    int result = a.exec();
+    if ( !traceFile.isEmpty() ) {
+        Trace::stop();
+        if ( !Trace::save( traceFile ))
+            qWarning() << "Could not write the trace:" << traceFile;
+    }
+    return result;
 }
@@ -20,16 +20,17 @@
 #include "ui_mainwindow.h"
 #include "ui_aboutbox.h"
 
-#include "./maxrects/MaxRectsBinPack.h"
-#include "packer.h"
 #include "dataexporter.h"
-#include "pixmapitem.h"
+#include "sheetpreviewitem.h"
+#include "sheetrenderer.h"
+#include "imageconverter.h"
+#include "pngwriter.h"
+#include "texturecompressor.h"
+#include "texturewriter.h"
 #include "customstylesheet.h"
 
 #include <QtDebug>
 #include <QFileDialog>
-#include <QJsonDocument>
-#include <QJsonObject>
 #include <QSettings>
 #include <QListWidget>
 #include <QMessageBox>
@@ -37,12 +38,13 @@
 #include <QMimeData>
 #include <QDropEvent>
 #include <QDir>
-#include <QDirIterator>
 #include <QGraphicsView>
-#include <QGraphicsPixmapItem>
+#include <QPixmapCache>
 #include <QSpinBox>
-#include <QMap>
 #include <QDesktopServices>
+#include <QProgressDialog>
+#include <QMenu>
+#include <QtConcurrent/QtConcurrentRun>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -58,28 +60,38 @@ MainWindow::MainWindow(QWidget *parent) :
     setWindowIcon( QIcon( ":/res1/images/icon-full.png" )); // (see also res.qrc and buncher.icns, set in .pro file).
     setWindowTitle( tr( "SpriteBuncher" ));
 
-    sheetProp.padding = 2.0;
-    sheetProp.border = 2.0;
-    sheetProp.height = 512;
-    sheetProp.width = 512;
-
     readAppSettings();
-    outFilen =  ui->basenameLineEdit->text();
-    inDirn = QString();
-    outDirn = inDirn + "/buncher"; // (name hardcoded for now).
-    jsonFilen = "/buncher.data"; // (name hardcoded for now).
 
     // note - graphicsview is set to 'interactive' in ui form, so we can select items.
     QGraphicsScene* scene = new QGraphicsScene(this);
     ui->graphicsView->setScene(scene);
     ui->graphicsView->setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
 
+    // The canvas items live for the whole session, updateViewWidgets just updates them.
+    canvasBG = scene->addRect( 0, 0, builder.sheetProperties().width, builder.sheetProperties().height, Qt::NoPen );
+    canvasBG->setFlag( QGraphicsItem::ItemIsSelectable, false );
+    canvasBG->setZValue( 0 );
+    canvasSheet = new SheetPreviewItem();
+    canvasSheet->setZValue( 1 );
+    scene->addItem( canvasSheet );
+    QPixmapCache::setCacheLimit( 64 * 1024 ); // (in KB - enough for a screenful of preview tiles, even at high res).
+
     // populate the data format combo box. Formats are defined in DataExporter.
      ui->formatComboBox->blockSignals( true ); // (dont want slot calls yet)
     for( int i = 0; i < DataExporter::NumDataFormats; i++ )
         ui->formatComboBox->addItem( DataExporter::displayName( DataExporter::DataFormats(i) ));
     ui->formatComboBox->blockSignals( false );
 
+    // ...and the menu of extra formats to export with it.
+    extraFormatsMenu = new QMenu( this );
+    for( int i = 0; i < DataExporter::NumDataFormats; i++ ) {
+        QAction *action = extraFormatsMenu->addAction( DataExporter::displayName( DataExporter::DataFormats(i) ));
+        action->setCheckable( true );
+        action->setData( i );
+    }
+    ui->extraFormatsButton->setMenu( extraFormatsMenu );
+    QObject::connect( extraFormatsMenu, SIGNAL(triggered(QAction*)), this, SLOT( extraFormatsChanged() ));
+
     // populate the image format combo box - must be in same order as ImageFormats enum [not quite as flexible as data formats].
     ui->imgFormatComboBox->blockSignals( true ); // (dont want slot calls yet)
     ui->imgFormatComboBox->addItem( "RGBA8888 (Best)" ); // aka 'ARGB32'
@@ -89,12 +101,61 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->imgFormatComboBox->addItem( "RGB565 (no alpha)" ); // aka 'RGB16'
     ui->imgFormatComboBox->addItem( "RGB565 Premultiplied alpha" );
     ui->imgFormatComboBox->addItem( "RGB555 (no alpha)" );
+    ui->imgFormatComboBox->addItem( "BC1 / DXT1 (KTX)" );
+    ui->imgFormatComboBox->addItem( "BC3 / DXT5 (KTX)" );
+    ui->imgFormatComboBox->addItem( "BC7 (KTX)" );
+    ui->imgFormatComboBox->addItem( "ETC2 RGBA (KTX)" );
+    ui->imgFormatComboBox->addItem( "Indexed 256 colours (PNG-8)" );
     ui->imgFormatComboBox->blockSignals( false );
 
+    // populate the png compression combo box. Levels are defined in PngWriter.
+    ui->pngComboBox->blockSignals( true ); // (dont want slot calls yet)
+    for( int i = 0; i < PngWriter::NumCompressionLevels; i++ )
+        ui->pngComboBox->addItem( PngWriter::displayName( PngWriter::CompressionLevels(i) ));
+    ui->pngComboBox->setCurrentIndex( PngWriter::COMPRESSION_DEFAULT );
+    ui->pngComboBox->blockSignals( false );
+
+    // populate the texture compression quality combo box. Presets are defined in TextureCompressor.
+    ui->texQualityComboBox->blockSignals( true ); // (dont want slot calls yet)
+    for( int i = 0; i < TextureCompressor::NumQualityLevels; i++ )
+        ui->texQualityComboBox->addItem( TextureCompressor::displayName( TextureCompressor::QualityLevels(i) ));
+    ui->texQualityComboBox->setCurrentIndex( TextureCompressor::QUALITY_NORMAL );
+    ui->texQualityComboBox->blockSignals( false );
+
+    // populate the texture container combo box. Containers are defined in TextureWriter.
+    ui->containerComboBox->blockSignals( true ); // (dont want slot calls yet)
+    for( int i = 0; i < TextureWriter::NumContainers; i++ )
+        ui->containerComboBox->addItem( TextureWriter::displayName( TextureWriter::Containers(i) ));
+    ui->containerComboBox->blockSignals( false );
+
+    // populate the variants combo box - must be in same order as Variants enum.
+    ui->variantsComboBox->blockSignals( true ); // (dont want slot calls yet)
+    ui->variantsComboBox->addItem( "None" );
+    ui->variantsComboBox->addItem( "@2x, @1x" );
+    ui->variantsComboBox->addItem( "@4x, @2x, @1x" );
+    ui->variantsComboBox->blockSignals( false );
+
+    // populate the dither combo box. Modes are defined in ImageConverter.
+    ui->ditherComboBox->blockSignals( true ); // (dont want slot calls yet)
+    for( int i = 0; i < ImageConverter::NumDitherModes; i++ )
+        ui->ditherComboBox->addItem( ImageConverter::displayName( ImageConverter::DitherModes(i) ));
+    ui->ditherComboBox->blockSignals( false );
+
     // Other signal/slot connections (most are already done via ui file).
-    QObject::connect( ui->graphicsView->scene(), SIGNAL(selectionChanged()), this, SLOT( sceneSelectionChanged() ));
+    QObject::connect( canvasSheet, SIGNAL(spriteClicked(int)), this, SLOT( previewSpriteClicked(int) ));
     ui->publishButton->setEnabled( false );
 
+    // Packing runs in the background (see startPacking).
+    packPending = false;
+    packReload = false;
+    packZoomToFit = false;
+    packFails = 0;
+    iconBytes = 0;
+    packTimer.setSingleShot( true );
+    packTimer.setInterval( PackDelay );
+    QObject::connect( &packTimer, SIGNAL(timeout()), this, SLOT( launchPacking() ));
+    QObject::connect( &packWatcher, SIGNAL(finished()), this, SLOT( packingFinished() ));
+
     // Start with the sample folder [Todo - remember recent folders etc].
     QDir dir( qApp->applicationDirPath() );
     #if defined(Q_OS_MAC)
@@ -109,6 +170,8 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    packCancel.store( 1 );
+    packWatcher.waitForFinished();
     delete ui;
 }
 
@@ -118,21 +181,13 @@ void MainWindow::on_listWidget_clicked(const QModelIndex &index)
     QListWidgetItem *item = ui->listWidget->item(index.row() );
     qDebug() << item->text();
 
-    ui->graphicsView->scene()->clearSelection();
-    QList<QGraphicsItem *> items = ui->graphicsView->scene()->items();
-    for (int i = 0; i < items.size(); ++i) {
-        static const int ObjectName = 0;
-        QString name = items.at(i)->data(ObjectName).toString();
-        if ( name == item->text() ){
-            qDebug() << "Found item on scene";
-            QPainterPath selectionArea;
-            QGraphicsPixmapItem *item = (QGraphicsPixmapItem*)items.at(i);
-            if ( item ) {
-                selectionArea.addRect( item->pos().x()+1, item->pos().y()+1, item->pixmap().width()-2, item->pixmap().height()-2 ); // (want to avoid catching neigbouring sprites).
-                // [dev note - theres a cyclic signal/slot effect here between graphicsview and listwidget. blockSignals doesnt fix it!].
-                ui->graphicsView->scene()->setSelectionArea( selectionArea );
-                ui->graphicsView->ensureVisible( item->pos().x(), item->pos().y(), item->pixmap().width()-1, item->pixmap().height()-1 ); // nice effect if zoomed
-            }
+    const QList<PackSprite> &packedsprites = builder.sprites();
+    for (int i = 0; i < packedsprites.size(); ++i) {
+        if ( packedsprites[i].packedRect().height > 0 && packedsprites[i].fileInfo().fileName() == item->text() ){
+            qDebug() << "Found item on sheet";
+            canvasSheet->setSelectedSprite( i );
+            ui->graphicsView->ensureVisible( canvasSheet->spriteRect( i )); // nice effect if zoomed
+            break;
         }
     }
 }
@@ -167,7 +222,7 @@ void MainWindow::on_action_Reload_triggered()
     zoomReset(); // (zoom seems to mess-up without this?).
     // Force reload of current folder, without loading its settings (they'll overwrite changes
     // user has made since export).
-    openFolder( inDirn, false, false );
+    openFolder( builder.inputFolder(), false, false );
 }
 
 void MainWindow::on_actionOpen_folder_triggered()
@@ -203,31 +258,27 @@ void MainWindow::on_actionUse_Dark_UI_Theme_triggered()
     else
         setStyleSheet( qApp->styleSheet() ); // reset to default stylesheet
     this->update();
-    updateViewWidgets();
+    updateViewWidgets( packFails );
 }
 
-void MainWindow::sceneSelectionChanged()
+void MainWindow::previewSpriteClicked( int index )
 {
-    qDebug() << "sceneSelectionChanged slot";
+    qDebug() << "previewSpriteClicked slot " << index;
     ui->listWidget->clearSelection();
-    QList<QGraphicsItem *> items = ui->graphicsView->scene()->selectedItems();
-
-    for (int i = 0; i < items.size(); ++i) {
-        static const int ObjectName = 0;
-        QString name = items.at(i)->data(ObjectName).toString();
-        qDebug() << " name: " << name;
-        // find the item in the list widget
-        QList<QListWidgetItem *> found = ui->listWidget->findItems( name, Qt::MatchExactly );
-        if ( found.count() > 0 ) {
-            ui->listWidget->setCurrentItem( found.first(), QItemSelectionModel::ClearAndSelect );
-        }
+    const QList<PackSprite> &packedsprites = builder.sprites();
+    if ( index < 0 || index >= packedsprites.size() )
+        return;
+    // find the item in the list widget
+    QList<QListWidgetItem *> found = ui->listWidget->findItems( packedsprites[index].fileInfo().fileName(), Qt::MatchExactly );
+    if ( found.count() > 0 ) {
+        ui->listWidget->setCurrentItem( found.first(), QItemSelectionModel::ClearAndSelect );
     }
 }
 
 void MainWindow::openFileDialog()
 {
     qDebug() << "Open fileDialog...";
-    QString dirStr = QFileDialog::getExistingDirectory(this, tr("Open Directory"), inDirn,
+    QString dirStr = QFileDialog::getExistingDirectory(this, tr("Open Directory"), builder.inputFolder(),
                                                        QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
     QDir dir( dirStr );
     if ( !dirStr.isEmpty() && dir.isReadable() ){
@@ -240,20 +291,20 @@ void MainWindow::packingOptionChanged( int index )
     Q_UNUSED( index ) // [Dev note - dont use the index, slot is connected to various signals].
     qDebug() << "packingOptionChanged(int)";
     // rotation supported for MaxRects only:
-    ui->rotationCheckBox->setHidden( ui->methodComboBox->currentIndex() >= ROWS_BY_NAME );
-    reloadAndRepackAll();
+    ui->rotationCheckBox->setHidden( ui->methodComboBox->currentIndex() >= BuncherSettings::ROWS_BY_NAME );
+    // Only the file list and its order need a reload - the other options are applied to the loaded sprites by pack().
+    const BuncherSettings &current = builder.settings();
+    if ( ui->methodComboBox->currentIndex() != current.method || ui->subfoldersCheckBox->isChecked() != current.subfolders )
+        reloadAndRepackAll();
+    else
+        repackAll();
 }
 
 void MainWindow::sheetOptionChanged( int index )
 {
     Q_UNUSED( index ) // [Dev note - dont use the index, slot is connected to various signals].
     qDebug() << "sheetOptionChanged(int)";
-    // update all our sheet properties:
-    sheetProp.width = ui->widthSpinBox->value();
-    sheetProp.height = ui->heightSpinBox->value();
-    sheetProp.border = ui->borderSpinBox->value();
-    sheetProp.padding = ui->paddingSpinBox->value();
-    repackAll();
+    repackAll(); // (pack() picks up the new sheet properties)
 }
 
  void MainWindow::sheetOptionChanged( double value )
@@ -264,34 +315,56 @@ void MainWindow::sheetOptionChanged( int index )
 void MainWindow::exportFiles()
 {
     qDebug() << "exportFiles";
-    outFilen = ui->basenameLineEdit->text();
-    QDir dir( outDirn );
-    bool ok = dir.mkpath( outDirn );
-    if ( !ok || !dir.exists() ) {
-        qWarning( "Could not create/write to output folder.");
-        QMessageBox::warning(this, tr("SpriteBuncher"), QString( "Can not create/write to output folder." ), QMessageBox::Ok );
+    if ( packPending || packWatcher.isRunning() ) {
+        ui->statusBar->showMessage( "Still packing - please export again when it's finished.", 3000 );
         return;
     }
+    builder.setSettings( uiSettings() );
+    builder.clearStats();
     QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-    saveJsonSettings();
-
-    // Write the canvas image to file.
-    QImage sheetImg = renderSheet(); // [could've cached this from updateViewWidgets, but we do another final render anyway].
-    if ( !sheetImg.isNull() )
-        sheetImg.save( dir.path() + "/" + outFilen + ".png" ); // (note, png format. Todo - needs option/var.)
-    else
-        QMessageBox::warning(this, tr("SpriteBuncher"), QString( "Could not create sheeet image." ), QMessageBox::Ok );
+    // The progress dialog keeps the UI alive while the sheet image is written (it's reused for each variant).
+    QProgressDialog progress( builder.settings().textureFormat() >= 0 ? "Compressing sheet texture..." : "Writing sheet image...",
+                              "Cancel", 0, 1, this );
+    progress.setWindowModality( Qt::WindowModal );
+    progress.setMinimumDuration( 500 );
+    QString error;
+    SheetBuilder::ExportResults result = builder.exportFiles( error, [&]( int done, int total ) {
+        progress.setMaximum( total );
+        progress.setValue( done );
+        return !progress.wasCanceled();
+    });
+    progress.reset();
+    QApplication::restoreOverrideCursor();
 
-    // Now export the text file == DataExporter class does the work.
-    bool okx = DataExporter::Export( sheetProp, DataExporter::DataFormats(ui->formatComboBox->currentIndex()), dir.path(),
-                                     outFilen, packedsprites );
+    QStringList formatNames;
+    foreach ( int format, builder.settings().dataFormats() )
+        formatNames.append( DataExporter::displayName( DataExporter::DataFormats( format )));
+    switch ( result ) {
+    case SheetBuilder::EXPORT_DONE:
+        ui->statusBar->showMessage( "Export timings: " + builder.stats().summary() + "  -  Memory: " + memoryUsage().summary() );
+        QMessageBox::information(this, tr("SpriteBuncher"), QString( formatNames.join( ", " ) + " files exported successfully!" ),
+                                 QMessageBox::Ok );
+        break;
+    case SheetBuilder::EXPORT_UP_TO_DATE:
+        QMessageBox::information(this, tr("SpriteBuncher"), QString( "Nothing has changed since the last export, the files are up to date." ),
+                                 QMessageBox::Ok );
+        break;
+    case SheetBuilder::EXPORT_CANCELLED:
+        break;
+    default:
+        QMessageBox::warning(this, tr("SpriteBuncher"), error, QMessageBox::Ok );
+        break;
+    }
+}
 
-    QString formatName = DataExporter::displayName( DataExporter::DataFormats(ui->formatComboBox->currentIndex()) );
-    QApplication::restoreOverrideCursor();
-    if ( okx )
-        QMessageBox::information(this, tr("SpriteBuncher"), QString( formatName + " files exported successfully!" ), QMessageBox::Ok );
-    else
-        QMessageBox::warning(this, tr("SpriteBuncher"), QString( "Could not write file/data for format: " + formatName ), QMessageBox::Ok );
+void MainWindow::extraFormatsChanged()
+{
+    QStringList names;
+    foreach ( QAction *action, extraFormatsMenu->actions() ) {
+        if ( action->isChecked() )
+            names.append( action->text() );
+    }
+    ui->extraFormatsButton->setText( names.isEmpty() ? QString( "None" ) : names.join( ", " ));
 }
 
 void MainWindow::zoomIn()
@@ -373,190 +446,134 @@ void MainWindow::reloadAndRepackAll()
 {
     qDebug() << "reloadAndRepackAll";
     processFolder();
-    repackAll();
 }
 
 void MainWindow::repackAll()
 {
     qDebug() << "repackAll";
-    int nfails = pack();
-    updateViewWidgets( nfails );
+    startPacking( false );
 }
 
 bool MainWindow::loadJsonSettings()
-{   // [ Dev notes - we use blockSignals here to prevent getting a signal from each
-    // widget, which would trigger a reload for each].
+{
     qDebug() << "loadJsonSettings";
-    bool ok = false;
-    QDir odir( outDirn );
-    QFile outjsf;
-    outjsf.setFileName( odir.path() + jsonFilen );
-    if ( outjsf.exists() ){
-        qDebug() << "Previous json file exists, reading it.";
-        ok = true;
-        outjsf.open(QIODevice::ReadOnly | QIODevice::Text);
-        QByteArray val = outjsf.readAll();
-        outjsf.close();
-        qDebug() << "Read json: " << val;
-        QJsonDocument jd = QJsonDocument::fromJson(val);
-        QJsonObject obj = jd.object();
-
-        if ( obj.contains( "sheetw" )){
-            QJsonValue jsval = obj.value( "sheetw");
-            if ( jsval.toDouble() > 0 ){
-                sheetProp.width = jsval.toDouble();
-                ui->widthSpinBox->blockSignals( true );
-                ui->widthSpinBox->setValue( sheetProp.width );
-                ui->widthSpinBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "sheeth" )){
-            QJsonValue jsval = obj.value( "sheeth");
-            if ( jsval.toDouble() > 0 ){
-                sheetProp.height = jsval.toDouble();
-                ui->heightSpinBox->blockSignals( true );
-                ui->heightSpinBox->setValue( sheetProp.height );
-                ui->heightSpinBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "padding" )){
-            QJsonValue jsval = obj.value( "padding");
-            if ( jsval.toDouble() >= 0 ){
-                int val = jsval.toDouble();
-                sheetProp.padding = val;
-                ui->paddingSpinBox->blockSignals( true );
-                ui->paddingSpinBox->setValue( val );
-                ui->paddingSpinBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "border" )){
-            QJsonValue jsval = obj.value( "border");
-            if ( jsval.toDouble() >= 0 ){
-                int val = jsval.toDouble();
-                sheetProp.border = val;
-                ui->borderSpinBox->blockSignals( true );
-                ui->borderSpinBox->setValue( val );
-                ui->borderSpinBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "expand" )){
-            QJsonValue jsval = obj.value( "expand");
-            if ( jsval.toDouble() >= 0 ){
-                int val = jsval.toDouble();
-                //sheetProp.expand = val;
-                ui->expandSpinBox->blockSignals( true );
-                ui->expandSpinBox->setValue( val );
-                ui->expandSpinBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "extrude" )){
-            QJsonValue jsval = obj.value( "extrude");
-            if ( jsval.toDouble() >= 0 ){
-                int val = jsval.toDouble();
-                ui->extrudeSpinBox->blockSignals( true );
-                ui->extrudeSpinBox->setValue( val );
-                ui->extrudeSpinBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "method" )){
-            QJsonValue jsval = obj.value( "method");
-            if ( jsval.toDouble() >= 0 ){
-                int val = jsval.toDouble();
-                ui->methodComboBox->blockSignals( true );
-                ui->methodComboBox->setCurrentIndex( val );
-                ui->rotationCheckBox->setHidden( ui->methodComboBox->currentIndex() >= ROWS_BY_NAME );
-                ui->methodComboBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "format" )){ // data format
-            QJsonValue jsval = obj.value( "format");
-            if ( jsval.toDouble() >= 0 ){
-                int val = jsval.toDouble();
-                ui->formatComboBox->blockSignals( true );
-                ui->formatComboBox->setCurrentIndex( val );
-                ui->formatComboBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "imgformat" )){ // image format
-            QJsonValue jsval = obj.value( "imgformat");
-            if ( jsval.toDouble() >= 0 ){
-                int val = jsval.toDouble();
-                ui->imgFormatComboBox->blockSignals( true );
-                ui->imgFormatComboBox->setCurrentIndex( val );
-                ui->imgFormatComboBox->blockSignals( false );
-            }
-        }
-        if ( obj.contains( "rotation" )){
-            QJsonValue jsval = obj.value( "rotation");
-            bool val = jsval.toBool();
-            ui->rotationCheckBox->blockSignals( true );
-            ui->rotationCheckBox->setChecked( val );
-            ui->rotationCheckBox->blockSignals( false );
-        }
-        if ( obj.contains( "cropping" )){
-            QJsonValue jsval = obj.value( "cropping");
-            bool val = jsval.toBool();
-            ui->croppingCheckBox->blockSignals( true );
-            ui->croppingCheckBox->setChecked( val );
-            ui->croppingCheckBox->blockSignals( false );
-        }
-        if ( obj.contains( "basename" )){
-            QJsonValue jsval = obj.value( "basename");
-            if ( jsval.toString().length() > 0 ){
-                QString str = jsval.toString();
-                ui->basenameLineEdit->setText( str );
-                outFilen =  str;
-            }
-        }
-         if ( obj.contains( "subfolders" )){
-            QJsonValue jsval = obj.value( "subfolders");
-            bool val = jsval.toBool();
-            ui->subfoldersCheckBox->blockSignals( true );
-            ui->subfoldersCheckBox->setChecked( val );
-            ui->subfoldersCheckBox->blockSignals( false );
-        }
-        if ( obj.contains( "version" )) { // (SpriteBuncher app version)
-            QJsonValue jsval = obj.value( "version");
-            qDebug() << "version string = "  << jsval.toString();
-        }
-    }
-    else
-        qDebug() << "(no previous json file exists).";
-
+    // (settings missing from the file keep their current values)
+    builder.setSettings( uiSettings() );
+    bool ok = builder.loadSettings();
+    if ( ok )
+        applySettings( builder.settings() );
     return ok;
 }
 
-void MainWindow::saveJsonSettings()
-{   qDebug() << "saveJsonSettings";
-    QDir dir( outDirn );
-    QFile saveFile( dir.path() + jsonFilen );
-    if (!saveFile.open(QIODevice::WriteOnly)) {
-        qWarning("Couldn't open json file for saving.");
-        return;
+BuncherSettings MainWindow::uiSettings() const
+{
+    BuncherSettings settings;
+    settings.sheetWidth = ui->widthSpinBox->value();
+    settings.sheetHeight = ui->heightSpinBox->value();
+    settings.padding = ui->paddingSpinBox->value();
+    settings.border = ui->borderSpinBox->value();
+    settings.expand = ui->expandSpinBox->value();
+    settings.extrude = ui->extrudeSpinBox->value();
+    settings.scale = ui->scalingSpinBox->value();
+    settings.method = ui->methodComboBox->currentIndex();
+    settings.dataFormat = ui->formatComboBox->currentIndex();
+    foreach ( QAction *action, extraFormatsMenu->actions() ) {
+        if ( action->isChecked() )
+            settings.extraFormats.append( action->data().toInt() );
     }
-    QJsonObject gameObject;
-    gameObject.insert( "sheetw", sheetProp.width );
-    gameObject.insert( "sheeth", sheetProp.height );
-    gameObject.insert( "expand", ui->expandSpinBox->value() );
-    gameObject.insert( "extrude", ui->extrudeSpinBox->value() );
-    gameObject.insert( "padding", ui->paddingSpinBox->value() );
-    gameObject.insert( "border", ui->borderSpinBox->value() );
-    gameObject.insert( "method", ui->methodComboBox->currentIndex() );
-    gameObject.insert( "format", ui->formatComboBox->currentIndex() ); // data export format
-    gameObject.insert( "imgformat", ui->imgFormatComboBox->currentIndex() ); // image export format
-    gameObject.insert( "rotation", ui->rotationCheckBox->isChecked() );
-    gameObject.insert( "cropping", ui->croppingCheckBox->isChecked() );
-    gameObject.insert( "subfolders", ui->subfoldersCheckBox->isChecked() );
-    gameObject.insert( "basename", ui->basenameLineEdit->text() );
-    gameObject.insert( "version", QCoreApplication::applicationVersion() );
-    QJsonDocument saveDoc(gameObject);
-    saveFile.write( saveDoc.toJson() );
+    settings.imageFormat = ui->imgFormatComboBox->currentIndex();
+    settings.dither = ui->ditherComboBox->currentIndex();
+    settings.bleed = ui->bleedCheckBox->isChecked();
+    settings.pngCompression = ui->pngComboBox->currentIndex();
+    settings.texQuality = ui->texQualityComboBox->currentIndex();
+    settings.texContainer = ui->containerComboBox->currentIndex();
+    settings.mipmaps = ui->mipmapsCheckBox->isChecked();
+    settings.blockAlign = ui->alignCheckBox->isChecked();
+    settings.variants = ui->variantsComboBox->currentIndex();
+    settings.rotation = ui->rotationCheckBox->isChecked();
+    settings.cropping = ui->croppingCheckBox->isChecked();
+    settings.subfolders = ui->subfoldersCheckBox->isChecked();
+    settings.baseName = ui->basenameLineEdit->text();
+    return settings;
+}
+
+void MainWindow::applySettings( const BuncherSettings &settings )
+{   // [ Dev notes - we use blockSignals here to prevent getting a signal from each
+    // widget, which would trigger a reload for each].
+    ui->widthSpinBox->blockSignals( true );
+    ui->widthSpinBox->setValue( settings.sheetWidth );
+    ui->widthSpinBox->blockSignals( false );
+    ui->heightSpinBox->blockSignals( true );
+    ui->heightSpinBox->setValue( settings.sheetHeight );
+    ui->heightSpinBox->blockSignals( false );
+    ui->paddingSpinBox->blockSignals( true );
+    ui->paddingSpinBox->setValue( settings.padding );
+    ui->paddingSpinBox->blockSignals( false );
+    ui->borderSpinBox->blockSignals( true );
+    ui->borderSpinBox->setValue( settings.border );
+    ui->borderSpinBox->blockSignals( false );
+    ui->expandSpinBox->blockSignals( true );
+    ui->expandSpinBox->setValue( settings.expand );
+    ui->expandSpinBox->blockSignals( false );
+    ui->extrudeSpinBox->blockSignals( true );
+    ui->extrudeSpinBox->setValue( settings.extrude );
+    ui->extrudeSpinBox->blockSignals( false );
+    ui->scalingSpinBox->blockSignals( true );
+    ui->scalingSpinBox->setValue( settings.scale );
+    ui->scalingSpinBox->blockSignals( false );
+    ui->methodComboBox->blockSignals( true );
+    ui->methodComboBox->setCurrentIndex( settings.method );
+    ui->rotationCheckBox->setHidden( settings.method >= BuncherSettings::ROWS_BY_NAME );
+    ui->methodComboBox->blockSignals( false );
+    ui->formatComboBox->blockSignals( true );
+    ui->formatComboBox->setCurrentIndex( settings.dataFormat );
+    ui->formatComboBox->blockSignals( false );
+    foreach ( QAction *action, extraFormatsMenu->actions() )
+        action->setChecked( settings.extraFormats.contains( action->data().toInt() ));
+    extraFormatsChanged();
+    ui->imgFormatComboBox->blockSignals( true );
+    ui->imgFormatComboBox->setCurrentIndex( settings.imageFormat );
+    ui->imgFormatComboBox->blockSignals( false );
+    ui->ditherComboBox->blockSignals( true );
+    ui->ditherComboBox->setCurrentIndex( settings.dither );
+    ui->ditherComboBox->blockSignals( false );
+    ui->bleedCheckBox->blockSignals( true );
+    ui->bleedCheckBox->setChecked( settings.bleed );
+    ui->bleedCheckBox->blockSignals( false );
+    ui->pngComboBox->blockSignals( true );
+    ui->pngComboBox->setCurrentIndex( settings.pngCompression );
+    ui->pngComboBox->blockSignals( false );
+    ui->texQualityComboBox->blockSignals( true );
+    ui->texQualityComboBox->setCurrentIndex( settings.texQuality );
+    ui->texQualityComboBox->blockSignals( false );
+    ui->containerComboBox->blockSignals( true );
+    ui->containerComboBox->setCurrentIndex( settings.texContainer );
+    ui->containerComboBox->blockSignals( false );
+    ui->mipmapsCheckBox->blockSignals( true );
+    ui->mipmapsCheckBox->setChecked( settings.mipmaps );
+    ui->mipmapsCheckBox->blockSignals( false );
+    ui->alignCheckBox->blockSignals( true );
+    ui->alignCheckBox->setChecked( settings.blockAlign );
+    ui->alignCheckBox->blockSignals( false );
+    ui->variantsComboBox->blockSignals( true );
+    ui->variantsComboBox->setCurrentIndex( settings.variants );
+    ui->variantsComboBox->blockSignals( false );
+    ui->rotationCheckBox->blockSignals( true );
+    ui->rotationCheckBox->setChecked( settings.rotation );
+    ui->rotationCheckBox->blockSignals( false );
+    ui->croppingCheckBox->blockSignals( true );
+    ui->croppingCheckBox->setChecked( settings.cropping );
+    ui->croppingCheckBox->blockSignals( false );
+    ui->subfoldersCheckBox->blockSignals( true );
+    ui->subfoldersCheckBox->setChecked( settings.subfolders );
+    ui->subfoldersCheckBox->blockSignals( false );
+    ui->basenameLineEdit->setText( settings.baseName );
 }
 
 void MainWindow::openFolder( const QString &path, bool ignoreIfCurrent, bool loadSettings )
 {
     qDebug() << "openFolder: " << path;
-    if ( path == inDirn && ignoreIfCurrent ){
+    if ( path == builder.inputFolder() && ignoreIfCurrent ){
         qDebug() << "(openFolder - same as current folder, returning)";
         return;
     }
@@ -571,11 +588,10 @@ void MainWindow::openFolder( const QString &path, bool ignoreIfCurrent, bool loa
     if ( okdir ) {
         qDebug() << "Valid folder in openFolder(): " << path;
         ui->inputPathEdit->setText( path );
-        inDirn = path;
-        outDirn = inDirn + "/buncher";
+        builder.setInputFolder( path );
         if ( loadSettings ) loadJsonSettings();
         reloadAndRepackAll();
-        zoomBestFit(); // (probably better than keeping prev zoom level)
+        packZoomToFit = true; // (probably better than keeping prev zoom level)
     }
     else
         qDebug() << "Unreadable or empty folder in openFolder(): " << path;
@@ -584,132 +600,115 @@ void MainWindow::openFolder( const QString &path, bool ignoreIfCurrent, bool loa
 void MainWindow::processFolder()
 {
     qDebug() << "processFolder";
-    QDir dir( inDirn );
+    QDir dir( builder.inputFolder() );
     if (!dir.exists() ){
         qWarning( "Could not open the input folder. " );
         QMessageBox::warning(this, tr( "SpriteBuncher" ), QString( "Could not open the input folder." ), QMessageBox::Ok );
         return;
     }
-    QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-    QFileInfoList fulllist;
-
-    if ( ui->subfoldersCheckBox->isChecked() ) {
-        QDirIterator it( dir, QDirIterator::Subdirectories ); // (note - ignores sym links by default).
-        while( it.hasNext() ) {
-            it.next();
-            // avoid buncher output files! [path name hardcoded for now]
-            if ( !it.fileInfo().path().endsWith( QString("/buncher") ) ) {
-                //qDebug() << "Processing... " << it.fileName();
-                fulllist.append( it.fileInfo() );
-            }
-        }
-    }
-    else { // single file scan
-        dir.setFilter(QDir::Files); // ignores subfolders.
-        fulllist = dir.entryInfoList();
-        for (int i = 0; i < fulllist.size(); ++i) {
-            //qDebug() << "Processing...  " << fulllist[i].fileName();
-        }
-    }
+    startPacking( true ); // (subfolders option and packing method decide what gets loaded, and in what order)
+}
 
-    // Sort the initial list and get the fileinfo for each:
-    packedsprites.clear();
-    for (int i = 0; i < fulllist.size(); ++i) {
-        QFileInfo fileInfo = fulllist.at(i);
-        QPixmap px( fileInfo.filePath() );
-        if ( !px.isNull() ){ // [we could check file format/extension, but instead we just try to open everything]
-            bool inserted = false;
-            for (int is = 0; is < packedsprites.size(); ++is) {
-                // For the MaxRects methods we sort by descending area first [not sure if this is always best, I assumed it is!].
-                if ( ( ui->methodComboBox->currentIndex() <= MAXRECTS_CONTACTPOINT || ui->methodComboBox->currentIndex() == ROWS_BY_AREA ) &&
-                     px.width()*px.height() >= packedsprites[is].pixmap().width()*packedsprites[is].pixmap().height() ) { // orders by area (descending)
-                    if ( !inserted ) {
-                        packedsprites.insert( is, PackSprite( px, fileInfo ));
-                        inserted = true;
-                        break;
-                    }
-                }
-                else if ( ui->methodComboBox->currentIndex() == ROWS_BY_NAME ) { // ordering by name (ascending).
-                    if ( !inserted ) { // (simple - always inserts at end.)
-                        packedsprites.insert( packedsprites.size(), PackSprite( px, fileInfo ) );
-                        inserted = true;
-                        break;
-                    }
-                }
-                else if ( ui->methodComboBox->currentIndex() == ROWS_BY_WIDTH &&
-                          px.width() >= packedsprites[is].pixmap().width() ) { // order by width (descending)
-                    if ( !inserted ) {
-                        packedsprites.insert( is, PackSprite( px, fileInfo ) );
-                        inserted = true;
-                        break;
-                    }
-                }
-                else if ( ui->methodComboBox->currentIndex() == ROWS_BY_HEIGHT &&
-                          px.height() >= packedsprites[is].pixmap().height() ) { // order by width (descending)
-                    if ( !inserted ) {
-                        packedsprites.insert( is, PackSprite( px, fileInfo ) );
-                        inserted = true;
-                        break;
-                    }
-                }
-            }
-            // if not inserted after scan, always insert it at end
-            if ( !inserted)
-                packedsprites.insert( packedsprites.size(), PackSprite( px, fileInfo ) );
-        }
+void MainWindow::startPacking( bool reload )
+{
+    packReload = packReload || reload;
+    packPending = true;
+    if ( packWatcher.isRunning() )
+        packCancel.store( 1 ); // (its results would be out of date anyway)
+    packTimer.start();
+    ui->publishButton->setEnabled( false );
+    ui->statusImage->setVisible( false );
+    ui->statusLabel->setText( "Packing..." );
+}
+
+void MainWindow::launchPacking()
+{
+    if ( packWatcher.isRunning() )
+        return; // (packingFinished() launches it, once the cancelled job has stopped)
+    qDebug() << "launchPacking: Packing method selected: " << ui->methodComboBox->currentIndex() << " = " << ui->methodComboBox->currentText();
+    SheetBuilder job = builder;
+    job.setSettings( uiSettings() );
+    bool reload = packReload;
+    packPending = false;
+    packReload = false;
+    packCancel.store( 0 );
+    packWatcher.setFuture( QtConcurrent::run( &MainWindow::packInBackground, job, reload, &packCancel ));
+}
+
+MainWindow::PackedPreview::PackedPreview()
+{
+    reload = false;
+    cancelled = false;
+    nfails = 0;
+}
+
+MainWindow::PackedPreview MainWindow::packInBackground( SheetBuilder builder, bool reload, const QAtomicInt *cancel )
+{
+    PackedPreview result;
+    result.reload = reload;
+    builder.clearStats();
+    builder.setCancelFlag( cancel );
+    if ( reload )
+        builder.reloadSprites(); // (unchanged files keep their pixels, so their preview sprites stay as they are)
+    result.nfails = builder.pack(); // (with no sprites, this still picks up the sheet properties)
+    result.cancelled = builder.isCancelled();
+    builder.setCancelFlag( 0 );
+    result.builder = builder;
+    return result;
+}
+
+void MainWindow::packingFinished()
+{
+    PackedPreview result = packWatcher.result();
+    if ( result.cancelled || packPending ) {
+        // Out of date - drop it, and pack the latest settings instead.
+        qDebug() << "packingFinished - dropping an out of date job";
+        packReload = packReload || result.reload;
+        if ( !packTimer.isActive() )
+            launchPacking();
+        return;
     }
-    qDebug() << "Packed sprite list has " << packedsprites.size() << " entries." << " (full file list has " << fulllist.size() << " entries).";
-    /*for (int is = 0; is < packedsprites.size(); ++is){
-        qDebug() << is << packedsprites[is].fileInfo().fileName();
+    builder = result.builder;
+    showPackStatus( result.nfails );
+    updateViewWidgets( result.nfails );
+    if ( canvasSheet->hasSheet() ) // (else it says the sheet is too large to preview)
+        ui->statusBar->showMessage( "Timings: " + builder.stats().summary() + "  -  Memory: " + memoryUsage().summary() );
+    if ( packZoomToFit ) {
+        zoomBestFit();
+        packZoomToFit = false;
     }
-    */
-    QApplication::restoreOverrideCursor();
 }
 
-int MainWindow::pack()
+QVector<int> MainWindow::previewKey( const SheetBuilder &builder, int nfails, bool darkTheme )
+{
+    const SheetProperties &sheetProp = builder.sheetProperties();
+    const BuncherSettings &settings = builder.settings();
+    QVector<int> sheetKey;
+    sheetKey << sheetProp.width << sheetProp.height << sheetProp.border << builder.extrude()
+             << settings.imageFormat << settings.dither << settings.isBleeding()
+             << ( nfails > 0 ) << darkTheme;
+    return sheetKey;
+}
+
+MemoryUsage MainWindow::memoryUsage() const
 {
-    if ( packedsprites.size() == 0 ) {
-        qDebug() << "pack(): Empty list - nothing to pack.";
+    MemoryUsage usage = builder.memoryUsage();
+    usage.add( MemoryUsage::MEM_ICONS, iconBytes );
+    usage.add( MemoryUsage::MEM_PREVIEW, canvasSheet->pyramidBytes() );
+    return usage;
+}
+
+void MainWindow::showPackStatus( int nfails )
+{
+    packFails = nfails;
+    if ( builder.sprites().size() == 0 ) {
         ui->statusImage->setVisible( false );
         ui->statusLabel->setText( "(No images loaded)" );
-        return 0;
-    }
-    QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-    int nfails = 0;
-    qDebug() << "pack(): Packing method selected: " << ui->methodComboBox->currentIndex() << " = " << ui->methodComboBox->currentText();
-
-    if ( ui->methodComboBox->currentIndex() <= MAXRECTS_CONTACTPOINT ) {
-        rbp::MaxRectsBinPack::FreeRectChoiceHeuristic heuristic;
-        switch ( ui->methodComboBox->currentIndex() ){
-        case MAXRECTS_BESTAREA:
-            heuristic = rbp::MaxRectsBinPack::RectBestAreaFit;
-            break;
-        case MAXRECTS_SHORTSIDE:
-            heuristic = rbp::MaxRectsBinPack::RectBestShortSideFit;
-            break;
-        case MAXRECTS_LONGSIDE:
-            heuristic = rbp::MaxRectsBinPack::RectBestLongSideFit;
-            break;
-        case MAXRECTS_BOTTOMLEFT:
-            heuristic = rbp::MaxRectsBinPack::RectBottomLeftRule;
-            break;
-        case MAXRECTS_CONTACTPOINT:
-            heuristic = rbp::MaxRectsBinPack::RectContactPointRule;
-            break;
-        default:
-            qDebug() << "Warning - using default method in pack() - check indexes";
-            heuristic = rbp::MaxRectsBinPack::RectBestAreaFit;
-            break;
-        }
-        nfails = Packer::MaxRects( sheetProp, packedsprites, heuristic, ui->rotationCheckBox->isChecked(), ui->croppingCheckBox->isChecked(),
-                                   ui->expandSpinBox->value(), ui->extrudeSpinBox->value(), ui->scalingSpinBox->value() );
-    }
-    else if ( ui->methodComboBox->currentIndex() >= ROWS_BY_NAME ){
-        nfails = Packer::Rows( sheetProp, packedsprites, ui->rotationCheckBox->isChecked(), ui->croppingCheckBox->isChecked(),
-                               ui->expandSpinBox->value(), ui->extrudeSpinBox->value(), ui->scalingSpinBox->value() );
+        ui->publishButton->setEnabled( false );
+        return;
     }
     QString validStr;
-    validStr.setNum( packedsprites.size() - nfails );
+    validStr.setNum( builder.sprites().size() - nfails );
     QString failStr;
     failStr.setNum( nfails );
     if ( nfails == 0 ) {
@@ -724,184 +723,157 @@ int MainWindow::pack()
         ui->statusImage->setPixmap( QPixmap( ":/res1/images/cross.png" ));
         ui->publishButton->setEnabled( false ); // we choose to only allow export if all items were packed.
     }
-    QApplication::restoreOverrideCursor();
-    return nfails;
 }
 
-QImage::Format MainWindow::currentQImageFormat() const
+SheetPreviewItem::RenderFunction MainWindow::previewRenderer( const SheetBuilder &builder )
 {
-    QImage::Format format = QImage::Format_ARGB32;
-    switch ( ui->imgFormatComboBox->currentIndex() ) {
-        case 0: format = QImage::Format_ARGB32;
-        break;
-        case 1: format = QImage::Format_ARGB32_Premultiplied;
-        break;
-        case 2: format = QImage::Format_ARGB4444_Premultiplied;
-        break;
-        case 3: format = QImage::Format_RGB888;
-        break;
-        case 4: format = QImage::Format_RGB16; // 'RGB565'
-        break;
-        case 5: format = QImage::Format_ARGB8565_Premultiplied;
-        break;
-        case 6: format = QImage::Format_RGB555;
-        break;
-        default: format = QImage::Format_ARGB32;
-        qWarning() << "warning: renderSheet -- using 'default' img format, check combo values";
-    }
-    return format;
-}
-
-// e.g. see http://stackoverflow.com/questions/7451183/how-to-create-image-file-from-qgraphicsscene-qgraphicsview
-QImage MainWindow::renderSheet()
-{
-    ui->graphicsView->scene()->clearSelection(); // (else, selection rects will render to the image!)
-
-    // Since this fn can be called any time, need to hide the other canvas items:
-    if ( canvasBG ) canvasBG->setVisible( false );
-    if ( canvasSheet ) canvasSheet->setVisible( false );
-    qDebug() << "renderSheet - total canvas item count is " << ui->graphicsView->scene()->items().count();
-
-    // make all items fully visible (we used opacity trick to 'hide' them):
-    static const int ObjectName = 0;
-    QList<QGraphicsItem *> items = ui->graphicsView->scene()->items();
-    foreach( QGraphicsItem* itm, items )
-        if ( !itm->data(ObjectName).isNull() ) itm->setOpacity( 1.0 );
-
-    // Store current user view settings so we can restore them afterwards:
-    QRectF srect = ui->graphicsView->scene()->sceneRect();
-    QPainter::RenderHints renderHints = ui->graphicsView->renderHints();
-
-   QImage::Format qiformat = currentQImageFormat();
-    qDebug() << "QImage format is " << qiformat << " for our value " << ui->imgFormatComboBox->currentIndex() << " = " << ui->imgFormatComboBox->currentText();
-    ui->graphicsView->scene()->setSceneRect(  QRect( 0,0, sheetProp.width, sheetProp.height ) ); // always export exact sheet size
-    ui->graphicsView->setRenderHints( QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
-
-    // create transparent image with the correct scene rect size and render settings:
-    QImage image(  ui->graphicsView->scene()->sceneRect().size().toSize(), qiformat );
-    image.fill(Qt::transparent);
-    // [Dev note - could add some dithering options here?]
-    QPainter painter(&image);
-    ui->graphicsView->scene()->render(&painter);
-
-    // Paint extrusions, if required. This paints beyond the edges of each items.
-    // It affects packing only in the sense that we add on to the user's padding and border
-    // settings so the extruded pixels dont overlap another item).
-    qDebug() << "In renderSheet - sheetProp.extrude =  " << ui->extrudeSpinBox->value();
-    int extrude = ui->extrudeSpinBox->value();
-    if ( extrude > 0 ) {
-        foreach( QGraphicsItem* itm, items ){
-            QGraphicsPixmapItem *pmi = qgraphicsitem_cast<QGraphicsPixmapItem*>( itm );
-            if (pmi && !pmi->data(ObjectName).isNull()) {
-                painter.drawPixmap( QRect( pmi->pos().x(), pmi->pos().y() -extrude, pmi->pixmap().width(), extrude ),
-                                    pmi->pixmap(), QRectF( 0.0, 0.0, pmi->pixmap().width(), 1.0 ) ); // top edge
-
-                painter.drawPixmap( QRectF( pmi->pos().x(), pmi->pos().y() + pmi->pixmap().height(), pmi->pixmap().width(), extrude ),
-                                    pmi->pixmap(), QRectF( 0.0, pmi->pixmap().height()-1, pmi->pixmap().width(), 1.0 ) ); // bot edge
-
-                painter.drawPixmap( QRectF( pmi->pos().x() - extrude, pmi->pos().y(), extrude, pmi->pixmap().height() ),
-                                    pmi->pixmap(), QRectF( 0.0, 0.0, 1.0, pmi->pixmap().height() ) );  // left edge
-                painter.drawPixmap( QRectF( pmi->pos().x() + pmi->pixmap().width(), pmi->pos().y(), extrude, pmi->pixmap().height() ),
-                                    pmi->pixmap(), QRectF( pmi->pixmap().width() -1.0, 0.0, 1.0, pmi->pixmap().height() ) ); // right edge
-            }
-        }
-    }
-
-    // restore view settings etc now that we're done:
-    ui->graphicsView->scene()->setSceneRect( srect );
-    ui->graphicsView->setRenderHints( renderHints );
-    if ( canvasBG ) canvasBG->setVisible( true );
-    if ( canvasSheet ) canvasSheet->setVisible( true );
-    // make all items 'nearly invisible' again, for normal view
-    foreach( QGraphicsItem* itm, items )
-        if ( !itm->data(ObjectName).isNull() ) itm->setOpacity( 0.01 );
-
-    return image;
+    SheetBuilder snapshot( builder ); // (so later packing doesn't change what the preview is rendering)
+    return [snapshot]( const QRect &area ) {
+        QRect aligned = snapshot.alignedRenderArea( area );
+        return snapshot.renderSheetArea( aligned ).copy( area.translated( -aligned.topLeft() ));
+    };
 }
 
 void MainWindow::updateViewWidgets( int nfails )
 {
     qDebug() << "updateViewWidgets";
     QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-    // always clear the previous data
-    ui->listWidget->clear();
-    ui->graphicsView->scene()->clear(); // (will also delete the canvasBG and canvasSheet).
-    qDebug() << " ui->graphicsView->scene() count = " << ui->graphicsView->scene()->items().count();
-    canvasBG = NULL;
-    canvasSheet = NULL;
-    ui->graphicsView->scene()->setSceneRect(  QRect( 0,0, sheetProp.width, sheetProp.height ) ); // required, else view retains old rect size to view
-    double curZoom = ui->graphicsView->transform().m11();
-    zoomReset();
+    const SheetProperties &sheetProp = builder.sheetProperties();
 
-    // create new canvas bg elements
-    ui->graphicsView->setBackgroundBrush( QImage( ":/res1/images/black-bg.png" ));
-    ui->graphicsView->setCacheMode( QGraphicsView::CacheNone ); // (Qt docs recommend this when using a tiled background brush).
+    // Anything that affects the whole sheet means we start again from scratch, otherwise we only touch what changed.
+    QVector<int> sheetKey = previewKey( builder, nfails, useCustomStyleSheet );
+    bool rebuild = ( !canvasSheet->hasSheet() || sheetKey != previewSheetKey );
+    previewSheetKey = sheetKey;
 
-    QImage chkboard( ":/res1/images/checkerbg.png" );
-    if ( useCustomStyleSheet ) chkboard = QImage( ":/res1/images/checkerbg-dark.png" );
-    QImage redchkboard( ":/res1/images/redcheckerbg.png" );
-    if ( useCustomStyleSheet ) redchkboard = QImage( ":/res1/images/redcheckerbg-dark.png" );
+    if ( rebuild ) {
+        previewEntries.clear();
+        ui->graphicsView->scene()->setSceneRect(  QRect( 0,0, sheetProp.width, sheetProp.height ) ); // required, else view retains old rect size to view
 
-    if ( nfails > 0 )
-        canvasBG = ui->graphicsView->scene()->addRect( 0, 0, sheetProp.width, sheetProp.height, Qt::NoPen, QBrush( redchkboard ) );
-    else
-        canvasBG = ui->graphicsView->scene()->addRect( 0, 0, sheetProp.width, sheetProp.height, Qt::NoPen, QBrush( chkboard ) );
-    canvasBG->setFlag( QGraphicsItem::ItemIsSelectable, false );
-    canvasBG->setZValue( 0 );
+        // update canvas bg elements
+        ui->graphicsView->setBackgroundBrush( QImage( ":/res1/images/black-bg.png" ));
+        ui->graphicsView->setCacheMode( QGraphicsView::CacheNone ); // (Qt docs recommend this when using a tiled background brush).
+
+        QImage chkboard( ":/res1/images/checkerbg.png" );
+        if ( useCustomStyleSheet ) chkboard = QImage( ":/res1/images/checkerbg-dark.png" );
+        QImage redchkboard( ":/res1/images/redcheckerbg.png" );
+        if ( useCustomStyleSheet ) redchkboard = QImage( ":/res1/images/redcheckerbg-dark.png" );
+
+        canvasBG->setRect( 0, 0, sheetProp.width, sheetProp.height );
+        canvasBG->setBrush( QBrush( nfails > 0 ? redchkboard : chkboard ));
+    }
+
+    QRegion dirty = syncPreviewSprites();
+
+    // We show the sheet rendered with the users chosen output format, rather than just drawing the sprites, so the preview
+    // matches what gets exported.
+    // The preview renders it in bands and only keeps downsampled levels, plus the full size tiles in view.
+    if ( rebuild ) {
+        if ( qint64( sheetProp.width ) * sheetProp.height <= MaxPreviewPixels )
+            canvasSheet->setSheet( QSize( sheetProp.width, sheetProp.height ), previewRenderer( builder ));
+        else { // (still exports fine, that's done in bands)
+            canvasSheet->clearSheet();
+            ui->statusBar->showMessage( "Sheet is too large to preview, sprite positions are shown only." );
+        }
+    }
+    else if ( !dirty.isEmpty() && canvasSheet->hasSheet() ) {
+        QRegion aligned; // (error diffusion changes pixels beyond the sprites themselves)
+        foreach ( const QRect &r, dirty.rects() )
+            aligned += builder.alignedRenderArea( r );
+        qDebug() << "updateViewWidgets - re-rendering " << aligned.rectCount() << " changed area(s)";
+        canvasSheet->updateSheet( previewRenderer( builder ), aligned );
+    }
+    QApplication::restoreOverrideCursor();
+}
+
+QRegion MainWindow::syncPreviewSprites()
+{
+    QRegion dirty;
+    const QList<PackSprite> &packedsprites = builder.sprites();
+    const SheetProperties &sheetProp = builder.sheetProperties();
+    int extrude = builder.extrude();
+    bool bleed = builder.settings().isBleeding();
+    QHash<QString, PreviewEntry> entries;
+    QStringList names;
+    QList<int> changedIcons;
+    QVector<QRect> rects( packedsprites.size() );
+    QStringList toolTips;
 
-    // populate canvas and listWidget. Remember, the packedrects dont include the border pixels, but do include their padding.
     for (int i = 0; i < packedsprites.size(); ++i) {
-        rbp::Rect packedRect =  packedsprites[i].packedRect();
-        if (packedRect.height > 0) {
-            QPixmap pm;
-                pm = packedsprites[i].pixmap();
-            // if rotated, need to display a rotated pixmap on the canvas:
-            if ( packedsprites[i].isRotated() ){
-                QTransform trans;
-                trans = trans.rotate( 90 );
-                QPixmap rotpm = pm.transformed( trans );
-                pm = rotpm;
+        const PackSprite &spr = packedsprites[i];
+        QRect rect = SheetRenderer::SpriteRect( spr, sheetProp );
+        rects[i] = rect;
+        if ( rect.isEmpty() ) {
+            toolTips.append( QString() );
+            continue;
+        }
+        PreviewEntry entry;
+        entry.area = bleed ? SheetRenderer::BleedRect( spr, sheetProp, extrude ) : rect.adjusted( -extrude, -extrude, extrude, extrude );
+        entry.rotated = spr.isRotated();
+        entry.pixelKey = spr.pixelKey();
+
+        QHash<QString, PreviewEntry>::iterator prev = previewEntries.find( spr.fileInfo().filePath() );
+        if ( prev != previewEntries.end() ) {
+            if ( prev.value().area != entry.area || prev.value().rotated != entry.rotated || prev.value().pixelKey != entry.pixelKey ) {
+                dirty += prev.value().area;
+                dirty += entry.area;
+                if ( prev.value().pixelKey != entry.pixelKey )
+                    changedIcons.append( names.size() );
             }
-            PixmapItem *item = new PixmapItem( pm ); // (PixmapItem derives from QGraphicsPixmapItem).
-            item->setEnabled( true );
-            item->setZValue( 1 );
-            ui->graphicsView->scene()->addItem( item );
-            static const int ObjectName = 0;
-            item->setData(ObjectName, packedsprites[i].fileInfo().fileName() ); // store the name as data
-            item->setFlag( QGraphicsItem::ItemIsSelectable, true );
-            item->setPos( packedRect.x + ui->borderSpinBox->value(), packedRect.y + ui->borderSpinBox->value() );
-
-            // make the listwidget item and a useful tooltip:
-            QPixmap opm = packedsprites[i].originalPixmap(); // we choose to use orig pm, before crop/rot/expand.
-            ui->listWidget->addItem(new QListWidgetItem( QIcon( opm ), packedsprites[i].fileInfo().fileName() ) );
-            QString pxstr, pystr, widstr, hgtstr;
-            pxstr.setNum( int(item->pos().x() ));
-            pystr.setNum( int(item->pos().y() ));
-            widstr.setNum( pm.width() ); // use actual current pm for any data!
-            hgtstr.setNum( pm.height() );
-            QString rotStr;
-            if ( packedsprites[i].isRotated() )
-                rotStr = " (rotated)";
-            QString szStr;
-            if ( packedsprites[i].isCropped() )
-                szStr = " (cropped)";
-            else if ( packedsprites[i].isExpanded() ) // (could actually be cropped and then expanded).
-                szStr = " (expanded)";
-            item->setToolTip( packedsprites[i].fileInfo().fileName() + "\nPos: " + pxstr + ", " + pystr + rotStr + "\nSize: " + widstr + " x " + hgtstr + szStr );
+            previewEntries.erase( prev );
         }
+        else
+            dirty += entry.area;
+        entries.insert( spr.fileInfo().filePath(), entry );
+        names.append( spr.fileInfo().fileName() );
+
+        // make a useful tooltip:
+        QString pxstr, pystr, widstr, hgtstr;
+        pxstr.setNum( rect.x() );
+        pystr.setNum( rect.y() );
+        widstr.setNum( rect.width() ); // use actual current pm for any data!
+        hgtstr.setNum( rect.height() );
+        QString rotStr;
+        if ( spr.isRotated() )
+            rotStr = " (rotated)";
+        QString szStr;
+        if ( spr.isCropped() )
+            szStr = " (cropped)";
+        else if ( spr.isExpanded() ) // (could actually be cropped and then expanded).
+            szStr = " (expanded)";
+        toolTips.append( spr.fileInfo().fileName() + "\nPos: " + pxstr + ", " + pystr + rotStr + "\nSize: " + widstr + " x " + hgtstr + szStr );
     }
 
-    // [At this point we could just let the graphicsview to show as-is. However, we want to show the sheet rendered with the users chosen
-    // output format, and therefore its better to display the *actual* rendered sheet instead of the graphicsview items. By making the original
-    // items almost transparent we retain selection and other events].
-
-    QImage sheet = renderSheet();
-    QPixmap sc;
-    sc.convertFromImage( sheet );
-    canvasSheet= new QGraphicsPixmapItem( sc );
-    canvasSheet->setFlag( QGraphicsItem::ItemIsSelectable, false );
-    ui->graphicsView->scene()->addItem( canvasSheet );
-    canvasSheet->setZValue( 2 ); // in front of actual items (however, does mean we wont see some selection rects behind sheet).
-    ui->graphicsView->scale( curZoom, curZoom ); // restore prev zoom
-    QApplication::restoreOverrideCursor();
+    // Whatever is left over is no longer on the sheet (e.g. it failed to pack this time).
+    foreach ( const PreviewEntry &old, previewEntries )
+        dirty += old.area;
+    previewEntries = entries;
+    canvasSheet->setSprites( rects, toolTips );
+
+    // make the listwidget items. We choose to use orig pm, before crop/rot/expand.
+    if ( names != previewNames || !changedIcons.isEmpty() ) {
+        iconBytes = 0; // (each icon holds its own pixmap copy of the image)
+        for (int i = 0; i < packedsprites.size(); ++i) {
+            if ( !rects[i].isEmpty() )
+                iconBytes += MemoryUsage::ImageBytes( packedsprites[i].originalImage() );
+        }
+    }
+    if ( names != previewNames ) {
+        ui->listWidget->clear();
+        for (int i = 0; i < packedsprites.size(); ++i) {
+            if ( !rects[i].isEmpty() )
+                ui->listWidget->addItem( new QListWidgetItem( QIcon( QPixmap::fromImage( packedsprites[i].originalImage() )), packedsprites[i].fileInfo().fileName() ) );
+        }
+        previewNames = names;
+    }
+    else if ( !changedIcons.isEmpty() ) { // same list, just refresh the icons of reloaded images.
+        int row = 0;
+        for (int i = 0; i < packedsprites.size(); ++i) {
+            if ( !rects[i].isEmpty() ) {
+                if ( changedIcons.contains( row ) )
+                    ui->listWidget->item( row )->setIcon( QIcon( QPixmap::fromImage( packedsprites[i].originalImage() )));
+                row++;
+            }
+        }
+    }
+    return dirty;
 }
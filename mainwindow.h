@@ -23,21 +23,18 @@
 #include <QGraphicsRectItem>
 #include <QPixmap>
 #include <QFileInfo>
+#include <QHash>
+#include <QRegion>
+#include <QVector>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QTimer>
 
-#include "packsprite.h"
-#include "./maxrects/MaxRectsBinPack.h"
-
-//! Struct that stores basic sheet data.
-struct SheetProperties {
-    //! sheet width in pixles.
-    int width;
-    //! sheet height in pixles.
-    int height;
-    //! The gap added around each sprite, in pixels.
-    int padding;
-    //! The border added around entire sheet, in pixels.
-    int border;
-};
+#include "bunchersettings.h"
+#include "sheetbuilder.h"
+#include "sheetpreviewitem.h"
+
+class QMenu;
 
 namespace Ui {
 class MainWindow;
@@ -55,13 +52,6 @@ public:
     //! Destructor.
     ~MainWindow();
 
-    //! Packing Methods. Indexes must match ui packComboBox -- be careful if adding new ones. Index is saved in json settings file.
-    enum PackMethods { MAXRECTS_BESTAREA = 0, MAXRECTS_SHORTSIDE, MAXRECTS_LONGSIDE, MAXRECTS_BOTTOMLEFT, MAXRECTS_CONTACTPOINT,
-                       ROWS_BY_NAME, ROWS_BY_AREA, ROWS_BY_HEIGHT, ROWS_BY_WIDTH };
-    //! Image formats for output. These get converted to matching QImage formats.
-    enum ImageFormats { FORMAT_ARGB32, FORMAT_ARGB32_PRE, FORMAT_ARGB4444_PREM, FORMAT_RGB888, FORMAT_RGB565, FORMAT_RGB565_PREM,
-                        FORMAT_RGB555 };
-
 protected slots:
 
     // UI form action slots:
@@ -86,29 +76,38 @@ protected slots:
     //! Menu item slot to toggle dark UI skin.
     void on_actionUse_Dark_UI_Theme_triggered();
 
-    //! Slot called when selection changes on the graphicsview.
-    void sceneSelectionChanged();
+    //! Slot called when a sprite is clicked on the graphicsview sheet preview.
+    void previewSpriteClicked( int index );
 
     //! Calls up a standard file dialog to choose the input folder.
     void openFileDialog();
 
-    //! Slot is called when a main option is changed, ie requires full reload of image data and repacking. It calls reloadAndRepackAll().
-    /*! \see sheetOptionChanged(int), which is faster if the image list doesn't need to be re-processed.
+    //! Slot is called when a packing option is changed. The subfolders option and packing method change which files
+    //! are loaded, and their order, so they call reloadAndRepackAll(); the others (cropping, rotation etc) only repackAll().
+    /*! \see sheetOptionChanged(int).
         Note - don't rely on using the index param, the slot is connected to various signals.
      */
     void packingOptionChanged(int);
 
     //! Slot is called when a sheet option is changed. It calls repackAll(), so does not reload the images.
-    /*! See also: packingOptionChanged(int), which will reload all images before packing.
+    /*! See also: packingOptionChanged(int), which may reload the image list before packing.
         Note - don't rely on using the index param, the slot is connected to various signals.
     */
     void sheetOptionChanged(int);
     //! Alternative overloaded form.
     void sheetOptionChanged(double);
 
-    //! Exports the current sprite sheet and data file.
+    //! Exports the current sprite sheet and data file(s).
     void exportFiles();
 
+    //! Slot called when an extra data format is ticked or unticked. Updates the button text.
+    void extraFormatsChanged();
+
+    //! Starts a background packing job with the latest settings, unless one is still running (see startPacking).
+    void launchPacking();
+    //! Slot called when a background packing job has finished. Shows its results, unless they're already out of date.
+    void packingFinished();
+
     // Graphicsview zoom:
     //! Zoom in on the GraphicsView canvas.
     void zoomIn();
@@ -131,17 +130,23 @@ protected:
     //! Standard event Qt calls when application is closed. We save app QSettings here.
     void closeEvent(QCloseEvent *event);
 
-    //! Calls processFolder(), pack(), and updateViewWidgets(). i.e. reloads all images and re-packs everything.
+    //! Calls processFolder(). i.e. reloads the image list (decoding only new and changed files) and re-packs everything
+    //! (in the background).
     void reloadAndRepackAll();
 
-    //! Calls pack(), and updateViewWidgets(), using the currently loaded image list. Used if the image list is up-to-date.
+    //! Re-packs (in the background) using the currently loaded image list. Used if the image list is up-to-date.
     void repackAll();
 
-    //! Loads buncher json settings file from current folder. If none exists, returns false.
+    //! Loads buncher json settings file from current folder into the widgets. If none exists, returns false.
+    /*! The file is saved with each export (see SheetBuilder::exportFiles).
+     */
     bool loadJsonSettings();
 
-    //! Saves buncher json settings file for the current folder. These store the sheet data, current packing method, and so on.
-    void saveJsonSettings();
+    //! Returns the settings currently chosen in the widgets.
+    BuncherSettings uiSettings() const;
+
+    //! Sets the widgets to show the given settings (without triggering any repacking).
+    void applySettings( const BuncherSettings &settings );
 
     //! Opens the requested image folder.
     /*! \param path - full path of folder to load.
@@ -150,64 +155,125 @@ protected:
     */
     void openFolder( const QString &path, bool ignoreIfCurrent = true, bool loadSettings = true );
 
-    //! Loads images from the opened folder, ready for packing. Files are sorted based on packing method settings.
+    //! Reloads images from the opened folder, then packs them (in the background). Files are sorted based on packing method settings.
+    //! Only new and changed files are decoded (see SheetBuilder::reloadSprites).
     /*! Note - UI has user option to load subfolders.
       * \see openFolder, to open the folder.
      */
     void processFolder();
 
-    //! Starts the packing, based on current method and settings. Previous packing rect data will be lost.
-    /*!
-     * \return The number of sprites that failed to pack. Anything non-zero means we failed to pack all the images.
+    //! Asks for the sprites to be packed (and optionally reloaded first) in the background, with the current widget settings.
+    /*! Loading and packing run on a worker thread, so the UI stays responsive (the preview renders itself in the background too).
+     *  Requests are coalesced: the job starts after a short delay (restarted by each request), and a request made
+     *  while a job is running cancels it, so only the latest settings get packed. Results are shown by packingFinished().
+     * \param reload - set to reload the images from the folder first.
+     */
+    void startPacking( bool reload );
+
+    //! The results of a background packing job.
+    struct PackedPreview {
+        //! Constructor.
+        PackedPreview();
+        //! A copy of the main builder, with the new packing.
+        SheetBuilder builder;
+        //! The job reloaded the images.
+        bool reload;
+        //! The job was cancelled, its results are incomplete.
+        bool cancelled;
+        //! Number of sprites that failed to pack.
+        int nfails;
+    };
+
+    //! Runs a packing job. Runs in a worker thread.
+    /*! \param builder - a copy of the main builder, with the settings to use.
+     *  \param reload - set to reload the images first.
+     *  \param cancel - work stops as soon as this is set.
      */
-    int pack();
+    static PackedPreview packInBackground( SheetBuilder builder, bool reload, const QAtomicInt *cancel );
 
-    //! Returns the current image format as a QImage format id (be careful, they use different enum values).
-    QImage::Format currentQImageFormat() const;
+    //! Returns the sheet-wide settings the preview depends on. If any of these change the preview is rebuilt from scratch.
+    static QVector<int> previewKey( const SheetBuilder &builder, int nfails, bool darkTheme );
 
-    //! Renders the current sheet to an image, based on current format and settings.
-    /*!
-     * \return The QImage, with current color-depth setting.
+    //! Shows the number of sprites packed (or failed) in the status widgets, and enables export if they all fit.
+    void showPackStatus( int nfails );
+
+    //! Returns the memory held by the sprites, the sheet preview and the list icons.
+    MemoryUsage memoryUsage() const;
+
+    //! Returns a function that renders areas of the builder's sheet for the preview, from its own copy of the builder.
+    static SheetPreviewItem::RenderFunction previewRenderer( const SheetBuilder &builder );
+
+    //! Sheets with more pixels than this are not shown in the preview (they can still be exported).
+    /*! The preview keeps only the downsampled levels, a third of the sheet's pixels, so this holds it to about 85 MB.
      */
-    QImage renderSheet();
+    static const qint64 MaxPreviewPixels = qint64( 8192 ) * 8192;
+
+    //! Milliseconds to wait for further setting changes before packing (e.g. while a spin box is being scrubbed).
+    static const int PackDelay = 50;
 
     //! Repopulates the listWidget and GraphicsView widgets to display the current packing sprites.
-    /*!
+    /*! Only sprites that moved, rotated or changed pixels since the previous call get updated, unless a sheet-wide
+     *  setting changed (size, format etc), in which case everything is rebuilt.
      * \param nfails passes in the number of failed packing sprites, so widgets can display fail status.
      */
     void updateViewWidgets( int nfails = 0 );
 
-    //! Contains current list of packing sprites. Packing rects will be valid only after pack() is called.
+    //! Brings the sheet preview's sprite data and the listWidget into line with the current packing data.
     /*!
-     * \see PackSprite class for more details.
+     * \return The sheet areas that changed since the previous call, i.e. the parts of the sheet needing a re-render.
      */
-    QList<PackSprite> packedsprites;
+    QRegion syncPreviewSprites();
 
-    //! Stores main sheet properties.
-    SheetProperties sheetProp;
-
-    //! Output file name (without extension).
-    QString outFilen;
-    //! Input folder name.
-    QString inDirn;
-    //! Output folder name.
-    /*! Currently, this is always set internally to be the "buncher" dir inside the input folder.
-    */
-    QString outDirn;
-    //! File name for this folders local settings, which gets written to outDirn.
-    /*! Currently, this is hardcoded to be the "buncher.data" file.
+    //! Loads, packs, renders and exports the sprites, using the settings from the widgets (see uiSettings()).
+    /*! It holds the current folder, the list of packing sprites and the sheet properties.
      */
-    QString jsonFilen;
+    SheetBuilder builder;
 
 private:
 
     //! UI form object.
     Ui::MainWindow *ui;
 
-    //! graphicsview background item (gets hidden for export).
+    //! graphicsview background item.
     QGraphicsRectItem *canvasBG;
-    //! graphicsview full sheet image (gets hidden for export).
-    QGraphicsPixmapItem *canvasSheet;
+    //! graphicsview tiled preview of the rendered sheet. It also handles sprite selection.
+    SheetPreviewItem *canvasSheet;
+
+    //! What the preview last showed for one sprite, so the next update can tell what changed.
+    struct PreviewEntry {
+        //! Sheet area covered by the sprite, including any extrusion.
+        QRect area;
+        //! Rotation status.
+        bool rotated;
+        //! Pixel key of the sprite (see PackSprite::pixelKey).
+        quint64 pixelKey;
+    };
+    //! Preview entries for all sprites currently on the canvas, keyed by file path.
+    QHash<QString, PreviewEntry> previewEntries;
+    //! Names shown in the listWidget, in list order.
+    QStringList previewNames;
+    //! Bytes held by the listWidget icons (full size copies of the original images).
+    qint64 iconBytes;
+    //! Sheet-wide settings the preview was built with. If any of these change the preview is rebuilt from scratch.
+    QVector<int> previewSheetKey;
+
+    //! Menu of extra data formats, one checkable action per format (the action data is the format id).
+    QMenu *extraFormatsMenu;
+
+    //! Watches the background packing job.
+    QFutureWatcher<PackedPreview> packWatcher;
+    //! Set to cancel the background packing job.
+    QAtomicInt packCancel;
+    //! Single shot timer that coalesces packing requests (see startPacking).
+    QTimer packTimer;
+    //! A packing request is waiting - the running job (if any) is out of date.
+    bool packPending;
+    //! The next packing job must reload the images.
+    bool packReload;
+    //! Zoom to fit once the next packing job is shown (e.g. after opening a folder).
+    bool packZoomToFit;
+    //! Number of sprites that failed in the packing currently shown.
+    int packFails;
 
     //! Flag for custom ui skin.
     /*! \see mainStyleSheet
@@ -23,7 +23,9 @@ using namespace std;
 
 MaxRectsBinPack::MaxRectsBinPack()
 :binWidth(0),
-binHeight(0)
+binHeight(0),
+freeRectsPeak(0),
+pruneTests(0)
 {
 }
 
@@ -48,6 +50,9 @@ void MaxRectsBinPack::Init(int width, int height, bool allowRot )
 
 	freeRectangles.clear();
 	freeRectangles.push_back(n);
+
+	freeRectsPeak = 1;
+	pruneTests = 0;
 }
 
 Rect MaxRectsBinPack::Insert(int width, int height, FreeRectChoiceHeuristic method)
@@ -499,10 +504,14 @@ void MaxRectsBinPack::PruneFreeList()
 		}
 	*/
 
+	if (freeRectangles.size() > freeRectsPeak)
+		freeRectsPeak = freeRectangles.size();
+
 	/// Go through each pair and remove any rectangle that is redundant.
 	for(size_t i = 0; i < freeRectangles.size(); ++i)
 		for(size_t j = i+1; j < freeRectangles.size(); ++j)
 		{
+			++pruneTests;
 			if (IsContainedIn(freeRectangles[i], freeRectangles[j]))
 			{
 				freeRectangles.erase(freeRectangles.begin()+i);
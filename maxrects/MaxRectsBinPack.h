@@ -52,6 +52,14 @@ public:
 	/// Computes the ratio of used surface area to the total bin area.
 	float Occupancy() const;
 
+	/// [BRS] added counters, for performance stats. All are reset by Init.
+	/// @return The number of rectangles placed.
+	size_t NumInserts() const { return usedRectangles.size(); }
+	/// @return The most free rectangles there have been at once (measured before each prune).
+	size_t FreeRectsPeak() const { return freeRectsPeak; }
+	/// @return The number of containment tests done while pruning the free list.
+	unsigned long long PruneTests() const { return pruneTests; }
+
 private:
 	int binWidth;
 	int binHeight;
@@ -60,6 +68,9 @@ private:
 	std::vector<Rect> usedRectangles;
 	std::vector<Rect> freeRectangles;
 
+	size_t freeRectsPeak; // [BRS] added counters.
+	unsigned long long pruneTests;
+
 	/// Computes the placement score for placing the given rectangle with the given method.
 	/// @param score1 [out] The primary placement score will be outputted here.
 	/// @param score2 [out] The secondary placement score will be outputted here. This isu sed to break ties.
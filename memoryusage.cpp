@@ -0,0 +1,152 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "memoryusage.h"
+
+#include <QStringList>
+#include <algorithm>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+int MemoryUsage::NumCategories = 6; // --> Keep this up-to-date when adding categories! (and categoryName, and the array size in the header)
+
+MemoryUsage::MemoryUsage()
+{
+    clear();
+}
+
+void MemoryUsage::clear()
+{
+    for (int i = 0; i < NumCategories; ++i)
+        m_bytes[i] = 0;
+}
+
+void MemoryUsage::add( Categories category, qint64 bytes )
+{
+    m_bytes[category] += bytes;
+}
+
+void MemoryUsage::setPeak( Categories category, qint64 bytes )
+{
+    m_bytes[category] = qMax( m_bytes[category], bytes );
+}
+
+void MemoryUsage::add( const MemoryUsage &other )
+{
+    for (int i = 0; i < NumCategories; ++i) {
+        if ( i == MEM_ENCODER )
+            m_bytes[i] = qMax( m_bytes[i], other.m_bytes[i] ); // (exports don't overlap in one builder, folders' might)
+        else
+            m_bytes[i] += other.m_bytes[i];
+    }
+}
+
+qint64 MemoryUsage::bytes( Categories category ) const
+{
+    return m_bytes[category];
+}
+
+qint64 MemoryUsage::total() const
+{
+    qint64 sum = 0;
+    for (int i = 0; i < NumCategories; ++i)
+        sum += m_bytes[i];
+    return sum;
+}
+
+QJsonObject MemoryUsage::toJson() const
+{
+    QJsonObject categories;
+    for (int i = 0; i < NumCategories; ++i)
+        categories.insert( categoryName( Categories( i )), double( m_bytes[i] ));
+    QJsonObject obj;
+    obj.insert( "bytes", categories );
+    obj.insert( "total", double( total() ));
+    obj.insert( "peakRss", double( PeakRss() ));
+    return obj;
+}
+
+QString MemoryUsage::summary() const
+{
+    QList<int> order;
+    for (int i = 0; i < NumCategories; ++i) {
+        if ( m_bytes[i] > 0 )
+            order.append( i );
+    }
+    std::stable_sort( order.begin(), order.end(), [this]( int a, int b ) { return m_bytes[a] > m_bytes[b]; });
+    QStringList parts;
+    foreach ( int i, order )
+        parts.append( categoryName( Categories( i )) + " " + FormatBytes( m_bytes[i] ));
+    qint64 rss = PeakRss();
+    if ( rss > 0 )
+        parts.append( "peak RSS " + FormatBytes( rss ));
+    return parts.join( ", " );
+}
+
+QString MemoryUsage::categoryName( Categories category )
+{
+    switch ( category ) {
+    case MEM_ORIGINALS: return "originals";
+    case MEM_TRANSFORMED: return "transformed";
+    case MEM_PREVIEW: return "preview";
+    case MEM_ICONS: return "icons";
+    case MEM_SHEET: return "sheet";
+    case MEM_ENCODER: return "encoder";
+    }
+    return QString();
+}
+
+qint64 MemoryUsage::ImageBytes( const QImage &image )
+{
+    return qint64( image.bytesPerLine() ) * image.height();
+}
+
+qint64 MemoryUsage::PeakRss()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters )))
+        return qint64( counters.PeakWorkingSetSize );
+    return 0;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+        return 0;
+#if defined(Q_OS_MAC)
+    return qint64( usage.ru_maxrss ); // (bytes on mac)
+#else
+    return qint64( usage.ru_maxrss ) * 1024; // (kB elsewhere)
+#endif
+#else
+    return 0;
+#endif
+}
+
+QString MemoryUsage::FormatBytes( qint64 bytes )
+{
+    if ( bytes >= qint64( 1 ) << 30 )
+        return QString( "%1 GB" ).arg( bytes / double( qint64( 1 ) << 30 ), 0, 'f', 1 );
+    if ( bytes >= 1 << 20 )
+        return QString( "%1 MB" ).arg( bytes / double( 1 << 20 ), 0, 'f', 1 );
+    return QString( "%1 KB" ).arg( ( bytes + 1023 ) / 1024 );
+}
@@ -0,0 +1,77 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <QImage>
+#include <QJsonObject>
+#include <QString>
+
+//! Bytes of pixel data held, by what they're held for, plus the process's peak RSS.
+/*! A snapshot, filled in by whoever holds the data (see SheetBuilder::memoryUsage() for the sprites, and MainWindow for
+ *  the preview), so budgets can be set from real numbers. Images that share data (QImage is implicitly shared) are
+ *  counted once, in the first category that holds them. Encoder buffers are a peak over the last export, as they're
+ *  gone by the time anyone asks.
+ */
+class MemoryUsage
+{
+public:
+    //! What the bytes are held for. Names are used in the json report - keep categoryName() up to date.
+    enum Categories { MEM_ORIGINALS = 0, MEM_TRANSFORMED, MEM_PREVIEW, MEM_ICONS, MEM_SHEET, MEM_ENCODER };
+    //! Number of categories defined in Categories.
+    static int NumCategories;
+
+    //! Constructor. Everything starts at zero.
+    MemoryUsage();
+
+    //! Sets everything back to zero.
+    void clear();
+
+    //! Adds bytes to a category.
+    void add( Categories category, qint64 bytes );
+    //! Raises a category to bytes, if it's lower (for peaks).
+    void setPeak( Categories category, qint64 bytes );
+    //! Adds another snapshot to this one (e.g. a folder's sprites to the UI's own).
+    void add( const MemoryUsage &other );
+
+    //! Returns the bytes held in a category.
+    qint64 bytes( Categories category ) const;
+    //! Returns the bytes held in all categories.
+    qint64 total() const;
+
+    //! Returns the usage as json: {"bytes": {"originals": 1234, ...}, "total": 5678, "peakRss": 91011}.
+    QJsonObject toJson() const;
+    //! Returns a one line summary, largest categories first, e.g. for a status bar.
+    QString summary() const;
+
+    //! Returns a category's name.
+    static QString categoryName( Categories category );
+    //! Returns the bytes of pixel data an image holds.
+    static qint64 ImageBytes( const QImage &image );
+    //! Returns the peak resident set size of the process so far, in bytes (0 if the platform can't tell).
+    static qint64 PeakRss();
+    //! Returns bytes in a readable form, e.g. "1.5 GB".
+    static QString FormatBytes( qint64 bytes );
+
+protected:
+    //! Bytes per category.
+    qint64 m_bytes[MEM_ENCODER + 1];
+};
+
+#endif // MEMORYUSAGE_H
@@ -18,12 +18,44 @@
 
 #include <QDebug>
 #include "packer.h"
+#include "trace.h"
+
+namespace {
+
+// Rounds v up / down to a multiple of align (align >= 1).
+int AlignUp( int v, int align )
+{
+    return ( ( v + align - 1 ) / align ) * align;
+}
+
+int AlignDown( int v, int align )
+{
+    return v > 0 ? ( v / align ) * align : v;
+}
+
+// Offset added to packed positions so that packed pos + start lands on a multiple of align.
+int AlignOffset( int start, int align )
+{
+    return ( align - start % align ) % align;
+}
+
+// Space reserved for a sprite of the given size: with block alignment, its extruded pixels are rounded up to whole
+// blocks before the padding is added, so no block holds pixels or extrusion from two sprites.
+int AlignedSpace( int size, int padding, int extrude, int align )
+{
+    if ( align <= 1 )
+        return size + padding + extrude*2;
+    return AlignUp( AlignUp( size + extrude*2, align ) + padding, align );
+}
+
+}
 
 int Packer::MaxRects( const SheetProperties &sheetProp, QList<PackSprite> &packedsprites,
                       rbp::MaxRectsBinPack::FreeRectChoiceHeuristic heuristic,
                       bool allowRotation, bool allowCrop, int expandSprites,
-                      int extrude, qreal scaleSprites )
+                      int extrude, qreal scaleSprites, int blockAlign, const QAtomicInt *cancel, Stats *stats )
 {
+    Trace::Span span( "maxrects", "pack" );
     // Reset previous rect data, incl rotation and cropping.
     for (int i = 0; i < packedsprites.size(); ++i) {
         packedsprites[i].resetForPacking();
@@ -35,56 +67,83 @@ int Packer::MaxRects( const SheetProperties &sheetProp, QList<PackSprite> &packe
     int rpad = sheetProp.padding + extrude*2;
     int rbord = sheetProp.border + extrude;
 
+    // with block alignment, the bin works in whole blocks and is shifted so each sprite's extrusion (which the renderer
+    // paints before the sprite rect) starts on a block boundary:
+    int off = AlignOffset( sheetProp.border - extrude, blockAlign );
+
     rbp::MaxRectsBinPack bin;
-    bin.Init( sheetProp.width - 2*rbord, sheetProp.height - 2*rbord, allowRotation ); // note - border area is removed for packing.
+    bin.Init( AlignDown( sheetProp.width - 2*rbord - off, blockAlign ),
+              AlignDown( sheetProp.height - 2*rbord - off, blockAlign ), allowRotation ); // note - border area is removed for packing.
     for (int i = 0; i < packedsprites.size(); ++i) {
-        // This is the last chance to modifiy (e.g. crop, extend) pixmaps before they get packed.
-        QPixmap px;
+        if ( cancel && cancel->load() )
+            return -1;
+        // This is the last chance to modifiy (e.g. crop, extend) images before they get packed.
+        QSize px; // (only the size is needed - sprites in a pixel cache don't have to fetch their pixels)
         // Do any scaling first:
-        if ( qAbs(scaleSprites - 1.0 ) > 0.001 )
-            packedsprites[i].scalePixmap( scaleSprites );
+        if ( qAbs(scaleSprites - 1.0 ) > 0.001 ) {
+            Stats::Timer timer( stats, Stats::STAGE_SCALE );
+            packedsprites[i].scaleImage( scaleSprites );
+        }
         // Cropping next:
-        if ( allowCrop )
-            packedsprites[i].cropPixmap();
+        if ( allowCrop ) {
+            Stats::Timer timer( stats, Stats::STAGE_CROP );
+            packedsprites[i].cropImage();
+            if ( stats && packedsprites[i].isCropped() )
+                stats->addCount( Stats::COUNT_CROPPED );
+        }
         // Expand sprites. Obviously, must be after cropping!
         if ( expandSprites > 0 )
-            packedsprites[i].expandPixmap( expandSprites );
+            packedsprites[i].expandImage( expandSprites );
 
-        px = packedsprites[i].pixmap();
+        px = packedsprites[i].size();
 
-        if ( !px.isNull()  && px.width() > 0 && px.width() > 0 )
+        if ( !px.isEmpty() )
         {
             // MaxRects does the hard work:
-            rbp::Rect packedRect = bin.Insert( px.width() + rpad, px.height() + rpad, heuristic); // note - packed rects must include the padding
+            int rw = AlignedSpace( px.width(), sheetProp.padding, extrude, blockAlign ); // note - packed rects must include the padding
+            int rh = AlignedSpace( px.height(), sheetProp.padding, extrude, blockAlign );
+            rbp::Rect packedRect = bin.Insert( rw, rh, heuristic);
+
+            // need to check for rotated packed rect and set the image to match.
+            bool rotated = ( rw != rh && packedRect.height > 0 && packedRect.width == rh );
+            if ( packedRect.height > 0 ) {
+                // store the sprite's own size, not the block-rounded space reserved for it.
+                packedRect.x += off;
+                packedRect.y += off;
+                packedRect.width = ( rotated ? px.height() : px.width() ) + rpad;
+                packedRect.height = ( rotated ? px.width() : px.height() ) + rpad;
+            }
             packedsprites[i].setPackedRect( packedRect ); // will be zero size rect if didnt pack.
-
-            // need to check for rotated packed rect and set the pixmap to match.
-            if ( ( px.width() > px.height() && packedRect.width < packedRect.height ) ||
-                 ( px.width() < px.height() && packedRect.width > packedRect.height ) )
-            {
+            if ( rotated )
                 packedsprites[i].setIsRotated( true );
-            }
 
             if (packedRect.height > 0) {
-                qDebug() << "Packed to " <<  packedRect.x << " " << packedRect.y << " w:"
+                qCDebug( spriteLog ) << "Packed to " <<  packedRect.x << " " << packedRect.y << " w:"
                          << packedRect.width << " h:" << packedRect.height << " free space=" << 100.f - bin.Occupancy()*100.f;
                 validitems++;
             }
             else{
-                qDebug() << "Could not pack this rect - skipping this one.\n";
+                qCDebug( spriteLog ) << "Could not pack this rect - skipping this one.\n";
                 failitems++;
             }
         }
         else{
-            ignoreditems++; // (wasn't a valid pixmap file)
+            ignoreditems++; // (wasn't a valid image file)
         }
     }
+    if ( stats ) {
+        stats->addCount( Stats::COUNT_INSERTS, qint64( bin.NumInserts() ));
+        stats->setPeak( Stats::COUNT_FREE_RECTS_PEAK, qint64( bin.FreeRectsPeak() ));
+        stats->addCount( Stats::COUNT_PRUNE_TESTS, qint64( bin.PruneTests() ));
+    }
     return failitems;
 }
 
 int Packer::Rows( const SheetProperties &sheetProp, QList<PackSprite> &packedsprites,  bool allowRotation,
-                  bool allowCrop, int expandSprites, int extrude, qreal scaleSprites )
+                  bool allowCrop, int expandSprites, int extrude, qreal scaleSprites, int blockAlign,
+                  const QAtomicInt *cancel, Stats *stats )
 {
+    Trace::Span span( "rows", "pack" );
     Q_UNUSED( allowRotation ) // rot currently not supported, but we could...
 
     // Reset previous rect data, incl rotation and cropping.
@@ -102,76 +161,91 @@ int Packer::Rows( const SheetProperties &sheetProp, QList<PackSprite> &packedspr
     // we add space for extrusion on each side onto the sheet's padding and border settings:
     int rpad = sheetProp.padding + extrude*2;
     int rbord = sheetProp.border + extrude;
+    int off = AlignOffset( sheetProp.border - extrude, blockAlign ); // (see MaxRects)
+    int binw = AlignDown( sheetProp.width - 2*rbord - off, blockAlign );
+    int binh = AlignDown( sheetProp.height - 2*rbord - off, blockAlign );
 
     for (int i = 0; i < packedsprites.size(); ++i) {
-        QPixmap px;
+        if ( cancel && cancel->load() )
+            return -1;
+        QSize px;
         // Do any scaling first:
-        if ( qAbs(scaleSprites - 1.0 ) > 0.001 )
-            packedsprites[i].scalePixmap( scaleSprites );
+        if ( qAbs(scaleSprites - 1.0 ) > 0.001 ) {
+            Stats::Timer timer( stats, Stats::STAGE_SCALE );
+            packedsprites[i].scaleImage( scaleSprites );
+        }
         // Cropping next:
-        if ( allowCrop )
-            packedsprites[i].cropPixmap();
+        if ( allowCrop ) {
+            Stats::Timer timer( stats, Stats::STAGE_CROP );
+            packedsprites[i].cropImage();
+            if ( stats && packedsprites[i].isCropped() )
+                stats->addCount( Stats::COUNT_CROPPED );
+        }
         // Expand sprites. Obviously, must be after cropping!
         if ( expandSprites > 0 )
-            packedsprites[i].expandPixmap( expandSprites );
+            packedsprites[i].expandImage( expandSprites );
 
-        px = packedsprites[i].pixmap();
+        px = packedsprites[i].size();
 
-        if ( !px.isNull()  && px.width() > 0 && px.width() > 0 )
+        if ( !px.isEmpty() )
         {
             rbp::Rect packedRect;
+            int rw = AlignedSpace( px.width(), sheetProp.padding, extrude, blockAlign );
+            int rh = AlignedSpace( px.height(), sheetProp.padding, extrude, blockAlign );
             // see if it fits on current row.
-            if ( sheetx + px.width() + rpad < sheetProp.width - 2*rbord ){
+            if ( sheetx + rw < binw ){
                 // ok, it fits in x, now check it doesnt flow beyond y space. If so, invalidate the rect size.
-                if ( sheety + px.height() + rpad > sheetProp.height - 2*rbord ){
+                if ( sheety + rh > binh ){
                     packedRect.height = 0;
                     packedRect.width = 0;
-                    qDebug() << "Doesnt fit in y - could not pack this rectangle.\n";
+                    qCDebug( spriteLog ) << "Doesnt fit in y - could not pack this rectangle.\n";
                 }
                 else{
                     // it fits - update the sheet data.
-                    packedRect.x = sheetx;
-                    packedRect.y = sheety;
+                    packedRect.x = sheetx + off;
+                    packedRect.y = sheety + off;
                     packedRect.height = px.height() + rpad;
                     packedRect.width = px.width() + rpad;
-                    sheetx += px.width() + rpad;
-                    if ( packedRect.height > rowhgt )
-                        rowhgt = packedRect.height;
+                    sheetx += rw;
+                    if ( rh > rowhgt )
+                        rowhgt = rh;
                 }
             }
             else{ // try a new row. first check it would fit in new space. If not, invalidate the rect size.
-                if ( px.height() + sheety + rowhgt + rpad > sheetProp.height - 2*rbord || // ie cant fit in remaining y space
-                     px.width()  + rpad > sheetProp.width - 2*rbord ){ // ie wider than any x space avail
+                if ( rh + sheety + rowhgt > binh || // ie cant fit in remaining y space
+                     rw > binw ){ // ie wider than any x space avail
                     packedRect.height = 0;
                     packedRect.width = 0;
-                    qDebug() << "Tried new row - but could not pack this rectangle.\n";
+                    qCDebug( spriteLog ) << "Tried new row - but could not pack this rectangle.\n";
                 }
                 else{ // ok, add it on new row
                     // qDebug() << "New row for img " << px.width() << " x " << px.height();
                     sheetx = 0;
                     sheety += rowhgt;
-                    packedRect.x = sheetx;
-                    packedRect.y = sheety;
+                    packedRect.x = sheetx + off;
+                    packedRect.y = sheety + off;
                     packedRect.height = px.height() + rpad;
                     packedRect.width = px.width() + rpad;
-                    sheetx += px.width() + rpad;
-                    rowhgt = packedRect.height;
+                    sheetx += rw;
+                    rowhgt = rh;
                 }
             }
             packedsprites[i].setPackedRect( packedRect ); // will be zero size rect if didnt pack.
             if (packedRect.height > 0 && packedRect.width > 0) {
-                // qDebug() << "Packed to " <<  packedRect.x << " " << packedRect.y << " w:" << packedRect.width << " h:" << packedRect.height;
+                // qCDebug( spriteLog ) << "Packed to " <<  packedRect.x << " " << packedRect.y << " w:" << packedRect.width << " h:" << packedRect.height;
                 validitems++;
             }
             else{
-                qDebug() << "Could not pack this rectangle - skipping this one.\n";
+                qCDebug( spriteLog ) << "Could not pack this rectangle - skipping this one.\n";
                 failitems++;
             }
         }
         else{
-            ignoreditems++; // (wasn't a valid pixmap file)
+            ignoreditems++; // (wasn't a valid image file)
         }
     }
+    if ( stats )
+        stats->addCount( Stats::COUNT_INSERTS, validitems );
 
     return failitems;
 }
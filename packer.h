@@ -20,10 +20,12 @@
 #define PACKER_H
 
 #include <QList>
-#include <QPixmap>
+#include <QImage>
+#include <QAtomicInt>
 #include "packsprite.h"
 #include "./maxrects/MaxRectsBinPack.h"
-#include "mainwindow.h"
+#include "sheetproperties.h"
+#include "stats.h"
 
 //! Methods that performs sprite packing. Add new algorithms as required.
 /*! Mostly static functions. Note, the rbp::Rect data structure is used throughout, so that
@@ -42,12 +44,17 @@ public:
      *  \param expandSprites - expands sprites on all sides by the chosen number of pixels.
      *  \param extrude - should equal the extrusion size already applied (so it gets added to the padding).
         \param scaleSprites - scales sprites by this amount. Default 1.0.
-        \returns number of valid items that were packed.
+        \param blockAlign - sprite rects start on, and reserve space in, multiples of this many pixels
+               (e.g. 4 so compressed texture blocks are never shared by two sprites). Default 1 (off).
+        \param cancel - if not null, packing stops as soon as this is set (checked before each sprite).
+        \param stats - if not null, the scale and crop times, and the bin's insert and free rect counts, are added to it.
+        \returns number of items that failed to pack, or -1 if cancelled.
     */
     static int MaxRects( const SheetProperties &sheetProp, QList<PackSprite> &packedsprites,
                          rbp::MaxRectsBinPack::FreeRectChoiceHeuristic heuristic = rbp::MaxRectsBinPack::RectBestAreaFit,
                          bool allowRotation = false, bool allowCrop = false, int expandSprites = 0,
-                         int extrude = 0, qreal scaleSprites = 1.0 );
+                         int extrude = 0, qreal scaleSprites = 1.0, int blockAlign = 1, const QAtomicInt *cancel = 0,
+                         Stats *stats = 0 );
 
     //! Simple packing method using equal height rows ('shelves'). List is modified. Items are packed in order.
     /*! \param sheetProp - the sheet properties.
@@ -57,11 +64,15 @@ public:
      *  \param expandSprites - expands sprites on all sides by the chosen number of pixels.
      *  \param extrude - should equal the extrusion size already applied (so it gets added to the padding).
         \param scaleSprites - scales sprites by this amount. Default 1.0.
-     * \returns number of valid items that were packed.
+        \param blockAlign - sprite rects start on, and reserve space in, multiples of this many pixels. Default 1 (off).
+        \param cancel - if not null, packing stops as soon as this is set (checked before each sprite).
+        \param stats - if not null, the scale and crop times, and the number of inserts, are added to it.
+     * \returns number of items that failed to pack, or -1 if cancelled.
     */
     static int Rows( const SheetProperties &sheetProp, QList<PackSprite> &packedsprites,  bool allowRotation = false,
                      bool allowCrop = false, int expandSprites = 0,
-                      int extrude = 0, qreal scaleSprites = 1.0 );
+                      int extrude = 0, qreal scaleSprites = 1.0, int blockAlign = 1, const QAtomicInt *cancel = 0,
+                      Stats *stats = 0 );
 
 };
 
@@ -0,0 +1,91 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "packjob.h"
+#include "sheetbuilder.h"
+#include "sheetrenderer.h"
+
+#include <QtDebug>
+
+PackResult::PackResult()
+{
+    failed = 0;
+    sheet.width = 0;
+    sheet.height = 0;
+    sheet.padding = 0;
+    sheet.border = 0;
+}
+
+PackJob::PackJob( const BuncherSettings &settings )
+{
+    m_settings = settings;
+    m_renderImage = true;
+}
+
+void PackJob::setSettings( const BuncherSettings &settings )
+{
+    m_settings = settings;
+}
+
+const BuncherSettings& PackJob::settings() const
+{
+    return m_settings;
+}
+
+void PackJob::addSprite( const QString &name, const QImage &image )
+{
+    if ( image.isNull() )
+        return;
+    m_names.append( name );
+    m_images.append( image );
+}
+
+int PackJob::spriteCount() const
+{
+    return m_images.size();
+}
+
+void PackJob::setRenderImage( bool render )
+{
+    m_renderImage = render;
+}
+
+PackResult PackJob::run() const
+{
+    SheetBuilder builder;
+    builder.setSettings( m_settings );
+    for (int i = 0; i < m_images.size(); ++i)
+        builder.addSprite( m_names[i], m_images[i] );
+
+    PackResult result;
+    result.failed = builder.pack();
+    result.sheet = builder.sheetProperties();
+    result.sheet.imageName = m_settings.baseName + m_settings.imageExtension();
+    result.sheet.pixelFormat = m_settings.pixelFormatName();
+    result.sprites = builder.sprites();
+    result.rects.resize( result.sprites.size() );
+    for (int i = 0; i < result.sprites.size(); ++i)
+        result.rects[i] = SheetRenderer::SpriteRect( result.sprites[i], result.sheet );
+    if ( m_renderImage && result.failed == 0 ) {
+        result.image = builder.renderSheet();
+        if ( result.image.isNull() )
+            qWarning() << "PackJob - out of memory rendering the sheet";
+    }
+    return result;
+}
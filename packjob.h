@@ -0,0 +1,101 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PACKJOB_H
+#define PACKJOB_H
+
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "bunchersettings.h"
+#include "packsprite.h"
+#include "sheetproperties.h"
+
+//! The result of a PackJob.
+struct PackResult
+{
+    //! Constructor.
+    PackResult();
+
+    //! Number of sprites that didn't fit on the sheet (their rects are empty). Anything non-zero means the packing failed.
+    int failed;
+    //! Sheet properties of the packing, with the image name and pixel format filled in, ready for DataExporter::Export.
+    SheetProperties sheet;
+    //! The sprites in packing order, with their packed rects (as DataExporter::Export wants them).
+    QList<PackSprite> sprites;
+    //! The layout - each sprite's pixel rect on the sheet, in the same order as sprites (empty if it didn't fit).
+    QVector<QRect> rects;
+    //! The rendered sheet, in the chosen image format. Null if the packing failed or rendering was turned off.
+    /*! Block-compressed and indexed formats come out as their ARGB32 source; encoding them is up to the caller
+     *  (see TextureWriter and ColorQuantizer).
+     */
+    QImage image;
+};
+
+//! A self-contained packing job: settings and sprite images in, layout and sheet image out.
+/*! Jobs don't read or write any files, and share no state, so they can be run on any thread - any number at once.
+ *  For a whole folder, including loading and export, see SheetBuilder (which this uses to do the work).
+ *  \code
+ *  PackJob job( settings );
+ *  job.addSprite( "hero.png", heroImage );
+ *  PackResult result = job.run();
+ *  \endcode
+ */
+class PackJob
+{
+public:
+    //! Constructor.
+    explicit PackJob( const BuncherSettings &settings = BuncherSettings() );
+
+    //! Sets the packing, rendering and image format settings (folder and export settings are ignored).
+    void setSettings( const BuncherSettings &settings );
+    //! Returns the settings.
+    const BuncherSettings& settings() const;
+
+    //! Adds a sprite to pack.
+    /*! \param name - the sprite's name, as written in the data files.
+     *  \param image - the sprite's pixels. Null images are ignored.
+     */
+    void addSprite( const QString &name, const QImage &image );
+    //! Returns the number of sprites added.
+    int spriteCount() const;
+
+    //! Sets whether run() renders the sheet image (default true). Turn off if only the layout is needed.
+    void setRenderImage( bool render );
+
+    //! Packs the sprites, and renders the sheet if all of them fit.
+    PackResult run() const;
+
+protected:
+
+    //! The settings.
+    BuncherSettings m_settings;
+    //! Sprite names, in the order added.
+    QStringList m_names;
+    //! Sprite images, matching m_names.
+    QList<QImage> m_images;
+    //! Render the sheet image.
+    bool m_renderImage;
+};
+
+#endif // PACKJOB_H
@@ -16,25 +16,142 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <QGraphicsPixmapItem>
 #include <QPainter>
 #include <QDebug>
 #include "packsprite.h"
+#include "pixelcache.h"
+#include "stats.h"
 
-PackSprite::PackSprite( const QPixmap &pm, const QFileInfo &fi )
+namespace {
+
+// Returns the bounding rect of the pixels with any alpha, or an empty rect if the image is fully transparent.
+QRect opaqueRect( const QImage &img )
+{
+    int top = -1, bottom = -1, left = img.width(), right = -1;
+    for (int y = 0; y < img.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>( img.constScanLine( y ));
+        int x = 0;
+        while ( x < img.width() && qAlpha( line[x] ) == 0 )
+            x++;
+        if ( x == img.width() )
+            continue; // (fully transparent row)
+        if ( top < 0 )
+            top = y;
+        bottom = y;
+        left = qMin( left, x );
+        // (from the right, we only need to look beyond the current bounds)
+        int xr = img.width() - 1;
+        while ( xr > right && qAlpha( line[xr] ) == 0 )
+            xr--;
+        right = qMax( right, xr );
+    }
+    if ( top < 0 )
+        return QRect();
+    return QRect( QPoint( left, top ), QPoint( right, bottom ));
+}
+
+// Returns the image with npixels of transparency added on each side.
+QImage expanded( const QImage &img, int npixels )
 {
-    setPixmap( pm );
-    m_pm_original = m_pm; // ?.copy();
+    QImage newimg( img.width() + 2*npixels, img.height() + 2*npixels, QImage::Format_ARGB32_Premultiplied );
+    newimg.fill(Qt::transparent);
+    QPainter painter( &newimg );
+    painter.setCompositionMode( QPainter::CompositionMode_Source );
+    painter.drawImage( npixels, npixels, img );
+    painter.end();
+    return newimg;
+}
+
+}
+
+PackSprite::PackSprite( const QImage &img, const QFileInfo &fi )
+{
+    setImage( img.convertToFormat( QImage::Format_ARGB32_Premultiplied ));
+    m_img_original = m_img;
+    m_originalSize = m_size;
+    m_originalKey = quint64( m_img_original.cacheKey() );
     m_fi = fi;
+    m_fileName = fi.fileName();
+    m_fileSize = -1;
+    m_rotated = false;
+    m_isCropped = false;
+    m_isExpanded = false;
+    m_isScaled = false;
+    m_scale = 1.0;
+    m_expand = 0;
+    m_cropKey = 0;
+}
+
+PackSprite::PackSprite()
+{
+    m_originalKey = 0;
+    m_fileSize = -1;
     m_rotated = false;
     m_isCropped = false;
     m_isExpanded = false;
+    m_isScaled = false;
+    m_scale = 1.0;
+    m_expand = 0;
+    m_cropKey = 0;
 }
 
-void PackSprite::setPixmap ( const QPixmap& pm )
+PackSprite::PackSprite( const QSize &size, const QString &name )
 {
-    m_pm = pm;
-    //qDebug() << "setPixmap.  size is " << pixmap().width() << pixmap().height();
+    m_size = size;
+    m_originalSize = size;
+    m_originalKey = 0;
+    m_fi = QFileInfo( name );
+    m_fileName = m_fi.fileName();
+    m_fileSize = -1;
+    m_rotated = false;
+    m_isCropped = false;
+    m_isExpanded = false;
+    m_isScaled = false;
+    m_scale = 1.0;
+    m_expand = 0;
+    m_cropKey = 0;
+}
+
+void PackSprite::setFileStamp( qint64 size, const QDateTime &modified )
+{
+    m_fileSize = size;
+    m_fileModified = modified;
+}
+
+qint64 PackSprite::fileSize() const
+{
+    return m_fileSize;
+}
+
+const QDateTime& PackSprite::fileModified() const
+{
+    return m_fileModified;
+}
+
+void PackSprite::setImage( const QImage& img )
+{
+    m_img = img;
+    m_size = img.size();
+    //qDebug() << "setImage.  size is " << image().width() << image().height();
+}
+
+void PackSprite::setPixelCache( const QSharedPointer<PixelCache> &cache )
+{
+    if ( !cache || m_img_original.isNull() )
+        return;
+    if ( !m_isScaled && !m_isCropped && !m_isExpanded && m_cropKey != pixelKey() ) {
+        m_cropRect = opaqueRect( m_img_original );
+        m_cropKey = pixelKey();
+    }
+    m_cache = cache;
+    m_cache->insert( m_originalKey, m_img_original );
+    m_img_original = QImage();
+    m_img = QImage();
+}
+
+const QSharedPointer<PixelCache>& PackSprite::pixelCache() const
+{
+    return m_cache;
 }
 
 void PackSprite::resetForPacking()
@@ -42,43 +159,90 @@ void PackSprite::resetForPacking()
     setPackedRect( rbp::Rect() );
     setIsRotated( false );
     m_isScaled = false;
-    restoreOriginalPixmap();
+    m_scale = 1.0;
+    restoreOriginalImage();
 }
 
-QFileInfo PackSprite::fileInfo() const
+const QFileInfo& PackSprite::fileInfo() const
 {
     return m_fi;
 }
 
-const QPixmap& PackSprite::pixmap() const
+const QString& PackSprite::fileName() const
 {
-    return m_pm;
+    return m_fileName;
 }
 
-const QPixmap& PackSprite::originalPixmap() const
+QImage PackSprite::image() const
 {
-    return m_pm_original;
+    if ( !m_img.isNull() || !m_cache )
+        return m_img;
+    if ( !m_isScaled && !m_isCropped && !m_isExpanded )
+        return originalImage();
+    quint64 key = pixelKey();
+    QImage img = m_cache->find( key );
+    if ( img.isNull() ) {
+        img = originalImage();
+        if ( img.isNull() )
+            return img;
+        if ( m_isScaled )
+            img = img.scaled( m_scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+        if ( m_isCropped )
+            img = img.copy( m_cropArea );
+        if ( m_isExpanded )
+            img = expanded( img, m_expand );
+        m_cache->insert( key, img, true );
+    }
+    return img;
 }
 
-void PackSprite::cropPixmap()
+QImage PackSprite::originalImage() const
 {
-    if ( m_pm.isNull() ) return;
-    // [using  QGraphicsPixmapItem is not fast, but its easier than scanning lines ourselves]
-    QPixmap cropped;
-    QGraphicsPixmapItem pm( m_pm );
-    QRectF opaqueArea = pm.opaqueArea().boundingRect();
-    if ( opaqueArea.isValid() && ( opaqueArea.width() < m_pm.width() || opaqueArea.height() < m_pm.height() ) ) {
-        cropped = m_pm.copy( opaqueArea.x(), opaqueArea.y(), opaqueArea.width(), opaqueArea.height() ); // (deep copy).
+    if ( !m_img_original.isNull() || !m_cache )
+        return m_img_original;
+    return m_cache->original( m_originalKey, m_fi.filePath(), m_originalSize );
+}
+
+QSize PackSprite::size() const
+{
+    return m_size;
+}
+
+QSize PackSprite::originalSize() const
+{
+    return m_originalSize;
+}
+
+bool PackSprite::isNull() const
+{
+    return m_originalSize.isEmpty();
+}
+
+void PackSprite::cropImage()
+{
+    if ( m_size.isEmpty() ) return;
+    quint64 key = pixelKey();
+    if ( m_cropKey != key ) {
+        QImage img = image();
+        if ( img.isNull() ) return;
+        m_cropRect = opaqueRect( img );
+        m_cropKey = key;
+    }
+    QRect opaqueArea = m_cropRect;
+    if ( opaqueArea.isValid() && ( opaqueArea.width() < m_size.width() || opaqueArea.height() < m_size.height() ) ) {
+        if ( !m_img.isNull() )
+            m_img = m_img.copy( opaqueArea ); // (deep copy).
+        m_cropArea = opaqueArea;
+        m_size = opaqueArea.size();
         m_isCropped = true;
-        m_pm = cropped;
-        qDebug() << "Pixmap was cropped to size " << m_pm.width() << m_pm.height();
+        qCDebug( spriteLog ) << "Image was cropped to size " << m_size.width() << m_size.height();
     }
 }
 
-void  PackSprite::scalePixmap( qreal scalef )
+void  PackSprite::scaleImage( qreal scalef )
 {
-    qreal fnwid = scalef * pixmap().width();
-    qreal fnhgt = scalef * pixmap().height();
+    qreal fnwid = scalef * m_size.width();
+    qreal fnhgt = scalef * m_size.height();
     int nwid = int(fnwid);
     int nhgt = int(fnhgt);
     // usually ints get scaled down, but we prefer to scale up if we have any fractions of pixels.
@@ -86,12 +250,15 @@ void  PackSprite::scalePixmap( qreal scalef )
         nwid += 1;
     if ( fnhgt - nhgt > 0.1 )
         nhgt += 1;
-    if ( nwid == pixmap().width() && nhgt == pixmap().height() )
+    if ( nwid == m_size.width() && nhgt == m_size.height() )
         return;
     // (could do with some smoothing/scaling options here really).
-    QPixmap newpm = pixmap().scaled( nwid, nhgt, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ); // Todo need better option for pixel-art scaling.
-    setPixmap( newpm );
+    if ( !m_img.isNull() )
+        m_img = m_img.scaled( nwid, nhgt, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ); // Todo need better option for pixel-art scaling.
+    m_size = QSize( nwid, nhgt );
+    m_scaledSize = m_size;
     m_isScaled = true;
+    m_scale = scalef;
 }
 
 bool PackSprite::isCropped() const
@@ -104,25 +271,38 @@ bool PackSprite::isExpanded() const
     return m_isExpanded;
 }
 
-void PackSprite::restoreOriginalPixmap()
+quint64 PackSprite::pixelKey() const
+{
+    // (the original's cacheKey changes whenever an image is reloaded or edited, the rest covers the transforms we apply to it).
+    quint64 key = m_originalKey;
+    key = key * 31 + quint64( qRound( m_scale * 1000.0 ) );
+    key = key * 31 + quint64( m_expand );
+    key = key * 31 + quint64( m_isCropped );
+    key = key * 31 + quint64( m_size.width() );
+    key = key * 31 + quint64( m_size.height() );
+    return key;
+}
+
+void PackSprite::restoreOriginalImage()
 {
-    setPixmap( m_pm_original );
+    m_img = m_img_original;
+    m_size = m_originalSize;
     m_isCropped = false;
     m_isExpanded = false;
-    //qDebug() << " - new pixmap() size is " << pixmap().width() << " " << pixmap().height();
+    m_expand = 0;
+    //qDebug() << " - new image() size is " << image().width() << " " << image().height();
 }
 
-void PackSprite::expandPixmap( int npixels )
+void PackSprite::expandImage( int npixels )
 {
     if ( npixels <= 0 ) return;
-    QPixmap newpm( pixmap().width() + 2*npixels, pixmap().height() + 2*npixels );
-    newpm.fill(Qt::transparent);
-    QPainter painter( &newpm );
-    painter.drawPixmap( npixels, npixels, pixmap() );
-    qDebug() << "expandPixmap from " << pixmap().width() << " " << pixmap().height();
+    qCDebug( spriteLog ) << "expandImage from " << m_size.width() << " " << m_size.height();
+    if ( !m_img.isNull() )
+        m_img = expanded( m_img, npixels );
+    m_size += QSize( 2*npixels, 2*npixels );
     m_isExpanded = true;
-    setPixmap( newpm );
-    qDebug() << "expandPixmap to " << pixmap().width() << " " << pixmap().height();
+    m_expand = npixels;
+    qCDebug( spriteLog ) << "expandImage to " << m_size.width() << " " << m_size.height();
 }
 
 rbp::Rect PackSprite::packedRect() const
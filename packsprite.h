@@ -19,56 +19,112 @@
 #ifndef PACKSPRITE_H
 #define PACKSPRITE_H
 
+#include <QDateTime>
 #include <QFileInfo>
-#include <QPixmap>
+#include <QImage>
+#include <QSharedPointer>
 
 #include "./maxrects/MaxRectsBinPack.h"
 
+class PixelCache;
+
 //! Class that defines a 'sprite' on the sprite sheet.
-/*! The class groups together a pixmap with its associated fileinfo, and packed rect data on the sheet.
- *  The packsprite also has knowledge of its original pixmap, versus an adjusted copy based on cropping or extending.
+/*! The class groups together an image with its associated fileinfo, and packed rect data on the sheet.
+ *  The packsprite also has knowledge of its original image, versus an adjusted copy based on cropping or extending.
+ *  Images are kept as QImage (ARGB32 premultiplied, what the sheet is composited in), not QPixmap, so packing and
+ *  rendering work without a windowing system.
+ *
+ *  A sprite can also leave its pixels in a PixelCache (see setPixelCache). It then keeps only its sizes and crop rect,
+ *  which is all packing needs, and image() and originalImage() fetch the pixels, re-making any that were evicted.
  */
 class PackSprite
 {
 public:
     //! Constructor.
     /*!
-     * \param pm - the QPixmap for the sprite.
+     * \param img - the image for the sprite (converted to ARGB32 premultiplied if it isn't already).
      * \param fi - the QFileInfo associated with the sprite.
      */
-    PackSprite( const QPixmap &pm, const QFileInfo &fi );
+    PackSprite( const QImage &img, const QFileInfo &fi );
+    //! Constructs a null sprite, with no image.
+    PackSprite();
+    //! Constructs a sprite with a size but no pixels, for packing only (e.g. benchmarks). It renders as nothing.
+    /*! \param size - the sprite's size.
+     *  \param name - the sprite's name, as written in the data files.
+     */
+    PackSprite( const QSize &size, const QString &name );
 
     //! Access to the fileinfo for this sprite.
-    QFileInfo fileInfo() const;
-    //! Access to the current pixmap for this sprite (could be cropped, extended etc compared to original).
-    const QPixmap& pixmap() const;
-    //! Access to the original pixmap that was used to construct the item (prior to any subsequent cropping etc).
-    const QPixmap& originalPixmap() const;
-
-    //! Sets a new pixmap for this sprite (doesn't affect any 'original' pixmap that was set).
-    void setPixmap ( const QPixmap& pm );
+    const QFileInfo& fileInfo() const;
+    //! The sprite's file name (without the path). Same as fileInfo().fileName(), but kept, so exporters don't rebuild it.
+    const QString& fileName() const;
+    //! Sets the size and modified time the sprite's file had when it was decoded.
+    /*! Read before decoding (QFileInfo only reads them when first asked, which may be much later), so reloading can
+     *  tell whether the file has changed since.
+     */
+    void setFileStamp( qint64 size, const QDateTime &modified );
+    //! Returns the file size set by setFileStamp, or -1 if none was set.
+    qint64 fileSize() const;
+    //! Returns the modified time set by setFileStamp.
+    const QDateTime& fileModified() const;
+    //! Access to the current image for this sprite (could be cropped, extended etc compared to original).
+    /*! With a pixel cache, it's fetched from the cache, or re-made from the original - scaled, cropped and expanded,
+     *  in that order, as the packers do. Null if the file can't be read any more.
+     */
+    QImage image() const;
+    //! Access to the original image that was used to construct the item (prior to any subsequent cropping etc).
+    /*! With a pixel cache, it's fetched from the cache, or decoded from the file again.
+     */
+    QImage originalImage() const;
+    //! Returns the size of the current image. Doesn't need the pixels.
+    QSize size() const;
+    //! Returns the size of the original image. Doesn't need the pixels.
+    QSize originalSize() const;
+    //! Returns true for a sprite with no image.
+    bool isNull() const;
+
+    //! Sets a new image for this sprite (doesn't affect any 'original' image that was set).
+    void setImage( const QImage& img );
+
+    //! Moves the sprite's pixels into a cache, from which image() and originalImage() fetch them from now on.
+    /*! The unscaled crop rect is found first, while the pixels are at hand. Only for sprites loaded from files, so
+     *  evicted pixels can be decoded again.
+     */
+    void setPixelCache( const QSharedPointer<PixelCache> &cache );
+    //! Returns the cache holding the sprite's pixels, or null if it holds them itself.
+    const QSharedPointer<PixelCache>& pixelCache() const;
 
-    //! Resets the packing rect, rotation flag, cropping, and restores original pixmap (calls restoreOriginalPixmap).
+    //! Resets the packing rect, rotation flag, cropping, and restores original image (calls restoreOriginalImage).
     /*! This is generally used before the item is to be re-packed - ie we dont want previous data in place.
     */
     void resetForPacking();
 
-    //!  Auto-crops the current pixmap based on it's opaque bounding area. Original can be restored via restoreOriginalPixmap.
-    void cropPixmap();
+    //!  Auto-crops the current image to the bounding rect of its non-transparent pixels. Original can be restored via restoreOriginalImage.
+    /*!  The bounding rect is remembered (by pixelKey), so re-cropping the same (e.g. restored original) image doesn't
+     *   rescan it - or need its pixels, with a pixel cache.
+    */
+    void cropImage();
 
-    //! Scales the current pixmap by the specified amount.
-    void scalePixmap( qreal scalef );
+    //! Scales the current image by the specified amount.
+    void scaleImage( qreal scalef );
 
     //! Returns true if the image has been cropped, and its size reduced.
     bool isCropped() const;
     //! Returns true if the image has been extended from its original size.
     bool isExpanded() const;
 
-    //! Reverts to the (cached) original pixmap, removing any cropping or extending.
-    void restoreOriginalPixmap();
+    //! Returns a key identifying the pixels of the current image.
+    /*! The current image is always derived from the original one by scaling, cropping and expanding, so two sprites
+     *  (or the same sprite before and after re-packing) with equal keys will have identical pixels. Used to avoid
+     *  re-rendering unchanged sprites.
+     */
+    quint64 pixelKey() const;
+
+    //! Reverts to the (cached) original image, removing any cropping or extending.
+    void restoreOriginalImage();
 
-    //! Expands the current pixmap on each side by the chosen number of pixels.
-    void expandPixmap( int npixels = 0 );
+    //! Expands the current image on each side by the chosen number of pixels.
+    void expandImage( int npixels = 0 );
 
     //! Returns the packedrect data.
     /*! Will return a zero-sized rect if packing has not been run, or if packing failed for this item.
@@ -85,13 +141,31 @@ public:
 
 protected:
 
-    //! Stores current pixmap.
-    QPixmap m_pm;
-     //! Stores original pixmap, before any cropping, expanding etc.
-    QPixmap m_pm_original;
+    //! Stores current image (null with a pixel cache, unless set by setImage).
+    QImage m_img;
+     //! Stores original image, before any cropping, expanding etc (null with a pixel cache).
+    QImage m_img_original;
+    //! Size of the current image.
+    QSize m_size;
+    //! Size of the original image.
+    QSize m_originalSize;
+    //! Size the original was scaled to by the last scaleImage call.
+    QSize m_scaledSize;
+    //! Area of the scaled image kept by the last cropImage call.
+    QRect m_cropArea;
+    //! cacheKey of the original image when it was loaded. Identifies its pixels, even once they're only in the cache.
+    quint64 m_originalKey;
+    //! Where the pixels are kept, or null if the sprite holds them itself.
+    QSharedPointer<PixelCache> m_cache;
 
     //! Stores the fileinfo.
     QFileInfo m_fi;
+    //! Stores the file name.
+    QString m_fileName;
+    //! File size when the sprite was decoded (-1 if unknown).
+    qint64 m_fileSize;
+    //! File modified time when the sprite was decoded.
+    QDateTime m_fileModified;
     //! Stores the packing rect data.
     rbp::Rect m_packedRect;
     //! Cropping status.
@@ -102,6 +176,14 @@ protected:
     bool m_isExpanded;
     //! Scaled status.
     bool m_isScaled;
+    //! Scale factor applied by the last scaleImage call (1.0 if none).
+    qreal m_scale;
+    //! Number of pixels added on each side by the last expandImage call.
+    int m_expand;
+    //! Bounding rect of the non-transparent pixels, found by the last cropImage call.
+    QRect m_cropRect;
+    //! pixelKey of the image m_cropRect was found for (0 if none).
+    quint64 m_cropKey;
 };
 
 #endif // PACKSPRITE_H
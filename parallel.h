@@ -0,0 +1,51 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QAtomicInt>
+#include <QFuture>
+#include <QList>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+
+//! Calls fn(i) for every i from 0 to count-1, spread over the global thread pool, and waits until all calls are done.
+/*! Indexes are handed out one at a time, so uneven work (e.g. bands with more sprites) still balances well. The
+ *  calling thread takes part too, so this is safe to use from inside a pool thread.
+ */
+template <typename Function>
+void parallelFor( int count, const Function &fn )
+{
+    if ( count <= 0 )
+        return;
+    QAtomicInt next( 0 );
+    auto worker = [&]() {
+        for (int i = next.fetchAndAddRelaxed( 1 ); i < count; i = next.fetchAndAddRelaxed( 1 ))
+            fn( i );
+    };
+    QList< QFuture<void> > futures;
+    int nthreads = qMin( count, QThreadPool::globalInstance()->maxThreadCount() );
+    for (int t = 1; t < nthreads; ++t)
+        futures.append( QtConcurrent::run( worker ));
+    worker();
+    for (int t = 0; t < futures.size(); ++t)
+        futures[t].waitForFinished();
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,138 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixelcache.h"
+
+#include <QMutexLocker>
+#include <QtDebug>
+
+PixelCache::PixelCache( qint64 budget )
+    : m_budget( budget ), m_hits( 0 ), m_misses( 0 ), m_evictions( 0 ), m_decodes( 0 )
+{
+    m_bytes[0] = 0;
+    m_bytes[1] = 0;
+}
+
+QImage PixelCache::find( quint64 key )
+{
+    QMutexLocker lock( &m_mutex );
+    QHash<quint64, Entry>::iterator it = m_entries.find( key );
+    if ( it == m_entries.end() ) {
+        ++m_misses;
+        return QImage();
+    }
+    ++m_hits;
+    m_lru.splice( m_lru.begin(), m_lru, it->use );
+    return it->image;
+}
+
+void PixelCache::insert( quint64 key, const QImage &image, bool transformed )
+{
+    if ( image.isNull() )
+        return;
+    QMutexLocker lock( &m_mutex );
+    QHash<quint64, Entry>::iterator it = m_entries.find( key );
+    if ( it != m_entries.end() ) {
+        m_bytes[it->transformed] -= it->bytes;
+        m_lru.erase( it->use );
+        m_entries.erase( it );
+    }
+    Entry entry;
+    entry.image = image;
+    entry.bytes = qint64( image.bytesPerLine() ) * image.height();
+    entry.transformed = transformed;
+    m_lru.push_front( key );
+    entry.use = m_lru.begin();
+    m_entries.insert( key, entry );
+    m_bytes[transformed] += entry.bytes;
+    evict();
+}
+
+QImage PixelCache::original( quint64 key, const QString &filePath, const QSize &size )
+{
+    QImage image = find( key );
+    if ( !image.isNull() )
+        return image;
+    // (decoded without the lock, so other threads carry on - two threads may occasionally decode the same file.)
+    image = QImage( filePath ).convertToFormat( QImage::Format_ARGB32_Premultiplied );
+    if ( image.size() != size ) {
+        qWarning() << "PixelCache - " << filePath << " has changed since it was loaded, skipping it";
+        return QImage();
+    }
+    {
+        QMutexLocker lock( &m_mutex );
+        ++m_decodes;
+    }
+    insert( key, image );
+    return image;
+}
+
+void PixelCache::clear()
+{
+    QMutexLocker lock( &m_mutex );
+    m_entries.clear();
+    m_lru.clear();
+    m_bytes[0] = 0;
+    m_bytes[1] = 0;
+}
+
+qint64 PixelCache::budget() const
+{
+    return m_budget;
+}
+
+qint64 PixelCache::bytes( bool transformed ) const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_bytes[transformed];
+}
+
+qint64 PixelCache::hits() const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_hits;
+}
+
+qint64 PixelCache::misses() const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_misses;
+}
+
+qint64 PixelCache::evictions() const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_evictions;
+}
+
+qint64 PixelCache::decodes() const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_decodes;
+}
+
+void PixelCache::evict()
+{
+    while ( m_bytes[0] + m_bytes[1] > m_budget && m_lru.size() > 1 ) {
+        QHash<quint64, Entry>::iterator it = m_entries.find( m_lru.back() );
+        m_bytes[it->transformed] -= it->bytes;
+        m_entries.erase( it );
+        m_lru.pop_back();
+        ++m_evictions;
+    }
+}
@@ -0,0 +1,95 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIXELCACHE_H
+#define PIXELCACHE_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <list>
+
+//! A least-recently-used cache of sprite pixels, kept within a memory budget. Thread-safe.
+/*! With a pixel budget (see SheetBuilder::setPixelBudget), sprites loaded from files don't hold their pixels - they
+ *  hold their size and crop rect, which is all packing needs, and fetch pixels from here when rendering. Pixels that
+ *  have been evicted are decoded from the file again (the source files are compact already, so there's no separate
+ *  disk cache). Original images and transformed (scaled, cropped, expanded) ones share the one budget.
+ *
+ *  Images are implicitly shared, so one handed out stays valid after it's evicted - the budget limits what the cache
+ *  keeps, not what callers are still using.
+ */
+class PixelCache
+{
+public:
+    //! Constructor.
+    /*! \param budget - bytes of pixels to keep. The most recently used image is always kept, even if it's bigger.
+     */
+    explicit PixelCache( qint64 budget );
+
+    //! Returns the image cached under key, or a null image. Counts as a use.
+    QImage find( quint64 key );
+    //! Adds (or replaces) an image, then evicts the least recently used ones until the cache fits its budget.
+    /*! \param transformed - true for a scaled, cropped or expanded image (just for memoryUsage()).
+     */
+    void insert( quint64 key, const QImage &image, bool transformed = false );
+    //! Returns the original image cached under key, decoding it from the file (as ARGB32 premultiplied) if needed.
+    /*! \returns a null image if the file can't be read, or its size isn't size any more.
+     */
+    QImage original( quint64 key, const QString &filePath, const QSize &size );
+    //! Removes everything.
+    void clear();
+
+    //! Returns the budget, in bytes.
+    qint64 budget() const;
+    //! Returns the bytes held, for originals or transformed images.
+    qint64 bytes( bool transformed ) const;
+
+    //! Returns the number of lookups that found their image.
+    qint64 hits() const;
+    //! Returns the number of lookups that didn't.
+    qint64 misses() const;
+    //! Returns the number of images evicted to stay within the budget.
+    qint64 evictions() const;
+    //! Returns the number of images decoded again after being evicted.
+    qint64 decodes() const;
+
+protected:
+    //! One cached image.
+    struct Entry {
+        QImage image;
+        qint64 bytes;
+        bool transformed;
+        std::list<quint64>::iterator use; // (its place in m_lru)
+    };
+
+    //! Evicts from the least recently used end until within budget. Call with the mutex locked.
+    void evict();
+
+    mutable QMutex m_mutex;
+    qint64 m_budget;
+    QHash<quint64, Entry> m_entries;
+    std::list<quint64> m_lru; // most recently used first
+    qint64 m_bytes[2];        // [transformed]
+    qint64 m_hits;
+    qint64 m_misses;
+    qint64 m_evictions;
+    qint64 m_decodes;
+};
+
+#endif // PIXELCACHE_H
@@ -0,0 +1,364 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pngwriter.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <QtDebug>
+#include <QtEndian>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+int PngWriter::NumCompressionLevels = 3; // --> Keep this up-to-date when adding levels! UI uses this to populate png combobox.
+
+namespace {
+const int IdatSize = 256 * 1024;     // (bytes of compressed data per IDAT chunk)
+const int ChunkSize = 256 * 1024;    // (bytes of filtered data compressed as one parallel job)
+const int DictionarySize = 32 * 1024; // (deflate's window size)
+
+inline int zlibLevel( PngWriter::CompressionLevels level )
+{
+    return level == PngWriter::COMPRESSION_FAST ? 1 : ( level == PngWriter::COMPRESSION_MAX ? 9 : 6 );
+}
+
+// Deflates one chunk. All but the last chunk end with a sync flush, which pads to a byte boundary without ending the
+// stream, so the chunks can simply be joined together.
+PngWriter::CompressedChunk compressChunk( QByteArray input, QByteArray dictionary, bool last, int level )
+{
+    Trace::Span span( "deflate chunk", "encode" );
+    PngWriter::CompressedChunk chunk;
+    chunk.inputSize = input.size();
+    chunk.adler = quint32( adler32( adler32( 0, 0, 0 ), reinterpret_cast<const Bytef*>( input.constData() ), uInt( input.size() )));
+
+    z_stream zs;
+    memset( &zs, 0, sizeof( zs ));
+    if ( deflateInit2( &zs, level, Z_DEFLATED, -15, level == 9 ? 9 : 8, Z_DEFAULT_STRATEGY ) != Z_OK ) // (-15 is raw deflate, no header)
+        return chunk; // (no data - writer reports this)
+    if ( !dictionary.isEmpty() )
+        deflateSetDictionary( &zs, reinterpret_cast<const Bytef*>( dictionary.constData() ), uInt( dictionary.size() ));
+    chunk.data.resize( int( deflateBound( &zs, uLong( input.size() ))) + 16 ); // (+ room for the sync flush marker)
+    zs.next_in = reinterpret_cast<Bytef*>( input.data() );
+    zs.avail_in = uInt( input.size() );
+    zs.next_out = reinterpret_cast<Bytef*>( chunk.data.data() );
+    zs.avail_out = uInt( chunk.data.size() );
+    int ret = deflate( &zs, last ? Z_FINISH : Z_SYNC_FLUSH );
+    if ( ( last && ret != Z_STREAM_END ) || ( !last && ret != Z_OK ) || zs.avail_in != 0 )
+        chunk.data.clear();
+    else
+        chunk.data.resize( chunk.data.size() - int( zs.avail_out ));
+    deflateEnd( &zs );
+    return chunk;
+}
+
+inline uchar paeth( int a, int b, int c )
+{
+    int p = a + b - c;
+    int pa = abs( p - a ), pb = abs( p - b ), pc = abs( p - c );
+    if ( pa <= pb && pa <= pc )
+        return uchar( a );
+    return pb <= pc ? uchar( b ) : uchar( c );
+}
+
+// Filtered value of byte i for each PNG filter type (a = left, b = up, c = up-left).
+inline uchar filtered( int type, int x, int a, int b, int c )
+{
+    switch ( type ) {
+    case 1: return uchar( x - a );
+    case 2: return uchar( x - b );
+    case 3: return uchar( x - ( ( a + b ) >> 1 ));
+    case 4: return uchar( x - paeth( a, b, c ));
+    default: return uchar( x );
+    }
+}
+}
+
+PngWriter::PngWriter()
+    : m_level( COMPRESSION_DEFAULT ), m_adler( 1 ), m_queuedBytes( 0 ), m_width( 0 ), m_height( 0 ), m_rowsWritten( 0 ), m_bytesPerPixel( 4 )
+{
+}
+
+PngWriter::~PngWriter()
+{
+    waitForChunks();
+    if ( m_file.isOpen() ) {
+        qWarning() << "PngWriter - file was not completed, removing " << m_file.fileName();
+        m_file.close();
+        m_file.remove();
+    }
+}
+
+void PngWriter::setCompression( const CompressionLevels level )
+{
+    m_level = level;
+}
+
+void PngWriter::setPalette( const QVector<QRgb> &palette )
+{
+    m_palette = palette.mid( 0, 256 );
+}
+
+bool PngWriter::open( const QString &fileName, int width, int height, bool hasAlpha )
+{
+    if ( width <= 0 || height <= 0 )
+        return fail( "Invalid image size." );
+    m_width = width;
+    m_height = height;
+    m_rowsWritten = 0;
+    m_queuedBytes = 0;
+    m_bytesPerPixel = m_palette.isEmpty() ? ( hasAlpha ? 4 : 3 ) : 1;
+    if ( qint64( width ) * m_bytesPerPixel + 1 > 0x7fffffff )
+        return fail( "Image is too wide." );
+
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::WriteOnly | QIODevice::Truncate ))
+        return fail( m_file.errorString() );
+
+    static const char signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+    if ( m_file.write( signature, 8 ) != 8 )
+        return fail( m_file.errorString() );
+
+    QByteArray ihdr( 13, '\0' );
+    qToBigEndian<quint32>( quint32( width ), reinterpret_cast<uchar*>( ihdr.data() ));
+    qToBigEndian<quint32>( quint32( height ), reinterpret_cast<uchar*>( ihdr.data() + 4 ));
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = m_palette.isEmpty() ? ( hasAlpha ? 6 : 2 ) : 3; // colour type - RGBA, RGB or palette
+    // (compression, filter and interlace methods are all 0)
+    if ( !writeChunk( "IHDR", ihdr ))
+        return false;
+
+    if ( !m_palette.isEmpty() ) {
+        // Palette colours, then their alphas - only up to the last entry that isn't opaque (the rest default to opaque).
+        QByteArray plte, trns;
+        for (int i = 0; i < m_palette.size(); ++i) {
+            plte.append( char( qRed( m_palette[i] )));
+            plte.append( char( qGreen( m_palette[i] )));
+            plte.append( char( qBlue( m_palette[i] )));
+            if ( qAlpha( m_palette[i] ) != 255 )
+                trns.resize( i + 1 );
+        }
+        for (int i = 0; i < trns.size(); ++i)
+            trns[i] = char( qAlpha( m_palette[i] ));
+        if ( !writeChunk( "PLTE", plte ))
+            return false;
+        if ( !trns.isEmpty() && !writeChunk( "tRNS", trns ))
+            return false;
+    }
+
+    // zlib stream header - 32K window deflate, and the level hint. Header check bits make it a multiple of 31.
+    int flags = ( m_level == COMPRESSION_FAST ? 0 : ( m_level == COMPRESSION_MAX ? 3 : 2 )) << 6;
+    flags += 31 - ( ( 0x78 * 256 + flags ) % 31 );
+    m_idat.clear();
+    m_idat.append( char( 0x78 ));
+    m_idat.append( char( flags ));
+    m_pending.clear();
+    m_dictionary.clear();
+    m_adler = 1;
+    m_prevRow = QByteArray( width * m_bytesPerPixel, '\0' );
+    return true;
+}
+
+bool PngWriter::writeRows( const QImage &rows )
+{
+    if ( !m_file.isOpen() )
+        return fail( "File is not open." );
+    if ( rows.height() == 0 )
+        return true; // (e.g. an empty last band - there's nothing to filter or compress)
+    if ( m_rowsWritten == m_height )
+        return fail( "All rows have already been written." );
+    if ( rows.width() != m_width || m_rowsWritten + rows.height() > m_height )
+        return fail( "Rows do not fit the image size." );
+
+    // Qt's RGBA8888 and RGB888 formats are already in PNG's byte order (and non-premultiplied).
+    QImage::Format rowFormat = m_bytesPerPixel == 4 ? QImage::Format_RGBA8888 : QImage::Format_RGB888;
+    if ( !m_palette.isEmpty() ) {
+        if ( rows.format() != QImage::Format_Indexed8 )
+            return fail( "Indexed rows are needed with a palette." ); // (converting would make a new palette)
+        rowFormat = QImage::Format_Indexed8;
+    }
+    QImage src = rows.format() == rowFormat ? rows : rows.convertToFormat( rowFormat );
+    if ( src.isNull() )
+        return fail( "Out of memory converting rows." );
+
+    // Filter all the rows (in parallel, each only needs the unfiltered row above), onto the end of the pending data.
+    int rowBytes = m_width * m_bytesPerPixel;
+    int start = m_pending.size();
+    m_pending.resize( start + ( rowBytes + 1 ) * src.height() );
+    uchar *out = reinterpret_cast<uchar*>( m_pending.data() ) + start;
+    const uchar *firstPrev = reinterpret_cast<const uchar*>( m_prevRow.constData() );
+    parallelFor( src.height(), [&]( int y ) {
+        filterRow( src.constScanLine( y ), y > 0 ? src.constScanLine( y - 1 ) : firstPrev, out + qint64( y ) * ( rowBytes + 1 ));
+    });
+    memcpy( m_prevRow.data(), src.constScanLine( src.height() - 1 ), rowBytes );
+    m_rowsWritten += src.height();
+
+    int offset = 0;
+    for ( ; m_pending.size() - offset >= ChunkSize; offset += ChunkSize) {
+        if ( !queueChunk( m_pending.mid( offset, ChunkSize ), false ))
+            return false;
+    }
+    m_pending.remove( 0, offset );
+    return true;
+}
+
+bool PngWriter::close()
+{
+    if ( !m_file.isOpen() )
+        return fail( "File is not open." );
+    if ( m_rowsWritten != m_height )
+        return fail( "Not all rows were written." );
+    if ( !queueChunk( m_pending, true ))
+        return false;
+    m_pending.clear();
+    while ( !m_chunks.isEmpty() ) {
+        if ( !writeCompressed( m_chunks.takeFirst().result() ))
+            return false;
+    }
+    QByteArray adler( 4, '\0' );
+    qToBigEndian<quint32>( m_adler, reinterpret_cast<uchar*>( adler.data() ));
+    m_idat.append( adler );
+    if ( !writeChunk( "IDAT", m_idat ))
+        return false;
+    if ( !writeChunk( "IEND", QByteArray() ))
+        return false;
+    m_file.close();
+    if ( m_file.error() != QFile::NoError )
+        return fail( m_file.errorString() );
+    return true;
+}
+
+QString PngWriter::errorString() const
+{
+    return m_error;
+}
+
+qint64 PngWriter::bufferedBytes() const
+{
+    return m_pending.size() + m_dictionary.size() + m_idat.size() + m_prevRow.size() + m_queuedBytes;
+}
+
+QString PngWriter::displayName( const CompressionLevels level )
+{
+    switch( level ){
+    case COMPRESSION_FAST:
+        return "Fast";
+        break;
+    case COMPRESSION_DEFAULT:
+        return "Default";
+        break;
+    case COMPRESSION_MAX:
+        return "Smallest";
+        break;
+    default:
+        return "Undefined"; // (shouldnt see this, check NumCompressionLevels etc.)
+    }
+}
+
+void PngWriter::filterRow( const uchar *row, const uchar *prev, uchar *out ) const
+{
+    int bpp = m_bytesPerPixel;
+    int rowBytes = m_width * bpp;
+    int type = 1; // (the fast level always uses 'sub', it's cheap and still helps a lot)
+    if ( !m_palette.isEmpty() )
+        type = 0; // (palette indexes aren't smooth, so filtering rarely helps - libpng doesn't filter them either)
+    else if ( m_level != COMPRESSION_FAST ) {
+        // Pick the filter with the smallest sum of absolute (signed) differences, as libpng does.
+        quint64 sums[5] = { 0, 0, 0, 0, 0 };
+        for (int i = 0; i < rowBytes; ++i) {
+            int x = row[i], b = prev[i];
+            int a = i >= bpp ? row[i - bpp] : 0;
+            int c = i >= bpp ? prev[i - bpp] : 0;
+            sums[0] += abs( int( qint8( x )));
+            sums[1] += abs( int( qint8( x - a )));
+            sums[2] += abs( int( qint8( x - b )));
+            sums[3] += abs( int( qint8( x - ( ( a + b ) >> 1 ))));
+            sums[4] += abs( int( qint8( x - paeth( a, b, c ))));
+        }
+        type = 0;
+        for (int t = 1; t < 5; ++t) {
+            if ( sums[t] < sums[type] )
+                type = t;
+        }
+    }
+    out[0] = uchar( type );
+    for (int i = 0; i < rowBytes; ++i)
+        out[1 + i] = filtered( type, row[i], i >= bpp ? row[i - bpp] : 0, prev[i], i >= bpp ? prev[i - bpp] : 0 );
+}
+
+bool PngWriter::queueChunk( const QByteArray &input, bool last )
+{
+    m_chunks.append( QtConcurrent::run( &compressChunk, input, m_dictionary, last, zlibLevel( m_level )));
+    m_queuedBytes += input.size();
+    m_dictionary = input.size() >= DictionarySize ? input.right( DictionarySize ) : ( m_dictionary + input ).right( DictionarySize );
+
+    // Don't let too many chunks pile up (memory), but leave enough that every thread stays busy.
+    int maxQueued = 2 * qMax( 1, QThreadPool::globalInstance()->maxThreadCount() );
+    while ( m_chunks.size() > maxQueued ) {
+        if ( !writeCompressed( m_chunks.takeFirst().result() ))
+            return false;
+    }
+    return true;
+}
+
+bool PngWriter::writeCompressed( const CompressedChunk &chunk )
+{
+    if ( chunk.data.isEmpty() )
+        return fail( "Compression failed." );
+    m_adler = quint32( adler32_combine( m_adler, chunk.adler, chunk.inputSize ));
+    m_queuedBytes -= chunk.inputSize;
+    m_idat.append( chunk.data );
+    while ( m_idat.size() >= IdatSize ) {
+        if ( !writeChunk( "IDAT", m_idat.left( IdatSize )))
+            return false;
+        m_idat.remove( 0, IdatSize );
+    }
+    return true;
+}
+
+void PngWriter::waitForChunks()
+{
+    while ( !m_chunks.isEmpty() )
+        m_chunks.takeFirst().waitForFinished();
+}
+
+bool PngWriter::writeChunk( const char *type, const QByteArray &data )
+{
+    uchar header[8];
+    qToBigEndian<quint32>( quint32( data.size() ), header );
+    memcpy( header + 4, type, 4 );
+    uLong crc = crc32( 0, header + 4, 4 );
+    if ( !data.isEmpty() ) // (crc32 treats a null buffer as a request for the initial value)
+        crc = crc32( crc, reinterpret_cast<const Bytef*>( data.constData() ), uInt( data.size() ));
+    uchar trailer[4];
+    qToBigEndian<quint32>( quint32( crc ), trailer );
+    if ( m_file.write( reinterpret_cast<const char*>( header ), 8 ) != 8 ||
+         m_file.write( data ) != data.size() ||
+         m_file.write( reinterpret_cast<const char*>( trailer ), 4 ) != 4 )
+        return fail( m_file.errorString() );
+    return true;
+}
+
+bool PngWriter::fail( const QString &error )
+{
+    qWarning() << "PngWriter - " << error;
+    m_error = error;
+    return false;
+}
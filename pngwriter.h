@@ -0,0 +1,124 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QFuture>
+#include <QImage>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+//! Writes a PNG file a band of rows at a time.
+/*! Used for exporting sheets, so the whole sheet image never needs to be in memory - peak memory depends on the band
+ *  height, not the sheet size. Usage is open(), then writeRows() until all rows are written, then close().
+ *
+ *  Compression is done in parallel, in the same way as pigz: the filtered data is cut into chunks which are deflated
+ *  independently on the global thread pool, each primed with the last 32K of the chunk before so little compression
+ *  is lost. The chunks are joined into one zlib stream and written out as IDAT chunks, in order. writeRows() only
+ *  waits when too many chunks are queued, so the caller can render the next band while compression carries on.
+ */
+class PngWriter
+{
+public:
+
+    //! Compression levels. Indexes must match ui pngComboBox. Index is saved in json settings file.
+    /*!
+     * \see NumCompressionLevels - the number of levels defined.
+     */
+    enum CompressionLevels { COMPRESSION_FAST = 0, COMPRESSION_DEFAULT, COMPRESSION_MAX };
+    //! Number of compression levels. Must match the total number of levels defined in CompressionLevels.
+    static int NumCompressionLevels;
+
+    PngWriter();
+    ~PngWriter();
+
+    //! Sets the compression level. Call before open().
+    void setCompression( const CompressionLevels level );
+
+    //! Sets a palette (up to 256 non-premultiplied colours), to write an indexed image. Call before open().
+    /*! With a palette, writeRows() takes Indexed8 images (see ColorQuantizer). An empty palette turns it off again.
+     */
+    void setPalette( const QVector<QRgb> &palette );
+
+    //! Creates the file and writes the PNG header.
+    /*! \param fileName - the file to write.
+     *  \param width - image width in pixels.
+     *  \param height - image height in pixels.
+     *  \param hasAlpha - true to write RGBA pixels, otherwise RGB (ignored with a palette).
+     *  \returns true - if the operation was successful.
+     */
+    bool open( const QString &fileName, int width, int height, bool hasAlpha );
+
+    //! Appends the next rows of the image. Any QImage format is accepted, it's converted as needed.
+    /*! \param rows - image with the full width, and any number of rows (an empty image does nothing).
+     *  \returns true - if the operation was successful.
+     */
+    bool writeRows( const QImage &rows );
+
+    //! Finishes the image data and closes the file. Fails if not all rows were written.
+    bool close();
+
+    //! Returns a description of the last error.
+    QString errorString() const;
+
+    //! Returns roughly how much memory the writer is holding: rows waiting to be compressed, and chunks being compressed.
+    qint64 bufferedBytes() const;
+
+    //! Returns readable form of the compression level (as shown to user in UI menus etc).
+    static QString displayName( const CompressionLevels level );
+
+    //! Maximum PNG width and height (the format allows 2^31 - 1).
+    static const int MaxSize = 0x7fffffff;
+
+    //! One independently compressed piece of the image data.
+    struct CompressedChunk {
+        QByteArray data;    //!< raw deflate data, ending on a byte boundary (or the end of the stream)
+        quint32 adler;      //!< adler32 checksum of the uncompressed input
+        int inputSize;      //!< size of the uncompressed input
+    };
+
+protected:
+    bool writeChunk( const char *type, const QByteArray &data );
+    bool queueChunk( const QByteArray &input, bool last );
+    bool writeCompressed( const CompressedChunk &chunk );
+    void waitForChunks();
+    void filterRow( const uchar *row, const uchar *prev, uchar *out ) const;
+    bool fail( const QString &error );
+
+    QFile m_file;
+    CompressionLevels m_level;
+    QByteArray m_pending;   // filtered data waiting to be compressed
+    QByteArray m_dictionary; // last 32K of the data before m_pending
+    QList< QFuture<CompressedChunk> > m_chunks; // chunks being compressed, in file order
+    QByteArray m_idat;      // compressed data waiting to go out as an IDAT chunk
+    QByteArray m_prevRow;   // previous (unfiltered) row, for filtering the next band
+    QVector<QRgb> m_palette; // (empty unless writing an indexed image)
+    quint32 m_adler;        // adler32 of all data compressed so far
+    qint64 m_queuedBytes;   // input size of the chunks in m_chunks
+    int m_width;
+    int m_height;
+    int m_rowsWritten;
+    int m_bytesPerPixel;
+    QString m_error;
+};
+
+#endif // PNGWRITER_H
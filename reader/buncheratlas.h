@@ -0,0 +1,207 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUNCHERATLAS_H
+#define BUNCHERATLAS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//! Reader for the binary atlas data format. Header-only and free of Qt, so it can be copied into a game.
+/*! The file is meant to be used in place: read or mmap it (the data must be 4 byte aligned) and point an AtlasView at
+ *  it. Nothing is parsed or copied - frames are fixed size records, and find() looks a name up in O(1) through a
+ *  minimal perfect hash stored in the file.
+ *
+ *  Layout - little-endian throughout, each section starts on a 16 byte boundary:
+ *  - AtlasHeader.
+ *  - frameCount frame records (frameSize bytes each, starting with an AtlasFrame), in export order.
+ *  - bucketCount uint32 seeds, and slotCount uint32 frame indexes - the name index.
+ *  - the string table: zero-terminated UTF-8 sprite names, image name and pixel format.
+ *
+ *  The name index is built as in CHD (compress, hash and displace): names are hashed into buckets, and each bucket has
+ *  a seed that sends all its names to free slots. A lookup is two hashes, one seed, one slot, then a name compare (to
+ *  reject names that aren't in the atlas). If several sprites share a name, only the first is indexed.
+ */
+namespace buncher {
+
+//! Current file version. Readers reject other versions - a change to the layout must bump this.
+static const uint32_t AtlasVersion = 1;
+
+//! Frame flag - the sprite is rotated 90 degrees clockwise on the sheet.
+static const uint32_t AtlasRotated = 1;
+
+//! File header.
+struct AtlasHeader {
+    char magic[4];          //!< "SBAT"
+    uint32_t version;       //!< AtlasVersion
+    uint32_t headerSize;    //!< sizeof( AtlasHeader )
+    uint32_t fileSize;      //!< total file size in bytes
+    uint32_t sheetWidth;    //!< sheet image size in pixels
+    uint32_t sheetHeight;
+    uint32_t frameCount;    //!< number of frame records
+    uint32_t frameSize;     //!< size of one frame record (at least sizeof( AtlasFrame ), later versions may add fields)
+    uint32_t framesOffset;  //!< file offset of the first frame record
+    uint32_t bucketCount;   //!< number of hash buckets (seeds)
+    uint32_t seedsOffset;   //!< file offset of the seeds
+    uint32_t slotCount;     //!< number of indexed names (slots)
+    uint32_t slotsOffset;   //!< file offset of the slots
+    uint32_t stringsOffset; //!< file offset of the string table
+    uint32_t stringsSize;   //!< size of the string table in bytes
+    uint32_t imageName;     //!< string table offset of the sheet image file name
+    uint32_t pixelFormat;   //!< string table offset of the pixel format name (as in the other data formats, e.g. "RGBA8888")
+    uint32_t reserved[3];
+};
+
+//! Frame record - one per sprite.
+struct AtlasFrame {
+    uint32_t name;          //!< string table offset of the sprite's file name
+    uint32_t nameLength;    //!< name length in bytes (not counting the terminating zero)
+    int32_t x;              //!< position and size on the sheet, in pixels
+    int32_t y;
+    int32_t width;          //!< (the size before any rotation)
+    int32_t height;
+    uint32_t flags;         //!< AtlasRotated, or 0
+    uint32_t reserved;
+};
+
+static_assert( sizeof( AtlasHeader ) == 80, "AtlasHeader layout" );
+static_assert( sizeof( AtlasFrame ) == 32, "AtlasFrame layout" );
+
+//! Mixes the bits of a 64 bit value (the splitmix64 finaliser).
+inline uint64_t AtlasMix( uint64_t z )
+{
+    z = ( z ^ ( z >> 30 )) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 )) * 0x94d049bb133111ebULL;
+    return z ^ ( z >> 31 );
+}
+
+//! Hashes a name (FNV-1a, then mixed so the high and low halves are both usable).
+inline uint64_t AtlasHash( const char *str, size_t len )
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= uint8_t( str[i] );
+        h *= 0x100000001b3ULL;
+    }
+    return AtlasMix( h );
+}
+
+//! Bucket for a name hash.
+inline uint32_t AtlasBucket( uint64_t hash, uint32_t bucketCount )
+{
+    return uint32_t( hash >> 32 ) % bucketCount;
+}
+
+//! Slot for a name hash, given its bucket's seed.
+inline uint32_t AtlasSlot( uint64_t hash, uint32_t seed, uint32_t slotCount )
+{
+    return uint32_t( AtlasMix( hash ^ ( uint64_t( seed ) * 0x9e3779b97f4a7c15ULL )) % slotCount );
+}
+
+//! Read-only view of a binary atlas in memory.
+/*! Checks the header and section bounds once, in the constructor - if isValid() is false nothing else should be used.
+ *  The view doesn't own the data, which must stay put for as long as the view (and any pointers from it) are used.
+ */
+class AtlasView
+{
+public:
+    AtlasView( const void *data, size_t size ) : m_data( static_cast<const uint8_t*>( data )), m_header( 0 )
+    {
+        if ( !m_data || size < sizeof( AtlasHeader ) || ( reinterpret_cast<uintptr_t>( data ) & 3 ))
+            return;
+        const AtlasHeader *h = reinterpret_cast<const AtlasHeader*>( m_data );
+        if ( memcmp( h->magic, "SBAT", 4 ) != 0 || h->version != AtlasVersion || h->headerSize < sizeof( AtlasHeader ) ||
+             h->fileSize > size || h->headerSize > h->fileSize || h->frameSize < sizeof( AtlasFrame ) || ( h->frameSize & 3 ) ||
+             ( h->slotCount > 0 && h->bucketCount == 0 ) || h->stringsSize == 0 )
+            return;
+        // (sections start after the header, and 64 bit sums are used so no section can wrap around the end of the file)
+        if ( h->framesOffset < h->headerSize || h->seedsOffset < h->headerSize || h->slotsOffset < h->headerSize ||
+             h->stringsOffset < h->headerSize ||
+             !fits( h->framesOffset, uint64_t( h->frameCount ) * h->frameSize, h->fileSize ) ||
+             !fits( h->seedsOffset, uint64_t( h->bucketCount ) * 4, h->fileSize ) ||
+             !fits( h->slotsOffset, uint64_t( h->slotCount ) * 4, h->fileSize ) ||
+             !fits( h->stringsOffset, h->stringsSize, h->fileSize ) ||
+             ( ( h->framesOffset | h->seedsOffset | h->slotsOffset ) & 3 ) ||
+             m_data[h->stringsOffset + h->stringsSize - 1] != 0 ) // (so every string is terminated)
+            return;
+        m_header = h;
+    }
+
+    //! Returns true if the data is a binary atlas this reader understands.
+    bool isValid() const { return m_header != 0; }
+
+    //! File header.
+    const AtlasHeader &header() const { return *m_header; }
+
+    int frameCount() const { return int( m_header->frameCount ); }
+
+    //! Returns a frame by index (0 to frameCount() - 1, in export order).
+    const AtlasFrame &frame( int index ) const
+    {
+        return *reinterpret_cast<const AtlasFrame*>( m_data + m_header->framesOffset + size_t( index ) * m_header->frameSize );
+    }
+
+    //! Returns a frame's name (zero-terminated UTF-8).
+    const char *name( const AtlasFrame &frame ) const { return string( frame.name ); }
+
+    //! Returns the sheet image file name.
+    const char *imageName() const { return string( m_header->imageName ); }
+
+    //! Returns the pixel format name.
+    const char *pixelFormat() const { return string( m_header->pixelFormat ); }
+
+    //! Looks up a sprite by name. Returns 0 if there's no sprite with that name.
+    const AtlasFrame *find( const char *name, size_t len ) const
+    {
+        const AtlasHeader &h = *m_header;
+        if ( h.slotCount == 0 )
+            return 0;
+        uint64_t hash = AtlasHash( name, len );
+        const uint32_t *seeds = reinterpret_cast<const uint32_t*>( m_data + h.seedsOffset );
+        const uint32_t *slots = reinterpret_cast<const uint32_t*>( m_data + h.slotsOffset );
+        uint32_t index = slots[AtlasSlot( hash, seeds[AtlasBucket( hash, h.bucketCount )], h.slotCount )];
+        if ( index >= h.frameCount )
+            return 0;
+        const AtlasFrame &f = frame( int( index ));
+        if ( f.nameLength != len || uint64_t( f.name ) + len >= h.stringsSize ||
+             memcmp( m_data + h.stringsOffset + f.name, name, len ) != 0 )
+            return 0;
+        return &f;
+    }
+
+    //! Overload, for zero-terminated names.
+    const AtlasFrame *find( const char *name ) const { return find( name, strlen( name )); }
+
+protected:
+    static bool fits( uint64_t offset, uint64_t bytes, uint64_t fileSize ) { return offset + bytes <= fileSize; }
+
+    const char *string( uint32_t offset ) const
+    {
+        if ( offset >= m_header->stringsSize )
+            return "";
+        return reinterpret_cast<const char*>( m_data + m_header->stringsOffset + offset );
+    }
+
+    const uint8_t *m_data;
+    const AtlasHeader *m_header;
+};
+
+} // namespace buncher
+
+#endif // BUNCHERATLAS_H
@@ -0,0 +1,865 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "sheetbuilder.h"
+#include "packer.h"
+#include "dataexporter.h"
+#include "sheetrenderer.h"
+#include "imageconverter.h"
+#include "pngwriter.h"
+#include "colorquantizer.h"
+#include "texturewriter.h"
+#include "exporttransaction.h"
+#include "exportmanifest.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <QtDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QMap>
+#include <QSet>
+#include <QPainter>
+#include <QtConcurrent/QtConcurrentRun>
+
+SheetBuilder::SheetBuilder()
+{
+    m_sheetProp.padding = 2.0;
+    m_sheetProp.border = 2.0;
+    m_extrude = 0;
+    m_sheetProp.height = 512;
+    m_sheetProp.width = 512;
+    m_sheetProp.imageName = "sheet.png";
+    m_sheetProp.pixelFormat = "RGBA8888";
+    m_outDirn = m_inDirn + "/buncher"; // (name hardcoded for now).
+    m_cancel = 0;
+}
+
+void SheetBuilder::setPixelBudget( qint64 bytes )
+{
+    if ( bytes <= 0 ) {
+        m_pixelCache.clear();
+        return;
+    }
+    m_pixelCache = QSharedPointer<PixelCache>( new PixelCache( bytes ));
+}
+
+qint64 SheetBuilder::pixelBudget() const
+{
+    return m_pixelCache ? m_pixelCache->budget() : 0;
+}
+
+void SheetBuilder::setSettings( const BuncherSettings &settings )
+{
+    m_settings = settings;
+}
+
+const BuncherSettings& SheetBuilder::settings() const
+{
+    return m_settings;
+}
+
+void SheetBuilder::setCancelFlag( const QAtomicInt *cancel )
+{
+    m_cancel = cancel;
+}
+
+bool SheetBuilder::isCancelled() const
+{
+    return m_cancel && m_cancel->load();
+}
+
+void SheetBuilder::setInputFolder( const QString &path )
+{
+    m_inDirn = path;
+    m_outDirn = m_inDirn + "/buncher"; // (name hardcoded for now).
+}
+
+const QString& SheetBuilder::inputFolder() const
+{
+    return m_inDirn;
+}
+
+const QString& SheetBuilder::outputFolder() const
+{
+    return m_outDirn;
+}
+
+QString SheetBuilder::settingsFileName() const
+{
+    return m_outDirn + "/buncher.data"; // (name hardcoded for now).
+}
+
+bool SheetBuilder::loadSettings()
+{
+    qDebug() << "loadSettings";
+    return m_settings.load( settingsFileName() );
+}
+
+QFileInfoList SheetBuilder::inputFiles() const
+{
+    QDir dir( m_inDirn );
+    QFileInfoList fulllist;
+    if ( m_settings.subfolders ) {
+        QDirIterator it( dir, QDirIterator::Subdirectories ); // (note - ignores sym links by default).
+        while( it.hasNext() ) {
+            it.next();
+            // avoid buncher output files! [path name hardcoded for now]. Also skip the folder entries themselves.
+            if ( !it.fileInfo().path().endsWith( QString("/buncher") ) && it.fileInfo().isFile() ) {
+                //qDebug() << "Processing... " << it.fileName();
+                fulllist.append( it.fileInfo() );
+            }
+        }
+    }
+    else { // single file scan
+        dir.setFilter(QDir::Files); // ignores subfolders.
+        fulllist = dir.entryInfoList();
+    }
+    return fulllist;
+}
+
+int SheetBuilder::loadSprites()
+{
+    qDebug() << "loadSprites";
+    QFileInfoList fulllist = scanInputFiles();
+    m_sprites.clear();
+    // Decoding is the slow part, so the sprites are made on the thread pool, then sorted in here in file order.
+    // (with a pixel budget, each goes into the cache as soon as it's decoded, so they're never all in memory at once.)
+    QVector<PackSprite> loaded( fulllist.size() );
+    QVector<qint64> decodeTimes( fulllist.size(), 0 ); // (each thread times its own files, they're added up after)
+    parallelFor( fulllist.size(), [&]( int i ) {
+        if ( isCancelled() )
+            return;
+        Trace::Span span( "decode", "load", fulllist.at(i).filePath() );
+        QElapsedTimer timer;
+        timer.start();
+        loaded[i] = loadSprite( fulllist.at(i) );
+        decodeTimes[i] = timer.nsecsElapsed();
+    });
+    addDecodeTimes( decodeTimes );
+    for (int i = 0; i < fulllist.size(); ++i) {
+        if ( !loaded[i].isNull() ) // [we could check file format/extension, but instead we just try to open everything]
+            insertSprite( loaded[i] );
+        loaded[i] = PackSprite();
+    }
+    qDebug() << "Packed sprite list has " << m_sprites.size() << " entries." << " (full file list has " << fulllist.size() << " entries).";
+    return m_sprites.size();
+}
+
+int SheetBuilder::reloadSprites()
+{
+    QFileInfoList fulllist = scanInputFiles();
+    QMap<QString, PackSprite> previous;
+    foreach ( const PackSprite &sprite, m_sprites )
+        previous.insert( sprite.fileInfo().filePath(), sprite );
+    m_sprites.clear();
+    // Only new files, and those changed since they were loaded, are decoded (on the thread pool, as in loadSprites).
+    QVector<int> changed;
+    for (int i = 0; i < fulllist.size(); ++i) {
+        QMap<QString, PackSprite>::const_iterator it = previous.constFind( fulllist.at(i).filePath() );
+        if ( it == previous.constEnd() || it->fileModified() != fulllist.at(i).lastModified() ||
+             it->fileSize() != fulllist.at(i).size() )
+            changed.append( i );
+    }
+    QVector<PackSprite> loaded( fulllist.size() );
+    QVector<qint64> decodeTimes( changed.size(), 0 );
+    parallelFor( changed.size(), [&]( int c ) {
+        if ( isCancelled() )
+            return;
+        Trace::Span span( "decode", "load", fulllist.at( changed[c] ).filePath() );
+        QElapsedTimer timer;
+        timer.start();
+        loaded[changed[c]] = loadSprite( fulllist.at( changed[c] ));
+        decodeTimes[c] = timer.nsecsElapsed();
+    });
+    addDecodeTimes( decodeTimes );
+    int c = 0;
+    for (int i = 0; i < fulllist.size(); ++i) {
+        if ( c < changed.size() && changed[c] == i ) {
+            ++c;
+            if ( !loaded[i].isNull() )
+                insertSprite( loaded[i] );
+            loaded[i] = PackSprite();
+        }
+        else {
+            insertSprite( previous.value( fulllist.at(i).filePath() )); // (keeps its packing, until the next pack().)
+        }
+    }
+    qDebug() << "reloadSprites -" << changed.size() << "of" << fulllist.size() << "files decoded," << m_sprites.size() << "sprites";
+    return changed.size();
+}
+
+PackSprite SheetBuilder::loadSprite( const QFileInfo &file ) const
+{
+    // The file's stamp is read before decoding, so an edit made while it's decoded is picked up by the next reload.
+    QFileInfo stamp( file.filePath() );
+    qint64 size = stamp.size();
+    QDateTime modified = stamp.lastModified();
+    QImage image( file.filePath() );
+    if ( image.isNull() )
+        return PackSprite();
+    PackSprite sprite( image, file );
+    sprite.setFileStamp( size, modified );
+    sprite.setPixelCache( m_pixelCache ); // (does nothing without a pixel budget)
+    return sprite;
+}
+
+void SheetBuilder::addSprite( const QString &name, const QImage &image )
+{
+    if ( !image.isNull() )
+        insertSprite( PackSprite( image, QFileInfo( name )));
+}
+
+void SheetBuilder::clearSprites()
+{
+    m_sprites.clear();
+}
+
+QFileInfoList SheetBuilder::scanInputFiles()
+{
+    Stats::Timer timer( &m_stats, Stats::STAGE_SCAN );
+    QFileInfoList files = inputFiles();
+    m_stats.addCount( Stats::COUNT_FILES, files.size() );
+    return files;
+}
+
+void SheetBuilder::addDecodeTimes( const QVector<qint64> &nsecs )
+{
+    qint64 total = 0;
+    for (int i = 0; i < nsecs.size(); ++i)
+        total += nsecs[i];
+    m_stats.addTime( Stats::STAGE_DECODE, total, nsecs.size() );
+}
+
+void SheetBuilder::insertSprite( const PackSprite &sprite )
+{
+    Stats::Timer timer( &m_stats, Stats::STAGE_SORT );
+    m_stats.addCount( Stats::COUNT_SPRITES );
+    int method = m_settings.method;
+    // (sorted by the original size, so the order doesn't depend on any previous packing.)
+    QSize px = sprite.originalSize();
+    bool inserted = false;
+    for (int is = 0; is < m_sprites.size(); ++is) {
+        // For the MaxRects methods we sort by descending area first [not sure if this is always best, I assumed it is!].
+        if ( ( method <= BuncherSettings::MAXRECTS_CONTACTPOINT || method == BuncherSettings::ROWS_BY_AREA ) &&
+             px.width()*px.height() >= m_sprites[is].originalSize().width()*m_sprites[is].originalSize().height() ) { // orders by area (descending)
+            m_sprites.insert( is, sprite );
+            inserted = true;
+            break;
+        }
+        else if ( method == BuncherSettings::ROWS_BY_NAME ) { // ordering by name (ascending).
+            break; // (simple - always inserts at end.)
+        }
+        else if ( method == BuncherSettings::ROWS_BY_WIDTH &&
+                  px.width() >= m_sprites[is].originalSize().width() ) { // order by width (descending)
+            m_sprites.insert( is, sprite );
+            inserted = true;
+            break;
+        }
+        else if ( method == BuncherSettings::ROWS_BY_HEIGHT &&
+                  px.height() >= m_sprites[is].originalSize().height() ) { // order by width (descending)
+            m_sprites.insert( is, sprite );
+            inserted = true;
+            break;
+        }
+    }
+    // if not inserted after scan, always insert it at end
+    if ( !inserted )
+        m_sprites.append( sprite );
+}
+
+int SheetBuilder::pack()
+{
+    // Variants are packed once, at the largest scale. Rects are aligned (and padding, border and extrusion rounded up) to
+    // the largest factor, so every smaller variant's rects land on whole pixels - and on whole blocks too, if those are
+    // aligned. (block alignment puts the extruded edge on a block boundary, so the sprite rect stays on a multiple of
+    // the factor only because the extrusion is one too.)
+    int vscale = m_settings.variantScale();
+    m_sheetProp.width = m_settings.sheetWidth;
+    m_sheetProp.height = m_settings.sheetHeight;
+    m_sheetProp.padding = ( ( m_settings.padding + vscale - 1 ) / vscale ) * vscale;
+    m_sheetProp.border = ( ( m_settings.border + vscale - 1 ) / vscale ) * vscale;
+    m_extrude = ( ( m_settings.extrude + vscale - 1 ) / vscale ) * vscale;
+    if ( m_sprites.size() == 0 ) {
+        qDebug() << "pack(): Empty list - nothing to pack.";
+        return 0;
+    }
+    int nfails = 0;
+    qDebug() << "pack(): Packing method selected: " << m_settings.method;
+    // (the packers time their own scaling and cropping, which is taken off the packing time)
+    QElapsedTimer timer;
+    timer.start();
+    qint64 transformTime = m_stats.nsecs( Stats::STAGE_SCALE ) + m_stats.nsecs( Stats::STAGE_CROP );
+    int blockAlign = m_settings.blockAlign ? 4 : 1; // (4x4 is the block size of all the compressed texture formats)
+    blockAlign *= vscale;
+
+    if ( m_settings.method <= BuncherSettings::MAXRECTS_CONTACTPOINT ) {
+        rbp::MaxRectsBinPack::FreeRectChoiceHeuristic heuristic;
+        switch ( m_settings.method ){
+        case BuncherSettings::MAXRECTS_BESTAREA:
+            heuristic = rbp::MaxRectsBinPack::RectBestAreaFit;
+            break;
+        case BuncherSettings::MAXRECTS_SHORTSIDE:
+            heuristic = rbp::MaxRectsBinPack::RectBestShortSideFit;
+            break;
+        case BuncherSettings::MAXRECTS_LONGSIDE:
+            heuristic = rbp::MaxRectsBinPack::RectBestLongSideFit;
+            break;
+        case BuncherSettings::MAXRECTS_BOTTOMLEFT:
+            heuristic = rbp::MaxRectsBinPack::RectBottomLeftRule;
+            break;
+        case BuncherSettings::MAXRECTS_CONTACTPOINT:
+            heuristic = rbp::MaxRectsBinPack::RectContactPointRule;
+            break;
+        default:
+            qDebug() << "Warning - using default method in pack() - check indexes";
+            heuristic = rbp::MaxRectsBinPack::RectBestAreaFit;
+            break;
+        }
+        nfails = Packer::MaxRects( m_sheetProp, m_sprites, heuristic, m_settings.rotation, m_settings.cropping,
+                                   m_settings.expand, m_extrude, m_settings.scale, blockAlign, m_cancel, &m_stats );
+    }
+    else {
+        nfails = Packer::Rows( m_sheetProp, m_sprites, m_settings.rotation, m_settings.cropping,
+                               m_settings.expand, m_extrude, m_settings.scale, blockAlign, m_cancel, &m_stats );
+    }
+    transformTime = m_stats.nsecs( Stats::STAGE_SCALE ) + m_stats.nsecs( Stats::STAGE_CROP ) - transformTime;
+    m_stats.addTime( Stats::STAGE_PACK, timer.nsecsElapsed() - transformTime );
+    return nfails;
+}
+
+const QList<PackSprite>& SheetBuilder::sprites() const
+{
+    return m_sprites;
+}
+
+const SheetProperties& SheetBuilder::sheetProperties() const
+{
+    return m_sheetProp;
+}
+
+int SheetBuilder::extrude() const
+{
+    return m_extrude;
+}
+
+QImage SheetBuilder::renderSheet() const
+{
+    qDebug() << "QImage format is " << m_settings.qImageFormat() << " for our value " << m_settings.imageFormat;
+    return renderSheetArea( QRect( 0, 0, m_sheetProp.width, m_sheetProp.height ));
+}
+
+QImage SheetBuilder::renderSheetArea( const QRect &area ) const
+{
+    return renderSheetArea( area, m_settings.qImageFormat(), m_settings.dither, m_settings.isBleeding() );
+}
+
+QImage SheetBuilder::renderSheetArea( const QRect &area, QImage::Format format, int dither, bool bleed ) const
+{
+    // Bleeding looks at each sprite's whole bleed area, so a partial render has to include all of the ones it touches.
+    int extrude = m_extrude;
+    QRect renderArea = area;
+    if ( bleed ) {
+        for (int i = 0; i < m_sprites.size(); ++i) {
+            QRect bleedRect = SheetRenderer::BleedRect( m_sprites[i], m_sheetProp, extrude );
+            if ( bleedRect.intersects( area ))
+                renderArea |= bleedRect;
+        }
+    }
+
+    // Composite at full quality first (premultiplied is what QPainter is fastest at), then convert to the output format.
+    QImage image( renderArea.size(), QImage::Format_ARGB32_Premultiplied );
+    if ( image.isNull() )
+        return image;
+    image.fill( Qt::transparent );
+    {
+        Stats::Timer timer( &m_stats, Stats::STAGE_RENDER );
+        Trace::Span span( "composite", "render" );
+        QPainter painter(&image);
+        painter.translate( -renderArea.topLeft() );
+        SheetRenderer::RenderArea( painter, renderArea, m_sheetProp, m_sprites, extrude, m_cancel );
+    }
+    if ( isCancelled() )
+        return QImage();
+    {
+        Stats::Timer timer( &m_stats, Stats::STAGE_CONVERT );
+        Trace::Span span( "convert", "render" );
+        image = ImageConverter::Convert( image, format, ImageConverter::DitherModes( dither ), renderArea.top() );
+    }
+    if ( bleed ) {
+        Stats::Timer timer( &m_stats, Stats::STAGE_BLEED );
+        Trace::Span span( "bleed", "render" );
+        SheetRenderer::BleedAlpha( image, renderArea.topLeft(), m_sheetProp, m_sprites, extrude );
+        if ( renderArea != area )
+            image = image.copy( area.translated( -renderArea.topLeft() ));
+    }
+    return image;
+}
+
+QImage SheetBuilder::renderVariantArea( const QRect &area, int factor ) const
+{
+    if ( factor == 1 )
+        return renderSheetArea( area );
+    // Render the full size pixels in ARGB32 (so nothing is lost before downsampling), then halve them as often as needed.
+    // Halving works like a mip chain, so each sprite's pixels are only averaged with its own.
+    QRect fullArea = QRect( area.x() * factor, area.y() * factor, area.width() * factor, area.height() * factor )
+                     & QRect( 0, 0, m_sheetProp.width, m_sheetProp.height );
+    QImage image = renderSheetArea( fullArea, QImage::Format_ARGB32, ImageConverter::DITHER_NONE, m_settings.isBleeding() );
+    QVector<QRect> regions = spriteRegions( 1 );
+    {
+        Stats::Timer timer( &m_stats, Stats::STAGE_RENDER );
+        Trace::Span span( "downsample", "render" );
+        for (int level = 0; ( 1 << level ) < factor && !image.isNull(); ++level)
+            image = TextureWriter::Downsample( image, level, fullArea.y() >> level, ( image.width() + 1 ) / 2,
+                                               ( image.height() + 1 ) / 2, regions );
+    }
+    if ( image.isNull() )
+        return image;
+    Stats::Timer timer( &m_stats, Stats::STAGE_CONVERT );
+    return ImageConverter::Convert( image, m_settings.qImageFormat(), ImageConverter::DitherModes( m_settings.dither ), area.top() );
+}
+
+QVector<QRect> SheetBuilder::spriteRegions( int factor ) const
+{
+    // Each sprite owns its own area, plus half the padding around it.
+    QVector<QRect> regions;
+    for (int i = 0; i < m_sprites.size(); ++i) {
+        QRect r = SheetRenderer::BleedRect( m_sprites[i], m_sheetProp, m_extrude );
+        if ( factor > 1 )
+            r.setCoords( r.left() / factor, r.top() / factor, r.right() / factor, r.bottom() / factor );
+        regions.append( r );
+    }
+    return regions;
+}
+
+SheetProperties SheetBuilder::variantSheetProperties( int factor ) const
+{
+    // Padding and border were rounded up to a multiple of the largest factor when packing, so these divide exactly.
+    SheetProperties prop = m_sheetProp;
+    prop.width = ( m_sheetProp.width + factor - 1 ) / factor;
+    prop.height = ( m_sheetProp.height + factor - 1 ) / factor;
+    prop.padding = m_sheetProp.padding / factor;
+    prop.border = m_sheetProp.border / factor;
+    return prop;
+}
+
+QList<PackSprite> SheetBuilder::variantSprites( int factor ) const
+{
+    if ( factor == 1 )
+        return m_sprites;
+    // Sprite rects start on a multiple of the largest factor (see pack() - border and extrusion are multiples of it, and
+    // the packer keeps the extruded rects on multiples of it), so only their sizes need rounding.
+    int padding = m_sheetProp.padding / factor;
+    int border = m_sheetProp.border / factor;
+    QList<PackSprite> sprites = m_sprites;
+    for (int i = 0; i < sprites.size(); ++i) {
+        rbp::Rect r = sprites[i].packedRect();
+        if ( r.width <= 0 || r.height <= 0 )
+            continue;
+        rbp::Rect scaled;
+        scaled.x = ( r.x + m_sheetProp.border ) / factor - border;
+        scaled.y = ( r.y + m_sheetProp.border ) / factor - border;
+        scaled.width = ( r.width - m_sheetProp.padding + factor - 1 ) / factor + padding;
+        scaled.height = ( r.height - m_sheetProp.padding + factor - 1 ) / factor + padding;
+        sprites[i].setPackedRect( scaled );
+    }
+    return sprites;
+}
+
+QRect SheetBuilder::alignedRenderArea( const QRect &area ) const
+{
+    // Dither patterns are based on sheet position, so partial renders have to start on the same 4x4 grid as a full render.
+    // Error diffusion depends on everything to the left (and above, within a band), so we redo whole bands for that.
+    QRect aligned;
+    if ( m_settings.dither == ImageConverter::DITHER_DIFFUSION ) {
+        int band = ImageConverter::BandHeight;
+        aligned.setCoords( 0, ( area.top() / band ) * band, m_sheetProp.width - 1, ( area.bottom() / band + 1 ) * band - 1 );
+    }
+    else
+        aligned.setCoords( ( area.left() / 4 ) * 4, ( area.top() / 4 ) * 4, ( area.right() / 4 ) * 4 + 3, ( area.bottom() / 4 ) * 4 + 3 );
+    return aligned & QRect( 0, 0, m_sheetProp.width, m_sheetProp.height );
+}
+
+bool SheetBuilder::writeSheetPng( const QString &fileName, QString &error, int factor, const ProgressFunction &progress ) const
+{
+    SheetProperties prop = variantSheetProperties( factor );
+    QImage::Format format = m_settings.qImageFormat();
+    bool hasAlpha = QImage::toPixelFormat( format ).alphaUsage() == QPixelFormat::UsesAlpha;
+    bool indexed = m_settings.imageFormat == BuncherSettings::FORMAT_INDEXED8;
+    // Bands of about ExportBandBytes, in whole dither bands so the result matches the preview.
+    int ditherBand = ImageConverter::BandHeight;
+    // (smaller variants render factor times as many full size rows)
+    int rows = int( qMax( qint64( 1 ), ExportBandBytes / ( qint64( m_sheetProp.width ) * 4 * ditherBand * factor ))) * ditherBand;
+    qDebug() << "writeSheetPng - rendering in bands of " << rows << " rows";
+
+    // Indexed output renders the sheet twice - once for the palette, once to write.
+    int passes = indexed ? 2 : 1;
+    int total = prop.height * passes;
+
+    ColorQuantizer quantizer;
+    PngWriter png;
+    png.setCompression( PngWriter::CompressionLevels( m_settings.pngCompression ));
+    if ( indexed ) {
+        // The palette comes from a histogram of the whole sheet, so it's shared by every band.
+        for (int y = 0; y < prop.height; y += rows) {
+            if ( progress && !progress( y, total )) {
+                error = "Cancelled.";
+                return false;
+            }
+            QImage band;
+            {
+                Trace::Span span( "render band", "export" );
+                band = renderVariantArea( QRect( 0, y, prop.width, qMin( rows, prop.height - y )), factor );
+            }
+            if ( band.isNull() ) {
+                error = "Out of memory rendering the sheet.";
+                return false;
+            }
+            Stats::Timer timer( &m_stats, Stats::STAGE_ENCODE );
+            Trace::Span span( "histogram band", "encode" );
+            quantizer.addPixels( band );
+        }
+        Stats::Timer timer( &m_stats, Stats::STAGE_ENCODE );
+        png.setPalette( quantizer.buildPalette() );
+        qDebug() << "writeSheetPng - palette has " << quantizer.palette().size() << " colours";
+    }
+    if ( !png.open( fileName, prop.width, prop.height, hasAlpha )) {
+        error = png.errorString();
+        return false;
+    }
+
+    // Compression runs on the thread pool while we render the next band here.
+    for (int y = 0; y < prop.height; y += rows) {
+        if ( progress && !progress( y + prop.height * ( passes - 1 ), total )) {
+            error = "Cancelled.";
+            return false;
+        }
+        QImage band;
+        {
+            Trace::Span span( "render band", "export" );
+            band = renderVariantArea( QRect( 0, y, prop.width, qMin( rows, prop.height - y )), factor );
+        }
+        if ( band.isNull() ) {
+            error = "Out of memory rendering the sheet.";
+            return false;
+        }
+        m_stats.addCount( Stats::COUNT_BANDS );
+        Stats::Timer timer( &m_stats, Stats::STAGE_ENCODE ); // (includes streaming it to the file)
+        Trace::Span span( "encode band", "encode" );
+        if ( indexed )
+            band = quantizer.map( band, ImageConverter::DitherModes( m_settings.dither ), y );
+        if ( !png.writeRows( band )) {
+            error = png.errorString();
+            return false;
+        }
+        m_memory.setPeak( MemoryUsage::MEM_ENCODER, MemoryUsage::ImageBytes( band ) + png.bufferedBytes() );
+    }
+    Stats::Timer timer( &m_stats, Stats::STAGE_ENCODE );
+    bool ok = png.close();
+    if ( progress )
+        progress( total, total );
+    if ( !ok ) {
+        error = png.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SheetBuilder::writeSheetTexture( const QString &fileName, QString &error, int factor, const ProgressFunction &progress ) const
+{
+    SheetProperties prop = variantSheetProperties( factor );
+    TextureWriter writer;
+    writer.setFormat( TextureCompressor::Formats( m_settings.textureFormat() ),
+                      TextureCompressor::QualityLevels( m_settings.texQuality ));
+    writer.setContainer( TextureWriter::Containers( m_settings.texContainer ));
+    if ( m_settings.mipmaps )
+        writer.setMipmaps( true, spriteRegions( factor )); // (mip levels don't mix the sprites' areas)
+    if ( !writer.open( fileName, prop.width, prop.height )) {
+        error = writer.errorString();
+        return false;
+    }
+    // Bands of about ExportBandBytes, in whole rows of 4x4 blocks (BandHeight is a multiple of 4).
+    int band = ImageConverter::BandHeight;
+    int rows = int( qMax( qint64( 1 ), ExportBandBytes / ( qint64( m_sheetProp.width ) * 4 * band * factor ))) * band;
+    qDebug() << "writeSheetTexture - rendering in bands of " << rows << " rows";
+
+    // Each band's blocks are encoded on the thread pool.
+    for (int y = 0; y < prop.height; y += rows) {
+        if ( progress && !progress( y, prop.height )) {
+            error = "Cancelled.";
+            return false; // (the writer removes the unfinished file)
+        }
+        QImage img;
+        {
+            Trace::Span span( "render band", "export" );
+            img = renderVariantArea( QRect( 0, y, prop.width, qMin( rows, prop.height - y )), factor );
+        }
+        if ( img.isNull() ) {
+            error = "Out of memory rendering the sheet.";
+            return false;
+        }
+        m_stats.addCount( Stats::COUNT_BANDS );
+        Stats::Timer timer( &m_stats, Stats::STAGE_ENCODE ); // (includes streaming it to the file)
+        Trace::Span span( "encode band", "encode" );
+        if ( !writer.writeRows( img )) {
+            error = writer.errorString();
+            return false;
+        }
+        m_memory.setPeak( MemoryUsage::MEM_ENCODER, MemoryUsage::ImageBytes( img ) + writer.bufferedBytes() );
+    }
+    Stats::Timer timer( &m_stats, Stats::STAGE_ENCODE );
+    bool ok = writer.close();
+    if ( progress )
+        progress( prop.height, prop.height );
+    if ( !ok ) {
+        error = writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+const Stats& SheetBuilder::stats() const
+{
+    return m_stats;
+}
+
+void SheetBuilder::clearStats()
+{
+    m_stats.clear();
+    m_memory.clear();
+}
+
+MemoryUsage SheetBuilder::memoryUsage() const
+{
+    MemoryUsage usage = m_memory;
+    // Uncropped, unscaled sprites share their original's pixels, so images are counted by cacheKey, once each.
+    QSet<qint64> counted;
+    // Sprites in the pixel cache are counted from the cache (asking them for their images would fetch them).
+    if ( m_pixelCache ) {
+        usage.add( MemoryUsage::MEM_ORIGINALS, m_pixelCache->bytes( false ));
+        usage.add( MemoryUsage::MEM_TRANSFORMED, m_pixelCache->bytes( true ));
+    }
+    foreach ( const PackSprite &sprite, m_sprites ) {
+        if ( sprite.pixelCache() )
+            continue;
+        if ( !counted.contains( sprite.originalImage().cacheKey() )) {
+            counted.insert( sprite.originalImage().cacheKey() );
+            usage.add( MemoryUsage::MEM_ORIGINALS, MemoryUsage::ImageBytes( sprite.originalImage() ));
+        }
+    }
+    foreach ( const PackSprite &sprite, m_sprites ) {
+        if ( sprite.pixelCache() )
+            continue;
+        if ( !counted.contains( sprite.image().cacheKey() )) {
+            counted.insert( sprite.image().cacheKey() );
+            usage.add( MemoryUsage::MEM_TRANSFORMED, MemoryUsage::ImageBytes( sprite.image() ));
+        }
+    }
+    return usage;
+}
+
+QJsonObject SheetBuilder::report() const
+{
+    QJsonObject obj;
+    obj.insert( "folder", m_inDirn );
+    obj.insert( "sprites", m_sprites.size() );
+    obj.insert( "width", m_sheetProp.width );
+    obj.insert( "height", m_sheetProp.height );
+    obj.insert( "stats", m_stats.toJson() );
+    obj.insert( "memory", memoryUsage().toJson() );
+    if ( m_pixelCache ) {
+        QJsonObject cache;
+        cache.insert( "budget", double( m_pixelCache->budget() ));
+        cache.insert( "hits", double( m_pixelCache->hits() ));
+        cache.insert( "misses", double( m_pixelCache->misses() ));
+        cache.insert( "evictions", double( m_pixelCache->evictions() ));
+        cache.insert( "decodes", double( m_pixelCache->decodes() ));
+        obj.insert( "pixelCache", cache );
+    }
+    return obj;
+}
+
+QString SheetBuilder::reportFileName() const
+{
+    return m_outDirn + "/buncher-report.json";
+}
+
+bool SheetBuilder::saveReport( const QString &fileName ) const
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate )) {
+        qWarning() << "saveReport - could not write" << fileName;
+        return false;
+    }
+    return file.write( QJsonDocument( report() ).toJson() ) >= 0;
+}
+
+bool SheetBuilder::isUpToDate( ExportManifest *manifest ) const
+{
+    ExportManifest current, previous;
+    if ( !manifest )
+        manifest = &current;
+    manifest->setSettings( m_settings.toJson() );
+    manifest->setInputs( m_inDirn, inputFiles() );
+    return previous.load( m_outDirn + "/" + ExportManifest::fileName() ) && manifest->matches( previous ) &&
+           previous.outputsExist( m_outDirn );
+}
+
+SheetBuilder::ExportResults SheetBuilder::exportFiles( QString &error, const ProgressFunction &progress,
+                                                       const ExportManifest *current )
+{
+    qDebug() << "exportFiles";
+    QDir dir( m_outDirn );
+    bool ok = dir.mkpath( m_outDirn );
+    if ( !ok || !dir.exists() ) {
+        qWarning( "Could not create/write to output folder.");
+        error = "Can not create/write to output folder.";
+        return EXPORT_FAILED;
+    }
+    // Formats that share a file extension would overwrite each other.
+    QList<int> formats = m_settings.dataFormats();
+    QMap<QString, int> extensions;
+    foreach ( int format, formats ) {
+        QString extn = DataExporter::fileExtension( DataExporter::DataFormats( format ));
+        if ( extensions.contains( extn )) {
+            error = DataExporter::displayName( DataExporter::DataFormats( extensions[extn] )) + " and " +
+                    DataExporter::displayName( DataExporter::DataFormats( format )) + " both write " + extn +
+                    " files, please choose only one of them.";
+            return EXPORT_FAILED;
+        }
+        extensions.insert( extn, format );
+    }
+    // If the inputs and settings are the same as last time, and the files are still there, there's nothing to do.
+    ExportManifest manifest;
+    if ( current )
+        manifest = *current;
+    else if ( isUpToDate( &manifest )) {
+        qDebug() << "exportFiles - nothing changed since the last export";
+        return EXPORT_UP_TO_DATE;
+    }
+    // Everything is written to a staging folder, then moved into place together - so a failed or cancelled export
+    // leaves the previous files as they were.
+    ExportTransaction transaction( dir.path() );
+    if ( !transaction.isValid() ) {
+        error = "Can not create/write to output folder.";
+        return EXPORT_FAILED;
+    }
+    // The settings file is staged too, so it only changes along with the files it made.
+    QString stage = transaction.stagingPath();
+    bool settingsOk = m_settings.save( stage + "/" + QFileInfo( settingsFileName() ).fileName() );
+
+    // With variants, the packed (largest) sheet comes first, then each smaller one, each with its own data files.
+    struct VariantExport {
+        QString name;
+        SheetProperties prop;
+        QList<PackSprite> sprites;
+    };
+    QVector<VariantExport> variants;
+    int vscale = m_settings.variantScale();
+    for (int factor = 1; factor <= vscale; factor *= 2) {
+        VariantExport variant;
+        variant.name = m_settings.baseName + m_settings.variantSuffix( factor );
+        variant.prop = variantSheetProperties( factor );
+        // The data files name the image and its pixel format.
+        variant.prop.imageName = variant.name + m_settings.imageExtension();
+        variant.prop.pixelFormat = m_settings.pixelFormatName();
+        variant.sprites = variantSprites( factor );
+        variants.append( variant );
+    }
+    m_sheetProp = variants.first().prop;
+
+    // The data files only need the packing, so they're written on the thread pool while the image(s) are rendered
+    // here. (variants isn't touched until they've finished, so the sprite lists are shared, not copied, and freed here.)
+    QList< QFuture<bool> > dataJobs;
+    QVector<qint64> dataTimes( variants.size() * formats.size(), 0 ); // (each job times itself)
+    for (int v = 0; v < variants.size(); ++v) {
+        foreach ( int format, formats ) {
+            const VariantExport *variant = &variants[v];
+            qint64 *dataTime = &dataTimes[dataJobs.size()];
+            dataJobs.append( QtConcurrent::run( [=]() {
+                Trace::Span span( "data file", "write", variant->name );
+                QElapsedTimer timer;
+                timer.start();
+                bool ok = DataExporter::Export( variant->prop, DataExporter::DataFormats( format ), stage, variant->name, variant->sprites );
+                *dataTime = timer.nsecsElapsed();
+                return ok;
+            }));
+        }
+    }
+
+    // Each image is rendered in bands and streamed out, so it never has to fit in memory all at once.
+    bool cancelled = false;
+    ProgressFunction imageProgress = [&]( int done, int total ) {
+        cancelled = progress && !progress( done, total );
+        return !cancelled;
+    };
+    QString imgError;
+    bool imgOk = true;
+    for (int v = 0; v < variants.size() && imgOk; ++v) {
+        int factor = 1 << v;
+        if ( m_settings.textureFormat() >= 0 )
+            imgOk = writeSheetTexture( stage + "/" + variants[v].prop.imageName, imgError, factor, imageProgress );
+        else
+            imgOk = writeSheetPng( stage + "/" + variants[v].prop.imageName, imgError, factor, imageProgress );
+    }
+    bool okx = true;
+    for (int i = 0; i < dataJobs.size(); ++i) {
+        okx = dataJobs[i].result() && okx;
+        m_stats.addTime( Stats::STAGE_WRITE, dataTimes[i] );
+    }
+
+    // The manifest goes in with the files it describes.
+    if ( imgOk && okx && settingsOk ) {
+        manifest.setOutputs( QDir( stage ).entryList( QDir::Files ));
+        manifest.save( stage + "/" + ExportManifest::fileName() );
+    }
+    if ( cancelled ) {
+        error = "Cancelled.";
+        return EXPORT_CANCELLED;
+    }
+    if ( !imgOk ) {
+        error = "Could not create sheet image: " + imgError + "\nNo files were changed.";
+        return EXPORT_FAILED;
+    }
+    if ( !okx ) {
+        QStringList formatNames;
+        foreach ( int format, formats )
+            formatNames.append( DataExporter::displayName( DataExporter::DataFormats( format )));
+        error = "Could not write file/data for format: " + formatNames.join( ", " ) + "\nNo files were changed.";
+        return EXPORT_FAILED;
+    }
+    if ( !settingsOk ) {
+        error = "Could not write the settings file.\nNo files were changed.";
+        return EXPORT_FAILED;
+    }
+    m_stats.addCount( Stats::COUNT_FILES_WRITTEN, QDir( stage ).entryList( QDir::Files ).size() );
+    {
+        Stats::Timer timer( &m_stats, Stats::STAGE_WRITE );
+        if ( !transaction.commit() ) {
+            error = "Could not replace the exported files: " + transaction.errorString();
+            return EXPORT_FAILED;
+        }
+    }
+    saveReport( reportFileName() );
+    return EXPORT_DONE;
+}
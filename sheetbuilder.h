@@ -0,0 +1,259 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SHEETBUILDER_H
+#define SHEETBUILDER_H
+
+#include <QAtomicInt>
+#include <QFileInfoList>
+#include <QImage>
+#include <QJsonObject>
+#include <QList>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+#include "bunchersettings.h"
+#include "memoryusage.h"
+#include "packsprite.h"
+#include "pixelcache.h"
+#include "sheetproperties.h"
+#include "stats.h"
+
+class ExportManifest;
+
+//! Loads, packs, renders and exports one folder's sprite sheet. Needs no widgets (or even a QGuiApplication).
+/*! This is the whole pipeline the main window drives, working from a BuncherSettings struct rather than from the UI,
+ *  so it can also be run from the command line (see buncher-cli). Usual order: setInputFolder(), setSettings() (or
+ *  loadSettings()), loadSprites(), pack(), then renderSheet() or exportFiles().
+ */
+class SheetBuilder
+{
+public:
+
+    //! Results of exportFiles().
+    enum ExportResults { EXPORT_DONE = 0, EXPORT_UP_TO_DATE, EXPORT_FAILED, EXPORT_CANCELLED };
+
+    //! Progress callback for long operations, given the work done so far and the total. Return false to cancel.
+    typedef std::function<bool( int done, int total )> ProgressFunction;
+
+    //! Constructor.
+    SheetBuilder();
+
+    //! Sets the settings used by everything else. Call pack() again afterwards for changes to take effect.
+    void setSettings( const BuncherSettings &settings );
+    //! Returns the current settings.
+    const BuncherSettings& settings() const;
+
+    //! Sets a flag that cancels loading, packing and rendering as soon as it's set (from any thread). Null for none.
+    /*! A cancelled loadSprites() skips the files it hasn't decoded yet, pack() returns -1, and rendering returns a
+     *  null image. The results are incomplete, and should be thrown away.
+     */
+    void setCancelFlag( const QAtomicInt *cancel );
+    //! Returns true if the cancel flag is set.
+    bool isCancelled() const;
+
+    //! Keeps the sprites' pixels within a budget, in a least-recently-used PixelCache, instead of in every sprite.
+    /*! Packing only needs the sprites' sizes and crop rects; rendering fetches their pixels, decoding any that were
+     *  evicted from their files again. Applies to sprites loaded (or reloaded) from then on - but not addSprite() ones,
+     *  which have no file to go back to. 0 (the default) turns it off.
+     * \param bytes - bytes of decoded and transformed pixels to keep.
+     */
+    void setPixelBudget( qint64 bytes );
+    //! Returns the pixel budget, or 0 if there isn't one.
+    qint64 pixelBudget() const;
+
+    //! Sets the input folder. The output folder is always the "buncher" folder inside it.
+    void setInputFolder( const QString &path );
+    //! Returns the input folder.
+    const QString& inputFolder() const;
+    //! Returns the output folder.
+    const QString& outputFolder() const;
+    //! Returns the file name of the folder's json settings file (hardcoded to "buncher.data" in the output folder).
+    QString settingsFileName() const;
+
+    //! Reads the folder's json settings file over the current settings. Returns false if there isn't one.
+    bool loadSettings();
+
+    //! Returns the files in the input folder that loadSprites() tries to load (subfolders too, if that option is on).
+    QFileInfoList inputFiles() const;
+
+    //! Loads images from the input folder, ready for packing. Sprites are sorted based on the packing method.
+    /*! \returns the number of sprites loaded.
+     */
+    int loadSprites();
+
+    //! Like loadSprites(), but keeps the sprites already loaded whose files haven't changed (same size and modified time).
+    /*! Their crop rects are kept too (see PackSprite::cropImage). For tools that stay running between packs, e.g. the
+     *  buncher-cli daemon.
+     * \returns the number of files decoded (new or changed ones). Removed files just drop out of the list.
+     */
+    int reloadSprites();
+
+    //! Adds one sprite from memory, sorted in as loadSprites() would. Invalid images are ignored.
+    /*! \param name - the sprite's name, as written in the data files (only the part after any '/' is used).
+     *  \param image - the sprite's pixels.
+     */
+    void addSprite( const QString &name, const QImage &image );
+
+    //! Removes all sprites.
+    void clearSprites();
+
+    //! Starts the packing, based on current method and settings. Previous packing rect data will be lost.
+    /*!
+     * \return The number of sprites that failed to pack. Anything non-zero means we failed to pack all the images.
+     * Returns -1 if cancelled (see setCancelFlag).
+     */
+    int pack();
+
+    //! Returns the current list of packing sprites. Packing rects will be valid only after pack() is called.
+    const QList<PackSprite>& sprites() const;
+    //! Returns the sheet properties of the last packing.
+    const SheetProperties& sheetProperties() const;
+    //! Returns the extrusion used by the last packing (the setting, rounded up to a multiple of the largest variant
+    //! factor, as padding and border are). Use this, not the setting, when rendering.
+    int extrude() const;
+
+    //! Renders the whole sheet to an image, based on current format and settings.
+    QImage renderSheet() const;
+
+    //! Renders part of the current sheet, based on current format and settings.
+    /*! The sprites are composited in ARGB32 premultiplied, then converted (and dithered) to the chosen format.
+     * \param area - the sheet area to render, in pixels.
+     * \return The QImage for that area (same size as area), with current color-depth setting.
+     */
+    QImage renderSheetArea( const QRect &area ) const;
+
+    //! Renders part of the current sheet, with the given format, dithering and bleeding.
+    QImage renderSheetArea( const QRect &area, QImage::Format format, int dither, bool bleed ) const;
+
+    //! Renders part of a smaller variant of the sheet, by downsampling the full size pixels.
+    /*!
+     * \param area - the area to render, in the variant's pixels.
+     * \param factor - how many times smaller the variant is (1, 2 or 4).
+     * \return The QImage for that area, with current color-depth setting.
+     */
+    QImage renderVariantArea( const QRect &area, int factor ) const;
+
+    //! Returns each sprite's area on the sheet (see SheetRenderer::BleedRect), divided by factor.
+    QVector<QRect> spriteRegions( int factor ) const;
+
+    //! Returns the sheet properties for a variant factor times smaller than the packed sheet.
+    SheetProperties variantSheetProperties( int factor ) const;
+
+    //! Returns a copy of the packed sprites with their rects scaled for a variant factor times smaller.
+    QList<PackSprite> variantSprites( int factor ) const;
+
+    //! Grows an area so a partial render exactly matches the same part of a full render (dithering is position dependent).
+    QRect alignedRenderArea( const QRect &area ) const;
+
+    //! Renders the sheet in horizontal bands and streams them to a PNG file (see PngWriter).
+    /*!
+     * \param fileName - the file to write.
+     * \param error - set to a description of the problem, on failure.
+     * \param factor - for variants, how many times smaller than the packed sheet to write it.
+     * \param progress - optional progress callback, called before each band.
+     * \return true - if the file was written successfully.
+     */
+    bool writeSheetPng( const QString &fileName, QString &error, int factor = 1,
+                        const ProgressFunction &progress = ProgressFunction() ) const;
+
+    //! Renders the sheet in horizontal bands, block-compresses them and streams them to a texture file (see TextureWriter).
+    /*! Uses the current container and mipmap settings. Parameters are as for writeSheetPng.
+     */
+    bool writeSheetTexture( const QString &fileName, QString &error, int factor = 1,
+                            const ProgressFunction &progress = ProgressFunction() ) const;
+
+    //! Returns true if the last export's files are all there, and were made from the same inputs and settings.
+    /*! Only reads (and hashes) the input files, so it can be checked before loading anything. exportFiles() does this
+     *  check itself, unless it's given the manifest from here.
+     * \param manifest - if given, set to the manifest of the current inputs and settings.
+     */
+    bool isUpToDate( ExportManifest *manifest = 0 ) const;
+
+    //! Exports the sheet image(s) and data file(s) to the output folder, and saves the settings file with them.
+    /*! Nothing is written if the inputs and settings are the same as the last export (see ExportManifest). Everything
+     *  is written to a staging folder first, so a failed or cancelled export leaves the previous files as they were.
+     * \param error - set to a description of the problem, if the export failed.
+     * \param progress - optional progress callback, passed on to the image writers.
+     * \param current - optional manifest from an isUpToDate() call that returned false (since pack() was called). The
+     *  check isn't repeated, and the inputs aren't hashed again.
+     * \returns one of ExportResults.
+     */
+    ExportResults exportFiles( QString &error, const ProgressFunction &progress = ProgressFunction(),
+                               const ExportManifest *current = 0 );
+
+    //! Returns the timings and counters of everything done since the builder was made, or clearStats() was called.
+    const Stats& stats() const;
+    //! Sets the stats (and the encoder buffers' peak, see memoryUsage()) back to zero.
+    void clearStats();
+
+    //! Returns the memory held by the sprites' original and transformed images, and the peak used by encoder buffers.
+    MemoryUsage memoryUsage() const;
+
+    //! Returns a machine-readable report of the last run: the folder, sprite count, sheet size, stats() and memoryUsage(),
+    //! and the pixel cache's counters if there's a pixel budget.
+    QJsonObject report() const;
+    //! Returns the file name exportFiles() saves the report as ("buncher-report.json" in the output folder).
+    /*! It's written after the exported files are in place, so it's not part of the export (see ExportManifest).
+     */
+    QString reportFileName() const;
+    //! Saves report() as json. Returns false if the file can't be written.
+    bool saveReport( const QString &fileName ) const;
+
+    //! Roughly how much memory (in bytes) each band of an exported sheet may use.
+    static const qint64 ExportBandBytes = 64 * 1024 * 1024;
+
+protected:
+
+    //! Adds a sprite to the list, at its place in the packing order for the current method.
+    void insertSprite( const PackSprite &sprite );
+
+    //! Decodes a file into a sprite (in its pixel cache, if there's a budget). Returns a null sprite if it can't be read.
+    PackSprite loadSprite( const QFileInfo &file ) const;
+
+    //! Calls inputFiles(), adding it to the stats.
+    QFileInfoList scanInputFiles();
+    //! Adds the decode time of each file to the stats.
+    void addDecodeTimes( const QVector<qint64> &nsecs );
+
+    //! Current settings.
+    BuncherSettings m_settings;
+    //! Contains current list of packing sprites.
+    QList<PackSprite> m_sprites;
+    //! Stores main sheet properties.
+    SheetProperties m_sheetProp;
+    //! Extrusion used by the last packing (see extrude()).
+    int m_extrude;
+    //! Input folder name.
+    QString m_inDirn;
+    //! Output folder name.
+    QString m_outDirn;
+    //! Cancel flag, or null.
+    const QAtomicInt *m_cancel;
+    //! Where the sprites' pixels are kept, if there's a pixel budget. Shared by copies of the builder.
+    QSharedPointer<PixelCache> m_pixelCache;
+    //! Timings and counters. (mutable, as rendering is timed too.)
+    mutable Stats m_stats;
+    //! Peak memory of the encoder buffers (the only category kept - the rest are counted when asked for).
+    mutable MemoryUsage m_memory;
+};
+
+#endif // SHEETBUILDER_H
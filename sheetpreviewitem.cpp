@@ -0,0 +1,320 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sheetpreviewitem.h"
+#include "memoryusage.h"
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QGraphicsSceneMouseEvent>
+#include <QGraphicsSceneHoverEvent>
+#include <QStyleOptionGraphicsItem>
+#include <QPixmapCache>
+#include <QPainter>
+#include <QDebug>
+
+SheetPreviewItem::SheetPreviewItem( QGraphicsItem *parent ) :
+    QGraphicsObject( parent ),
+    m_pyramidReady( false ),
+    m_generation( 0 ),
+    m_selected( -1 )
+{
+    setAcceptHoverEvents( true );
+    QObject::connect( &m_pyramidWatcher, SIGNAL(finished()), this, SLOT(pyramidFinished()) );
+}
+
+SheetPreviewItem::~SheetPreviewItem()
+{
+    stopPyramid();
+}
+
+void SheetPreviewItem::setSheet( const QSize &size, const RenderFunction &render )
+{
+    stopPyramid();
+    prepareGeometryChange();
+    m_size = size;
+    m_render = render;
+    m_generation++;
+    startPyramid();
+    update();
+}
+
+void SheetPreviewItem::clearSheet()
+{
+    setSheet( QSize(), RenderFunction() );
+}
+
+bool SheetPreviewItem::hasSheet() const
+{
+    return !m_size.isEmpty() && m_render;
+}
+
+qint64 SheetPreviewItem::pyramidBytes() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < m_levels.size(); ++i)
+        bytes += MemoryUsage::ImageBytes( m_levels[i] );
+    return bytes;
+}
+
+void SheetPreviewItem::updateSheet( const RenderFunction &render, const QRegion &area )
+{
+    m_render = render;
+    if ( !hasSheet() )
+        return;
+    if ( m_pyramidReady ) {
+        // Levels are up-to-date apart from the changed area, so just redo that part of each level (it's usually small).
+        foreach ( const QRect &r, area.rects() )
+            renderLevels( m_render, m_size, m_levels, r & QRect( QPoint(), m_size ));
+    }
+    else
+        startPyramid(); // (an unfinished build has the old sheet, so start again)
+
+    // Drop the cached tiles that show the changed area, at every level.
+    int nlevels = LevelCount( m_size );
+    foreach ( const QRect &r, area.rects() ) {
+        for (int level = 0; level <= nlevels; ++level) {
+            int span = TileSize << level; // sheet pixels covered by a tile at this level
+            for (int ty = r.top() / span; ty <= r.bottom() / span; ++ty)
+                for (int tx = r.left() / span; tx <= r.right() / span; ++tx)
+                    QPixmapCache::remove( tileKey( level, tx, ty ));
+        }
+    }
+    update( area.boundingRect() );
+}
+
+void SheetPreviewItem::setSprites( const QVector<QRect> &rects, const QStringList &toolTips )
+{
+    m_index.build( rects, m_size );
+    m_toolTips = toolTips;
+    if ( m_selected >= rects.size() )
+        m_selected = -1;
+    update();
+}
+
+QRect SheetPreviewItem::spriteRect( int index ) const
+{
+    return m_index.rect( index );
+}
+
+void SheetPreviewItem::setSelectedSprite( int index )
+{
+    if ( index == m_selected )
+        return;
+    update( spriteRect( m_selected ));
+    m_selected = index;
+    update( spriteRect( m_selected ));
+}
+
+int SheetPreviewItem::selectedSprite() const
+{
+    return m_selected;
+}
+
+QRectF SheetPreviewItem::boundingRect() const
+{
+    return QRectF( 0, 0, m_size.width(), m_size.height() );
+}
+
+void SheetPreviewItem::paint( QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget )
+{
+    Q_UNUSED( widget )
+    if ( !hasSheet() )
+        return;
+
+    // Use the smallest level that still has at least one pixel per screen pixel.
+    qreal lod = option->levelOfDetailFromTransform( painter->worldTransform() );
+    int maxLevel = LevelCount( m_size );
+    int level = 0;
+    while ( level < maxLevel && ( 2 << level ) * lod <= 1.0 )
+        level++;
+
+    // Full size tiles are rendered on demand, which is fine for the few that fit on screen when zoomed in. Zoomed out, we
+    // wait for the levels rather than render the whole sheet here.
+    QRect exposed = option->exposedRect.toAlignedRect() & QRect( QPoint(), m_size );
+    if ( !exposed.isEmpty() && ( level == 0 || m_pyramidReady )) {
+        int scale = 1 << level;
+        int span = TileSize * scale;
+        painter->setRenderHint( QPainter::SmoothPixmapTransform, true );
+        for (int ty = exposed.top() / span; ty <= exposed.bottom() / span; ++ty) {
+            for (int tx = exposed.left() / span; tx <= exposed.right() / span; ++tx) {
+                QPixmap pm = tilePixmap( level, tx, ty );
+                if ( !pm.isNull() )
+                    painter->drawPixmap( QRectF( tx * span, ty * span, pm.width() * scale, pm.height() * scale ), pm, QRectF( pm.rect() ));
+            }
+        }
+    }
+
+    if ( m_selected >= 0 && !spriteRect( m_selected ).isEmpty() ) {
+        painter->setBrush( QBrush( QColor( 28, 120, 222, 110 )));
+        painter->setPen( QPen( Qt::white, 0, Qt::DotLine ) ); // (cosmetic pen, stays 1 pixel wide when zoomed)
+        painter->drawRect( spriteRect( m_selected ));
+    }
+}
+
+void SheetPreviewItem::pyramidFinished()
+{
+    if ( m_cancel.load() || !m_pyramidWatcher.future().isFinished() )
+        return; // (stopped early - whoever stopped it restarts it)
+    m_levels = m_pyramidWatcher.result();
+    m_pyramidReady = ( m_levels.size() == LevelCount( m_size )); // (else it ran out of memory, and only full size tiles are shown)
+    qDebug() << "SheetPreviewItem - built " << m_levels.size() << " preview levels";
+    update();
+}
+
+void SheetPreviewItem::mousePressEvent( QGraphicsSceneMouseEvent *event )
+{
+    int index = m_index.indexAt( event->pos().toPoint() );
+    setSelectedSprite( index );
+    emit spriteClicked( index );
+    event->accept();
+}
+
+void SheetPreviewItem::hoverMoveEvent( QGraphicsSceneHoverEvent *event )
+{
+    int index = m_index.indexAt( event->pos().toPoint() );
+    setToolTip( index >= 0 ? m_toolTips.value( index ) : QString() );
+}
+
+void SheetPreviewItem::startPyramid()
+{
+    stopPyramid();
+    m_levels.clear();
+    m_pyramidReady = false;
+    m_cancel.store( 0 );
+    if ( hasSheet() ) // (the worker gets its own copy of the render function)
+        m_pyramidWatcher.setFuture( QtConcurrent::run( &SheetPreviewItem::buildPyramid, m_size, m_render, &m_cancel ));
+}
+
+void SheetPreviewItem::stopPyramid()
+{
+    if ( m_pyramidWatcher.isRunning() ) {
+        m_cancel.store( 1 );
+        m_pyramidWatcher.waitForFinished();
+    }
+}
+
+int SheetPreviewItem::LevelCount( const QSize &size )
+{
+    int count = 0;
+    for (QSize level = size; qMax( level.width(), level.height() ) > TileSize; ++count)
+        level = QSize( ( level.width() + 1 ) / 2, ( level.height() + 1 ) / 2 );
+    return count;
+}
+
+QPixmap SheetPreviewItem::tilePixmap( int level, int tx, int ty )
+{
+    QString key = tileKey( level, tx, ty );
+    QPixmap pm;
+    if ( !QPixmapCache::find( key, &pm )) {
+        if ( level == 0 )
+            pm = QPixmap::fromImage( m_render( QRect( tx * TileSize, ty * TileSize, TileSize, TileSize ) & QRect( QPoint(), m_size )));
+        else {
+            const QImage &img = m_levels.at( level - 1 );
+            pm = QPixmap::fromImage( img.copy( QRect( tx * TileSize, ty * TileSize, TileSize, TileSize ) & img.rect() ));
+        }
+        QPixmapCache::insert( key, pm );
+    }
+    return pm;
+}
+
+QString SheetPreviewItem::tileKey( int level, int tx, int ty ) const
+{
+    return QString( "sheetpreview-%1-%2-%3-%4-%5" ).arg( quintptr( this )).arg( m_generation ).arg( level ).arg( tx ).arg( ty );
+}
+
+QVector<QImage> SheetPreviewItem::buildPyramid( QSize size, RenderFunction render, const QAtomicInt *cancel )
+{
+    QVector<QImage> levels;
+    int count = LevelCount( size );
+    levels.reserve( count );
+    QSize levelSize = size;
+    for (int i = 0; i < count; ++i) {
+        levelSize = QSize( ( levelSize.width() + 1 ) / 2, ( levelSize.height() + 1 ) / 2 );
+        QImage level( levelSize, QImage::Format_ARGB32_Premultiplied );
+        if ( level.isNull() ) {
+            qWarning() << "SheetPreviewItem - not enough memory for the preview levels";
+            return QVector<QImage>();
+        }
+        level.fill( 0 ); // (in case a band fails to render)
+        levels.append( level );
+    }
+    renderLevels( render, size, levels, QRect( QPoint(), size ), cancel );
+    if ( cancel->load() )
+        return QVector<QImage>();
+    return levels;
+}
+
+void SheetPreviewItem::renderLevels( const RenderFunction &render, const QSize &size, QVector<QImage> &levels, const QRect &area,
+                                     const QAtomicInt *cancel )
+{
+    if ( levels.isEmpty() )
+        return;
+    // Start on even pixels, so each 2x2 block of the half size level comes from the same band.
+    QRect even = QRect( QPoint( area.left() & ~1, area.top() & ~1 ), QPoint( area.right() | 1, area.bottom() | 1 )) & QRect( QPoint(), size );
+    if ( even.isEmpty() )
+        return;
+    for (int y = even.top(); y <= even.bottom(); y += BandRows) {
+        if ( cancel && cancel->load() )
+            return;
+        QRect band( even.left(), y, even.width(), qMin( BandRows, even.bottom() + 1 - y ));
+        QImage pixels = render( band );
+        if ( pixels.isNull() ) {
+            qWarning() << "SheetPreviewItem - failed to render preview band " << band;
+            continue;
+        }
+        downsample( pixels, band.topLeft(), levels[0], QRect( QPoint( band.left() / 2, band.top() / 2 ), QPoint( band.right() / 2, band.bottom() / 2 )), cancel );
+    }
+    // The smaller levels come from each other.
+    QRect levelRect = QRect( QPoint( even.left() / 2, even.top() / 2 ), QPoint( even.right() / 2, even.bottom() / 2 ));
+    for (int i = 1; i < levels.size(); ++i) {
+        levelRect = QRect( QPoint( levelRect.left() / 2, levelRect.top() / 2 ), QPoint( levelRect.right() / 2, levelRect.bottom() / 2 ));
+        downsample( levels[i - 1], QPoint(), levels[i], levelRect, cancel );
+    }
+}
+
+void SheetPreviewItem::downsample( const QImage &src, const QPoint &srcOrigin, QImage &dst, const QRect &dstArea,
+                                   const QAtomicInt *cancel )
+{
+    QRect area = dstArea & dst.rect();
+    if ( area.isEmpty() )
+        return;
+    int sx0 = 2 * area.left() - srcOrigin.x();
+    int sw = qMin( 2 * area.right() + 2 - srcOrigin.x(), src.width() ) - sx0;
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        if ( cancel && cancel->load() )
+            return;
+        // Take the two source rows as premultiplied pixels, whatever the sheet format is:
+        int sy0 = 2 * y - srcOrigin.y();
+        int sy1 = qMin( sy0 + 1, src.height() - 1 );
+        QImage strip = src.copy( sx0, sy0, sw, sy1 - sy0 + 1 );
+        if ( strip.format() != QImage::Format_ARGB32_Premultiplied )
+            strip = strip.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+        const quint32 *row0 = reinterpret_cast<const quint32*>( strip.constScanLine( 0 ));
+        const quint32 *row1 = reinterpret_cast<const quint32*>( strip.constScanLine( strip.height() - 1 ));
+        quint32 *out = reinterpret_cast<quint32*>( dst.scanLine( y ));
+        for (int x = area.left(); x <= area.right(); ++x) {
+            int i0 = 2 * x - sx0;
+            int i1 = qMin( i0 + 1, sw - 1 );
+            // average the 2x2 block, two channels at a time (each sum fits in its 16 bit half).
+            quint32 rb = ( row0[i0] & 0x00ff00ff ) + ( row0[i1] & 0x00ff00ff ) + ( row1[i0] & 0x00ff00ff ) + ( row1[i1] & 0x00ff00ff ) + 0x00020002;
+            quint32 ag = ( ( row0[i0] >> 8 ) & 0x00ff00ff ) + ( ( row0[i1] >> 8 ) & 0x00ff00ff ) +
+                         ( ( row1[i0] >> 8 ) & 0x00ff00ff ) + ( ( row1[i1] >> 8 ) & 0x00ff00ff ) + 0x00020002;
+            out[x] = ( ( rb >> 2 ) & 0x00ff00ff ) | ( ( ag << 6 ) & 0xff00ff00 );
+        }
+    }
+}
@@ -0,0 +1,171 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHEETPREVIEWITEM_H
+#define SHEETPREVIEWITEM_H
+
+#include <QGraphicsObject>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QImage>
+#include <QPixmap>
+#include <QRegion>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+#include "spriteindex.h"
+
+//! Graphicsview item that displays the rendered sheet as a tiled, level-of-detail image.
+/*! The full size sheet is never held in memory. Instead the item is given a function that renders any area of it, and
+ *  builds a pyramid of half-size levels in the background from horizontal bands of the sheet. When painting, only the
+ *  tiles of the level that best matches the current zoom are converted to pixmaps (full size tiles are rendered as they
+ *  come into view), and these are kept in QPixmapCache, so very large sheets never need one huge image or pixmap.
+ *  The item also handles hit-testing and selection of sprites, using a SpriteIndex over the packed rects.
+ */
+class SheetPreviewItem : public QGraphicsObject
+{
+    Q_OBJECT
+
+public:
+    //! Renders an area of the sheet, in sheet pixels. The result must be exactly the size of the area.
+    typedef std::function<QImage( const QRect &area )> RenderFunction;
+
+    //! Constructor.
+    explicit SheetPreviewItem( QGraphicsItem *parent = 0 );
+    //! Destructor. Waits for any background work to stop.
+    ~SheetPreviewItem();
+
+    //! Tile width and height, in pixels of the level being shown.
+    static const int TileSize = 256;
+    //! Rows of the sheet rendered at a time while building the levels. Even, and a whole number of dither bands.
+    static const int BandRows = 2 * TileSize;
+
+    //! Sets a new sheet to display. The downsampled levels get rebuilt in the background.
+    /*! \param size - the sheet size, in pixels. Use an empty size for no sheet.
+     *  \param render - renders areas of the sheet. It's called from a worker thread too, so it should work on its own
+     *  copy of whatever it renders from.
+     */
+    void setSheet( const QSize &size, const RenderFunction &render );
+    //! Removes the sheet, e.g. when it is too large to preview. Sprites can still be shown and selected.
+    void clearSheet();
+    //! Returns true if there's a sheet to show.
+    bool hasSheet() const;
+    //! Returns the bytes held by the downsampled levels. (Tiles are in QPixmapCache, which has its own limit.)
+    qint64 pyramidBytes() const;
+
+    //! Updates part of the sheet, refreshing the levels and tiles that show the changed area.
+    /*! \param render - renders areas of the updated sheet, see setSheet().
+     *  \param area - the changed area, in sheet pixels.
+     */
+    void updateSheet( const RenderFunction &render, const QRegion &area );
+
+    //! Sets the sprite rects used for hit-testing, and their tooltips.
+    /*! \param rects - one rect per sprite, in sheet pixels. Use an empty rect for sprites that are not on the sheet.
+     *  \param toolTips - one tooltip per sprite.
+     */
+    void setSprites( const QVector<QRect> &rects, const QStringList &toolTips );
+    //! Returns the rect of the sprite with the given index.
+    QRect spriteRect( int index ) const;
+
+    //! Highlights the sprite with the given index (-1 for none).
+    void setSelectedSprite( int index );
+    //! Returns the index of the highlighted sprite, or -1.
+    int selectedSprite() const;
+
+    //! Reimplemented from base class.
+    QRectF boundingRect() const;
+    //! Reimplemented from base class. Draws the visible tiles at the level of detail for the current zoom.
+    void paint( QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget );
+
+signals:
+    //! Emitted when the user clicks on the sheet. The index is -1 if no sprite was hit.
+    void spriteClicked( int index );
+
+protected slots:
+    //! Called when the background pyramid build has finished.
+    void pyramidFinished();
+
+protected:
+
+    //! Reimplemented from base class, selects the sprite under the mouse.
+    void mousePressEvent( QGraphicsSceneMouseEvent *event );
+    //! Reimplemented from base class, shows the tooltip of the sprite under the mouse.
+    void hoverMoveEvent( QGraphicsSceneHoverEvent *event );
+
+    //! Starts (re)building all downsampled levels in the background.
+    void startPyramid();
+    //! Cancels any background build, and waits for it to stop.
+    void stopPyramid();
+
+    //! Returns the number of downsampled levels a sheet of the given size gets (halving until it fits in one tile).
+    static int LevelCount( const QSize &size );
+    //! Returns the pixmap for one tile, creating it if it isn't already in QPixmapCache.
+    QPixmap tilePixmap( int level, int tx, int ty );
+    //! Returns the QPixmapCache key for a tile.
+    QString tileKey( int level, int tx, int ty ) const;
+
+    //! Builds all the downsampled levels for a sheet. Runs in a worker thread.
+    /*! \returns the levels, or an empty list if cancelled.
+     */
+    static QVector<QImage> buildPyramid( QSize size, RenderFunction render, const QAtomicInt *cancel );
+
+    //! Renders an area of the sheet in bands of BandRows, and downsamples it into every level.
+    /*! \param render - renders areas of the sheet.
+     *  \param size - the sheet size, in pixels.
+     *  \param levels - the levels to update, levels[0] being half size.
+     *  \param area - the area to update, in sheet pixels.
+     *  \param cancel - if not null, work stops as soon as this is set.
+     */
+    static void renderLevels( const RenderFunction &render, const QSize &size, QVector<QImage> &levels, const QRect &area,
+                              const QAtomicInt *cancel = 0 );
+
+    //! Box-filters the source image down to half size, for the given area of the destination.
+    /*! \param src - source image, any format.
+     *  \param srcOrigin - where the source image's top left pixel is, in the pixels of the full size source (for bands).
+     *  \param dst - destination image (ARGB32 premultiplied), half the size of the full source (rounded up).
+     *  \param dstArea - area of the destination to update. Its source pixels must all be inside src.
+     *  \param cancel - if not null, work stops as soon as this is set.
+     */
+    static void downsample( const QImage &src, const QPoint &srcOrigin, QImage &dst, const QRect &dstArea,
+                            const QAtomicInt *cancel = 0 );
+
+    //! Size of the sheet, in pixels.
+    QSize m_size;
+    //! Renders areas of the sheet, for full size tiles and level updates.
+    RenderFunction m_render;
+    //! Downsampled levels, m_levels[0] is level 1 (half size). Only valid when m_pyramidReady is set.
+    QVector<QImage> m_levels;
+    //! True when all the downsampled levels match the sheet.
+    bool m_pyramidReady;
+    //! Watches the background pyramid build.
+    QFutureWatcher< QVector<QImage> > m_pyramidWatcher;
+    //! Set to stop the background build early.
+    QAtomicInt m_cancel;
+    //! Bumped each time a new sheet is set, so cached tiles of old sheets are never reused.
+    int m_generation;
+
+    //! Hit-testing index for the sprite rects.
+    SpriteIndex m_index;
+    //! Tooltips for each sprite.
+    QStringList m_toolTips;
+    //! Index of the highlighted sprite, or -1.
+    int m_selected;
+};
+
+#endif // SHEETPREVIEWITEM_H
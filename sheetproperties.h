@@ -16,22 +16,26 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef PIXMAPITEM_H
-#define PIXMAPITEM_H
-
-#include <QGraphicsPixmapItem>
-
-//! Class derived from QGraphicsPixmapItem to allow custom paint.
-class PixmapItem : public QGraphicsPixmapItem
-{
-
-public:
-    //! Constructor.
-    explicit PixmapItem(const QPixmap & pixmap, QGraphicsItem * parent = 0);
-
-    //! Reimplemented from base class.
-    void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget);
 
+#ifndef SHEETPROPERTIES_H
+#define SHEETPROPERTIES_H
+
+#include <QString>
+
+//! Struct that stores basic sheet data.
+struct SheetProperties {
+    //! sheet width in pixles.
+    int width;
+    //! sheet height in pixles.
+    int height;
+    //! The gap added around each sprite, in pixels.
+    int padding;
+    //! The border added around entire sheet, in pixels.
+    int border;
+    //! File name of the exported sheet image, including extension (as referenced by the data files).
+    QString imageName;
+    //! Pixel format of the exported sheet image, e.g. "RGBA8888" or "BC7".
+    QString pixelFormat;
 };
 
-#endif // PIXMAPITEM_H
+#endif // SHEETPROPERTIES_H
@@ -0,0 +1,188 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QTransform>
+#include <QVector>
+#include "sheetrenderer.h"
+#include "parallel.h"
+
+namespace {
+
+// One chamfer step - takes neighbour j's seed if going via j is shorter.
+inline void relax( int &d, int &s, const int *dist, const int *seed, int j, int cost )
+{
+    int dj = dist[j] + cost;
+    bool closer = dj < d;
+    d = closer ? dj : d;
+    s = closer ? seed[j] : s;
+}
+
+// Fills the transparent pixels of one area of an ARGB32 image with the colour of the nearest pixel that has any alpha.
+// Nearest is found with a two pass 3-4 chamfer distance transform, carrying the nearest seed along with the distance.
+// Works on a copy of the area with a one pixel border, so neighbour lookups need no bounds checks.
+void bleedArea( uchar *bits, int bytesPerLine, const QRect &area )
+{
+    const int far = 1 << 29;
+    const int w = area.width();
+    const int h = area.height();
+    const int sw = w + 2;
+    QVector<QRgb> colourBuf( sw * ( h + 2 ), 0 );
+    QVector<int> distBuf( sw * ( h + 2 ), far );
+    QVector<int> seedBuf( sw * ( h + 2 ), -1 );
+    QRgb *colour = colourBuf.data();
+    int *dist = distBuf.data();
+    int *seed = seedBuf.data();
+    bool anyEmpty = false, anySeed = false;
+    for (int y = 0; y < h; ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>( bits + ( area.top() + y ) * bytesPerLine ) + area.left();
+        for (int x = 0; x < w; ++x) {
+            int i = ( y + 1 ) * sw + x + 1;
+            colour[i] = line[x];
+            if ( qAlpha( line[x] ) > 0 ) {
+                dist[i] = 0;
+                seed[i] = i;
+                anySeed = true;
+            }
+            else
+                anyEmpty = true;
+        }
+    }
+    if ( !anyEmpty || !anySeed )
+        return;
+
+    // forward pass looks at the neighbours already visited above and to the left, backward pass the rest:
+    for (int y = 1; y <= h; ++y) {
+        for (int i = y * sw + 1; i <= y * sw + w; ++i) {
+            int d = dist[i], s = seed[i];
+            if ( d == 0 )
+                continue; // (a seed pixel)
+            relax( d, s, dist, seed, i - 1, 3 );
+            relax( d, s, dist, seed, i - sw - 1, 4 );
+            relax( d, s, dist, seed, i - sw, 3 );
+            relax( d, s, dist, seed, i - sw + 1, 4 );
+            dist[i] = d;
+            seed[i] = s;
+        }
+    }
+    for (int y = h; y >= 1; --y) {
+        for (int i = y * sw + w; i >= y * sw + 1; --i) {
+            int d = dist[i], s = seed[i];
+            if ( d == 0 )
+                continue; // (a seed pixel)
+            relax( d, s, dist, seed, i + 1, 3 );
+            relax( d, s, dist, seed, i + sw + 1, 4 );
+            relax( d, s, dist, seed, i + sw, 3 );
+            relax( d, s, dist, seed, i + sw - 1, 4 );
+            dist[i] = d;
+            seed[i] = s;
+        }
+    }
+
+    for (int y = 0; y < h; ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>( bits + ( area.top() + y ) * bytesPerLine ) + area.left();
+        const int *s = seed + ( y + 1 ) * sw + 1;
+        for (int x = 0; x < w; ++x) {
+            if ( qAlpha( line[x] ) == 0 )
+                line[x] = colour[s[x]] & 0x00ffffff; // (colour only, stays fully transparent)
+        }
+    }
+}
+
+} // namespace
+
+void SheetRenderer::RenderArea( QPainter &painter, const QRect &area, const SheetProperties &sheetProp,
+                                const QList<PackSprite> &packedsprites, int extrude, const QAtomicInt *cancel )
+{
+    painter.setRenderHints( QPainter::Antialiasing | QPainter::SmoothPixmapTransform );
+    for (int i = 0; i < packedsprites.size(); ++i) {
+        if ( cancel && cancel->load() )
+            return;
+        QRect rect = SpriteRect( packedsprites[i], sheetProp );
+        if ( rect.isEmpty() || !rect.adjusted( -extrude, -extrude, extrude, extrude ).intersects( area ) )
+            continue;
+        QImage pm = SheetImage( packedsprites[i] );
+        painter.drawImage( rect.topLeft(), pm );
+
+        // Paint extrusions, if required. This paints beyond the edges of each items.
+        // It affects packing only in the sense that we add on to the user's padding and border
+        // settings so the extruded pixels dont overlap another item).
+        if ( extrude > 0 ) {
+            painter.drawImage( QRectF( rect.x(), rect.y() - extrude, pm.width(), extrude ),
+                                pm, QRectF( 0.0, 0.0, pm.width(), 1.0 ) ); // top edge
+            painter.drawImage( QRectF( rect.x(), rect.y() + pm.height(), pm.width(), extrude ),
+                                pm, QRectF( 0.0, pm.height() - 1, pm.width(), 1.0 ) ); // bot edge
+            painter.drawImage( QRectF( rect.x() - extrude, rect.y(), extrude, pm.height() ),
+                                pm, QRectF( 0.0, 0.0, 1.0, pm.height() ) ); // left edge
+            painter.drawImage( QRectF( rect.x() + pm.width(), rect.y(), extrude, pm.height() ),
+                                pm, QRectF( pm.width() - 1.0, 0.0, 1.0, pm.height() ) ); // right edge
+        }
+    }
+}
+
+QRect SheetRenderer::SpriteRect( const PackSprite &sprite, const SheetProperties &sheetProp )
+{
+    rbp::Rect packedRect = sprite.packedRect();
+    if ( packedRect.height <= 0 || packedRect.width <= 0 )
+        return QRect();
+    // Remember, the packedrects dont include the border pixels, but do include their padding.
+    int w = sprite.isRotated() ? sprite.size().height() : sprite.size().width();
+    int h = sprite.isRotated() ? sprite.size().width() : sprite.size().height();
+    return QRect( packedRect.x + sheetProp.border, packedRect.y + sheetProp.border, w, h );
+}
+
+QImage SheetRenderer::SheetImage( const PackSprite &sprite )
+{
+    if ( !sprite.isRotated() )
+        return sprite.image();
+    QTransform trans;
+    trans = trans.rotate( 90 );
+    return sprite.image().transformed( trans );
+}
+
+QRect SheetRenderer::BleedRect( const PackSprite &sprite, const SheetProperties &sheetProp, int extrude )
+{
+    QRect rect = SpriteRect( sprite, sheetProp );
+    if ( rect.isEmpty() )
+        return rect;
+    // (sprites are at least padding + 2*extrude apart, so half the padding each keeps the areas separate)
+    int margin = extrude + sheetProp.padding / 2;
+    return rect.adjusted( -margin, -margin, margin, margin ) & QRect( 0, 0, sheetProp.width, sheetProp.height );
+}
+
+void SheetRenderer::BleedAlpha( QImage &image, const QPoint &origin, const SheetProperties &sheetProp,
+                                const QList<PackSprite> &packedsprites, int extrude )
+{
+    if ( image.format() != QImage::Format_ARGB32 ) {
+        qWarning() << "BleedAlpha - image must be ARGB32, skipping";
+        return;
+    }
+    // find the bleed areas in image coordinates:
+    QRect bounds = image.rect();
+    QVector<QRect> areas;
+    for (int i = 0; i < packedsprites.size(); ++i) {
+        QRect area = BleedRect( packedsprites[i], sheetProp, extrude ).translated( -origin ) & bounds;
+        if ( !area.isEmpty() )
+            areas.append( area );
+    }
+    uchar *bits = image.bits(); // (detach now - areas are written from several threads)
+    int bytesPerLine = image.bytesPerLine();
+    parallelFor( areas.size(), [&]( int i ) {
+        bleedArea( bits, bytesPerLine, areas[i] );
+    });
+}
@@ -0,0 +1,78 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHEETRENDERER_H
+#define SHEETRENDERER_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QPainter>
+#include <QRect>
+#include "packsprite.h"
+#include "sheetproperties.h"
+
+//! Methods that draw packed sprites onto a sheet image.
+/*! Static functions, working directly from the packing data (no graphicsview items are needed), so any part
+ *  of the sheet can be rendered on its own.
+ */
+class SheetRenderer
+{
+public:
+
+    //! Draws all sprites that touch the area, including their extrusions.
+    /*! The painter should already be clipped to the area (and translated if the target image is only part of the
+     *  sheet). The area is not cleared first.
+     *  \param painter - painter to draw with, in sheet coordinates.
+     *  \param area - the sheet area being rendered. Sprites outside it are skipped.
+     *  \param sheetProp - the sheet properties.
+     *  \param packedsprites - the list of packed sprites.
+     *  \param extrude - the number of edge pixels to extrude around each sprite.
+     *  \param cancel - if not null, drawing stops as soon as this is set (checked before each sprite).
+     */
+    static void RenderArea( QPainter &painter, const QRect &area, const SheetProperties &sheetProp,
+                            const QList<PackSprite> &packedsprites, int extrude = 0, const QAtomicInt *cancel = 0 );
+
+    //! Returns the rect covered by the sprite's pixels on the sheet (not including padding or extrusion).
+    /*! \returns an empty rect if the sprite was not packed.
+     */
+    static QRect SpriteRect( const PackSprite &sprite, const SheetProperties &sheetProp );
+
+    //! Returns the sprite's image as it appears on the sheet, i.e. rotated if the packer rotated it.
+    static QImage SheetImage( const PackSprite &sprite );
+
+    //! Returns the area a sprite may bleed its edge colours into: its extrusion plus half the padding on each side.
+    /*! These areas never overlap between sprites, so each can be processed independently.
+     *  \returns an empty rect if the sprite was not packed.
+     */
+    static QRect BleedRect( const PackSprite &sprite, const SheetProperties &sheetProp, int extrude = 0 );
+
+    //! Spreads sprite edge colours outwards into fully transparent pixels (alpha stays at zero).
+    /*! Stops the dark fringes that otherwise appear around sprites when the sheet is filtered or mipmapped. Each
+     *  transparent pixel in a sprite's BleedRect takes the colour of the nearest non-transparent pixel (found with a
+     *  chamfer distance transform). Sprites are processed in parallel.
+     *  \param image - the rendered sheet (or part of it), must be non-premultiplied ARGB32.
+     *  \param origin - sheet position of the image's top left pixel.
+     *  \param sheetProp - the sheet properties.
+     *  \param packedsprites - the list of packed sprites.
+     *  \param extrude - the number of edge pixels extruded around each sprite.
+     */
+    static void BleedAlpha( QImage &image, const QPoint &origin, const SheetProperties &sheetProp,
+                            const QList<PackSprite> &packedsprites, int extrude = 0 );
+};
+
+#endif // SHEETRENDERER_H
@@ -0,0 +1,102 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/qmath.h>
+#include "spriteindex.h"
+
+SpriteIndex::SpriteIndex() :
+    m_cellSize( 1 ),
+    m_cols( 0 ),
+    m_rows( 0 )
+{
+}
+
+void SpriteIndex::build( const QVector<QRect> &rects, const QSize &area )
+{
+    clear();
+    m_rects = rects;
+    if ( rects.isEmpty() || area.isEmpty() )
+        return;
+
+    // Aim for a cell about the size of an average sprite, so most cells hold only one or two rects.
+    qint64 totalArea = 0;
+    int nrects = 0;
+    for (int i = 0; i < rects.size(); ++i) {
+        if ( !rects[i].isEmpty() ) {
+            totalArea += qint64( rects[i].width() ) * rects[i].height();
+            nrects++;
+        }
+    }
+    if ( nrects == 0 )
+        return;
+    m_cellSize = qMax( 16, int( qSqrt( qreal( totalArea ) / nrects )));
+    m_cols = ( area.width() + m_cellSize - 1 ) / m_cellSize;
+    m_rows = ( area.height() + m_cellSize - 1 ) / m_cellSize;
+    m_cells.resize( m_cols * m_rows );
+
+    for (int i = 0; i < rects.size(); ++i) {
+        QRect r = rects[i] & QRect( QPoint( 0, 0 ), area );
+        if ( r.isEmpty() )
+            continue;
+        for (int cy = r.top() / m_cellSize; cy <= r.bottom() / m_cellSize; ++cy)
+            for (int cx = r.left() / m_cellSize; cx <= r.right() / m_cellSize; ++cx)
+                m_cells[cy * m_cols + cx].append( i );
+    }
+}
+
+void SpriteIndex::clear()
+{
+    m_rects.clear();
+    m_cells.clear();
+    m_cols = 0;
+    m_rows = 0;
+}
+
+int SpriteIndex::indexAt( const QPoint &pos ) const
+{
+    int cell = cellAt( pos );
+    if ( cell < 0 )
+        return -1;
+    const QVector<int> &candidates = m_cells.at( cell );
+    for (int i = 0; i < candidates.size(); ++i) {
+        if ( m_rects.at( candidates[i] ).contains( pos ) )
+            return candidates[i];
+    }
+    return -1;
+}
+
+QRect SpriteIndex::rect( int index ) const
+{
+    return m_rects.value( index );
+}
+
+int SpriteIndex::count() const
+{
+    return m_rects.size();
+}
+
+int SpriteIndex::cellAt( const QPoint &pos ) const
+{
+    if ( pos.x() < 0 || pos.y() < 0 )
+        return -1;
+    int cx = pos.x() / m_cellSize;
+    int cy = pos.y() / m_cellSize;
+    if ( cx >= m_cols || cy >= m_rows )
+        return -1;
+    return cy * m_cols + cx;
+}
@@ -0,0 +1,72 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITEINDEX_H
+#define SPRITEINDEX_H
+
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+
+//! Spatial index over the packed sprite rects, used for hit-testing on the sheet.
+/*! A uniform grid: each cell lists the rects overlapping it, so a lookup only tests the few rects in one cell
+ *  no matter how many sprites are on the sheet.
+ */
+class SpriteIndex
+{
+public:
+    //! Constructor. The index is empty until build() is called.
+    SpriteIndex();
+
+    //! Rebuilds the index.
+    /*! \param rects - one rect per sprite. Empty rects (e.g. sprites that failed to pack) are not indexed.
+     *  \param area - size of the area covered by the index, i.e. the sheet size.
+     */
+    void build( const QVector<QRect> &rects, const QSize &area );
+
+    //! Removes all rects from the index.
+    void clear();
+
+    //! Returns the index of the rect containing the point, or -1 if there isn't one.
+    int indexAt( const QPoint &pos ) const;
+
+    //! Returns the rect stored for the given index.
+    QRect rect( int index ) const;
+
+    //! Returns the number of rects (including empty ones) the index was built with.
+    int count() const;
+
+protected:
+
+    //! Returns the grid cell containing the point, or -1 if it is outside the grid.
+    int cellAt( const QPoint &pos ) const;
+
+    //! The indexed rects.
+    QVector<QRect> m_rects;
+    //! Rect indexes overlapping each grid cell, row by row.
+    QVector< QVector<int> > m_cells;
+    //! Width and height of a grid cell, in pixels.
+    int m_cellSize;
+    //! Number of grid columns.
+    int m_cols;
+    //! Number of grid rows.
+    int m_rows;
+};
+
+#endif // SPRITEINDEX_H
@@ -0,0 +1,165 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stats.h"
+
+#include <QStringList>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY( spriteLog, "buncher.sprites", QtInfoMsg )
+
+int Stats::NumStages = 11; // --> Keep this up-to-date when adding stages! (and stageName, and the array sizes in the header)
+int Stats::NumCounters = 8; // --> Keep this up-to-date when adding counters! (and counterName, and the array sizes in the header)
+
+Stats::Stats()
+{
+    clear();
+}
+
+void Stats::clear()
+{
+    for (int i = 0; i < NumStages; ++i) {
+        m_nsecs[i] = 0;
+        m_calls[i] = 0;
+    }
+    for (int i = 0; i < NumCounters; ++i)
+        m_counts[i] = 0;
+}
+
+void Stats::addTime( Stages stage, qint64 nsecs, int calls )
+{
+    m_nsecs[stage] += nsecs;
+    m_calls[stage] += calls;
+}
+
+void Stats::addCount( Counters counter, qint64 n )
+{
+    m_counts[counter] += n;
+}
+
+void Stats::setPeak( Counters counter, qint64 n )
+{
+    m_counts[counter] = qMax( m_counts[counter], n );
+}
+
+void Stats::add( const Stats &other )
+{
+    for (int i = 0; i < NumStages; ++i)
+        addTime( Stages( i ), other.m_nsecs[i], other.m_calls[i] );
+    for (int i = 0; i < NumCounters; ++i) {
+        if ( i == COUNT_FREE_RECTS_PEAK )
+            setPeak( Counters( i ), other.m_counts[i] );
+        else
+            addCount( Counters( i ), other.m_counts[i] );
+    }
+}
+
+qint64 Stats::nsecs( Stages stage ) const
+{
+    return m_nsecs[stage];
+}
+
+int Stats::calls( Stages stage ) const
+{
+    return m_calls[stage];
+}
+
+qint64 Stats::count( Counters counter ) const
+{
+    return m_counts[counter];
+}
+
+QJsonObject Stats::toJson() const
+{
+    QJsonObject stages;
+    for (int i = 0; i < NumStages; ++i) {
+        QJsonObject stage;
+        stage.insert( "ms", m_nsecs[i] / 1000000.0 );
+        stage.insert( "calls", m_calls[i] );
+        stages.insert( stageName( Stages( i )), stage );
+    }
+    QJsonObject counters;
+    for (int i = 0; i < NumCounters; ++i)
+        counters.insert( counterName( Counters( i )), double( m_counts[i] ));
+    QJsonObject obj;
+    obj.insert( "stages", stages );
+    obj.insert( "counters", counters );
+    return obj;
+}
+
+QString Stats::summary() const
+{
+    // The stages that took any time, slowest first.
+    QList<int> order;
+    for (int i = 0; i < NumStages; ++i) {
+        if ( m_nsecs[i] >= 1000000 )
+            order.append( i );
+    }
+    std::stable_sort( order.begin(), order.end(), [this]( int a, int b ) { return m_nsecs[a] > m_nsecs[b]; });
+    QStringList parts;
+    foreach ( int i, order )
+        parts.append( QString( "%1 %2 ms" ).arg( stageName( Stages( i ))).arg( m_nsecs[i] / 1000000 ));
+    return parts.join( ", " );
+}
+
+QString Stats::stageName( Stages stage )
+{
+    switch ( stage ) {
+    case STAGE_SCAN: return "scan";
+    case STAGE_DECODE: return "decode";
+    case STAGE_CROP: return "crop";
+    case STAGE_SCALE: return "scale";
+    case STAGE_SORT: return "sort";
+    case STAGE_PACK: return "pack";
+    case STAGE_RENDER: return "render";
+    case STAGE_CONVERT: return "convert";
+    case STAGE_BLEED: return "bleed";
+    case STAGE_ENCODE: return "encode";
+    case STAGE_WRITE: return "write";
+    }
+    return QString();
+}
+
+QString Stats::counterName( Counters counter )
+{
+    switch ( counter ) {
+    case COUNT_FILES: return "files";
+    case COUNT_SPRITES: return "sprites";
+    case COUNT_CROPPED: return "cropped";
+    case COUNT_INSERTS: return "inserts";
+    case COUNT_FREE_RECTS_PEAK: return "freeRectsPeak";
+    case COUNT_PRUNE_TESTS: return "pruneTests";
+    case COUNT_BANDS: return "bands";
+    case COUNT_FILES_WRITTEN: return "filesWritten";
+    }
+    return QString();
+}
+
+Stats::Timer::Timer( Stats *stats, Stages stage )
+{
+    m_stats = stats;
+    m_stage = stage;
+    if ( m_stats )
+        m_timer.start();
+}
+
+Stats::Timer::~Timer()
+{
+    if ( m_stats )
+        m_stats->addTime( m_stage, m_timer.nsecsElapsed() );
+}
@@ -0,0 +1,107 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QString>
+
+//! Per-sprite debug output (from the packers and PackSprite). Off by default, so the hot loops only pay for a flag test.
+/*! Turn on with the rule "buncher.sprites.debug=true", e.g. QT_LOGGING_RULES="buncher.sprites.debug=true".
+ */
+Q_DECLARE_LOGGING_CATEGORY( spriteLog )
+
+//! Timings and counters for each stage of the pipeline, from scanning the folder to writing the files.
+/*! Each SheetBuilder keeps one (see SheetBuilder::stats()). Time is summed over calls, and over threads where a stage
+ *  runs in parallel (e.g. decoding), so a stage can take longer than the wall-clock time it spanned. Not thread-safe -
+ *  parallel work is added up by the thread that started it.
+ */
+class Stats
+{
+public:
+    //! Pipeline stages. Names are used in the json report - keep stageName() up to date.
+    enum Stages { STAGE_SCAN = 0, STAGE_DECODE, STAGE_CROP, STAGE_SCALE, STAGE_SORT, STAGE_PACK, STAGE_RENDER,
+                  STAGE_CONVERT, STAGE_BLEED, STAGE_ENCODE, STAGE_WRITE };
+    //! Number of stages defined in Stages.
+    static int NumStages;
+
+    //! Counters. Names are used in the json report - keep counterName() up to date.
+    enum Counters { COUNT_FILES = 0, COUNT_SPRITES, COUNT_CROPPED, COUNT_INSERTS, COUNT_FREE_RECTS_PEAK, COUNT_PRUNE_TESTS,
+                    COUNT_BANDS, COUNT_FILES_WRITTEN };
+    //! Number of counters defined in Counters.
+    static int NumCounters;
+
+    //! Constructor. Everything starts at zero.
+    Stats();
+
+    //! Sets everything back to zero.
+    void clear();
+
+    //! Adds time to a stage.
+    void addTime( Stages stage, qint64 nsecs, int calls = 1 );
+    //! Adds to a counter.
+    void addCount( Counters counter, qint64 n = 1 );
+    //! Raises a counter to n, if it's lower (for high-water marks).
+    void setPeak( Counters counter, qint64 n );
+    //! Adds another set of stats to this one (peaks take the highest).
+    void add( const Stats &other );
+
+    //! Returns the total time spent in a stage, in nanoseconds.
+    qint64 nsecs( Stages stage ) const;
+    //! Returns the number of times a stage was timed.
+    int calls( Stages stage ) const;
+    //! Returns a counter's value.
+    qint64 count( Counters counter ) const;
+
+    //! Returns the stats as json: {"stages": {"decode": {"ms": 12.5, "calls": 40}, ...}, "counters": {"inserts": 40, ...}}.
+    QJsonObject toJson() const;
+    //! Returns a one line summary of the slowest stages, e.g. for a status bar.
+    QString summary() const;
+
+    //! Returns a stage's name.
+    static QString stageName( Stages stage );
+    //! Returns a counter's name.
+    static QString counterName( Counters counter );
+
+    //! Times a scope, adding it to a stage when it ends. Does nothing if stats is null.
+    class Timer
+    {
+    public:
+        //! Constructor. Starts timing.
+        Timer( Stats *stats, Stages stage );
+        //! Destructor. Adds the time to the stage.
+        ~Timer();
+    private:
+        Stats *m_stats;
+        Stages m_stage;
+        QElapsedTimer m_timer;
+    };
+
+protected:
+    //! Time per stage, in nanoseconds.
+    qint64 m_nsecs[STAGE_WRITE + 1];
+    //! Calls per stage.
+    int m_calls[STAGE_WRITE + 1];
+    //! Counter values.
+    qint64 m_counts[COUNT_FILES_WRITTEN + 1];
+};
+
+#endif // STATS_H
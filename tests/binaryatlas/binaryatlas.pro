@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# Round trip tests for the binary atlas format (DataExporter and reader/buncheratlas.h).
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent testlib
+QT       -= widgets
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_binaryatlas
+TEMPLATE = app
+
+# The packing engine (core/core.pro) - zlib comes along with it.
+include(../../core/core.pri)
+
+SOURCES += tst_binaryatlas.cpp
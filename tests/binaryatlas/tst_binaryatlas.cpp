@@ -0,0 +1,257 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Round trip tests for the binary atlas format: sheets exported by DataExporter::ExportBinary, read back with the
+// header-only reader (reader/buncheratlas.h), plus the reader's checks on damaged files.
+
+#include "dataexporter.h"
+#include "packsprite.h"
+#include "sheetproperties.h"
+#include "reader/buncheratlas.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QVector>
+#include <QtTest>
+#include <functional>
+
+namespace {
+
+const int Border = 2;
+const int Padding = 1;
+
+SheetProperties testSheet()
+{
+    SheetProperties prop;
+    prop.width = 1024;
+    prop.height = 512;
+    prop.padding = Padding;
+    prop.border = Border;
+    prop.imageName = "sheet.png";
+    prop.pixelFormat = "RGBA8888";
+    return prop;
+}
+
+// Makes packed sprites with distinct rects (every fourth one rotated), one per name.
+QList<PackSprite> testSprites( const QStringList &names )
+{
+    QList<PackSprite> sprites;
+    for (int i = 0; i < names.size(); ++i) {
+        QSize size( 8 + i % 13, 5 + i % 7 );
+        PackSprite sprite( size, names[i] );
+        rbp::Rect rect;
+        rect.x = ( i * 37 ) % 1000;
+        rect.y = i / 3;
+        rect.width = size.width() + Padding;
+        rect.height = size.height() + Padding;
+        sprite.setPackedRect( rect );
+        if ( i % 4 == 3 )
+            sprite.setIsRotated( true );
+        sprites.append( sprite );
+    }
+    return sprites;
+}
+
+// An exported file, in 4 byte aligned memory (as the reader needs).
+struct AtlasFile
+{
+    QVector<quint32> words;
+    size_t size;
+    const void *data() const { return words.constData(); }
+    buncher::AtlasHeader &header() { return *reinterpret_cast<buncher::AtlasHeader*>( words.data() ); }
+    uint8_t *bytes() { return reinterpret_cast<uint8_t*>( words.data() ); }
+};
+
+bool exportAtlas( const QList<PackSprite> &sprites, AtlasFile &file )
+{
+    QTemporaryDir dir;
+    if ( !dir.isValid() ||
+         !DataExporter::Export( testSheet(), DataExporter::FORMAT_BINARY, dir.path(), "atlas", sprites ))
+        return false;
+    QFile in( dir.path() + "/atlas.sbatlas" );
+    if ( !in.open( QIODevice::ReadOnly ))
+        return false;
+    QByteArray bytes = in.readAll();
+    file.size = size_t( bytes.size() );
+    file.words.fill( 0, ( bytes.size() + 3 ) / 4 );
+    memcpy( file.words.data(), bytes.constData(), size_t( bytes.size() ));
+    return true;
+}
+
+}
+
+class TestBinaryAtlas : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void rejectsDamagedHeaders();
+    void damagedIndexMisses();
+};
+
+void TestBinaryAtlas::roundTrip_data()
+{
+    QTest::addColumn<QStringList>( "names" );
+
+    QTest::newRow( "empty" ) << QStringList();
+    QTest::newRow( "single" ) << ( QStringList() << "hero.png" );
+    QTest::newRow( "non-ascii" ) << ( QStringList() << QString::fromUtf8( "h\xc3\xa9ros.png" )
+                                      << QString::fromUtf8( "\xe7\xb2\xbe\xe7\x81\xb5.png" )
+                                      << QString::fromUtf8( "\xf0\x9f\x98\x80.png" )
+                                      << QString::fromUtf8( "\xc3\xa4.png" )       // (precomposed)
+                                      << QString::fromUtf8( "a\xcc\x88.png" ));    // (decomposed - different bytes)
+    // Names that differ in case, one character or length, plus a real duplicate (only the first is indexed).
+    QTest::newRow( "duplicate-looking" ) << ( QStringList() << "a.png" << "A.png" << "a.png.png" << "a.pn" << "a_png"
+                                              << "b.png" << "a.png" << "ab.png" << "ba.png" << "a" );
+    QStringList many;
+    for (int i = 0; i < 1000; ++i)
+        many << QString( "frame_%1.png" ).arg( i );
+    QTest::newRow( "many" ) << many;
+}
+
+void TestBinaryAtlas::roundTrip()
+{
+    QFETCH( QStringList, names );
+    QList<PackSprite> sprites = testSprites( names );
+    AtlasFile file;
+    QVERIFY( exportAtlas( sprites, file ));
+
+    buncher::AtlasView view( file.data(), file.size );
+    QVERIFY( view.isValid() );
+    QCOMPARE( view.header().sheetWidth, 1024u );
+    QCOMPARE( view.header().sheetHeight, 512u );
+    QCOMPARE( QString( view.imageName() ), QString( "sheet.png" ));
+    QCOMPARE( QString( view.pixelFormat() ), QString( "RGBA8888" ));
+    QCOMPARE( view.frameCount(), sprites.size() );
+
+    QStringList found;
+    for (int i = 0; i < sprites.size(); ++i) {
+        const buncher::AtlasFrame &frame = view.frame( i );
+        rbp::Rect rect = sprites[i].packedRect();
+        QCOMPARE( QString::fromUtf8( view.name( frame )), names[i] );
+        QCOMPARE( frame.x, rect.x + Border );
+        QCOMPARE( frame.y, rect.y + Border );
+        QCOMPARE( frame.width, rect.width - Padding );
+        QCOMPARE( frame.height, rect.height - Padding );
+        QCOMPARE( frame.flags, sprites[i].isRotated() ? buncher::AtlasRotated : 0u );
+
+        // find() gives the first frame with the name.
+        QByteArray name = names[i].toUtf8();
+        const buncher::AtlasFrame *hit = view.find( name.constData(), size_t( name.size() ));
+        QVERIFY( hit != 0 );
+        QCOMPARE( hit, &view.frame( names.indexOf( names[i] )));
+        QCOMPARE( view.find( name.constData() ), hit );
+        found << names[i];
+    }
+
+    QStringList absent;
+    absent << "" << "missing.png" << "A" << "hero" << "hero.png.png" << "frame_1000.png" << "frame_0.PNG"
+           << QString::fromUtf8( "\xc3\xa4" );
+    foreach ( const QString &name, names ) {
+        absent << name.left( name.size() - 1 ) << name + "x" << name.toUpper();
+    }
+    foreach ( const QString &name, absent ) {
+        if ( found.contains( name ))
+            continue;
+        QByteArray bytes = name.toUtf8();
+        QVERIFY2( view.find( bytes.constData(), size_t( bytes.size() )) == 0, qPrintable( "found " + name ));
+    }
+}
+
+void TestBinaryAtlas::rejectsDamagedHeaders()
+{
+    AtlasFile good;
+    QVERIFY( exportAtlas( testSprites( QStringList() << "a.png" << "b.png" << "c.png" ), good ));
+    QVERIFY( buncher::AtlasView( good.data(), good.size ).isValid() );
+
+    // Truncated, missing or misaligned data.
+    QVERIFY( !buncher::AtlasView( good.data(), good.size - 1 ).isValid() );
+    QVERIFY( !buncher::AtlasView( good.data(), sizeof( buncher::AtlasHeader ) - 1 ).isValid() );
+    QVERIFY( !buncher::AtlasView( good.data(), 0 ).isValid() );
+    QVERIFY( !buncher::AtlasView( 0, good.size ).isValid() );
+    QByteArray shifted( int( good.size ) + 8, 0 );
+    char *odd = shifted.data() + ( 4 - reinterpret_cast<quintptr>( shifted.data() ) % 4 ) + 1;
+    memcpy( odd, good.data(), good.size );
+    QVERIFY( !buncher::AtlasView( odd, good.size ).isValid() );
+
+    typedef std::function<void( buncher::AtlasHeader &h, uint8_t *data )> Damage;
+    QList< QPair<QString, Damage> > damages;
+    damages << qMakePair( QString( "magic" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.magic[0] = 'X'; }));
+    damages << qMakePair( QString( "version" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.version++; }));
+    damages << qMakePair( QString( "small header" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.headerSize = 76; }));
+    damages << qMakePair( QString( "header past end" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.headerSize = h.fileSize + 4; }));
+    damages << qMakePair( QString( "file size" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.fileSize += 16; }));
+    damages << qMakePair( QString( "small frames" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.frameSize = 28; }));
+    damages << qMakePair( QString( "unaligned frames" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.frameSize = 34; }));
+    damages << qMakePair( QString( "frame count" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.frameCount = 0x7fffffff; }));
+    damages << qMakePair( QString( "frames in header" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.framesOffset = 0; }));
+    damages << qMakePair( QString( "frames past end" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.framesOffset = h.fileSize; }));
+    damages << qMakePair( QString( "frames wrap" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.framesOffset = 0xfffffff0; }));
+    damages << qMakePair( QString( "unaligned seeds" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.seedsOffset += 2; }));
+    damages << qMakePair( QString( "seeds past end" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.bucketCount = h.fileSize; }));
+    damages << qMakePair( QString( "no buckets" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.bucketCount = 0; }));
+    damages << qMakePair( QString( "slots in header" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.slotsOffset = 4; }));
+    damages << qMakePair( QString( "slots past end" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.slotsOffset = h.fileSize - 4; }));
+    damages << qMakePair( QString( "strings past end" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.stringsSize += 1; }));
+    damages << qMakePair( QString( "no strings" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.stringsSize = 0; }));
+    damages << qMakePair( QString( "strings in header" ), Damage( []( buncher::AtlasHeader &h, uint8_t * ) { h.stringsOffset = 8; }));
+    damages << qMakePair( QString( "unterminated strings" ), Damage( []( buncher::AtlasHeader &h, uint8_t *data ) {
+        data[h.stringsOffset + h.stringsSize - 1] = 'x'; }));
+
+    for (int i = 0; i < damages.size(); ++i) {
+        AtlasFile file = good;
+        damages[i].second( file.header(), file.bytes() );
+        QVERIFY2( !buncher::AtlasView( file.data(), file.size ).isValid(), qPrintable( damages[i].first ));
+    }
+}
+
+void TestBinaryAtlas::damagedIndexMisses()
+{
+    QStringList names;
+    names << "a.png" << "b.png" << "c.png" << "d.png" << "e.png";
+    AtlasFile file;
+    QVERIFY( exportAtlas( testSprites( names ), file ));
+
+    // A frame whose name offset is out of range has no name, and can't be found.
+    AtlasFile badName = file;
+    buncher::AtlasHeader &nh = badName.header();
+    reinterpret_cast<buncher::AtlasFrame*>( badName.bytes() + nh.framesOffset + nh.frameSize )->name = 0xfffffff0;
+    buncher::AtlasView view( badName.data(), badName.size );
+    QVERIFY( view.isValid() );
+    QCOMPARE( QString( view.name( view.frame( 1 ))), QString() );
+    QVERIFY( view.find( "b.png" ) == 0 );
+    QVERIFY( view.find( "a.png" ) != 0 );
+
+    // Slots pointing past the frames are misses, not crashes.
+    AtlasFile badSlots = file;
+    buncher::AtlasHeader &h = badSlots.header();
+    for (quint32 i = 0; i < h.slotCount; ++i)
+        reinterpret_cast<uint32_t*>( badSlots.bytes() + h.slotsOffset )[i] = 0xffffffff;
+    buncher::AtlasView slotView( badSlots.data(), badSlots.size );
+    QVERIFY( slotView.isValid() );
+    foreach ( const QString &name, names )
+        QVERIFY( slotView.find( name.toUtf8().constData() ) == 0 );
+}
+
+QTEST_GUILESS_MAIN( TestBinaryAtlas )
+
+#include "tst_binaryatlas.moc"
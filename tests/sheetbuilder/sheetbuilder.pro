@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# SheetBuilder tests - reloading changed files, and variant rects.
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent testlib
+QT       -= widgets
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_sheetbuilder
+TEMPLATE = app
+
+# The packing engine (core/core.pro) - zlib comes along with it.
+include(../../core/core.pri)
+
+SOURCES += tst_sheetbuilder.cpp
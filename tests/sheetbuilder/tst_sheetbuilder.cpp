@@ -0,0 +1,180 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// SheetBuilder tests.
+
+#include "sheetbuilder.h"
+#include "sheetrenderer.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QtTest>
+
+namespace {
+
+bool writeSprite( const QString &fileName, const QSize &size, QRgb colour )
+{
+    QImage image( size, QImage::Format_ARGB32 );
+    image.fill( colour );
+    return image.save( fileName, "PNG" );
+}
+
+// Moves a file's modified time on, so the edit shows however coarse the file system's times are.
+bool touchLater( const QString &fileName, int seconds )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadWrite ))
+        return false;
+    QDateTime modified = file.fileTime( QFileDevice::FileModificationTime );
+    return file.setFileTime( modified.addSecs( seconds ), QFileDevice::FileModificationTime );
+}
+
+const PackSprite *findSprite( const SheetBuilder &builder, const QString &name )
+{
+    foreach ( const PackSprite &sprite, builder.sprites() ) {
+        if ( sprite.fileName() == name )
+            return &sprite;
+    }
+    return 0;
+}
+
+}
+
+class TestSheetBuilder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void reloadPicksUpEdits();
+    void variantsWithExtrusion_data();
+    void variantsWithExtrusion();
+};
+
+void TestSheetBuilder::reloadPicksUpEdits()
+{
+    QTemporaryDir dir;
+    QVERIFY( dir.isValid() );
+    QString a = dir.path() + "/a.png";
+    QVERIFY( writeSprite( a, QSize( 8, 8 ), qRgb( 255, 0, 0 )));
+    QVERIFY( writeSprite( dir.path() + "/b.png", QSize( 8, 8 ), qRgb( 0, 0, 255 )));
+
+    SheetBuilder builder;
+    builder.setInputFolder( dir.path() );
+    QCOMPARE( builder.loadSprites(), 2 );
+    QCOMPARE( builder.reloadSprites(), 0 );
+
+    // Same size, new pixels - only a.png is decoded again, and its new pixels are used.
+    QVERIFY( writeSprite( a, QSize( 8, 8 ), qRgb( 0, 255, 0 )));
+    QVERIFY( touchLater( a, 10 ));
+    QCOMPARE( builder.reloadSprites(), 1 );
+    const PackSprite *sprite = findSprite( builder, "a.png" );
+    QVERIFY( sprite != 0 );
+    QCOMPARE( sprite->image().pixel( 0, 0 ), qRgb( 0, 255, 0 ));
+    QCOMPARE( builder.reloadSprites(), 0 );
+
+    // A new size is picked up too.
+    QVERIFY( writeSprite( a, QSize( 12, 6 ), qRgb( 0, 255, 0 )));
+    QVERIFY( touchLater( a, 20 ));
+    QCOMPARE( builder.reloadSprites(), 1 );
+    QCOMPARE( findSprite( builder, "a.png" )->size(), QSize( 12, 6 ));
+
+    // New files are decoded, removed ones drop out.
+    QVERIFY( writeSprite( dir.path() + "/c.png", QSize( 4, 4 ), qRgb( 255, 255, 0 )));
+    QVERIFY( QFile::remove( dir.path() + "/b.png" ));
+    QCOMPARE( builder.reloadSprites(), 1 );
+    QCOMPARE( builder.sprites().size(), 2 );
+    QVERIFY( findSprite( builder, "b.png" ) == 0 );
+    QVERIFY( findSprite( builder, "c.png" ) != 0 );
+}
+
+void TestSheetBuilder::variantsWithExtrusion_data()
+{
+    QTest::addColumn<bool>( "blockAlign" );
+    QTest::newRow( "unaligned" ) << false;
+    QTest::newRow( "block aligned" ) << true;
+}
+
+// With variants, every smaller variant's rects have to be the packed rects divided exactly - so the extrusion has to
+// be rounded up to the variant factor, or block alignment would put the sprites between whole variant pixels.
+void TestSheetBuilder::variantsWithExtrusion()
+{
+    QFETCH( bool, blockAlign );
+    QTemporaryDir dir;
+    QVERIFY( dir.isValid() );
+    QList<QSize> sizes;
+    sizes << QSize( 4, 4 ) << QSize( 5, 3 ) << QSize( 7, 9 ) << QSize( 12, 4 ) << QSize( 1, 6 );
+    QHash<QString, QRgb> colours;
+    for (int i = 0; i < sizes.size(); ++i) {
+        QString name = QString( "s%1.png" ).arg( i );
+        colours.insert( name, qRgb( 40 * i, 255 - 40 * i, 128 ));
+        QVERIFY( writeSprite( dir.path() + "/" + name, sizes[i], colours[name] ));
+    }
+
+    SheetBuilder builder;
+    builder.setInputFolder( dir.path() );
+    BuncherSettings settings;
+    settings.sheetWidth = 256;
+    settings.sheetHeight = 256;
+    settings.padding = 1;
+    settings.border = 1;
+    settings.extrude = 2;
+    settings.variants = BuncherSettings::VARIANTS_4X;
+    settings.blockAlign = blockAlign;
+    builder.setSettings( settings );
+    QCOMPARE( builder.loadSprites(), sizes.size() );
+    QCOMPARE( builder.pack(), 0 );
+    QCOMPARE( builder.extrude(), 4 );
+    int extrude = builder.extrude();
+
+    const QList<PackSprite> &sprites = builder.sprites();
+    for (int i = 0; i < sprites.size(); ++i) {
+        QRect rect = SheetRenderer::SpriteRect( sprites[i], builder.sheetProperties() );
+        QCOMPARE( rect.x() % 4, 0 );
+        QCOMPARE( rect.y() % 4, 0 );
+        if ( blockAlign ) {
+            QCOMPARE( ( rect.x() - extrude ) % 16, 0 ); // (whole blocks in the @1x sheet too)
+            QCOMPARE( ( rect.y() - extrude ) % 16, 0 );
+        }
+    }
+
+    for (int factor = 2; factor <= 4; factor *= 2) {
+        SheetProperties prop = builder.variantSheetProperties( factor );
+        QList<PackSprite> variants = builder.variantSprites( factor );
+        QImage image = builder.renderVariantArea( QRect( 0, 0, prop.width, prop.height ), factor );
+        QVERIFY( !image.isNull() );
+        for (int i = 0; i < sprites.size(); ++i) {
+            QRect rect = SheetRenderer::SpriteRect( sprites[i], builder.sheetProperties() );
+            rbp::Rect vr = variants[i].packedRect();
+            int x = vr.x + prop.border, y = vr.y + prop.border;
+            QCOMPARE( x * factor, rect.x() );
+            QCOMPARE( y * factor, rect.y() );
+            QCOMPARE( vr.width - prop.padding, ( rect.width() + factor - 1 ) / factor );
+            QCOMPARE( vr.height - prop.padding, ( rect.height() + factor - 1 ) / factor );
+            // (the first variant pixel only covers the sprite and its extrusion, which has the same colour)
+            QCOMPARE( image.pixel( x, y ), colours.value( sprites[i].fileName() ));
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN( TestSheetBuilder )
+
+#include "tst_sheetbuilder.moc"
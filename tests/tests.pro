@@ -0,0 +1,9 @@
+#-------------------------------------------------
+#
+# Tests - one QtTest executable per folder. Run them all with "make check".
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = binaryatlas sheetbuilder
@@ -0,0 +1,788 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "texturecompressor.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <QtDebug>
+#include <QtEndian>
+#include <math.h>
+#include <string.h>
+
+int TextureCompressor::NumQualityLevels = 3; // --> Keep this up-to-date when adding presets! UI uses this to populate combobox.
+
+namespace {
+
+// One 4x4 block of pixels, row by row, as r,g,b,a.
+typedef int BlockPixels[16][4];
+
+inline int clamp255( int v )
+{
+    return v < 0 ? 0 : ( v > 255 ? 255 : v );
+}
+
+inline int sq( int v )
+{
+    return v * v;
+}
+
+void loadBlock( const QImage &image, int bx, int by, BlockPixels px )
+{
+    for (int y = 0; y < 4; ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>( image.constScanLine( qMin( by * 4 + y, image.height() - 1 )));
+        for (int x = 0; x < 4; ++x) {
+            QRgb c = line[qMin( bx * 4 + x, image.width() - 1 )]; // (repeat edge pixels to fill partial blocks)
+            px[y * 4 + x][0] = qRed( c );
+            px[y * 4 + x][1] = qGreen( c );
+            px[y * 4 + x][2] = qBlue( c );
+            px[y * 4 + x][3] = qAlpha( c );
+        }
+    }
+}
+
+// Fits a line through the (weighted) pixel values, using the first 'channels' channels. The end points are where the
+// pixels project furthest along the principal axis, found by power iteration on the covariance matrix.
+void fitLine( const BlockPixels px, const float *weight, int channels, int iterations, float e0[4], float e1[4] )
+{
+    float mean[4] = { 0, 0, 0, 0 }, total = 0;
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < channels; ++c)
+            mean[c] += weight[i] * px[i][c];
+        total += weight[i];
+    }
+    if ( total <= 0 ) {
+        for (int c = 0; c < 4; ++c)
+            e0[c] = e1[c] = 0;
+        return;
+    }
+    for (int c = 0; c < channels; ++c)
+        mean[c] /= total;
+
+    float cov[4][4] = { { 0 } };
+    float lo[4] = { 255, 255, 255, 255 }, hi[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        if ( weight[i] <= 0 )
+            continue;
+        float d[4];
+        for (int c = 0; c < channels; ++c) {
+            d[c] = px[i][c] - mean[c];
+            lo[c] = qMin( lo[c], float( px[i][c] ));
+            hi[c] = qMax( hi[c], float( px[i][c] ));
+        }
+        for (int a = 0; a < channels; ++a)
+            for (int b = 0; b < channels; ++b)
+                cov[a][b] += weight[i] * d[a] * d[b];
+    }
+    // start from the bounding box diagonal, with signs taken from the covariance with the widest channel:
+    int widest = 0;
+    for (int c = 1; c < channels; ++c)
+        if ( hi[c] - lo[c] > hi[widest] - lo[widest] )
+            widest = c;
+    float axis[4] = { 0, 0, 0, 0 };
+    for (int c = 0; c < channels; ++c)
+        axis[c] = ( cov[widest][c] < 0 ? -1.0f : 1.0f ) * ( hi[c] - lo[c] );
+    for (int it = 0; it < iterations; ++it) {
+        float next[4] = { 0, 0, 0, 0 }, len = 0;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b)
+                next[a] += cov[a][b] * axis[b];
+            len = qMax( len, qAbs( next[a] ));
+        }
+        if ( len <= 0 )
+            break;
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] / len;
+    }
+    float len2 = 0;
+    for (int c = 0; c < channels; ++c)
+        len2 += axis[c] * axis[c];
+    if ( len2 <= 0 ) { // (all the same colour)
+        for (int c = 0; c < 4; ++c)
+            e0[c] = e1[c] = mean[c];
+        return;
+    }
+    float tmin = 1e9f, tmax = -1e9f;
+    for (int i = 0; i < 16; ++i) {
+        if ( weight[i] <= 0 )
+            continue;
+        float t = 0;
+        for (int c = 0; c < channels; ++c)
+            t += ( px[i][c] - mean[c] ) * axis[c];
+        t /= len2;
+        tmin = qMin( tmin, t );
+        tmax = qMax( tmax, t );
+    }
+    for (int c = 0; c < 4; ++c) {
+        e0[c] = c < channels ? mean[c] + tmin * axis[c] : 0;
+        e1[c] = c < channels ? mean[c] + tmax * axis[c] : 0;
+    }
+}
+
+// Least squares end points for pixels at fixed positions t (0 = e0, 1 = e1) along the line.
+bool refineLine( const BlockPixels px, const float *weight, const float *t, int channels, float e0[4], float e1[4] )
+{
+    float a = 0, b = 0, c = 0, x0[4] = { 0, 0, 0, 0 }, x1[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        if ( weight[i] <= 0 || t[i] < 0 )
+            continue;
+        float s = 1.0f - t[i];
+        a += weight[i] * s * s;
+        b += weight[i] * s * t[i];
+        c += weight[i] * t[i] * t[i];
+        for (int k = 0; k < channels; ++k) {
+            x0[k] += weight[i] * s * px[i][k];
+            x1[k] += weight[i] * t[i] * px[i][k];
+        }
+    }
+    float det = a * c - b * b;
+    if ( qAbs( det ) < 1e-6f )
+        return false;
+    for (int k = 0; k < channels; ++k) {
+        e0[k] = qBound( 0.0f, ( c * x0[k] - b * x1[k] ) / det, 255.0f );
+        e1[k] = qBound( 0.0f, ( a * x1[k] - b * x0[k] ) / det, 255.0f );
+    }
+    return true;
+}
+
+// ---- BC1 colour blocks (also the colour half of BC3) ----
+
+inline quint16 to565( const float c[4] )
+{
+    int r = qBound( 0, int( c[0] * 31.0f / 255.0f + 0.5f ), 31 );
+    int g = qBound( 0, int( c[1] * 63.0f / 255.0f + 0.5f ), 63 );
+    int b = qBound( 0, int( c[2] * 31.0f / 255.0f + 0.5f ), 31 );
+    return quint16( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+inline void from565( quint16 v, int c[3] )
+{
+    int r = ( v >> 11 ) & 31, g = ( v >> 5 ) & 63, b = v & 31;
+    c[0] = ( r << 3 ) | ( r >> 2 );
+    c[1] = ( g << 2 ) | ( g >> 4 );
+    c[2] = ( b << 3 ) | ( b >> 2 );
+}
+
+// Chooses indices for the two end points, returns the weighted error. Index 3 means transparent in 3 colour mode.
+int bc1Indices( const BlockPixels px, const float *weight, const bool *transparent, quint16 c0, quint16 c1, bool threeColour,
+                int indices[16] )
+{
+    int pal[4][3];
+    from565( c0, pal[0] );
+    from565( c1, pal[1] );
+    for (int k = 0; k < 3; ++k) {
+        if ( threeColour ) {
+            pal[2][k] = ( pal[0][k] + pal[1][k] ) / 2;
+            pal[3][k] = 0;
+        }
+        else {
+            pal[2][k] = ( 2 * pal[0][k] + pal[1][k] ) / 3;
+            pal[3][k] = ( pal[0][k] + 2 * pal[1][k] ) / 3;
+        }
+    }
+    int error = 0;
+    int ncolours = threeColour ? 3 : 4;
+    for (int i = 0; i < 16; ++i) {
+        if ( transparent[i] ) {
+            indices[i] = 3;
+            continue;
+        }
+        int best = 0, bestErr = 1 << 30;
+        for (int j = 0; j < ncolours; ++j) {
+            int e = sq( px[i][0] - pal[j][0] ) + sq( px[i][1] - pal[j][1] ) + sq( px[i][2] - pal[j][2] );
+            if ( e < bestErr ) {
+                bestErr = e;
+                best = j;
+            }
+        }
+        indices[i] = best;
+        error += int( weight[i] * bestErr );
+    }
+    return error;
+}
+
+void encodeColourBlock( const BlockPixels px, bool allowTransparent, TextureCompressor::QualityLevels quality, uchar *out )
+{
+    float weight[16];
+    bool transparent[16];
+    bool anyTransparent = false, anyColour = false;
+    for (int i = 0; i < 16; ++i) {
+        transparent[i] = allowTransparent && px[i][3] < 128;
+        anyTransparent |= transparent[i];
+        weight[i] = ( transparent[i] || px[i][3] == 0 ) ? 0.0f : 1.0f; // (colour of invisible pixels doesn't matter)
+        anyColour |= weight[i] > 0;
+    }
+    if ( !anyColour ) { // (nothing visible - if it's all transparent too, use 3 colour mode's transparent index)
+        for (int i = 0; i < 16; ++i)
+            weight[i] = transparent[i] ? 0.0f : 1.0f;
+    }
+
+    int iterations = quality == TextureCompressor::QUALITY_FAST ? 1 : ( quality == TextureCompressor::QUALITY_NORMAL ? 4 : 8 );
+    float e0[4], e1[4];
+    fitLine( px, weight, 3, iterations, e0, e1 );
+
+    // 4 colour mode needs c0 > c1, 3 colour mode (with transparency) needs c0 <= c1.
+    quint16 best0 = to565( e1 ), best1 = to565( e0 );
+    int bestIdx[16];
+    int bestErr = bc1Indices( px, weight, transparent, best0, best1, anyTransparent, bestIdx );
+    int refines = quality == TextureCompressor::QUALITY_FAST ? 0 : ( quality == TextureCompressor::QUALITY_NORMAL ? 1 : 3 );
+    for (int r = 0; r < refines; ++r) {
+        float t[16];
+        for (int i = 0; i < 16; ++i) {
+            static const float pos4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+            static const float pos3[4] = { 0.0f, 1.0f, 0.5f, -1.0f };
+            t[i] = anyTransparent ? pos3[bestIdx[i]] : pos4[bestIdx[i]];
+        }
+        float r0[4], r1[4];
+        if ( !refineLine( px, weight, t, 3, r0, r1 ))
+            break;
+        int idx[16];
+        quint16 c0 = to565( r0 ), c1 = to565( r1 );
+        int err = bc1Indices( px, weight, transparent, c0, c1, anyTransparent, idx );
+        if ( err >= bestErr )
+            break;
+        bestErr = err;
+        best0 = c0;
+        best1 = c1;
+        memcpy( bestIdx, idx, sizeof( idx ));
+    }
+
+    // put the end points in the right order for the mode, swapping the indices to match:
+    if ( ( !anyTransparent && best0 < best1 ) || ( anyTransparent && best0 > best1 )) {
+        qSwap( best0, best1 );
+        static const int swap4[4] = { 1, 0, 3, 2 };
+        static const int swap3[4] = { 1, 0, 2, 3 };
+        for (int i = 0; i < 16; ++i)
+            bestIdx[i] = anyTransparent ? swap3[bestIdx[i]] : swap4[bestIdx[i]];
+    }
+    if ( !anyTransparent && best0 == best1 ) { // (same colours - that decodes as 3 colour mode, so stick to index 0)
+        for (int i = 0; i < 16; ++i)
+            bestIdx[i] = 0;
+    }
+    quint32 bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= quint32( bestIdx[i] ) << ( 2 * i );
+    qToLittleEndian<quint16>( best0, out );
+    qToLittleEndian<quint16>( best1, out + 2 );
+    qToLittleEndian<quint32>( bits, out + 4 );
+}
+
+// ---- BC3 alpha blocks ----
+
+int bc3AlphaIndices( const BlockPixels px, int a0, int a1, int indices[16] )
+{
+    int pal[8];
+    pal[0] = a0;
+    pal[1] = a1;
+    if ( a0 > a1 ) {
+        for (int j = 1; j < 7; ++j)
+            pal[j + 1] = ( ( 7 - j ) * a0 + j * a1 ) / 7;
+    }
+    else {
+        for (int j = 1; j < 5; ++j)
+            pal[j + 1] = ( ( 5 - j ) * a0 + j * a1 ) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+    int error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestErr = 1 << 30;
+        for (int j = 0; j < 8; ++j) {
+            int e = sq( px[i][3] - pal[j] );
+            if ( e < bestErr ) {
+                bestErr = e;
+                best = j;
+            }
+        }
+        indices[i] = best;
+        error += bestErr;
+    }
+    return error;
+}
+
+void encodeAlphaBlock( const BlockPixels px, TextureCompressor::QualityLevels quality, uchar *out )
+{
+    int amin = 255, amax = 0, imin = 255, imax = 0; // (i = inner values, not counting 0 and 255)
+    for (int i = 0; i < 16; ++i) {
+        int a = px[i][3];
+        amin = qMin( amin, a );
+        amax = qMax( amax, a );
+        if ( a > 0 && a < 255 ) {
+            imin = qMin( imin, a );
+            imax = qMax( imax, a );
+        }
+    }
+    int a0 = amax, a1 = amin;
+    int indices[16];
+    int err = bc3AlphaIndices( px, a0, a1, indices );
+    if ( quality != TextureCompressor::QUALITY_FAST && err > 0 ) {
+        // the 6 value mode has exact 0 and 255, which can suit blocks with hard edges better:
+        int b0 = imin <= imax ? imin : 0, b1 = imin <= imax ? imax : 0;
+        int idx6[16];
+        int err6 = bc3AlphaIndices( px, b0, b1, idx6 );
+        if ( err6 < err ) {
+            err = err6;
+            a0 = b0;
+            a1 = b1;
+            memcpy( indices, idx6, sizeof( idx6 ));
+        }
+    }
+    quint64 bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= quint64( indices[i] ) << ( 3 * i );
+    out[0] = uchar( a0 );
+    out[1] = uchar( a1 );
+    for (int k = 0; k < 6; ++k)
+        out[2 + k] = uchar( bits >> ( 8 * k ));
+}
+
+// ---- BC7, mode 6 only (one subset, RGBA end points with p-bits, 4 bit indices) ----
+
+const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+inline void bc7Quantize( const float e[4], int p, int q[4] )
+{
+    for (int c = 0; c < 4; ++c)
+        q[c] = qBound( 0, int( ( e[c] - p ) / 2.0f + 0.5f ), 127 );
+}
+
+int bc7Indices( const BlockPixels px, const float *weight, const int q0[4], int p0, const int q1[4], int p1, int indices[16] )
+{
+    int pal[16][4];
+    for (int c = 0; c < 4; ++c) {
+        int v0 = ( q0[c] << 1 ) | p0, v1 = ( q1[c] << 1 ) | p1;
+        for (int j = 0; j < 16; ++j)
+            pal[j][c] = ( ( 64 - bc7Weights[j] ) * v0 + bc7Weights[j] * v1 + 32 ) >> 6;
+    }
+    int error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestErr = 1 << 30;
+        for (int j = 0; j < 16; ++j) {
+            int e = int( weight[i] * ( sq( px[i][0] - pal[j][0] ) + sq( px[i][1] - pal[j][1] ) + sq( px[i][2] - pal[j][2] )))
+                    + sq( px[i][3] - pal[j][3] );
+            if ( e < bestErr ) {
+                bestErr = e;
+                best = j;
+            }
+        }
+        indices[i] = best;
+        error += bestErr;
+    }
+    return error;
+}
+
+// Adds bits to a 128 bit little-endian block.
+inline void putBits( quint64 bits[2], int &pos, quint64 value, int count )
+{
+    if ( pos < 64 ) {
+        bits[0] |= value << pos;
+        if ( pos + count > 64 )
+            bits[1] |= value >> ( 64 - pos );
+    }
+    else
+        bits[1] |= value << ( pos - 64 );
+    pos += count;
+}
+
+void encodeBC7Block( const BlockPixels px, TextureCompressor::QualityLevels quality, uchar *out )
+{
+    float weight[16];
+    for (int i = 0; i < 16; ++i)
+        weight[i] = px[i][3] > 0 ? 1.0f : 0.0f; // (colour of invisible pixels doesn't matter, their alpha does)
+    float ones[16];
+    for (int i = 0; i < 16; ++i)
+        ones[i] = 1.0f;
+
+    // There's only one line through RGBA space, so stop invisible pixels pulling it towards their (meaningless) colour
+    // by fitting them as the average visible colour.
+    BlockPixels fit;
+    memcpy( fit, px, sizeof( fit ));
+    int mean[3] = { 0, 0, 0 }, visible = 0;
+    for (int i = 0; i < 16; ++i) {
+        if ( px[i][3] > 0 ) {
+            for (int c = 0; c < 3; ++c)
+                mean[c] += px[i][c];
+            visible++;
+        }
+    }
+    for (int i = 0; i < 16 && visible > 0; ++i) {
+        if ( px[i][3] == 0 )
+            for (int c = 0; c < 3; ++c)
+                fit[i][c] = ( mean[c] + visible / 2 ) / visible;
+    }
+    int iterations = quality == TextureCompressor::QUALITY_FAST ? 1 : ( quality == TextureCompressor::QUALITY_NORMAL ? 4 : 8 );
+    float e0[4], e1[4];
+    fitLine( fit, ones, 4, iterations, e0, e1 );
+
+    int best0[4], best1[4], bestP0 = 0, bestP1 = 0, bestIdx[16], bestErr = 1 << 30;
+    int refines = quality == TextureCompressor::QUALITY_HIGH ? 2 : ( quality == TextureCompressor::QUALITY_NORMAL ? 1 : 0 );
+    for (int r = 0; r <= refines; ++r) {
+        // try the p-bits - all four combinations, or just the one that rounds best when being quick:
+        for (int pp = 0; pp < 4; ++pp) {
+            int p0 = pp & 1, p1 = pp >> 1;
+            if ( quality == TextureCompressor::QUALITY_FAST && pp != 0 ) {
+                break;
+            }
+            int q0[4], q1[4], idx[16];
+            if ( quality == TextureCompressor::QUALITY_FAST ) { // (choose p-bits by the rounding of alpha)
+                p0 = int( e0[3] + 0.5f ) & 1;
+                p1 = int( e1[3] + 0.5f ) & 1;
+            }
+            bc7Quantize( e0, p0, q0 );
+            bc7Quantize( e1, p1, q1 );
+            int err = bc7Indices( px, weight, q0, p0, q1, p1, idx );
+            if ( err < bestErr ) {
+                bestErr = err;
+                memcpy( best0, q0, sizeof( q0 ));
+                memcpy( best1, q1, sizeof( q1 ));
+                bestP0 = p0;
+                bestP1 = p1;
+                memcpy( bestIdx, idx, sizeof( idx ));
+            }
+        }
+        if ( r == refines || bestErr == 0 )
+            break;
+        float t[16];
+        for (int i = 0; i < 16; ++i)
+            t[i] = bc7Weights[bestIdx[i]] / 64.0f;
+        if ( !refineLine( fit, ones, t, 4, e0, e1 ))
+            break;
+    }
+
+    // the first pixel's index is stored without its top bit, so it has to be under 8 - swap the end points if not.
+    if ( bestIdx[0] >= 8 ) {
+        for (int c = 0; c < 4; ++c)
+            qSwap( best0[c], best1[c] );
+        qSwap( bestP0, bestP1 );
+        for (int i = 0; i < 16; ++i)
+            bestIdx[i] = 15 - bestIdx[i];
+    }
+    quint64 bits[2] = { 0, 0 };
+    int pos = 0;
+    putBits( bits, pos, 1 << 6, 7 ); // mode 6
+    for (int c = 0; c < 4; ++c) {
+        putBits( bits, pos, quint64( best0[c] ), 7 );
+        putBits( bits, pos, quint64( best1[c] ), 7 );
+    }
+    putBits( bits, pos, quint64( bestP0 ), 1 );
+    putBits( bits, pos, quint64( bestP1 ), 1 );
+    putBits( bits, pos, quint64( bestIdx[0] ), 3 );
+    for (int i = 1; i < 16; ++i)
+        putBits( bits, pos, quint64( bestIdx[i] ), 4 );
+    qToLittleEndian<quint64>( bits[0], out );
+    qToLittleEndian<quint64>( bits[1], out + 8 );
+}
+
+// ---- ETC2 RGBA (EAC alpha, plus ETC2 colour using the ETC1 compatible individual and differential modes) ----
+
+const int etcModifiers[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+const int eacModifiers[16][8] = {
+    { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 },
+    { -2, -4, -6, -13, 1, 3, 5, 12 }, { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 }, { -2, -6, -8, -10, 1, 5, 7, 9 },
+    { -2, -5, -8, -10, 1, 4, 7, 9 }, { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 }, { -4, -6, -8, -9, 3, 5, 7, 8 },
+    { -3, -5, -7, -9, 2, 4, 6, 8 } };
+
+int eacError( const BlockPixels px, int base, int mult, int table, int indices[16] )
+{
+    int error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestErr = 1 << 30;
+        for (int j = 0; j < 8; ++j) {
+            int e = sq( px[i][3] - clamp255( base + eacModifiers[table][j] * mult ));
+            if ( e < bestErr ) {
+                bestErr = e;
+                best = j;
+            }
+        }
+        if ( indices )
+            indices[i] = best;
+        error += bestErr;
+    }
+    return error;
+}
+
+void encodeEACAlpha( const BlockPixels px, TextureCompressor::QualityLevels quality, uchar *out )
+{
+    int amin = 255, amax = 0;
+    for (int i = 0; i < 16; ++i) {
+        amin = qMin( amin, px[i][3] );
+        amax = qMax( amax, px[i][3] );
+    }
+    int bestBase = amin, bestMult = 1, bestTable = 13, bestErr = 1 << 30; // (table 13 has a zero modifier, exact for flat blocks)
+    if ( amin != amax ) {
+        int spread = quality == TextureCompressor::QUALITY_FAST ? 0 : ( quality == TextureCompressor::QUALITY_NORMAL ? 1 : 3 );
+        for (int t = 0; t < 16 && bestErr > 0; ++t) {
+            int lo = eacModifiers[t][3], hi = eacModifiers[t][7];
+            int mult = qBound( 1, int( float( amax - amin ) / ( hi - lo ) + 0.5f ), 15 );
+            int base = clamp255( int( ( amin + amax ) / 2.0f - ( lo + hi ) * mult / 2.0f + 0.5f ));
+            for (int m = qMax( 1, mult - spread ); m <= qMin( 15, mult + spread ); ++m) {
+                for (int b = base - spread; b <= base + spread; ++b) {
+                    if ( b < 0 || b > 255 )
+                        continue;
+                    int err = eacError( px, b, m, t, 0 );
+                    if ( err < bestErr ) {
+                        bestErr = err;
+                        bestBase = b;
+                        bestMult = m;
+                        bestTable = t;
+                    }
+                }
+            }
+        }
+    }
+    int indices[16];
+    eacError( px, bestBase, bestMult, bestTable, indices );
+    quint64 bits = quint64( bestBase ) << 56 | quint64( bestMult ) << 52 | quint64( bestTable ) << 48;
+    for (int x = 0; x < 4; ++x)
+        for (int y = 0; y < 4; ++y)
+            bits |= quint64( indices[y * 4 + x] ) << ( 45 - 3 * ( x * 4 + y )); // (pixels are stored by column)
+    qToBigEndian<quint64>( bits, out );
+}
+
+// Best modifier table and indices for one half of an ETC block with the given base colour.
+int etcSubblock( const BlockPixels px, const float *weight, const int *pixels, const int base[3], int &table, int codes[8] )
+{
+    int bestErr = 1 << 30;
+    for (int t = 0; t < 8; ++t) {
+        const int mods[4] = { etcModifiers[t][0], etcModifiers[t][1], -etcModifiers[t][0], -etcModifiers[t][1] };
+        int err = 0, c[8];
+        for (int i = 0; i < 8 && err < bestErr; ++i) {
+            const int *p = px[pixels[i]];
+            int best = 0, be = 1 << 30;
+            for (int j = 0; j < 4; ++j) {
+                int e = sq( p[0] - clamp255( base[0] + mods[j] )) + sq( p[1] - clamp255( base[1] + mods[j] ))
+                        + sq( p[2] - clamp255( base[2] + mods[j] ));
+                if ( e < be ) {
+                    be = e;
+                    best = j;
+                }
+            }
+            c[i] = best;
+            err += int( weight[pixels[i]] * be );
+        }
+        if ( err < bestErr ) {
+            bestErr = err;
+            table = t;
+            memcpy( codes, c, sizeof( c ));
+        }
+    }
+    return bestErr;
+}
+
+struct EtcCandidate {
+    bool differential;
+    int base[2][3]; // (4 bit values in individual mode, 5 bit in differential)
+    int table[2];
+    int codes[2][8];
+    int error;
+};
+
+inline int expand4( int v ) { return ( v << 4 ) | v; }
+inline int expand5( int v ) { return ( v << 3 ) | ( v >> 2 ); }
+
+void encodeETC2Colour( const BlockPixels px, TextureCompressor::QualityLevels quality, uchar *out )
+{
+    float weight[16];
+    for (int i = 0; i < 16; ++i)
+        weight[i] = px[i][3] > 0 ? 1.0f : 0.0f;
+    bool anyVisible = false;
+    for (int i = 0; i < 16; ++i)
+        anyVisible |= weight[i] > 0;
+    if ( !anyVisible )
+        for (int i = 0; i < 16; ++i)
+            weight[i] = 1.0f;
+
+    EtcCandidate best;
+    memset( &best, 0, sizeof( best ));
+    best.error = 1 << 30;
+    int bestFlip = 0;
+    int shifts = quality == TextureCompressor::QUALITY_HIGH ? 2 : 0; // (also tries base colours a little lighter/darker)
+    for (int flip = 0; flip < 2; ++flip) {
+        int pixels[2][8];
+        for (int i = 0, n0 = 0, n1 = 0; i < 16; ++i) {
+            int x = i & 3, y = i >> 2;
+            bool second = flip ? y >= 2 : x >= 2;
+            if ( second )
+                pixels[1][n1++] = i;
+            else
+                pixels[0][n0++] = i;
+        }
+        float avg[2][3];
+        for (int s = 0; s < 2; ++s) {
+            float total = 0;
+            for (int c = 0; c < 3; ++c)
+                avg[s][c] = 0;
+            for (int i = 0; i < 8; ++i) {
+                for (int c = 0; c < 3; ++c)
+                    avg[s][c] += weight[pixels[s][i]] * px[pixels[s][i]][c];
+                total += weight[pixels[s][i]];
+            }
+            for (int c = 0; c < 3; ++c)
+                avg[s][c] = total > 0 ? avg[s][c] / total : 0;
+        }
+        for (int mode = 0; mode < 2; ++mode) { // 0 = differential, 1 = individual
+            if ( mode == 1 && quality == TextureCompressor::QUALITY_FAST && best.error < ( 1 << 30 ) && best.differential )
+                continue; // (quick - only use individual mode when differential can't represent the colours)
+            int levels = mode == 0 ? 31 : 15;
+            for (int shift = -shifts; shift <= shifts; ++shift) {
+                EtcCandidate cand;
+                cand.differential = ( mode == 0 );
+                cand.error = 0;
+                for (int s = 0; s < 2; ++s)
+                    for (int c = 0; c < 3; ++c)
+                        cand.base[s][c] = qBound( 0, int( avg[s][c] * levels / 255.0f + 0.5f ) + shift, levels );
+                if ( cand.differential ) {
+                    bool ok = true;
+                    for (int c = 0; c < 3; ++c) {
+                        int d = cand.base[1][c] - cand.base[0][c];
+                        ok &= ( d >= -4 && d <= 3 );
+                    }
+                    if ( !ok )
+                        continue;
+                }
+                for (int s = 0; s < 2; ++s) {
+                    int base[3];
+                    for (int c = 0; c < 3; ++c)
+                        base[c] = cand.differential ? expand5( cand.base[s][c] ) : expand4( cand.base[s][c] );
+                    cand.error += etcSubblock( px, weight, pixels[s], base, cand.table[s], cand.codes[s] );
+                }
+                if ( cand.error < best.error ) {
+                    best = cand;
+                    bestFlip = flip;
+                }
+            }
+        }
+    }
+
+    quint64 bits = 0;
+    if ( best.differential ) {
+        for (int c = 0; c < 3; ++c) {
+            int d = best.base[1][c] - best.base[0][c];
+            bits |= quint64( best.base[0][c] ) << ( 59 - 8 * c );
+            bits |= quint64( d & 7 ) << ( 56 - 8 * c );
+        }
+        bits |= quint64( 1 ) << 33;
+    }
+    else {
+        for (int c = 0; c < 3; ++c) {
+            bits |= quint64( best.base[0][c] ) << ( 60 - 8 * c );
+            bits |= quint64( best.base[1][c] ) << ( 56 - 8 * c );
+        }
+    }
+    bits |= quint64( best.table[0] ) << 37 | quint64( best.table[1] ) << 34 | quint64( bestFlip ) << 32;
+    // codes 0-3 are +small, +large, -small, -large, stored as a high bit plane and a low bit plane, by column:
+    for (int s = 0; s < 2; ++s) {
+        for (int i = 0, n = 0; i < 16; ++i) {
+            int x = i & 3, y = i >> 2;
+            bool second = bestFlip ? y >= 2 : x >= 2;
+            if ( int( second ) != s )
+                continue;
+            int code = best.codes[s][n++];
+            int k = x * 4 + y;
+            bits |= quint64( code >> 1 ) << ( 16 + k );
+            bits |= quint64( code & 1 ) << k;
+        }
+    }
+    qToBigEndian<quint64>( bits, out );
+}
+
+void encodeBlock( const BlockPixels px, TextureCompressor::Formats format, TextureCompressor::QualityLevels quality, uchar *out )
+{
+    switch ( format ) {
+    case TextureCompressor::TEXTURE_BC1:
+        encodeColourBlock( px, true, quality, out );
+        break;
+    case TextureCompressor::TEXTURE_BC3:
+        encodeAlphaBlock( px, quality, out );
+        encodeColourBlock( px, false, quality, out + 8 );
+        break;
+    case TextureCompressor::TEXTURE_BC7:
+        encodeBC7Block( px, quality, out );
+        break;
+    case TextureCompressor::TEXTURE_ETC2_RGBA:
+        encodeEACAlpha( px, quality, out );
+        encodeETC2Colour( px, quality, out + 8 );
+        break;
+    }
+}
+
+} // namespace
+
+QByteArray TextureCompressor::Compress( const QImage &image, const Formats format, const QualityLevels quality )
+{
+    if ( image.isNull() )
+        return QByteArray();
+    QImage src = image.format() == QImage::Format_ARGB32 ? image : image.convertToFormat( QImage::Format_ARGB32 );
+    int bw = ( src.width() + 3 ) / 4, bh = ( src.height() + 3 ) / 4;
+    int blockBytes = BlockBytes( format );
+    QByteArray data( bw * bh * blockBytes, '\0' );
+    uchar *out = reinterpret_cast<uchar*>( data.data() ); // (detached here - rows are written from several threads)
+    parallelFor( bh, [&]( int by ) {
+        Trace::Span span( "block row", "encode" );
+        BlockPixels px;
+        for (int bx = 0; bx < bw; ++bx) {
+            loadBlock( src, bx, by, px );
+            encodeBlock( px, format, quality, out + ( qint64( by ) * bw + bx ) * blockBytes );
+        }
+    });
+    return data;
+}
+
+int TextureCompressor::BlockBytes( const Formats format )
+{
+    return format == TEXTURE_BC1 ? 8 : 16;
+}
+
+qint64 TextureCompressor::ImageBytes( const Formats format, int width, int height )
+{
+    return qint64( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * BlockBytes( format );
+}
+
+quint32 TextureCompressor::GLInternalFormat( const Formats format )
+{
+    switch ( format ) {
+    case TEXTURE_BC1:
+        return 0x83F1; // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+    case TEXTURE_BC3:
+        return 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    case TEXTURE_BC7:
+        return 0x8E8C; // GL_COMPRESSED_RGBA_BPTC_UNORM
+    case TEXTURE_ETC2_RGBA:
+        return 0x9278; // GL_COMPRESSED_RGBA8_ETC2_EAC
+    }
+    return 0;
+}
+
+QString TextureCompressor::displayName( const QualityLevels quality )
+{
+    switch( quality ){
+    case QUALITY_FAST:
+        return "Fast";
+        break;
+    case QUALITY_NORMAL:
+        return "Normal";
+        break;
+    case QUALITY_HIGH:
+        return "High (slow)";
+        break;
+    default:
+        return "Undefined"; // (shouldnt see this, check NumQualityLevels etc.)
+    }
+}
@@ -0,0 +1,67 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+
+//! CPU encoders for GPU block-compressed texture formats.
+/*! All formats store 4x4 pixel blocks. Images are encoded a row of blocks at a time, spread over the thread pool, so
+ *  a sheet can be compressed in bands as it's rendered (bands should be a multiple of 4 rows, except the last).
+ *  Images with sizes that aren't a multiple of 4 are padded by repeating their edge pixels.
+ */
+class TextureCompressor
+{
+public:
+
+    //! Supported block formats.
+    enum Formats { TEXTURE_BC1 = 0, TEXTURE_BC3, TEXTURE_BC7, TEXTURE_ETC2_RGBA };
+
+    //! Quality presets, slower gives better quality. Indexes must match ui texQualityComboBox. Index is saved in json settings file.
+    /*!
+     * \see NumQualityLevels - the number of presets defined.
+     */
+    enum QualityLevels { QUALITY_FAST = 0, QUALITY_NORMAL, QUALITY_HIGH };
+    //! Number of quality presets. Must match the total number of presets defined in QualityLevels.
+    static int NumQualityLevels;
+
+    //! Encodes an image (or a band of one) into blocks, in rows of blocks from the top left.
+    /*! \param image - the pixels, as non-premultiplied ARGB32 (other formats are converted).
+     *  \param format - the block format to encode.
+     *  \param quality - the quality preset.
+     *  \returns the block data.
+     */
+    static QByteArray Compress( const QImage &image, const Formats format, const QualityLevels quality = QUALITY_NORMAL );
+
+    //! Returns the size in bytes of one 4x4 block.
+    static int BlockBytes( const Formats format );
+
+    //! Returns the size in bytes of a whole image, once compressed.
+    static qint64 ImageBytes( const Formats format, int width, int height );
+
+    //! Returns the OpenGL internal format id, as used in KTX files (see TextureWriter).
+    static quint32 GLInternalFormat( const Formats format );
+
+    //! Returns readable form of the quality preset (as shown to user in UI menus etc).
+    static QString displayName( const QualityLevels quality );
+};
+
+#endif // TEXTURECOMPRESSOR_H
@@ -0,0 +1,513 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "texturewriter.h"
+#include "parallel.h"
+
+#include <QCoreApplication>
+#include <QtDebug>
+#include <QtEndian>
+#include <string.h>
+
+int TextureWriter::NumContainers = 3; // --> Keep this up-to-date when adding containers! UI uses this to populate combobox.
+
+namespace {
+
+void put16( QByteArray &out, quint16 v )
+{
+    uchar b[2];
+    qToLittleEndian<quint16>( v, b );
+    out.append( reinterpret_cast<const char*>( b ), 2 );
+}
+
+void put32( QByteArray &out, quint32 v )
+{
+    uchar b[4];
+    qToLittleEndian<quint32>( v, b );
+    out.append( reinterpret_cast<const char*>( b ), 4 );
+}
+
+void put64( QByteArray &out, quint64 v )
+{
+    uchar b[8];
+    qToLittleEndian<quint64>( v, b );
+    out.append( reinterpret_cast<const char*>( b ), 8 );
+}
+
+inline int floorDiv( int a, int b )
+{
+    return a >= 0 ? a / b : -( ( -a + b - 1 ) / b );
+}
+
+// Vulkan format ids, as used in KTX2 files.
+quint32 vkFormat( TextureCompressor::Formats format )
+{
+    switch ( format ) {
+    case TextureCompressor::TEXTURE_BC1: return 133;       // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+    case TextureCompressor::TEXTURE_BC3: return 137;       // VK_FORMAT_BC3_UNORM_BLOCK
+    case TextureCompressor::TEXTURE_BC7: return 145;       // VK_FORMAT_BC7_UNORM_BLOCK
+    case TextureCompressor::TEXTURE_ETC2_RGBA: return 151; // VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+    }
+    return 0;
+}
+
+// KTX2 data format descriptor - a single 'basic' block describing the compressed blocks (see the Khronos Data Format spec).
+QByteArray dataFormatDescriptor( TextureCompressor::Formats format )
+{
+    struct Sample { int bitOffset, bitLength, channel; };
+    int model = 0, numSamples = 1;
+    Sample samples[2] = { { 0, 64, 0 }, { 64, 64, 0 } };
+    switch ( format ) {
+    case TextureCompressor::TEXTURE_BC1:
+        model = 128;                   // KHR_DF_MODEL_BC1A
+        samples[0].channel = 1;        // KHR_DF_CHANNEL_BC1A_ALPHAPRESENT
+        break;
+    case TextureCompressor::TEXTURE_BC3:
+        model = 130;                   // KHR_DF_MODEL_BC3
+        numSamples = 2;
+        samples[0].channel = 15;       // KHR_DF_CHANNEL_BC3_ALPHA
+        samples[1].channel = 0;        // KHR_DF_CHANNEL_BC3_COLOR
+        break;
+    case TextureCompressor::TEXTURE_BC7:
+        model = 134;                   // KHR_DF_MODEL_BC7
+        samples[0].bitLength = 128;    // (channel 0 = KHR_DF_CHANNEL_BC7_COLOR)
+        break;
+    case TextureCompressor::TEXTURE_ETC2_RGBA:
+        model = 161;                   // KHR_DF_MODEL_ETC2
+        numSamples = 2;
+        samples[0].channel = 15;       // KHR_DF_CHANNEL_ETC2_ALPHA
+        samples[1].channel = 2;        // KHR_DF_CHANNEL_ETC2_COLOR
+        break;
+    }
+    int blockSize = 24 + 16 * numSamples;
+    QByteArray dfd;
+    put32( dfd, quint32( 4 + blockSize ));  // total size
+    put32( dfd, 0 );                        // vendor id and descriptor type (Khronos, basic)
+    put16( dfd, 2 );                        // version
+    put16( dfd, quint16( blockSize ));
+    dfd.append( char( model ));
+    dfd.append( char( 1 ));                 // colour primaries - BT709
+    dfd.append( char( 1 ));                 // transfer function - linear (matches the UNORM formats)
+    dfd.append( char( 0 ));                 // flags - straight alpha
+    dfd.append( QByteArray( "\x03\x03\x00\x00", 4 )); // texel block dimensions, minus one (4x4x1x1)
+    dfd.append( char( TextureCompressor::BlockBytes( format )));
+    dfd.append( QByteArray( 7, '\0' ));    // (other planes unused)
+    for (int i = 0; i < numSamples; ++i) {
+        put16( dfd, quint16( samples[i].bitOffset ));
+        dfd.append( char( samples[i].bitLength - 1 ));
+        dfd.append( char( samples[i].channel ));
+        put32( dfd, 0 );                    // sample position
+        put32( dfd, 0 );                    // lower
+        put32( dfd, 0xFFFFFFFF );           // upper
+    }
+    return dfd;
+}
+
+} // namespace
+
+TextureWriter::TextureWriter()
+    : m_format( TextureCompressor::TEXTURE_BC3 ), m_quality( TextureCompressor::QUALITY_NORMAL ), m_container( CONTAINER_KTX ),
+      m_mipmaps( false )
+{
+}
+
+TextureWriter::~TextureWriter()
+{
+    if ( m_file.isOpen() ) {
+        qWarning() << "TextureWriter - file was not completed, removing " << m_file.fileName();
+        m_file.close();
+        m_file.remove();
+    }
+}
+
+void TextureWriter::setFormat( const TextureCompressor::Formats format, const TextureCompressor::QualityLevels quality )
+{
+    m_format = format;
+    m_quality = quality;
+}
+
+void TextureWriter::setContainer( const Containers container )
+{
+    m_container = container;
+}
+
+void TextureWriter::setMipmaps( bool mipmaps, const QVector<QRect> &regions )
+{
+    m_mipmaps = mipmaps;
+    m_regions = regions;
+}
+
+bool TextureWriter::open( const QString &fileName, int width, int height )
+{
+    if ( width <= 0 || height <= 0 )
+        return fail( "Invalid image size." );
+    if ( m_container == CONTAINER_DDS && m_format == TextureCompressor::TEXTURE_ETC2_RGBA )
+        return fail( "DDS files can't hold ETC2 textures - use KTX or KTX2." );
+    if ( m_container != CONTAINER_KTX2 && TextureCompressor::ImageBytes( m_format, width, height ) > 0xffffffffLL )
+        return fail( "Texture is too big for this file type (4GB limit) - use KTX2." );
+
+    int count = m_mipmaps ? MipLevelCount( width, height ) : 1;
+    m_levels.resize( count );
+    for (int i = 0; i < count; ++i) {
+        MipLevel &lv = m_levels[i];
+        lv.width = qMax( 1, width >> i );
+        lv.height = qMax( 1, height >> i );
+        lv.offset = 0;
+        lv.written = 0;
+        lv.rowsIn = 0;
+        lv.rowsDone = 0;
+        lv.pending = QImage();
+    }
+
+    // Lay out the level data. The header size doesn't depend on the offsets, so we can measure it first.
+    qint64 pos = header().size();
+    if ( m_container == CONTAINER_KTX2 ) {
+        pos = ( pos + 15 ) & ~qint64( 15 ); // (level data must be aligned to the block size)
+        for (int i = count - 1; i >= 0; --i) { // (KTX2 stores the smallest level first)
+            m_levels[i].offset = pos;
+            pos += TextureCompressor::ImageBytes( m_format, m_levels[i].width, m_levels[i].height );
+        }
+    }
+    else {
+        for (int i = 0; i < count; ++i) {
+            if ( m_container == CONTAINER_KTX )
+                pos += 4; // (each KTX level starts with its size)
+            m_levels[i].offset = pos;
+            pos += TextureCompressor::ImageBytes( m_format, m_levels[i].width, m_levels[i].height );
+        }
+    }
+
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::WriteOnly | QIODevice::Truncate ))
+        return fail( m_file.errorString() );
+    // Sizing the file up front means levels can be written in any order.
+    if ( !m_file.resize( pos ) || m_file.write( header() ) < 0 )
+        return fail( m_file.errorString() );
+    if ( m_container == CONTAINER_KTX ) {
+        for (int i = 0; i < count; ++i) {
+            QByteArray size;
+            put32( size, quint32( TextureCompressor::ImageBytes( m_format, m_levels[i].width, m_levels[i].height )));
+            if ( !m_file.seek( m_levels[i].offset - 4 ) || m_file.write( size ) != 4 )
+                return fail( m_file.errorString() );
+        }
+    }
+    return true;
+}
+
+bool TextureWriter::writeRows( const QImage &rows )
+{
+    if ( !m_file.isOpen() )
+        return fail( "File is not open." );
+    if ( rows.isNull() || rows.width() != m_levels[0].width || m_levels[0].rowsIn + rows.height() > m_levels[0].height )
+        return fail( "Rows don't match the image size." );
+    return addRows( 0, rows.format() == QImage::Format_ARGB32 ? rows : rows.convertToFormat( QImage::Format_ARGB32 ));
+}
+
+bool TextureWriter::close()
+{
+    if ( !m_file.isOpen() )
+        return fail( "File is not open." );
+    for (int i = 0; i < m_levels.size(); ++i) {
+        if ( m_levels[i].rowsDone != m_levels[i].height )
+            return fail( "Not all rows were written." );
+    }
+    m_file.close();
+    if ( m_file.error() != QFile::NoError )
+        return fail( m_file.errorString() );
+    return true;
+}
+
+QString TextureWriter::errorString() const
+{
+    return m_error;
+}
+
+qint64 TextureWriter::bufferedBytes() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < m_levels.size(); ++i)
+        bytes += qint64( m_levels[i].pending.bytesPerLine() ) * m_levels[i].pending.height();
+    return bytes;
+}
+
+QString TextureWriter::displayName( const Containers container )
+{
+    switch( container ){
+    case CONTAINER_KTX:
+        return "KTX";
+        break;
+    case CONTAINER_KTX2:
+        return "KTX2";
+        break;
+    case CONTAINER_DDS:
+        return "DDS (not ETC2)";
+        break;
+    default:
+        return "Undefined"; // (shouldnt see this, check NumContainers etc.)
+    }
+}
+
+QString TextureWriter::fileExtension( const Containers container )
+{
+    switch( container ){
+    case CONTAINER_KTX2:
+        return ".ktx2";
+    case CONTAINER_DDS:
+        return ".dds";
+    default:
+        return ".ktx";
+    }
+}
+
+int TextureWriter::MipLevelCount( int width, int height )
+{
+    int count = 1;
+    while ( width > 1 || height > 1 ) {
+        width = qMax( 1, width / 2 );
+        height = qMax( 1, height / 2 );
+        count++;
+    }
+    return count;
+}
+
+QImage TextureWriter::Downsample( const QImage &src, int level, int y, int width, int height, const QVector<QRect> &regions )
+{
+    QImage dst( width, height, QImage::Format_ARGB32 );
+    if ( dst.isNull() || src.isNull() )
+        return QImage();
+    int sw = src.width(), sh = src.height();
+
+    // Which region each source pixel belongs to (by where its centre lands on the full size sheet), -1 for none.
+    int scale = 1 << level;
+    QVector<int> owner( sw * sh, -1 );
+    for (int i = 0; i < regions.size(); ++i) {
+        const QRect &r = regions[i];
+        int x0 = qMax( 0, floorDiv( r.left() - scale / 2 + scale - 1, scale ));
+        int x1 = qMin( sw - 1, floorDiv( r.right() - scale / 2, scale ));
+        int y0 = qMax( 0, floorDiv( r.top() - scale / 2 + scale - 1, scale ) - y );
+        int y1 = qMin( sh - 1, floorDiv( r.bottom() - scale / 2, scale ) - y );
+        for (int yy = y0; yy <= y1; ++yy) {
+            int *row = owner.data() + yy * sw;
+            for (int xx = x0; xx <= x1; ++xx)
+                row[xx] = i;
+        }
+    }
+
+    parallelFor( height, [&]( int dy ) {
+        int sy[2] = { qMin( dy * 2, sh - 1 ), qMin( dy * 2 + 1, sh - 1 ) };
+        QRgb *out = reinterpret_cast<QRgb*>( dst.scanLine( dy ));
+        for (int dx = 0; dx < width; ++dx) {
+            int sx[2] = { qMin( dx * 2, sw - 1 ), qMin( dx * 2 + 1, sw - 1 ) };
+            QRgb p[4];
+            int o[4];
+            for (int i = 0; i < 4; ++i) {
+                p[i] = reinterpret_cast<const QRgb*>( src.constScanLine( sy[i / 2] ))[ sx[i % 2] ];
+                o[i] = owner[ sy[i / 2] * sw + sx[i % 2] ];
+            }
+            // The region with the most coverage wins the pixel, the others' pixels are left out.
+            int region = o[0], regionAlpha = -1;
+            for (int i = 0; i < 4; ++i) {
+                int a = 0;
+                for (int j = 0; j < 4; ++j)
+                    if ( o[j] == o[i] ) a += qAlpha( p[j] );
+                if ( a > regionAlpha ) {
+                    regionAlpha = a;
+                    region = o[i];
+                }
+            }
+            int wr = 0, wg = 0, wb = 0, r = 0, g = 0, b = 0, n = 0;
+            for (int i = 0; i < 4; ++i) {
+                if ( o[i] != region )
+                    continue;
+                int a = qAlpha( p[i] );
+                wr += qRed( p[i] ) * a; wg += qGreen( p[i] ) * a; wb += qBlue( p[i] ) * a;
+                r += qRed( p[i] ); g += qGreen( p[i] ); b += qBlue( p[i] );
+                n++;
+            }
+            if ( regionAlpha > 0 ) // (alpha weighted, so transparent pixels don't darken edges)
+                out[dx] = qRgba( ( wr + regionAlpha / 2 ) / regionAlpha, ( wg + regionAlpha / 2 ) / regionAlpha,
+                                 ( wb + regionAlpha / 2 ) / regionAlpha, ( regionAlpha + 2 ) / 4 );
+            else // (keep any bled colour in the transparent areas)
+                out[dx] = qRgba( ( r + n / 2 ) / n, ( g + n / 2 ) / n, ( b + n / 2 ) / n, 0 );
+        }
+    });
+    return dst;
+}
+
+bool TextureWriter::addRows( int level, const QImage &rows )
+{
+    MipLevel &lv = m_levels[level];
+    if ( lv.pending.isNull() )
+        lv.pending = rows;
+    else {
+        QImage joined( lv.width, lv.pending.height() + rows.height(), QImage::Format_ARGB32 );
+        if ( joined.isNull() )
+            return fail( "Out of memory." );
+        for (int y = 0; y < lv.pending.height(); ++y)
+            memcpy( joined.scanLine( y ), lv.pending.constScanLine( y ), size_t( lv.width ) * 4 );
+        for (int y = 0; y < rows.height(); ++y)
+            memcpy( joined.scanLine( lv.pending.height() + y ), rows.constScanLine( y ), size_t( lv.width ) * 4 );
+        lv.pending = joined;
+    }
+    lv.rowsIn += rows.height();
+
+    // Compress whole rows of blocks, until the last rows arrive.
+    bool last = lv.rowsIn >= lv.height;
+    int n = last ? lv.pending.height() : ( lv.pending.height() / 4 ) * 4;
+    if ( n == 0 )
+        return true;
+    QImage chunk = lv.pending;
+    if ( n < lv.pending.height() ) {
+        chunk = lv.pending.copy( 0, 0, lv.width, n );
+        lv.pending = lv.pending.copy( 0, n, lv.width, lv.pending.height() - n );
+    }
+    else
+        lv.pending = QImage();
+
+    QByteArray data = TextureCompressor::Compress( chunk, m_format, m_quality );
+    if ( !m_file.seek( lv.offset + lv.written ) || m_file.write( data ) != data.size() )
+        return fail( m_file.errorString() );
+    lv.written += data.size();
+    int y = lv.rowsDone;
+    lv.rowsDone += n;
+
+    // Pass the rows on down the mip chain.
+    if ( level + 1 < m_levels.size() ) {
+        const MipLevel &next = m_levels[level + 1];
+        int nextRows = last ? next.height - next.rowsIn : n / 2;
+        if ( nextRows > 0 ) {
+            QImage half = Downsample( chunk, level, y, next.width, nextRows, m_regions );
+            if ( half.isNull() )
+                return fail( "Out of memory." );
+            return addRows( level + 1, half );
+        }
+    }
+    return true;
+}
+
+QByteArray TextureWriter::header() const
+{
+    switch ( m_container ) {
+    case CONTAINER_KTX2:
+        return headerKTX2();
+    case CONTAINER_DDS:
+        return headerDDS();
+    default:
+        return headerKTX();
+    }
+}
+
+QByteArray TextureWriter::headerKTX() const
+{
+    static const uchar identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    QByteArray header( reinterpret_cast<const char*>( identifier ), 12 );
+    put32( header, 0x04030201 );                // endianness
+    put32( header, 0 );                         // glType, glTypeSize, glFormat (all 'compressed')
+    put32( header, 1 );
+    put32( header, 0 );
+    put32( header, TextureCompressor::GLInternalFormat( m_format ));
+    put32( header, 0x1908 );                    // glBaseInternalFormat = GL_RGBA
+    put32( header, quint32( m_levels[0].width ));
+    put32( header, quint32( m_levels[0].height ));
+    put32( header, 0 );                         // pixel depth
+    put32( header, 0 );                         // array elements
+    put32( header, 1 );                         // faces
+    put32( header, quint32( m_levels.size() )); // mip levels
+    put32( header, 0 );                         // key/value data bytes
+    return header;
+}
+
+QByteArray TextureWriter::headerKTX2() const
+{
+    static const uchar identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    QByteArray dfd = dataFormatDescriptor( m_format );
+    QByteArray kvd;
+    QByteArray writer = "KTXwriter";
+    writer.append( '\0' );
+    writer.append( QString( QCoreApplication::applicationName() + " " + QCoreApplication::applicationVersion() ).toUtf8() );
+    writer.append( '\0' );
+    put32( kvd, quint32( writer.size() ));
+    kvd.append( writer );
+    while ( kvd.size() % 4 )
+        kvd.append( '\0' );
+
+    int count = m_levels.size();
+    quint32 dfdOffset = quint32( 80 + 24 * count );
+    QByteArray header( reinterpret_cast<const char*>( identifier ), 12 );
+    put32( header, vkFormat( m_format ));
+    put32( header, 1 );                         // type size (1 for block formats)
+    put32( header, quint32( m_levels[0].width ));
+    put32( header, quint32( m_levels[0].height ));
+    put32( header, 0 );                         // pixel depth
+    put32( header, 0 );                         // layers
+    put32( header, 1 );                         // faces
+    put32( header, quint32( count ));           // levels
+    put32( header, 0 );                         // supercompression - none
+    put32( header, dfdOffset );
+    put32( header, quint32( dfd.size() ));
+    put32( header, dfdOffset + quint32( dfd.size() ));
+    put32( header, quint32( kvd.size() ));
+    put64( header, 0 );                         // (no supercompression global data)
+    put64( header, 0 );
+    for (int i = 0; i < count; ++i) {
+        quint64 bytes = quint64( TextureCompressor::ImageBytes( m_format, m_levels[i].width, m_levels[i].height ));
+        put64( header, quint64( m_levels[i].offset ));
+        put64( header, bytes );
+        put64( header, bytes );                 // (uncompressed length - same, as there's no supercompression)
+    }
+    header.append( dfd );
+    header.append( kvd );
+    return header;
+}
+
+QByteArray TextureWriter::headerDDS() const
+{
+    bool dx10 = m_format == TextureCompressor::TEXTURE_BC7; // (BC7 has no FourCC code of its own)
+    bool mips = m_levels.size() > 1;
+    QByteArray header( "DDS ", 4 );
+    put32( header, 124 );                       // header size
+    put32( header, 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000 | ( mips ? 0x20000 : 0 ) ); // caps, height, width, pixel format,
+                                                // linear size, mip count
+    put32( header, quint32( m_levels[0].height ));
+    put32( header, quint32( m_levels[0].width ));
+    put32( header, quint32( TextureCompressor::ImageBytes( m_format, m_levels[0].width, m_levels[0].height )));
+    put32( header, 0 );                         // depth
+    put32( header, quint32( m_levels.size() ));
+    header.append( QByteArray( 11 * 4, '\0' ));  // (reserved)
+    put32( header, 32 );                        // pixel format size
+    put32( header, 0x4 );                       // DDPF_FOURCC
+    header.append( dx10 ? "DX10" : ( m_format == TextureCompressor::TEXTURE_BC1 ? "DXT1" : "DXT5" ), 4 );
+    header.append( QByteArray( 5 * 4, '\0' ));   // (bit count and masks unused)
+    put32( header, 0x1000 | ( mips ? 0x400008 : 0 )); // DDSCAPS_TEXTURE, + COMPLEX and MIPMAP
+    header.append( QByteArray( 4 * 4, '\0' ));   // (caps2-4, reserved)
+    if ( dx10 ) {
+        put32( header, 98 );                    // DXGI_FORMAT_BC7_UNORM
+        put32( header, 3 );                     // texture 2D
+        put32( header, 0 );
+        put32( header, 1 );                     // array size
+        put32( header, 1 );                     // straight alpha
+    }
+    return header;
+}
+
+bool TextureWriter::fail( const QString &error )
+{
+    qWarning() << "TextureWriter - " << error;
+    m_error = error;
+    return false;
+}
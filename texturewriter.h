@@ -0,0 +1,139 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTUREWRITER_H
+#define TEXTUREWRITER_H
+
+#include "texturecompressor.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+//! Writes a block-compressed texture file (KTX, KTX2 or DDS) a band of rows at a time, optionally with a mip chain.
+/*! Works like PngWriter: open(), then writeRows() until all rows are written, then close(). Each level's size is known
+ *  up front, so the file is laid out in open() and every level is written straight to its place as its rows arrive,
+ *  whatever order the container stores levels in. Nothing bigger than a band is held in memory.
+ *
+ *  Mip levels are built from the level above as its rows are compressed. Downsampling is region-aware: each sheet pixel
+ *  belongs to the region (sprite area) containing it, and a 2x2 average only uses the pixels of one region, so sprites
+ *  don't bleed into each other at lower mips (given enough padding). Averages are alpha weighted, so colour from fully
+ *  transparent pixels doesn't leak into sprite edges.
+ */
+class TextureWriter
+{
+public:
+
+    //! File containers. Indexes must match ui containerComboBox. Index is saved in json settings file.
+    /*!
+     * \see NumContainers - the number of containers defined.
+     */
+    enum Containers { CONTAINER_KTX = 0, CONTAINER_KTX2, CONTAINER_DDS };
+    //! Number of containers. Must match the total number of containers defined in Containers.
+    static int NumContainers;
+
+    TextureWriter();
+    ~TextureWriter();
+
+    //! Sets the block format and encoding quality. Call before open().
+    void setFormat( const TextureCompressor::Formats format, const TextureCompressor::QualityLevels quality );
+
+    //! Sets the file container. Call before open().
+    void setContainer( const Containers container );
+
+    //! Turns the mip chain on or off. Call before open().
+    /*! \param mipmaps - true to write all levels down to 1x1.
+     *  \param regions - areas (in full size pixels) that must not be mixed with each other when downsampling.
+     */
+    void setMipmaps( bool mipmaps, const QVector<QRect> &regions = QVector<QRect>() );
+
+    //! Creates the file and writes the container header.
+    /*! \param fileName - the file to write.
+     *  \param width - image width in pixels.
+     *  \param height - image height in pixels.
+     *  \returns true - if the operation was successful.
+     */
+    bool open( const QString &fileName, int width, int height );
+
+    //! Appends the next rows of the full size image. Any QImage format is accepted, it's converted to ARGB32.
+    /*! \param rows - image with the full width, and any number of rows (multiples of 4 avoid extra copying).
+     *  \returns true - if the operation was successful.
+     */
+    bool writeRows( const QImage &rows );
+
+    //! Finishes the file. Fails if not all rows were written.
+    bool close();
+
+    //! Returns a description of the last error.
+    QString errorString() const;
+
+    //! Returns roughly how much memory the writer is holding: rows of each mip level waiting for a whole row of blocks.
+    qint64 bufferedBytes() const;
+
+    //! Returns readable form of the container (as shown to user in UI menus etc).
+    static QString displayName( const Containers container );
+
+    //! Returns the file extension for the container, including the dot.
+    static QString fileExtension( const Containers container );
+
+    //! Returns the number of levels in a full mip chain (down to 1x1) for an image size.
+    static int MipLevelCount( int width, int height );
+
+    //! Halves an image with a region-aware, alpha weighted 2x2 box filter.
+    /*! \param src - rows of a mip level, non-premultiplied ARGB32.
+     *  \param level - the level src belongs to (0 is full size).
+     *  \param y - the row of that level that src starts at.
+     *  \param width - width of the result.
+     *  \param height - height of the result (src rows past the end are clamped).
+     *  \param regions - see setMipmaps().
+     */
+    static QImage Downsample( const QImage &src, int level, int y, int width, int height, const QVector<QRect> &regions );
+
+protected:
+    //! One level of the mip chain.
+    struct MipLevel {
+        int width;
+        int height;
+        qint64 offset;      // file position of the level's data
+        qint64 written;     // bytes of data written so far
+        int rowsIn;         // rows received from the level above (or the caller)
+        int rowsDone;       // rows compressed (and passed on to the next level)
+        QImage pending;     // rows received but not compressed yet
+    };
+
+    bool addRows( int level, const QImage &rows );
+    QByteArray header() const;
+    QByteArray headerKTX() const;
+    QByteArray headerKTX2() const;
+    QByteArray headerDDS() const;
+    bool fail( const QString &error );
+
+    QFile m_file;
+    TextureCompressor::Formats m_format;
+    TextureCompressor::QualityLevels m_quality;
+    Containers m_container;
+    bool m_mipmaps;
+    QVector<QRect> m_regions;
+    QVector<MipLevel> m_levels;
+    QString m_error;
+};
+
+#endif // TEXTUREWRITER_H
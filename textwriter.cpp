@@ -0,0 +1,150 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "textwriter.h"
+
+#include <QtDebug>
+
+TextWriter::TextWriter()
+{
+    m_buffer.reserve( BufferSize ); // (reserved, so resizing to 0 after each flush keeps the memory)
+}
+
+bool TextWriter::open( const QString &fileName )
+{
+    m_file.setFileName( fileName );
+    m_buffer.resize( 0 );
+    m_error.clear();
+    if ( !m_file.open( QIODevice::WriteOnly | QIODevice::Text )) {
+        m_error = m_file.errorString();
+        qWarning() << "TextWriter - could not open " << fileName << " - " << m_error;
+        return false;
+    }
+    return true;
+}
+
+bool TextWriter::commit()
+{
+    flushBuffer();
+    if ( !m_file.commit() ) { // (also fails if any write did)
+        m_error = m_file.errorString();
+        qWarning() << "TextWriter - could not write " << m_file.fileName() << " - " << m_error;
+        return false;
+    }
+    return true;
+}
+
+QString TextWriter::errorString() const
+{
+    return m_error;
+}
+
+TextWriter &TextWriter::operator<<( const char *str )
+{
+    m_buffer.append( str );
+    if ( m_buffer.size() >= BufferSize )
+        flushBuffer();
+    return *this;
+}
+
+TextWriter &TextWriter::operator<<( char c )
+{
+    m_buffer.append( c );
+    if ( m_buffer.size() >= BufferSize )
+        flushBuffer();
+    return *this;
+}
+
+TextWriter &TextWriter::operator<<( const QString &str )
+{
+    // Most names are plain ASCII, which can go straight in without a temporary UTF-8 copy.
+    const QChar *chars = str.constData();
+    int n = str.size();
+    int i = 0;
+    for ( ; i < n && chars[i].unicode() < 0x80; ++i) ;
+    if ( i == n ) {
+        int start = m_buffer.size();
+        m_buffer.resize( start + n );
+        char *out = m_buffer.data() + start;
+        for (i = 0; i < n; ++i)
+            out[i] = char( chars[i].unicode() );
+    }
+    else
+        m_buffer.append( str.toUtf8() );
+    if ( m_buffer.size() >= BufferSize )
+        flushBuffer();
+    return *this;
+}
+
+TextWriter &TextWriter::operator<<( int val )
+{
+    char digits[12];
+    int n = 0;
+    unsigned int u = val < 0 ? 0u - unsigned( val ) : unsigned( val );
+    do {
+        digits[n++] = char( '0' + u % 10 );
+        u /= 10;
+    } while ( u );
+    if ( val < 0 )
+        digits[n++] = '-';
+    while ( n )
+        m_buffer.append( digits[--n] );
+    if ( m_buffer.size() >= BufferSize )
+        flushBuffer();
+    return *this;
+}
+
+TextWriter &TextWriter::operator<<( const JsonString &str )
+{
+    // Escapes as QJsonDocument does - quotes, backslashes and control characters, everything else as UTF-8.
+    static const char hex[] = "0123456789abcdef";
+    m_buffer.append( '"' );
+    const QString &s = str.value;
+    int from = 0;
+    for (int i = 0; i < s.size(); ++i) {
+        ushort c = s[i].unicode();
+        if ( c >= 0x20 && c != '"' && c != '\\' )
+            continue;
+        *this << s.mid( from, i - from );
+        from = i + 1;
+        switch ( c ) {
+            case '"': m_buffer.append( "\\\"" ); break;
+            case '\\': m_buffer.append( "\\\\" ); break;
+            case '\b': m_buffer.append( "\\b" ); break;
+            case '\f': m_buffer.append( "\\f" ); break;
+            case '\n': m_buffer.append( "\\n" ); break;
+            case '\r': m_buffer.append( "\\r" ); break;
+            case '\t': m_buffer.append( "\\t" ); break;
+            default:
+                m_buffer.append( "\\u00" );
+                m_buffer.append( hex[c >> 4] );
+                m_buffer.append( hex[c & 15] );
+        }
+    }
+    *this << ( from == 0 ? s : s.mid( from ));
+    return *this << '"';
+}
+
+void TextWriter::flushBuffer()
+{
+    if ( m_buffer.isEmpty() )
+        return;
+    if ( m_file.isOpen() )
+        m_file.write( m_buffer ); // (errors are kept by QSaveFile, and reported by commit)
+    m_buffer.resize( 0 );
+}
@@ -0,0 +1,85 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTWRITER_H
+#define TEXTWRITER_H
+
+#include <QByteArray>
+#include <QSaveFile>
+#include <QString>
+
+//! Writes a UTF-8 text file through a buffer, for the data exporters.
+/*! Text goes straight into a small buffer as UTF-8 (no QString document is built first), and the buffer goes out to a
+ *  QSaveFile whenever it fills, so memory use doesn't grow with the number of sprites. The file only replaces any
+ *  existing one when commit() succeeds - a failed export never leaves a half written data file behind.
+ *
+ *  Usage is open(), then any number of << calls, then commit(). Write errors are remembered and reported by commit().
+ */
+class TextWriter
+{
+public:
+    //! Wraps a value so it's written in double quotes, without making a temporary string.
+    template <typename T>
+    struct Quoted {
+        const T &value;
+    };
+
+    //! Wraps a string so it's written as a quoted JSON string, escaped as needed.
+    struct JsonString {
+        const QString &value;
+    };
+
+    TextWriter();
+
+    //! Opens the file for writing (in text mode, so line endings suit the platform).
+    /*! \returns true - if the operation was successful.
+     */
+    bool open( const QString &fileName );
+
+    //! Writes out any buffered text, and replaces the target file with what was written.
+    /*! \returns true - if the operation was successful, and no writes failed.
+     */
+    bool commit();
+
+    //! Returns a description of the last error.
+    QString errorString() const;
+
+    TextWriter &operator<<( const char *str );
+    TextWriter &operator<<( char c );
+    TextWriter &operator<<( const QString &str );
+    TextWriter &operator<<( int val );
+    TextWriter &operator<<( const JsonString &str );
+
+    template <typename T>
+    TextWriter &operator<<( const Quoted<T> &quoted )
+    {
+        return *this << '"' << quoted.value << '"';
+    }
+
+    //! Buffer size - the file is written in pieces of about this many bytes.
+    static const int BufferSize = 64 * 1024;
+
+protected:
+    void flushBuffer();
+
+    QSaveFile m_file;
+    QByteArray m_buffer;
+    QString m_error;
+};
+
+#endif // TEXTWRITER_H
@@ -0,0 +1,229 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trace.h"
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QThread>
+
+namespace {
+
+struct TraceEvent
+{
+    const char *name;
+    const char *category;
+    QString detail;
+    qint64 start; // (ns from Trace::start())
+    qint64 duration;
+};
+
+// Events are kept in fixed-size blocks, so appending never moves what a reader might be looking at.
+const int BlockEvents = 1024;
+
+struct TraceBlock
+{
+    TraceBlock() : count( 0 ), next( 0 ) {}
+    TraceEvent events[BlockEvents];
+    QAtomicInt count; // (events are published by storing this, with release)
+    QAtomicPointer<TraceBlock> next;
+};
+
+// One per thread that has recorded anything. Only its own thread writes to it. They're never freed, as pool threads
+// come and go while the trace may still be read.
+struct TraceBuffer
+{
+    TraceBuffer() : tail( &head ), tid( 0 ), generation( 0 ), next( 0 ) {}
+    TraceBlock head;
+    TraceBlock *tail;
+    int tid;
+    QString threadName;
+    QAtomicInt generation; // (the trace it holds events for)
+    TraceBuffer *next;
+};
+
+QAtomicPointer<TraceBuffer> buffers; // (a list, pushed onto with compare-and-swap)
+QAtomicInt enabled;
+QAtomicInt generation; // (bumped by each start(), buffers from earlier traces reset themselves)
+QAtomicInt nextTid;
+QElapsedTimer clock;
+thread_local TraceBuffer *threadBuffer = 0;
+
+TraceBuffer* currentBuffer( int gen )
+{
+    TraceBuffer *buffer = threadBuffer;
+    if ( !buffer ) {
+        buffer = new TraceBuffer;
+        buffer->tid = nextTid.fetchAndAddRelaxed( 1 ) + 1;
+        QCoreApplication *app = QCoreApplication::instance();
+        if ( app && QThread::currentThread() == app->thread() )
+            buffer->threadName = "main";
+        else
+            buffer->threadName = QString( "worker %1" ).arg( buffer->tid );
+        TraceBuffer *head;
+        do {
+            head = buffers.loadAcquire();
+            buffer->next = head;
+        } while ( !buffers.testAndSetOrdered( head, buffer ));
+        threadBuffer = buffer;
+    }
+    if ( buffer->generation.loadAcquire() != gen ) {
+        // A new trace - reuse the blocks from the old one.
+        for (TraceBlock *block = &buffer->head; block; block = block->next.loadAcquire())
+            block->count.storeRelease( 0 );
+        buffer->tail = &buffer->head;
+        buffer->generation.storeRelease( gen );
+    }
+    return buffer;
+}
+
+void addEvent( int gen, const char *name, const char *category, const QString &detail, qint64 start, qint64 end )
+{
+    TraceBuffer *buffer = currentBuffer( gen );
+    TraceBlock *block = buffer->tail;
+    int n = block->count.load();
+    if ( n == BlockEvents ) {
+        TraceBlock *next = block->next.loadAcquire();
+        if ( !next ) {
+            next = new TraceBlock;
+            block->next.storeRelease( next );
+        }
+        buffer->tail = block = next;
+        n = 0;
+    }
+    TraceEvent &event = block->events[n];
+    event.name = name;
+    event.category = category;
+    event.detail = detail;
+    event.start = start;
+    event.duration = end - start;
+    block->count.storeRelease( n + 1 );
+}
+
+} // namespace
+
+void Trace::start()
+{
+    enabled.storeRelease( 0 );
+    clock.start();
+    generation.fetchAndAddOrdered( 1 );
+    enabled.storeRelease( 1 );
+}
+
+void Trace::stop()
+{
+    enabled.storeRelease( 0 );
+}
+
+bool Trace::isEnabled()
+{
+    return enabled.load() != 0;
+}
+
+QJsonObject Trace::toJson()
+{
+    int gen = generation.loadAcquire();
+    QJsonArray events;
+    QJsonObject process;
+    process.insert( "name", QString( "process_name" ));
+    process.insert( "ph", QString( "M" ));
+    process.insert( "pid", 1 );
+    QJsonObject processArgs;
+    processArgs.insert( "name", QCoreApplication::applicationName().isEmpty() ? QString( "buncher" ) : QCoreApplication::applicationName() );
+    process.insert( "args", processArgs );
+    events.append( process );
+    for (TraceBuffer *buffer = buffers.loadAcquire(); buffer; buffer = buffer->next) {
+        if ( buffer->generation.loadAcquire() != gen )
+            continue;
+        QJsonObject thread;
+        thread.insert( "name", QString( "thread_name" ));
+        thread.insert( "ph", QString( "M" ));
+        thread.insert( "pid", 1 );
+        thread.insert( "tid", buffer->tid );
+        QJsonObject threadArgs;
+        threadArgs.insert( "name", buffer->threadName );
+        thread.insert( "args", threadArgs );
+        events.append( thread );
+        for (TraceBlock *block = &buffer->head; block; block = block->next.loadAcquire()) {
+            int count = block->count.loadAcquire();
+            for (int i = 0; i < count; ++i) {
+                const TraceEvent &e = block->events[i];
+                QJsonObject event;
+                event.insert( "name", QString( e.name ));
+                event.insert( "cat", QString( e.category ));
+                event.insert( "ph", QString( "X" ));
+                event.insert( "pid", 1 );
+                event.insert( "tid", buffer->tid );
+                event.insert( "ts", e.start / 1000.0 ); // (microseconds)
+                event.insert( "dur", e.duration / 1000.0 );
+                if ( !e.detail.isEmpty() ) {
+                    QJsonObject args;
+                    args.insert( "detail", e.detail );
+                    event.insert( "args", args );
+                }
+                events.append( event );
+            }
+            if ( count < BlockEvents )
+                break;
+        }
+    }
+    QJsonObject trace;
+    trace.insert( "traceEvents", events );
+    trace.insert( "displayTimeUnit", QString( "ms" ));
+    return trace;
+}
+
+bool Trace::save( const QString &fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ))
+        return false;
+    QByteArray json = QJsonDocument( toJson() ).toJson( QJsonDocument::Compact );
+    return file.write( json ) == json.size();
+}
+
+Trace::Span::Span( const char *name, const char *category )
+    : m_name( name ), m_category( category ), m_start( -1 ), m_generation( 0 )
+{
+    if ( isEnabled() ) {
+        m_generation = generation.loadAcquire();
+        m_start = clock.nsecsElapsed();
+    }
+}
+
+Trace::Span::Span( const char *name, const char *category, const QString &detail )
+    : m_name( name ), m_category( category ), m_start( -1 ), m_generation( 0 )
+{
+    if ( isEnabled() ) {
+        m_detail = detail;
+        m_generation = generation.loadAcquire();
+        m_start = clock.nsecsElapsed();
+    }
+}
+
+Trace::Span::~Span()
+{
+    // (a span that started in an earlier trace is dropped - its start time is from the old clock.)
+    if ( m_start >= 0 && m_generation == generation.loadAcquire() )
+        addEvent( m_generation, m_name, m_category, m_detail, m_start, clock.nsecsElapsed() );
+}
@@ -0,0 +1,70 @@
+/*
+    This file is part of SpriteBuncher - a texture packing program.
+    Copyright (C) 2014 Barry R Smith.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QJsonObject>
+#include <QString>
+
+//! Records spans of work (file decodes, packer runs, render bands, encoder chunks...) as Chrome trace events.
+/*! Off unless start() is called. The result loads in chrome://tracing or https://ui.perfetto.dev, one track per
+ *  thread, to see how the parallel stages overlap and where threads sit idle - which the summed-up Stats can't show.
+ *
+ *  Each thread records into its own buffer, with no locks (a new thread takes one compare-and-swap to register), so
+ *  tracing barely changes the timings it measures. With tracing off, a Span costs a flag test.
+ */
+class Trace
+{
+public:
+    //! Starts a new trace, dropping any earlier one. Timestamps are from here.
+    static void start();
+    //! Stops recording. Spans already open still end up in the trace.
+    static void stop();
+    //! Returns true while recording.
+    static bool isEnabled();
+
+    //! Returns the trace in Chrome's trace event format: {"traceEvents": [...], "displayTimeUnit": "ms"}.
+    /*! Call after stop(), once the traced work is done (threads still recording may be missed, but it's safe).
+     */
+    static QJsonObject toJson();
+    //! Saves toJson() to a file. Returns false if it can't be written.
+    static bool save( const QString &fileName );
+
+    //! Records a span from its construction to its destruction, on the current thread's track.
+    /*! Name and category must be string literals (or otherwise outlive the trace) - they're stored as pointers.
+     */
+    class Span
+    {
+    public:
+        //! Constructor. Starts the span, if tracing.
+        Span( const char *name, const char *category );
+        //! Constructor. As above, with a detail shown in the span's args (e.g. the file name).
+        Span( const char *name, const char *category, const QString &detail );
+        //! Destructor. Records the span.
+        ~Span();
+    private:
+        const char *m_name;
+        const char *m_category;
+        QString m_detail;
+        qint64 m_start; // (-1 if not tracing)
+        int m_generation; // (which trace it started in)
+    };
+};
+
+#endif // TRACE_H